@@ -94,19 +94,25 @@ def generate(function_name, callback_name, report_name, keymap, command_class, i
     if payload_allowed:
         payload_after_value = "case ';': state = PAYLOAD; break;"
         payload = ', PAYLOAD'
-        parr = 'static uint8_t payload[4096];'
-        payload_case = f'''
-            case PAYLOAD: {{
-                sz = screen->parser_buf_pos - pos;
-                const char *err = base64_decode(screen->parser_buf + pos, sz, payload, sizeof(payload), &g.payload_sz);
-                if (err != NULL) {{ REPORT_ERROR("Failed to parse {command_class} command payload with error: %s", err); return; }}
+        # The payload is decoded by the parser as it is received, see accumulate_apc()
+        parr = 'const uint8_t *payload = screen->apc_payload.buf;'
+        payload_case = '''
+            case PAYLOAD:
                 pos = screen->parser_buf_pos;
-                }}
                 break;
         '''
+        payload_end_case = f'''
+        case PAYLOAD: {{
+            const char *err = base64_decoder_finish(&screen->apc_payload.decoder);
+            if (err != NULL) {{ REPORT_ERROR("Failed to parse {command_class} command payload with error: %s", err); return; }}
+            g.payload_sz = screen->apc_payload.decoder.dest_sz;
+            g.payload_decode_time = screen->apc_payload.decode_time;
+            }}
+            break;
+        '''
         callback = f'{callback_name}(screen, &g, payload)'
     else:
-        payload_after_value = payload = parr = payload_case = ''
+        payload_after_value = payload = parr = payload_case = payload_end_case = ''
         callback = f'{callback_name}(screen, &g)'
 
     return f'''
@@ -120,7 +126,6 @@ static inline void
     uint64_t lcode;
     bool is_negative;
     memset(&g, 0, sizeof(g));
-    size_t sz;
     {parr}
     {keys_enum}
     enum KEYS key = '{initial_key}';
@@ -214,6 +219,7 @@ static inline void
             REPORT_ERROR("Malformed {command_class} control block, expecting an integer value"); return;
         case FLAG:
             REPORT_ERROR("Malformed {command_class} control block, expecting a flag value"); return;
+        {payload_end_case}
         default:
             break;
     }}
@@ -236,9 +242,9 @@ def write_header(text, path):
 def graphics_parser():
     flag = frozenset
     keymap = {
-        'a': ('action', flag('tTqpd')),
+        'a': ('action', flag('tTqpdfa')),
         'd': ('delete_action', flag('aAiIcCpPqQxXyYzZ')),
-        't': ('transmission_type', flag('dfts')),
+        't': ('transmission_type', flag('dftsS')),
         'o': ('compressed', flag('z')),
         'f': ('format', 'uint'),
         'm': ('more', 'uint'),
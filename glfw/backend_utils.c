@@ -31,13 +31,25 @@ update_fds(EventLoopData *eld) {
     }
 }
 
+static inline bool
+grow_array(void **array, size_t item_size, nfds_t capacity) {
+    void *p = realloc(*array, capacity * item_size);
+    if (!p) return false;
+    *array = p;
+    return true;
+}
+
 static id_type watch_counter = 0;
 
 id_type
 addWatch(EventLoopData *eld, const char* name, int fd, int events, int enabled, watch_callback_func cb, void *cb_data) {
-    if (eld->watches_count >= sizeof(eld->watches)/sizeof(eld->watches[0])) {
-        _glfwInputError(GLFW_PLATFORM_ERROR, "Too many watches added");
-        return 0;
+    if (eld->watches_count >= eld->watches_capacity) {
+        nfds_t capacity = eld->watches_capacity ? 2 * eld->watches_capacity : 16;
+        if (!grow_array((void**)&eld->watches, sizeof(eld->watches[0]), capacity) || !grow_array((void**)&eld->fds, sizeof(eld->fds[0]), capacity)) {
+            _glfwInputError(GLFW_PLATFORM_ERROR, "Out of memory adding watch");
+            return 0;
+        }
+        eld->watches_capacity = capacity;
     }
     Watch *w = eld->watches + eld->watches_count++;
     w->name = name;
@@ -50,23 +62,21 @@ addWatch(EventLoopData *eld, const char* name, int fd, int events, int enabled,
     return w->id;
 }
 
-#define removeX(which, item_id, update_func) {\
-    for (nfds_t i = 0; i < eld->which##_count; i++) { \
-        if (eld->which[i].id == item_id) { \
-            eld->which##_count--; \
-            if (eld->which[i].callback_data && eld->which[i].free) { \
-                eld->which[i].free(eld->which[i].id, eld->which[i].callback_data); \
-                eld->which[i].callback_data = NULL; eld->which[i].free = NULL; \
-            } \
-            if (i < eld->which##_count) { \
-                memmove(eld->which + i, eld->which + i + 1, sizeof(eld->which[0]) * (eld->which##_count - i)); \
-            } \
-            update_func(eld); break; \
-}}}
-
 void
 removeWatch(EventLoopData *eld, id_type watch_id) {
-    removeX(watches, watch_id, update_fds);
+    for (nfds_t i = 0; i < eld->watches_count; i++) {
+        if (eld->watches[i].id == watch_id) {
+            eld->watches_count--;
+            if (eld->watches[i].callback_data && eld->watches[i].free) {
+                eld->watches[i].free(eld->watches[i].id, eld->watches[i].callback_data);
+                eld->watches[i].callback_data = NULL; eld->watches[i].free = NULL;
+            }
+            if (i < eld->watches_count) {
+                memmove(eld->watches + i, eld->watches + i + 1, sizeof(eld->watches[0]) * (eld->watches_count - i));
+            }
+            update_fds(eld); break;
+        }
+    }
 }
 
 void
@@ -82,24 +92,67 @@ toggleWatch(EventLoopData *eld, id_type watch_id, int enabled) {
     }
 }
 
+// Timers heap {{{
 static id_type timer_counter = 0;
 
-static int
-compare_timers(const void *a_, const void *b_) {
-    const Timer *a = (const Timer*)a_, *b = (const Timer*)b_;
-    return (a->trigger_at > b->trigger_at) ? 1 : (a->trigger_at < b->trigger_at) ? -1 : 0;
+static inline bool
+timer_before(const Timer *a, const Timer *b) {
+    // Timers due at the same time fire in the order they were added
+    return a->trigger_at < b->trigger_at || (a->trigger_at == b->trigger_at && a->id < b->id);
 }
 
 static inline void
-update_timers(EventLoopData *eld) {
-    if (eld->timers_count > 1) qsort(eld->timers, eld->timers_count, sizeof(eld->timers[0]), compare_timers);
+swap_timers(EventLoopData *eld, nfds_t a, nfds_t b) {
+    Timer t = eld->timers[a]; eld->timers[a] = eld->timers[b]; eld->timers[b] = t;
+}
+
+static nfds_t
+sift_up(EventLoopData *eld, nfds_t i) {
+    while (i > 0) {
+        nfds_t parent = (i - 1) / 2;
+        if (!timer_before(eld->timers + i, eld->timers + parent)) break;
+        swap_timers(eld, i, parent);
+        i = parent;
+    }
+    return i;
 }
 
+static void
+sift_down(EventLoopData *eld, nfds_t i) {
+    while (true) {
+        nfds_t first = 2 * i + 1, second = first + 1, smallest = i;
+        if (first < eld->timers_count && timer_before(eld->timers + first, eld->timers + smallest)) smallest = first;
+        if (second < eld->timers_count && timer_before(eld->timers + second, eld->timers + smallest)) smallest = second;
+        if (smallest == i) break;
+        swap_timers(eld, i, smallest);
+        i = smallest;
+    }
+}
+
+static inline void
+reposition_timer(EventLoopData *eld, nfds_t i) {
+    if (sift_up(eld, i) == i) sift_down(eld, i);
+}
+
+static inline nfds_t
+find_timer(EventLoopData *eld, id_type timer_id) {
+    // There are few timers, so a scan of their ids is cheaper than an index
+    for (nfds_t i = 0; i < eld->timers_count; i++) {
+        if (eld->timers[i].id == timer_id) return i;
+    }
+    return eld->timers_count;
+}
+// }}}
+
 id_type
 addTimer(EventLoopData *eld, const char *name, monotonic_t interval, int enabled, bool repeats, timer_callback_func cb, void *cb_data, GLFWuserdatafreefun free) {
-    if (eld->timers_count >= sizeof(eld->timers)/sizeof(eld->timers[0])) {
-        _glfwInputError(GLFW_PLATFORM_ERROR, "Too many timers added");
-        return 0;
+    if (eld->timers_count >= eld->timers_capacity) {
+        nfds_t capacity = eld->timers_capacity ? 2 * eld->timers_capacity : 64;
+        if (!grow_array((void**)&eld->timers, sizeof(eld->timers[0]), capacity)) {
+            _glfwInputError(GLFW_PLATFORM_ERROR, "Out of memory adding timer");
+            return 0;
+        }
+        eld->timers_capacity = capacity;
     }
     Timer *t = eld->timers + eld->timers_count++;
     t->interval = interval;
@@ -110,13 +163,24 @@ addTimer(EventLoopData *eld, const char *name, monotonic_t interval, int enabled
     t->callback_data = cb_data;
     t->free = free;
     t->id = ++timer_counter;
-    update_timers(eld);
+    sift_up(eld, eld->timers_count - 1);
     return timer_counter;
 }
 
 void
 removeTimer(EventLoopData *eld, id_type timer_id) {
-    removeX(timers, timer_id, update_timers);
+    nfds_t i = find_timer(eld, timer_id);
+    if (i >= eld->timers_count) return;
+    Timer *t = eld->timers + i;
+    if (t->callback_data && t->free) {
+        t->free(t->id, t->callback_data);
+        t->callback_data = NULL; t->free = NULL;
+    }
+    eld->timers_count--;
+    if (i < eld->timers_count) {
+        eld->timers[i] = eld->timers[eld->timers_count];
+        reposition_timer(eld, i);
+    }
 }
 
 void
@@ -129,48 +193,69 @@ removeAllTimers(EventLoopData *eld) {
 
 void
 toggleTimer(EventLoopData *eld, id_type timer_id, int enabled) {
-    for (nfds_t i = 0; i < eld->timers_count; i++) {
-        if (eld->timers[i].id == timer_id) {
-            monotonic_t trigger_at = enabled ? (monotonic() + eld->timers[i].interval) : MONOTONIC_T_MAX;
-            if (trigger_at != eld->timers[i].trigger_at) {
-                eld->timers[i].trigger_at = trigger_at;
-                update_timers(eld);
-            }
-            break;
-        }
+    nfds_t i = find_timer(eld, timer_id);
+    if (i >= eld->timers_count) return;
+    monotonic_t trigger_at = enabled ? (monotonic() + eld->timers[i].interval) : MONOTONIC_T_MAX;
+    if (trigger_at != eld->timers[i].trigger_at) {
+        eld->timers[i].trigger_at = trigger_at;
+        reposition_timer(eld, i);
     }
 }
 
 void
 changeTimerInterval(EventLoopData *eld, id_type timer_id, monotonic_t interval) {
-    for (nfds_t i = 0; i < eld->timers_count; i++) {
-        if (eld->timers[i].id == timer_id) {
-            eld->timers[i].interval = interval;
-            break;
-        }
-    }
+    nfds_t i = find_timer(eld, timer_id);
+    if (i < eld->timers_count) eld->timers[i].interval = interval;
+}
+
+static inline struct timespec
+calc_time(monotonic_t nsec) {
+    struct timespec result;
+    result.tv_sec  = nsec / (1000LL * 1000LL * 1000LL);
+    result.tv_nsec = nsec % (1000LL * 1000LL * 1000LL);
+    return result;
+}
+
+#ifdef HAS_TIMER_FD
+static void
+arm_timer_fd(EventLoopData *eld, monotonic_t trigger_at, monotonic_t now) {
+    if (trigger_at == eld->timer_fd_armed_at) return;
+    eld->timer_fd_armed_at = trigger_at;
+    struct itimerspec spec = {{0}};  // a zero it_value disarms the timer
+    if (trigger_at != MONOTONIC_T_MAX) spec.it_value = calc_time(trigger_at - now);
+    timerfd_settime(eld->timerFd, 0, &spec, NULL);
 }
 
+static void
+drain_timer_fd(int fd, int events UNUSED, void *data) {
+    uint64_t expirations;
+    while (read(fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR);
+    ((EventLoopData*)data)->timer_fd_armed_at = MONOTONIC_T_MAX;
+}
+#endif
 
 monotonic_t
 prepareForPoll(EventLoopData *eld, monotonic_t timeout) {
     for (nfds_t i = 0; i < eld->watches_count; i++) eld->fds[i].revents = 0;
-    if (!eld->timers_count || eld->timers[0].trigger_at == MONOTONIC_T_MAX) return timeout;
+    if (!eld->timers_count || eld->timers[0].trigger_at == MONOTONIC_T_MAX) {
+#ifdef HAS_TIMER_FD
+        if (eld->timer_watch) arm_timer_fd(eld, MONOTONIC_T_MAX, 0);
+#endif
+        return timeout;
+    }
     monotonic_t now = monotonic(), next_repeat_at = eld->timers[0].trigger_at;
-    if (timeout < 0 || now + timeout > next_repeat_at) {
-        timeout = next_repeat_at <= now ? 0 : next_repeat_at - now;
+    if (next_repeat_at <= now) return 0;
+#ifdef HAS_TIMER_FD
+    if (eld->timer_watch) {
+        // The timer fd wakes up the poll when the timer is due
+        arm_timer_fd(eld, next_repeat_at, now);
+        return timeout;
     }
+#endif
+    if (timeout < 0 || now + timeout > next_repeat_at) timeout = next_repeat_at - now;
     return timeout;
 }
 
-static inline struct timespec
-calc_time(monotonic_t nsec) {
-    struct timespec result;
-    result.tv_sec  = nsec / (1000LL * 1000LL * 1000LL);
-    result.tv_nsec = nsec % (1000LL * 1000LL * 1000LL);
-    return result;
-}
-
 int
 pollWithTimeout(struct pollfd *fds, nfds_t nfds, monotonic_t timeout) {
     struct timespec tv = calc_time(timeout);
@@ -192,16 +277,25 @@ dispatchEvents(EventLoopData *eld) {
 unsigned
 dispatchTimers(EventLoopData *eld) {
     if (!eld->timers_count || eld->timers[0].trigger_at == MONOTONIC_T_MAX) return 0;
-    static struct { timer_callback_func func; id_type id; void* data; bool repeats; } dispatches[sizeof(eld->timers)/sizeof(eld->timers[0])];
+    typedef struct { timer_callback_func func; id_type id; void* data; bool repeats; } Dispatch;
+    static Dispatch *dispatches = NULL;
+    static nfds_t dispatches_capacity = 0;
+    if (dispatches_capacity < eld->timers_count) {
+        if (!grow_array((void**)&dispatches, sizeof(dispatches[0]), eld->timers_capacity)) return 0;
+        dispatches_capacity = eld->timers_capacity;
+    }
     unsigned num_dispatches = 0;
     monotonic_t now = monotonic();
-    for (nfds_t i = 0; i < eld->timers_count && eld->timers[i].trigger_at <= now; i++) {
-        eld->timers[i].trigger_at = now + eld->timers[i].interval;
-        dispatches[num_dispatches].func = eld->timers[i].callback;
-        dispatches[num_dispatches].id = eld->timers[i].id;
-        dispatches[num_dispatches].data = eld->timers[i].callback_data;
-        dispatches[num_dispatches].repeats = eld->timers[i].repeats;
+    // Every due timer is rescheduled after now, so each fires at most once
+    while (eld->timers[0].trigger_at <= now) {
+        Timer *t = eld->timers;
+        t->trigger_at = now + (t->interval > 0 ? t->interval : 1);
+        dispatches[num_dispatches].func = t->callback;
+        dispatches[num_dispatches].id = t->id;
+        dispatches[num_dispatches].data = t->callback_data;
+        dispatches[num_dispatches].repeats = t->repeats;
         num_dispatches++;
+        sift_down(eld, 0);
     }
     // we dispatch separately so that the callbacks can modify timers
     for (unsigned i = 0; i < num_dispatches; i++) {
@@ -210,7 +304,6 @@ dispatchTimers(EventLoopData *eld) {
             removeTimer(eld, dispatches[i].id);
         }
     }
-    if (num_dispatches) update_timers(eld);
     return num_dispatches;
 }
 
@@ -246,6 +339,16 @@ initPollData(EventLoopData *eld, int display_fd) {
     const int wakeup_fd = eld->wakeupFds[0];
 #endif
     if (!addWatch(eld, "wakeup", wakeup_fd, POLLIN, 1, mark_wakep_fd_ready, eld)) return false;
+#ifdef HAS_TIMER_FD
+    // Optional, without it the poll timeout is used to wait for timers
+    eld->timer_watch = 0;
+    eld->timer_fd_armed_at = MONOTONIC_T_MAX;
+    eld->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (eld->timerFd > -1) {
+        eld->timer_watch = addWatch(eld, "timers", eld->timerFd, POLLIN, 1, drain_timer_fd, eld);
+        if (!eld->timer_watch) { close(eld->timerFd); eld->timerFd = -1; }
+    }
+#endif
     return true;
 }
 
@@ -289,6 +392,14 @@ finalizePollData(EventLoopData *eld) {
 #else
     closeFds(eld->wakeupFds, arraysz(eld->wakeupFds));
 #endif
+#ifdef HAS_TIMER_FD
+    if (eld->timer_watch) { close(eld->timerFd); eld->timerFd = -1; eld->timer_watch = 0; }
+#endif
+    free(eld->watches); eld->watches = NULL;
+    free(eld->fds); eld->fds = NULL;
+    eld->watches_count = 0; eld->watches_capacity = 0;
+    free(eld->timers); eld->timers = NULL;
+    eld->timers_count = 0; eld->timers_capacity = 0;
 }
 
 int
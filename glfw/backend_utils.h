@@ -40,6 +40,13 @@
 #include <sys/eventfd.h>
 #endif
 
+#ifdef __has_include
+#if __has_include(<sys/timerfd.h>)
+#define HAS_TIMER_FD
+#include <sys/timerfd.h>
+#endif
+#endif
+
 typedef unsigned long long id_type;
 typedef void(*watch_callback_func)(int, int, void*);
 typedef void(*timer_callback_func)(id_type, void*);
@@ -66,16 +73,24 @@ typedef struct {
 
 
 typedef struct {
-    struct pollfd fds[32];
+    struct pollfd *fds;
 #ifdef HAS_EVENT_FD
     int wakeupFd;
 #else
     int wakeupFds[2];
+#endif
+#ifdef HAS_TIMER_FD
+    // Wakes up the poll when the next timer is due, without the slack that
+    // ppoll() adds to its timeout. timer_watch is zero if it is not available
+    int timerFd;
+    id_type timer_watch;
+    monotonic_t timer_fd_armed_at;
 #endif
     bool wakeup_data_read, wakeup_fd_ready;
-    nfds_t watches_count, timers_count;
-    Watch watches[32];
-    Timer timers[128];
+    nfds_t watches_count, watches_capacity, timers_count, timers_capacity;
+    Watch *watches;
+    // A binary min-heap ordered by trigger_at, so the next timer due is timers[0]
+    Timer *timers;
 } EventLoopData;
 
 
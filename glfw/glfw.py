@@ -33,10 +33,11 @@ def init_env(env, pkg_config, at_least_version, test_compile, module='x11'):
     ans.sources = sinfo['common']['sources'] + module_sources
     ans.all_headers = [x for x in os.listdir(base) if x.endswith('.h')]
 
-    if module in ('x11', 'wayland'):
+    if module in ('x11', 'wayland', 'osmesa'):
         ans.cflags.append('-pthread')
         ans.ldpaths.append('-pthread')
         ans.ldpaths.extend('-lrt -lm -ldl'.split())
+    if module in ('x11', 'wayland'):
         at_least_version('xkbcommon', 0, 5)
 
     if module == 'x11':
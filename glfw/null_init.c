@@ -28,6 +28,7 @@
 //========================================================================
 
 #include "internal.h"
+#include <stdlib.h>
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -36,15 +37,28 @@
 
 int _glfwPlatformInit(void)
 {
+    // There is no display connection, so only the wakeup fd is polled
+    if (!initPollData(&_glfw.null.eventLoopData, -1))
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Null: Failed to initialize event loop data");
+        return false;
+    }
     return true;
 }
 
 void _glfwPlatformTerminate(void)
 {
     _glfwTerminateOSMesa();
+    free(_glfw.null.clipboardString);
+    _glfw.null.clipboardString = NULL;
+    finalizePollData(&_glfw.null.eventLoopData);
 }
 
 const char* _glfwPlatformGetVersionString(void)
 {
     return _GLFW_VERSION_NUMBER " null OSMesa";
 }
+
+#define GLFW_LOOP_BACKEND null
+#include "main_loop.h"
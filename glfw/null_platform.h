@@ -30,17 +30,17 @@
 #define _GLFW_PLATFORM_WINDOW_STATE _GLFWwindowNull null
 
 #define _GLFW_PLATFORM_CONTEXT_STATE
-#define _GLFW_PLATFORM_MONITOR_STATE
-#define _GLFW_PLATFORM_CURSOR_STATE
-#define _GLFW_PLATFORM_LIBRARY_WINDOW_STATE
+#define _GLFW_PLATFORM_MONITOR_STATE _GLFWmonitorNull null
+#define _GLFW_PLATFORM_CURSOR_STATE _GLFWcursorNull null
+#define _GLFW_PLATFORM_LIBRARY_WINDOW_STATE _GLFWlibraryNull null
 #define _GLFW_PLATFORM_LIBRARY_CONTEXT_STATE
-#define _GLFW_EGL_CONTEXT_STATE
-#define _GLFW_EGL_LIBRARY_CONTEXT_STATE
+#define _GLFW_EGL_CONTEXT_STATE _GLFWcontextEGLNull egl
+#define _GLFW_EGL_LIBRARY_CONTEXT_STATE _GLFWcontextEGLNull egl
 
 #include "osmesa_context.h"
-#include "posix_time.h"
 #include "posix_thread.h"
 #include "null_joystick.h"
+#include "backend_utils.h"
 
 #if defined(_GLFW_WIN32)
  #define _glfw_dlopen(name) LoadLibraryA(name)
@@ -58,5 +58,23 @@ typedef struct _GLFWwindowNull
 {
     int width;
     int height;
+    bool visible;
+    bool iconified;
+    bool maximized;
 } _GLFWwindowNull;
 
+// The null platform has no native monitors, cursors or EGL, but ISO C does not
+// allow empty structs
+//
+typedef struct _GLFWmonitorNull { int unused; } _GLFWmonitorNull;
+typedef struct _GLFWcursorNull { int unused; } _GLFWcursorNull;
+typedef struct _GLFWcontextEGLNull { int unused; } _GLFWcontextEGLNull;
+
+// Null-specific global data
+//
+typedef struct _GLFWlibraryNull
+{
+    EventLoopData eventLoopData;
+    char* clipboardString;
+} _GLFWlibraryNull;
+
@@ -28,6 +28,7 @@
 //========================================================================
 
 #include "internal.h"
+#include <stdlib.h>
 #include "../kitty/monotonic.h"
 
 
@@ -36,10 +37,19 @@ static int createNativeWindow(_GLFWwindow* window,
 {
     window->null.width = wndconfig->width;
     window->null.height = wndconfig->height;
+    window->null.visible = wndconfig->visible;
+    window->null.maximized = wndconfig->maximized;
 
     return true;
 }
 
+static void
+handleEvents(monotonic_t timeout) {
+    EventLoopData *eld = &_glfw.null.eventLoopData;
+    pollForEvents(eld, timeout);
+    if (eld->wakeup_fd_ready) check_for_wakeup_events(eld);
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                       GLFW platform API                      //////
@@ -156,23 +166,32 @@ monotonic_t _glfwPlatformGetDoubleClickInterval(_GLFWwindow* window UNUSED)
     return ms_to_monotonic_t(500ll);
 }
 
-void _glfwPlatformIconifyWindow(_GLFWwindow* window UNUSED)
+void _glfwPlatformIconifyWindow(_GLFWwindow* window)
 {
+    window->null.iconified = true;
 }
 
-void _glfwPlatformRestoreWindow(_GLFWwindow* window UNUSED)
+void _glfwPlatformRestoreWindow(_GLFWwindow* window)
 {
+    window->null.iconified = false;
+    window->null.maximized = false;
 }
 
-void _glfwPlatformMaximizeWindow(_GLFWwindow* window UNUSED)
+void _glfwPlatformMaximizeWindow(_GLFWwindow* window)
 {
+    window->null.maximized = true;
 }
 
-int _glfwPlatformWindowMaximized(_GLFWwindow* window UNUSED)
+bool _glfwPlatformToggleFullscreen(_GLFWwindow* window UNUSED, unsigned int flags UNUSED)
 {
     return false;
 }
 
+int _glfwPlatformWindowMaximized(_GLFWwindow* window)
+{
+    return window->null.maximized;
+}
+
 int _glfwPlatformWindowHovered(_GLFWwindow* window UNUSED)
 {
     return false;
@@ -204,8 +223,9 @@ void _glfwPlatformSetWindowOpacity(_GLFWwindow* window UNUSED, float opacity UNU
 {
 }
 
-void _glfwPlatformShowWindow(_GLFWwindow* window UNUSED)
+void _glfwPlatformShowWindow(_GLFWwindow* window)
 {
+    window->null.visible = true;
 }
 
 
@@ -218,12 +238,9 @@ int _glfwPlatformWindowBell(_GLFWwindow* window UNUSED)
     return false;
 }
 
-void _glfwPlatformUnhideWindow(_GLFWwindow* window UNUSED)
-{
-}
-
-void _glfwPlatformHideWindow(_GLFWwindow* window UNUSED)
+void _glfwPlatformHideWindow(_GLFWwindow* window)
 {
+    window->null.visible = false;
 }
 
 void _glfwPlatformFocusWindow(_GLFWwindow* window UNUSED)
@@ -240,30 +257,38 @@ int _glfwPlatformWindowOccluded(_GLFWwindow* window UNUSED)
     return false;
 }
 
-int _glfwPlatformWindowIconified(_GLFWwindow* window UNUSED)
+int _glfwPlatformWindowIconified(_GLFWwindow* window)
 {
-    return false;
+    return window->null.iconified;
 }
 
-int _glfwPlatformWindowVisible(_GLFWwindow* window UNUSED)
+int _glfwPlatformWindowVisible(_GLFWwindow* window)
+{
+    return window->null.visible;
+}
+
+void _glfwPlatformUpdateIMEState(_GLFWwindow* window UNUSED, int which UNUSED, int a UNUSED, int b UNUSED, int c UNUSED, int d UNUSED)
 {
-    return false;
 }
 
 void _glfwPlatformPollEvents(void)
 {
+    handleEvents(0);
 }
 
 void _glfwPlatformWaitEvents(void)
 {
+    handleEvents(-1);
 }
 
-void _glfwPlatformWaitEventsTimeout(monotonic_t timeout UNUSED)
+void _glfwPlatformWaitEventsTimeout(monotonic_t timeout)
 {
+    handleEvents(timeout);
 }
 
 void _glfwPlatformPostEmptyEvent(void)
 {
+    wakeupEventLoop(&_glfw.null.eventLoopData);
 }
 
 void _glfwPlatformGetCursorPos(_GLFWwindow* window UNUSED, double* xpos UNUSED, double* ypos UNUSED)
@@ -285,7 +310,7 @@ int _glfwPlatformCreateCursor(_GLFWcursor* cursor UNUSED,
     return true;
 }
 
-int _glfwPlatformCreateStandardCursor(_GLFWcursor* cursor UNUSED, int shape UNUSED)
+int _glfwPlatformCreateStandardCursor(_GLFWcursor* cursor UNUSED, GLFWCursorShape shape UNUSED)
 {
     return true;
 }
@@ -298,13 +323,15 @@ void _glfwPlatformSetCursor(_GLFWwindow* window UNUSED, _GLFWcursor* cursor UNUS
 {
 }
 
-void _glfwPlatformSetClipboardString(const char* string UNUSED)
+void _glfwPlatformSetClipboardString(const char* string)
 {
+    free(_glfw.null.clipboardString);
+    _glfw.null.clipboardString = _glfw_strdup(string);
 }
 
 const char* _glfwPlatformGetClipboardString(void)
 {
-    return NULL;
+    return _glfw.null.clipboardString;
 }
 
 const char* _glfwPlatformGetNativeKeyName(int native_key UNUSED)
@@ -669,7 +669,7 @@ void _glfwPlatformTerminate(void)
     {
         XCloseDisplay(_glfw.x11.display);
         _glfw.x11.display = NULL;
-        _glfw.x11.eventLoopData.fds[0].fd = -1;
+        if (_glfw.x11.eventLoopData.fds) _glfw.x11.eventLoopData.fds[0].fd = -1;
     }
 
     if (_glfw.x11.xcursor.handle)
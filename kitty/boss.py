@@ -13,6 +13,7 @@ from weakref import WeakValueDictionary
 
 from .child import cached_process_data, cwd_of_process
 from .cli import create_opts, parse_args
+from .cmds import StreamedResponse
 from .conf.utils import to_cmdline
 from .config import initial_window_size_func, prepare_config_file_for_editing
 from .config_data import MINIMUM_FONT_SIZE
@@ -25,7 +26,9 @@ from .fast_data_types import (
     change_os_window_state, create_os_window, current_os_window,
     destroy_global_data, focus_os_window, get_clipboard_string,
     global_font_size, mark_os_window_for_close, os_window_font_size,
-    patch_global_colors, safe_pipe, set_clipboard_string, set_in_sequence_mode,
+    patch_global_colors, safe_pipe, set_clipboard_string,
+    set_image_decode_threads, set_image_texture_scale,
+    set_image_texture_sharing, set_in_sequence_mode,
     thread_write, toggle_fullscreen, toggle_maximized
 )
 from .keys import get_shortcut, shortcut_matches
@@ -129,6 +132,11 @@ class Boss:
             talk_fd, listen_fd
         )
         set_boss(self)
+        # Decode PNG and compressed images sent via the graphics protocol in
+        # the background, so that large images do not block rendering
+        set_image_decode_threads(max(1, min(4, (os.cpu_count() or 1) - 1)))
+        set_image_texture_sharing(opts.share_image_textures)
+        set_image_texture_scale(opts.image_texture_scale)
         self.opts, self.args = opts, args
         startup_sessions = create_sessions(opts, args, default_session=opts.startup_session)
         self.keymap = self.opts.keymap.copy()
@@ -278,11 +286,11 @@ class Boss:
         self.child_monitor.add_child(window.id, window.child.pid, window.child.child_fd, window.screen)
         self.window_id_map[window.id] = window
 
-    def _handle_remote_command(self, cmd, window=None, from_peer=False):
+    def _handle_remote_command(self, cmd, window=None, from_peer=False, allow_streams=False):
         response = None
         if self.opts.allow_remote_control == 'y' or from_peer or getattr(window, 'allow_remote_control', False):
             try:
-                response = handle_cmd(self, window, cmd)
+                response = handle_cmd(self, window, cmd, allow_streams)
             except Exception as err:
                 import traceback
                 response = {'ok': False, 'error': str(err)}
@@ -317,6 +325,19 @@ class Boss:
             else:
                 log_error('Unknown message received from peer, ignoring')
 
+    def peer_frame_received(self, msg):
+        # A command received on a connection carrying many commands, see
+        # FramedConnection in remote_control.py
+        response = self._handle_remote_command(msg.decode('utf-8'), from_peer=True, allow_streams=True)
+        if response is not None:
+            stream = response.get('data')
+            if isinstance(stream, StreamedResponse):
+                # The streamed data is sent after the response by
+                # start_stream() in child-monitor.c
+                response['data'] = stream.data
+                return json.dumps(response).encode('utf-8'), stream.kind, stream.spec
+            return json.dumps(response).encode('utf-8')
+
     def handle_remote_cmd(self, cmd, window=None):
         response = self._handle_remote_command(cmd, window)
         if response is not None:
@@ -9,6 +9,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#include "charsets.h"
 #define UTF8_ACCEPT 0
 #define UTF8_REJECT 1
 
@@ -318,3 +320,53 @@ base64_decode(const uint32_t *src, size_t src_sz, uint8_t *dest, size_t dest_cap
     }
     return NULL;
 }
+
+void
+base64_decoder_init(Base64Decoder *d, uint8_t *dest, size_t dest_capacity) {
+    memset(d, 0, sizeof(*d));
+    d->dest = dest; d->dest_capacity = dest_capacity;
+}
+
+static inline void
+write_triple(Base64Decoder *d, uint32_t triple) {
+    if (d->dest_sz + 3 > d->dest_capacity + 2) { d->overflow = true; return; }
+    d->dest[d->dest_sz++] = (triple >> 2 * 8) & 0xFF;
+    d->dest[d->dest_sz++] = (triple >> 1 * 8) & 0xFF;
+    d->dest[d->dest_sz++] = (triple >> 0 * 8) & 0xFF;
+}
+
+static inline void
+decode_one(Base64Decoder *d, uint8_t ch) {
+    d->partial = (d->partial << 6) | b64_decoding_table[ch];
+    if (++d->partial_count == 4) {
+        write_triple(d, d->partial);
+        d->partial = 0; d->partial_count = 0;
+    }
+}
+
+void
+base64_decode_chunk(Base64Decoder *d, const uint8_t *src, size_t src_sz) {
+    // = has no special meaning, it decodes to zero, like any other character
+    // not in the alphabet, padding is accounted for when finishing
+    size_t i = 0;
+    if (!src_sz) return;
+    while (d->partial_count && i < src_sz) decode_one(d, src[i++]);
+    const uint8_t *t = b64_decoding_table;
+    for (; i + 4 <= src_sz; i += 4) {
+        write_triple(d, ((uint32_t)t[src[i]] << 18) | ((uint32_t)t[src[i+1]] << 12) | ((uint32_t)t[src[i+2]] << 6) | t[src[i+3]]);
+    }
+    while (i < src_sz) decode_one(d, src[i++]);
+    if (src_sz > 1) { d->last_two[0] = src[src_sz - 2]; d->last_two[1] = src[src_sz - 1]; }
+    else { d->last_two[0] = d->last_two[1]; d->last_two[1] = src[0]; }
+    d->src_sz += src_sz;
+}
+
+const char*
+base64_decoder_finish(Base64Decoder *d) {
+    if (!d->src_sz) return NULL;
+    if (d->src_sz % 4 != 0) return "base64 encoded data must have a length that is a multiple of four";
+    if (d->last_two[1] == '=') d->dest_sz--;
+    if (d->last_two[0] == '=') d->dest_sz--;
+    if (d->overflow || d->dest_sz > d->dest_capacity) return "output buffer too small";
+    return NULL;
+}
@@ -8,7 +8,22 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+// Incremental base64 decoding, dest must have room for dest_capacity + 2 bytes
+// as the padding of the last quad is only removed when finishing.
+typedef struct {
+    uint8_t *dest;
+    size_t dest_capacity, dest_sz, src_sz;
+    uint32_t partial;
+    unsigned int partial_count;
+    uint8_t last_two[2];
+    bool overflow;
+} Base64Decoder;
 
 uint32_t decode_utf8(uint32_t*, uint32_t*, uint8_t byte);
 size_t decode_utf8_string(const char *src, size_t sz, uint32_t *dest);
 unsigned int encode_utf8(uint32_t ch, char* dest);
+void base64_decoder_init(Base64Decoder *d, uint8_t *dest, size_t dest_capacity);
+void base64_decode_chunk(Base64Decoder *d, const uint8_t *src, size_t src_sz);
+const char* base64_decoder_finish(Base64Decoder *d);
@@ -41,6 +41,10 @@ typedef struct {
     char *data;
     size_t sz;
     int fd;
+    // Messages received on framed connections are responded to with a frame
+    // with the same request id, see send_frame_response()
+    uint32_t request_id;
+    bool framed;
 } Message;
 
 typedef struct {
@@ -150,6 +154,8 @@ new(PyTypeObject *type, PyObject *args, PyObject UNUSED *kwds) {
     return (PyObject*) self;
 }
 
+static void free_streams(void);
+
 static void
 dealloc(ChildMonitor* self) {
     pthread_mutex_destroy(&children_lock);
@@ -165,6 +171,7 @@ dealloc(ChildMonitor* self) {
         FREE_CHILD(add_queue[add_queue_count]);
     }
     free_loop_data(&self->io_loop_data);
+    free_streams();
 }
 
 static void
@@ -175,6 +182,10 @@ wakeup_io_loop(ChildMonitor *self, bool in_signal_handler) {
 static void* io_loop(void *data);
 static void* talk_loop(void *data);
 static void send_response(int fd, const char *msg, size_t msg_sz);
+static void send_frame_response(int fd, uint32_t request_id, const char *msg, size_t msg_sz);
+static void start_stream(int fd, uint32_t request_id, PyObject *resp);
+static void service_text_streams(void);
+static void update_subscriptions(monotonic_t now);
 static void wakeup_talk_loop(bool);
 static bool talk_thread_started = false;
 
@@ -218,6 +229,33 @@ add_child(ChildMonitor *self, PyObject *args) {
     Py_RETURN_NONE;
 }
 
+#define MAX_PENDING_WRITE (100 * 1024 * 1024)
+
+static inline bool
+reserve_write_space(Screen *screen, unsigned long id, size_t sz) {
+    // Must be called with the write lock of the screen held
+    size_t space_left = screen->write_buf_sz - screen->write_buf_used;
+    if (space_left < sz) {
+        if (screen->write_buf_used + sz > MAX_PENDING_WRITE) {
+            log_error("Too much data being sent to child with id: %lu, ignoring it", id);
+            return false;
+        }
+        screen->write_buf_sz = screen->write_buf_used + sz;
+        screen->write_buf = PyMem_RawRealloc(screen->write_buf, screen->write_buf_sz);
+        if (screen->write_buf == NULL) { fatal("Out of memory."); }
+    }
+    return true;
+}
+
+static inline void
+shrink_write_buf(Screen *screen) {
+    if (screen->write_buf_sz > BUFSIZ && screen->write_buf_used < BUFSIZ) {
+        screen->write_buf_sz = BUFSIZ;
+        screen->write_buf = PyMem_RawRealloc(screen->write_buf, screen->write_buf_sz);
+        if (screen->write_buf == NULL) { fatal("Out of memory."); }
+    }
+}
+
 bool
 schedule_write_to_child(unsigned long id, unsigned int num, ...) {
     ChildMonitor *self = the_monitor;
@@ -237,16 +275,9 @@ schedule_write_to_child(unsigned long id, unsigned int num, ...) {
             found = true;
             Screen *screen = children[i].screen;
             screen_mutex(lock, write);
-            size_t space_left = screen->write_buf_sz - screen->write_buf_used;
-            if (space_left < sz) {
-                if (screen->write_buf_used + sz > 100 * 1024 * 1024) {
-                    log_error("Too much data being sent to child with id: %lu, ignoring it", id);
-                    screen_mutex(unlock, write);
-                    break;
-                }
-                screen->write_buf_sz = screen->write_buf_used + sz;
-                screen->write_buf = PyMem_RawRealloc(screen->write_buf, screen->write_buf_sz);
-                if (screen->write_buf == NULL) { fatal("Out of memory."); }
+            if (!reserve_write_space(screen, id, sz)) {
+                screen_mutex(unlock, write);
+                break;
             }
             va_start(ap, num);
             for (unsigned int i = 0; i < num; i++) {
@@ -256,11 +287,7 @@ schedule_write_to_child(unsigned long id, unsigned int num, ...) {
                 screen->write_buf_used += dsz;
             }
             va_end(ap);
-            if (screen->write_buf_sz > BUFSIZ && screen->write_buf_used < BUFSIZ) {
-                screen->write_buf_sz = BUFSIZ;
-                screen->write_buf = PyMem_RawRealloc(screen->write_buf, screen->write_buf_sz);
-                if (screen->write_buf == NULL) { fatal("Out of memory."); }
-            }
+            shrink_write_buf(screen);
             if (screen->write_buf_used) wakeup_io_loop(self, false);
             screen_mutex(unlock, write);
             break;
@@ -280,6 +307,55 @@ needs_write(ChildMonitor UNUSED *self, PyObject *args) {
     Py_RETURN_FALSE;
 }
 
+static PyObject *
+broadcast_to_children(ChildMonitor *self, PyObject *args) {
+#define broadcast_to_children_doc "broadcast_to_children(data, window_ids) -> Queue data to be written to the children of all the specified windows at once. "\
+    "Returns a tuple with the number of bytes waiting to be written to each child, after the data, or -1 if the window has no child or -2 if the data was dropped as too much is waiting."
+    const char *data;
+    Py_ssize_t sz;
+    PyObject *ids;
+    if (!PyArg_ParseTuple(args, "y#O!", &data, &sz, &PyTuple_Type, &ids)) return NULL;
+    Py_ssize_t num = PyTuple_GET_SIZE(ids);
+    unsigned long *window_ids = calloc(MAX(1, num), sizeof(unsigned long));
+    ssize_t *pending = calloc(MAX(1, num), sizeof(ssize_t));
+    if (!window_ids || !pending) { free(window_ids); free(pending); return PyErr_NoMemory(); }
+    for (Py_ssize_t k = 0; k < num; k++) {
+        window_ids[k] = PyLong_AsUnsignedLong(PyTuple_GET_ITEM(ids, k));
+        pending[k] = -1;
+    }
+    if (PyErr_Occurred()) { free(window_ids); free(pending); return NULL; }
+    // The windows are matched with their children, and the data queued for
+    // all of them, in a single pass with the children lock held, waking the
+    // I/O thread once, instead of once for every window
+    bool queued = false;
+    children_mutex(lock);
+    for (size_t i = 0; i < self->count; i++) {
+        for (Py_ssize_t k = 0; k < num; k++) {
+            if (children[i].id != window_ids[k]) continue;
+            Screen *screen = children[i].screen;
+            screen_mutex(lock, write);
+            if (reserve_write_space(screen, children[i].id, sz)) {
+                memcpy(screen->write_buf + screen->write_buf_used, data, sz);
+                screen->write_buf_used += sz;
+                shrink_write_buf(screen);
+                pending[k] = screen->write_buf_used;
+                queued = true;
+            } else pending[k] = -2;
+            screen_mutex(unlock, write);
+        }
+    }
+    children_mutex(unlock);
+    if (queued && sz) wakeup_io_loop(self, false);
+    PyObject *ans = PyTuple_New(num);
+    for (Py_ssize_t k = 0; ans && k < num; k++) {
+        PyObject *n = PyLong_FromSsize_t(pending[k]);
+        if (!n) { Py_CLEAR(ans); break; }
+        PyTuple_SET_ITEM(ans, k, n);
+    }
+    free(window_ids); free(pending);
+    return ans;
+}
+
 static PyObject *
 shutdown_monitor(ChildMonitor *self, PyObject *a UNUSED) {
 #define shutdown_monitor_doc "shutdown_monitor() -> Shutdown the monitor loop."
@@ -298,14 +374,21 @@ shutdown_monitor(ChildMonitor *self, PyObject *a UNUSED) {
 
 static inline bool
 do_parse(ChildMonitor *self, Screen *screen, monotonic_t now) {
-    bool input_read = false;
     screen_mutex(lock, read);
+    // Input is left in the read buffer while an image is being decoded. The
+    // response and placement of a finished decode count as input read.
+    bool input_read = screen->grman->decode_job != NULL;
+    if (screen_image_decode_pending(screen)) { screen_mutex(unlock, read); return false; }
     if (screen->read_buf_sz || screen->pending_mode.used) {
         monotonic_t time_since_new_input = now - screen->new_input_at;
         if (time_since_new_input >= OPT(input_delay)) {
             bool read_buf_full = screen->read_buf_sz >= READ_BUF_SZ;
             input_read = true;
+            TRACE_COUNTER("read_buf_sz", screen->read_buf_sz);
+            TRACE_BEGIN("parse");
             parse_func(screen, self->dump_callback, now);
+            TRACE_END("parse");
+            if (screen->input_latency.read_at && !screen->input_latency.parse_at) screen->input_latency.parse_at = monotonic();
             if (read_buf_full) wakeup_io_loop(self, false);  // Ensure the read fd has POLLIN set
             screen->new_input_at = 0;
             if (screen->pending_mode.activated_at) {
@@ -325,6 +408,7 @@ parse_input(ChildMonitor *self) {
     bool input_read = false;
     monotonic_t now = monotonic();
     PyObject *msg = NULL;
+    TRACE_BEGIN("parse_input");
     children_mutex(lock);
     while (remove_queue_count) {
         remove_queue_count--;
@@ -338,7 +422,7 @@ parse_input(ChildMonitor *self) {
         if (msg) {
             for (size_t i = 0; i < self->messages_count; i++) {
                 Message *m = self->messages + i;
-                PyTuple_SET_ITEM(msg, i, Py_BuildValue("y#i", m->data, (int)m->sz, m->fd));
+                PyTuple_SET_ITEM(msg, i, Py_BuildValue("y#iIi", m->data, (int)m->sz, m->fd, m->request_id, (int)m->framed));
                 free(m->data); m->data = NULL; m->sz = 0;
             }
             self->messages_count = 0;
@@ -356,31 +440,71 @@ parse_input(ChildMonitor *self) {
     }
     children_mutex(unlock);
     if (msg) {
+        bool has_frame_responses = false;
         for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(msg); i++) {
-            PyObject *resp = PyObject_CallMethod(global_state.boss, "peer_message_received", "O", PyTuple_GET_ITEM(PyTuple_GET_ITEM(msg, i), 0));
-            int peer_fd = (int)PyLong_AsLong(PyTuple_GET_ITEM(PyTuple_GET_ITEM(msg, i), 1));
+            PyObject *m = PyTuple_GET_ITEM(msg, i);
+            int peer_fd = (int)PyLong_AsLong(PyTuple_GET_ITEM(m, 1));
+            if (PyLong_AsLong(PyTuple_GET_ITEM(m, 3))) {
+                uint32_t request_id = (uint32_t)PyLong_AsUnsignedLong(PyTuple_GET_ITEM(m, 2));
+                TRACE_BEGIN("boss.peer_frame_received");
+                PyObject *resp = PyObject_CallMethod(global_state.boss, "peer_frame_received", "O", PyTuple_GET_ITEM(m, 0));
+                TRACE_END("boss.peer_frame_received");
+                // Every request is responded to, with an empty frame if there is no response
+                if (resp && PyBytes_Check(resp)) send_frame_response(peer_fd, request_id, PyBytes_AS_STRING(resp), PyBytes_GET_SIZE(resp));
+                else if (resp && PyTuple_Check(resp) && PyTuple_GET_SIZE(resp) == 3 && PyBytes_Check(PyTuple_GET_ITEM(resp, 0))) {
+                    // A response followed by streamed data
+                    start_stream(peer_fd, request_id, resp);
+                }
+                else { send_frame_response(peer_fd, request_id, NULL, 0); if (!resp) PyErr_Print(); }
+                Py_CLEAR(resp);
+                has_frame_responses = true;
+                continue;
+            }
+            TRACE_BEGIN("boss.peer_message_received");
+            PyObject *resp = PyObject_CallMethod(global_state.boss, "peer_message_received", "O", PyTuple_GET_ITEM(m, 0));
+            TRACE_END("boss.peer_message_received");
             if (resp && PyBytes_Check(resp)) send_response(peer_fd, PyBytes_AS_STRING(resp), PyBytes_GET_SIZE(resp));
             else { send_response(peer_fd, NULL, 0); if (!resp) PyErr_Print(); }
             Py_CLEAR(resp);
         }
+        // Responses to framed requests are sent by the talk thread once it is woken up
+        if (has_frame_responses) wakeup_talk_loop(false);
         Py_CLEAR(msg);
     }
+    service_text_streams();
 
     while(remove_count) {
         // must be done while no locks are held, since the locks are non-recursive and
         // the python function could call into other functions in this module
         remove_count--;
+        TRACE_BEGIN("death_notify");
         PyObject *t = PyObject_CallFunction(self->death_notify, "k", remove_notify[remove_count]);
+        TRACE_END("death_notify");
         if (t == NULL) PyErr_Print();
         else Py_DECREF(t);
     }
 
-    for (size_t i = 0; i < count; i++) {
-        if (!scratch[i].needs_removal) {
-            if (do_parse(self, scratch[i].screen, now)) input_read = true;
+    // Children are parsed in turn, starting after the last one parsed, until
+    // the parse budget is used up, after which the rest are left for the next
+    // loop iteration, so that a flood of output in one window cannot delay
+    // rendering, and so input latency, in the others
+    static size_t next_child = 0;
+    bool budget_used = false;
+    for (size_t n = 0; n < count; n++) {
+        size_t i = (next_child + n) % count;
+        if (!scratch[i].needs_removal && !budget_used) {
+            if (do_parse(self, scratch[i].screen, now)) {
+                input_read = true;
+                if (monotonic() - now >= OPT(repaint_delay)) {
+                    budget_used = true;
+                    next_child = i + 1;
+                    set_maximum_wait(0);
+                }
+            }
         }
         DECREF_CHILD(scratch[i]);
     }
+    TRACE_END("parse_input");
     return input_read;
 }
 
@@ -579,6 +703,102 @@ prepare_to_render_os_window(OSWindow *os_window, monotonic_t now, unsigned int *
     return needs_render;
 }
 
+// Input latency {{{
+// The time from a key press to the frame that displays the output that
+// follows it, split into stages: until the key is sent to the child, until
+// the child produces output, until that output is parsed and until the frame
+// is swapped. One key press per window is followed at a time. The last
+// INPUT_LATENCY_SAMPLES key presses are kept for input_latency_stats() and are
+// optionally also written to a trace file.
+
+#define INPUT_LATENCY_SAMPLES 1024
+// A key press whose output was never displayed, for instance because the
+// window was hidden or the child did not echo it, is abandoned after this
+// long, rather than being measured against some unrelated later output
+#define INPUT_LATENCY_TIMEOUT s_to_monotonic_t(1ll)
+enum { LATENCY_KEY, LATENCY_CHILD, LATENCY_PARSE, LATENCY_RENDER, LATENCY_TOTAL, NUM_LATENCY_STAGES };
+static const char* latency_stage_names[NUM_LATENCY_STAGES] = {"key", "child", "parse", "render", "total"};
+static struct {
+    monotonic_t samples[INPUT_LATENCY_SAMPLES][NUM_LATENCY_STAGES];
+    unsigned long long count;
+    FILE *trace;
+} input_latency = {{{0}}};
+
+void
+start_input_latency_probe(Screen *screen, monotonic_t key_at) {
+    monotonic_t now = monotonic();
+    screen_mutex(lock, read);
+    if (!screen->input_latency.key_at || now - screen->input_latency.key_at > INPUT_LATENCY_TIMEOUT) {
+        screen->input_latency.key_at = key_at; screen->input_latency.write_at = now;
+        screen->input_latency.read_at = 0; screen->input_latency.parse_at = 0;
+    }
+    screen_mutex(unlock, read);
+}
+
+static inline void
+finish_input_latency_probe(Screen *screen, id_type window_id, monotonic_t swapped_at) {
+    // parse_at is only set in the main thread, so it can be checked without locking
+    if (!screen->input_latency.parse_at) return;
+    screen_mutex(lock, read);
+    monotonic_t key_at = screen->input_latency.key_at, write_at = screen->input_latency.write_at, read_at = screen->input_latency.read_at, parse_at = screen->input_latency.parse_at;
+    zero_at_ptr(&screen->input_latency);
+    screen_mutex(unlock, read);
+    if (swapped_at - key_at > INPUT_LATENCY_TIMEOUT) return;
+    monotonic_t *s = input_latency.samples[input_latency.count++ % INPUT_LATENCY_SAMPLES];
+    s[LATENCY_KEY] = write_at - key_at; s[LATENCY_CHILD] = read_at - write_at; s[LATENCY_PARSE] = parse_at - read_at;
+    s[LATENCY_RENDER] = swapped_at - parse_at; s[LATENCY_TOTAL] = swapped_at - key_at;
+    if (input_latency.trace) {
+        fprintf(input_latency.trace, "{\"window\": %llu, \"at\": %.6f", window_id, monotonic_t_to_s_double(key_at));
+        for (unsigned i = 0; i < NUM_LATENCY_STAGES; i++) fprintf(input_latency.trace, ", \"%s\": %.3f", latency_stage_names[i], monotonic_t_to_s_double(s[i]) * 1e3);
+        fprintf(input_latency.trace, "}\n");
+        fflush(input_latency.trace);
+    }
+}
+
+static int
+cmp_monotonic_t(const void *a, const void *b) {
+    monotonic_t x = *(const monotonic_t*)a, y = *(const monotonic_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static PyObject*
+input_latency_stats(PyObject *self UNUSED, PyObject *args UNUSED) {
+    static monotonic_t sorted[INPUT_LATENCY_SAMPLES];
+    size_t n = MIN(input_latency.count, (unsigned long long)INPUT_LATENCY_SAMPLES);
+    PyObject *ans = Py_BuildValue("{sKsn}", "count", input_latency.count, "num_samples", (Py_ssize_t)n);
+    if (!ans) return NULL;
+    for (unsigned stage = 0; stage < NUM_LATENCY_STAGES; stage++) {
+        monotonic_t total = 0;
+        for (size_t i = 0; i < n; i++) { sorted[i] = input_latency.samples[i][stage]; total += sorted[i]; }
+        qsort(sorted, n, sizeof(sorted[0]), cmp_monotonic_t);
+#define P(p) monotonic_t_to_s_double(n ? sorted[MIN(n - 1, (size_t)(n * p))] : 0)
+        PyObject *s = Py_BuildValue("{sdsdsdsdsd}", "mean", monotonic_t_to_s_double(n ? total / (monotonic_t)n : 0),
+                "p50", P(0.5), "p90", P(0.9), "p99", P(0.99), "max", monotonic_t_to_s_double(n ? sorted[n - 1] : 0));
+#undef P
+        if (!s || PyDict_SetItemString(ans, latency_stage_names[stage], s) != 0) { Py_XDECREF(s); Py_DECREF(ans); return NULL; }
+        Py_DECREF(s);
+    }
+    return ans;
+}
+
+static PyObject*
+reset_input_latency_stats(PyObject *self UNUSED, PyObject *args UNUSED) {
+    input_latency.count = 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+set_input_latency_trace(PyObject *self UNUSED, PyObject *path) {
+    if (input_latency.trace) { fclose(input_latency.trace); input_latency.trace = NULL; }
+    if (path != Py_None) {
+        if (!PyUnicode_Check(path)) { PyErr_SetString(PyExc_TypeError, "path must be a string or None"); return NULL; }
+        input_latency.trace = fopen(PyUnicode_AsUTF8(path), "ae");
+        if (!input_latency.trace) return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    }
+    Py_RETURN_NONE;
+}
+// }}}
+
 static inline void
 render_os_window(OSWindow *os_window, monotonic_t now, unsigned int active_window_id, color_type active_window_bg, unsigned int num_visible_windows, bool all_windows_have_same_bg) {
     // ensure all pixels are cleared to background color at least once in every buffer
@@ -608,7 +828,14 @@ render_os_window(OSWindow *os_window, monotonic_t now, unsigned int active_windo
             w->cursor_visible_at_last_render = WD.screen->cursor_render_info.is_visible; w->last_cursor_x = WD.screen->cursor_render_info.x; w->last_cursor_y = WD.screen->cursor_render_info.y; w->last_cursor_shape = WD.screen->cursor_render_info.shape;
         }
     }
+    TRACE_BEGIN("swap_buffers");
     swap_window_buffers(os_window);
+    TRACE_END("swap_buffers");
+    monotonic_t swapped_at = monotonic();
+    for (unsigned int i = 0; i < tab->num_windows; i++) {
+        Window *w = tab->windows + i;
+        if (w->visible && WD.screen) finish_input_latency_probe(WD.screen, w->id, swapped_at);
+    }
     os_window->last_active_tab = os_window->active_tab; os_window->last_num_tabs = os_window->num_tabs; os_window->last_active_window_id = active_window_id;
     os_window->focused_at_last_render = os_window->is_focused;
     os_window->is_damaged = false;
@@ -646,15 +873,74 @@ no_render_frame_received_recently(OSWindow *w, monotonic_t now, monotonic_t max_
 }
 
 static inline void
-render(monotonic_t now, bool input_read) {
-    EVDBG("input_read: %d", input_read);
-    static monotonic_t last_render_at = MONOTONIC_T_MIN;
-    monotonic_t time_since_last_render = last_render_at == MONOTONIC_T_MIN ? OPT(repaint_delay) : now - last_render_at;
-    if (!input_read && time_since_last_render < OPT(repaint_delay)) {
-        set_maximum_wait(OPT(repaint_delay) - time_since_last_render);
-        return;
-    }
+add_to_frame_histogram(unsigned long long *histogram, monotonic_t duration) {
+    unsigned bucket = 0;
+    for (monotonic_t limit = ms_to_monotonic_t(1ll); duration >= limit && bucket < FRAME_HISTOGRAM_SIZE - 1; limit *= 2) bucket++;
+    histogram[bucket]++;
+}
+
+static inline bool
+update_and_render_os_window(OSWindow *w, monotonic_t now) {
+    if (w->live_resize.in_progress && OPT(resize_draw_strategy) == RESIZE_DRAW_STATIC) blank_os_window(w);
+    bool needs_render = w->is_damaged || w->live_resize.in_progress;
+    if (w->viewport_size_dirty) {
+        w->clear_count = 0;
+        update_surface_size(w->viewport_width, w->viewport_height, w->offscreen_texture_id);
+        w->viewport_size_dirty = false;
+        needs_render = true;
+    }
+    unsigned int active_window_id = 0, num_visible_windows = 0;
+    bool all_windows_have_same_bg;
+    color_type active_window_bg = 0;
+    if (!w->fonts_data) { log_error("No fonts data found for window id: %llu", w->id); return false; }
+    RenderTimings *rt = &w->render_timings;
+    zero_at_ptr(&rt->current);
+    FontRenderTimes font_times = font_render_times;
+    if (prepare_to_render_os_window(w, now, &active_window_id, &active_window_bg, &num_visible_windows, &all_windows_have_same_bg)) needs_render = true;
+    if (w->last_active_window_id != active_window_id || w->last_active_tab != w->active_tab || w->focused_at_last_render != w->is_focused) needs_render = true;
+    if (!needs_render) return false;
+    monotonic_t start = monotonic();
+    TRACE_BEGIN("render_os_window");
+    render_os_window(w, now, active_window_id, active_window_bg, num_visible_windows, all_windows_have_same_bg);
+    TRACE_END("render_os_window");
+    monotonic_t end = monotonic();
+    add_to_frame_histogram(rt->frame_times, end - start);
+    if (rt->last_frame_at) add_to_frame_histogram(rt->frame_intervals, end - rt->last_frame_at);
+    rt->last_frame_at = end;
+    // Text is shaped and rasterized while the cell data is being updated
+    rt->current.shaping = font_render_times.shaping - font_times.shaping;
+    rt->current.rasterization = font_render_times.rasterization - font_times.rasterization;
+    rt->current.sprite_upload = font_render_times.sprite_upload - font_times.sprite_upload;
+    rt->last = rt->current;
+#define A(x) rt->total.x += rt->current.x
+    A(map); A(cell_data); A(draw_calls); A(shaping); A(rasterization); A(sprite_upload);
+#undef A
+    rt->num_frames++;
+    return true;
+}
+
+static inline monotonic_t
+time_until_next_frame(monotonic_t now, monotonic_t last_render_at, monotonic_t frame_interval, bool resized) {
+    // Zero if an OS window should be rendered now, otherwise the time until
+    // its next frame is due. Input for an OS window does not make its frame
+    // due earlier, it is rendered immediately only when it has not been
+    // rendered for frame_interval, so a window flooded with output is
+    // rendered at most once every frame_interval.
+    if (resized || !last_render_at || now - last_render_at >= frame_interval) return 0;
+    return frame_interval - (now - last_render_at);
+}
 
+static inline void
+render(monotonic_t now, bool resized) {
+    // Every OS window has its own deadline for its next frame, at least
+    // repaint_delay after its last one, so that OS windows do not delay each
+    // other. With sync_to_monitor and without render frames, which are paced
+    // by the compositor, it is also at least one refresh of the monitor the
+    // OS window is on. All OS windows are rendered immediately after resizes.
+    EVDBG("resized: %d", resized);
+    TRACE_BEGIN("render");
+    // Before rendering marks the lines of screens clean
+    update_subscriptions(now);
     for (size_t i = 0; i < global_state.num_os_windows; i++) {
         OSWindow *w = global_state.os_windows + i;
         if (!w->num_tabs) continue;
@@ -662,6 +948,16 @@ render(monotonic_t now, bool input_read) {
             update_os_window_title(w);
             continue;
         }
+        monotonic_t frame_interval = OPT(repaint_delay);
+        if (!USE_RENDER_FRAMES && OPT(sync_to_monitor)) {
+            if (w->monitor_changed) update_os_window_frame_interval(w);
+            frame_interval = MAX(frame_interval, w->frame_interval);
+        }
+        monotonic_t wait = time_until_next_frame(now, w->last_render_at, frame_interval, resized);
+        if (wait) {
+            set_maximum_wait(wait);
+            continue;
+        }
         if (USE_RENDER_FRAMES && w->render_state != RENDER_FRAME_READY) {
             if (w->render_state == RENDER_FRAME_NOT_REQUESTED || no_render_frame_received_recently(w, now, ms_to_monotonic_t(250ll))) request_frame_render(w);
             continue;
@@ -672,28 +968,30 @@ render(monotonic_t now, bool input_read) {
             if (OPT(resize_draw_strategy) == RESIZE_DRAW_SIZE) draw_resizing_text(w);
             swap_window_buffers(w);
             if (USE_RENDER_FRAMES) request_frame_render(w);
-            continue;
-        }
-        if (w->live_resize.in_progress && OPT(resize_draw_strategy) == RESIZE_DRAW_STATIC) blank_os_window(w);
-        bool needs_render = w->is_damaged || w->live_resize.in_progress;
-        if (w->viewport_size_dirty) {
-            w->clear_count = 0;
-            update_surface_size(w->viewport_width, w->viewport_height, w->offscreen_texture_id);
-            w->viewport_size_dirty = false;
-            needs_render = true;
-        }
-        unsigned int active_window_id = 0, num_visible_windows = 0;
-        bool all_windows_have_same_bg;
-        color_type active_window_bg = 0;
-        if (!w->fonts_data) { log_error("No fonts data found for window id: %llu", w->id); continue; }
-        if (prepare_to_render_os_window(w, now, &active_window_id, &active_window_bg, &num_visible_windows, &all_windows_have_same_bg)) needs_render = true;
-        if (w->last_active_window_id != active_window_id || w->last_active_tab != w->active_tab || w->focused_at_last_render != w->is_focused) needs_render = true;
-        if (needs_render) render_os_window(w, now, active_window_id, active_window_bg, num_visible_windows, all_windows_have_same_bg);
-    }
-    last_render_at = now;
-#undef TD
+            w->last_render_at = now;
+        // Undamaged windows are not rendered, so must not delay the frame
+        // for output that arrives right after this check
+        } else if (update_and_render_os_window(w, now)) w->last_render_at = now;
+    }
+    TRACE_END("render");
 }
 
+static PyObject*
+render_os_window_now(PyObject *self UNUSED, PyObject *args) {
+    // Render a single OS window immediately, bypassing repaint_delay and
+    // render frames. Used by the headless render benchmark.
+    unsigned long long os_window_id;
+    if (!PyArg_ParseTuple(args, "K", &os_window_id)) return NULL;
+    for (size_t i = 0; i < global_state.num_os_windows; i++) {
+        OSWindow *w = global_state.os_windows + i;
+        if (w->id != os_window_id || !w->num_tabs) continue;
+        make_os_window_context_current(w);
+        w->is_damaged = true;
+        if (update_and_render_os_window(w, monotonic())) Py_RETURN_TRUE;
+        break;
+    }
+    Py_RETURN_FALSE;
+}
 
 typedef struct { int fd; uint8_t *buf; size_t sz; } ThreadWriteData;
 
@@ -791,7 +1089,9 @@ static void
 python_timer_callback(id_type timer_id, void *data) {
     PyObject *callback = (PyObject*)data;
     unsigned long long id = timer_id;
+    TRACE_BEGIN("python_timer");
     PyObject *ret = PyObject_CallFunction(callback, "K", id);
+    TRACE_END("python_timer");
     if (ret == NULL) PyErr_Print();
     else Py_DECREF(ret);
 }
@@ -913,18 +1213,19 @@ static id_type state_check_timer = 0;
 static void
 process_global_state(void *data) {
     EVDBG("Processing global state");
+    TRACE_BEGIN("process_global_state");
     ChildMonitor *self = data;
     maximum_wait = -1;
     bool state_check_timer_enabled = false;
-    bool input_read = false;
+    bool resized = false;
 
     monotonic_t now = monotonic();
     if (global_state.has_pending_resizes) {
         process_pending_resizes(now);
-        input_read = true;
+        resized = true;
     }
-    if (parse_input(self)) input_read = true;
-    render(now, input_read);
+    parse_input(self);
+    render(now, resized);
 #ifdef __APPLE__
         if (cocoa_pending_actions) {
             if (cocoa_pending_actions & PREFERENCES_WINDOW) { call_boss(edit_config_file, NULL); }
@@ -957,6 +1258,7 @@ process_global_state(void *data) {
         stop_main_loop();
     }
     update_main_loop_timer(state_check_timer, MAX(0, maximum_wait), state_check_timer_enabled);
+    TRACE_END("process_global_state");
 }
 
 static PyObject*
@@ -1052,9 +1354,15 @@ read_bytes(int fd, Screen *screen) {
         break;
     }
     if (UNLIKELY(len == 0)) return false;
+    TRACE_COUNTER("bytes_read", len);
 
     screen_mutex(lock, read);
     if (screen->new_input_at == 0) screen->new_input_at = monotonic();
+    if (screen->input_latency.write_at && !screen->input_latency.read_at) {
+        monotonic_t now = monotonic();
+        if (now - screen->input_latency.key_at > INPUT_LATENCY_TIMEOUT) zero_at_ptr(&screen->input_latency);
+        else screen->input_latency.read_at = now;
+    }
     if (orig_sz != screen->read_buf_sz) {
         // The other thread consumed some of the screen read buffer
         memmove(screen->read_buf + screen->read_buf_sz, screen->read_buf + orig_sz, len);
@@ -1200,6 +1508,7 @@ io_loop(void *data) {
             ret = poll(fds, self->count + EXTRA_FDS, -1);
         }
         if (ret > 0) {
+            TRACE_BEGIN("io_loop");
             if (fds[0].revents && POLLIN) drain_fd(fds[0].fd); // wakeup
             if (fds[1].revents && POLLIN) {
                 SignalSet ss = {0};
@@ -1237,6 +1546,7 @@ io_loop(void *data) {
 #undef P
             }
 #endif
+            TRACE_END("io_loop");
         } else if (ret < 0) {
             if (errno != EAGAIN && errno != EINTR) {
                 perror("Call to poll() failed");
@@ -1267,7 +1577,7 @@ typedef struct {
     char *data;
     size_t capacity, used;
     int fd;
-    bool finished, close_socket;
+    bool finished, close_socket, framed;
 } PeerReadData;
 static PeerReadData empty_prd = {.fd = -1, 0};
 
@@ -1279,13 +1589,54 @@ typedef struct {
 } PeerWriteData;
 static PeerWriteData empty_pwd = {.fd = -1, 0};
 
+// A connection that starts with FRAMED_PEER_MAGIC is kept open for any
+// number of requests, each sent as a frame: a four byte length and a four
+// byte request id, both big endian, followed by the request. Requests are
+// handled in order and each one is responded to with a frame with its request
+// id, so clients can send requests without waiting for the responses to
+// earlier ones.
+#define FRAMED_PEER_MAGIC "kitty-rc-frames\n"
+#define FRAME_HEADER_SZ 8u
+#define MAX_MESSAGE_SZ (1024u * 1024u)
+// Text is streamed in chunks of STREAM_CHUNK_SZ while there are fewer than
+// STREAM_HIGH_WATER bytes waiting to be sent to the peer, and once there are
+// more, again when fewer than STREAM_LOW_WATER are left
+#define STREAM_CHUNK_SZ (64u * 1024u)
+#define STREAM_HIGH_WATER (1024u * 1024u)
+#define STREAM_LOW_WATER (256u * 1024u)
+// A framed peer is not read from while the main thread has more than
+// MAX_OUTSTANDING_REQUESTS of its requests to respond to, or there are more
+// than MAX_UNSENT_RESPONSES bytes waiting to be sent to it, so that a peer
+// that sends requests without reading the responses cannot make kitty queue
+// any amount of either. Reading resumes once it is below both again.
+#define MAX_OUTSTANDING_REQUESTS 1024u
+#define MAX_UNSENT_RESPONSES (4u * 1024u * 1024u)
+
+typedef struct {
+    int fd;
+    char *read_buf, *write_buf;
+    size_t read_buf_capacity, read_buf_used;
+    // The fields below are protected by peer_lock, as responses are appended
+    // to write_buf by the main thread
+    size_t write_buf_capacity, write_buf_used, write_buf_pos;
+    // The number of requests the main thread has not yet responded to, the
+    // connection is closed only once it is zero, so that responses are never
+    // sent to a new connection that reuses the fd
+    size_t outstanding;
+    // Set when the main thread is waiting for write_buf to drain before it
+    // sends more streamed text, see service_text_streams()
+    bool stream_waiting;
+    bool read_closed, failed, polled;
+} FramedPeer;
+
 typedef struct {
-    size_t num_listen_fds, num_talk_fds, num_reads, num_writes, num_queued_writes;
-    size_t fds_capacity, reads_capacity, writes_capacity, queued_writes_capacity;
+    size_t num_listen_fds, num_talk_fds, num_reads, num_writes, num_queued_writes, num_framed_peers;
+    size_t fds_capacity, reads_capacity, writes_capacity, queued_writes_capacity, framed_peers_capacity;
     struct pollfd *fds;
     PeerReadData *reads;
     PeerWriteData *writes;
     PeerWriteData *queued_writes;
+    FramedPeer *framed_peers;
     LoopData loop_data;
     pthread_mutex_t peer_lock;
 } TalkData;
@@ -1317,6 +1668,152 @@ accept_peer(int listen_fd, bool shutting_down) {
     return true;
 }
 
+static inline uint32_t
+read_be32(const char *p) {
+    const uint8_t *b = (const uint8_t*)p;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+}
+
+static inline void
+write_be32(char *p, uint32_t x) {
+    uint8_t *b = (uint8_t*)p;
+    b[0] = x >> 24; b[1] = x >> 16; b[2] = x >> 8; b[3] = x;
+}
+
+static inline FramedPeer*
+framed_peer_for_fd(int fd) {
+    for (size_t i = 0; i < talk_data.num_framed_peers; i++) {
+        if (talk_data.framed_peers[i].fd == fd) return talk_data.framed_peers + i;
+    }
+    return NULL;
+}
+
+static inline void
+fail_framed_peer(FramedPeer *fp) {
+    peer_mutex(lock);
+    fp->read_closed = true; fp->failed = true;
+    fp->write_buf_pos = fp->write_buf_used = 0;
+    bool wakeup = fp->stream_waiting || fp->outstanding;
+    fp->stream_waiting = false;
+    peer_mutex(unlock);
+    // Let the main thread end streams and subscriptions, so that the
+    // connection can be closed
+    if (wakeup) wakeup_main_loop();
+}
+
+static inline void
+queue_frames(ChildMonitor *self, FramedPeer *fp) {
+    // Pass all complete frames in the read buffer to the main thread
+    size_t pos = 0, num_queued = 0;
+    bool too_large = false;
+    children_mutex(lock);
+    while (fp->read_buf_used - pos >= FRAME_HEADER_SZ) {
+        uint32_t sz = read_be32(fp->read_buf + pos), request_id = read_be32(fp->read_buf + pos + 4);
+        if (sz > MAX_MESSAGE_SZ) { too_large = true; break; }
+        if (fp->read_buf_used - pos < FRAME_HEADER_SZ + sz) break;
+        ensure_space_for(self, messages, Message, self->messages_count + 1, messages_capacity, 16, true);
+        Message *m = self->messages + self->messages_count++;
+        m->data = malloc(MAX(1u, sz));
+        if (!m->data) fatal("Out of memory");
+        memcpy(m->data, fp->read_buf + pos + FRAME_HEADER_SZ, sz);
+        m->sz = sz; m->fd = fp->fd; m->request_id = request_id; m->framed = true;
+        pos += FRAME_HEADER_SZ + sz;
+        num_queued++;
+    }
+    children_mutex(unlock);
+    if (too_large) {
+        log_error("Ignoring too large message from peer, closing connection");
+        fail_framed_peer(fp);
+    }
+    if (pos) {
+        fp->read_buf_used -= pos;
+        if (fp->read_buf_used) memmove(fp->read_buf, fp->read_buf + pos, fp->read_buf_used);
+    }
+    if (num_queued) {
+        peer_mutex(lock);
+        fp->outstanding += num_queued;
+        peer_mutex(unlock);
+        wakeup_main_loop();
+    }
+}
+
+static inline void
+read_from_framed_peer(ChildMonitor *self, FramedPeer *fp) {
+    // Make room for at least the rest of the frame being received
+    size_t needed = fp->read_buf_used + 4096;
+    if (fp->read_buf_used >= FRAME_HEADER_SZ) needed = MAX(needed, FRAME_HEADER_SZ + MIN(MAX_MESSAGE_SZ, read_be32(fp->read_buf)));
+    ensure_space_for(fp, read_buf, char, needed, read_buf_capacity, 8192, false);
+    ssize_t n = recv(fp->fd, fp->read_buf + fp->read_buf_used, fp->read_buf_capacity - fp->read_buf_used, 0);
+    if (n == 0) { fp->read_closed = true; return; }
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return;
+        if (errno != ECONNRESET) perror("Error reading from talk peer");
+        fail_framed_peer(fp);
+        return;
+    }
+    fp->read_buf_used += n;
+    queue_frames(self, fp);
+}
+
+static inline void
+write_to_framed_peer(FramedPeer *fp) {
+    peer_mutex(lock);
+    if (fp->write_buf_pos < fp->write_buf_used) {
+        // The socket is non-blocking, so peer_lock is not held for long
+        ssize_t n = send(fp->fd, fp->write_buf + fp->write_buf_pos, fp->write_buf_used - fp->write_buf_pos, MSG_NOSIGNAL);
+        if (n > 0) {
+            fp->write_buf_pos += n;
+            if (fp->write_buf_pos >= fp->write_buf_used) fp->write_buf_pos = fp->write_buf_used = 0;
+        } else if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+            // The peer closing the connection without waiting for responses is not an error
+            if (errno != EPIPE && errno != ECONNRESET) perror("write() to peer socket failed with error");
+            fp->read_closed = true; fp->failed = true;
+            fp->write_buf_pos = fp->write_buf_used = 0;
+        }
+    }
+    bool wakeup = (fp->stream_waiting && fp->write_buf_used - fp->write_buf_pos < STREAM_LOW_WATER) || (fp->failed && fp->outstanding);
+    if (wakeup) fp->stream_waiting = false;
+    peer_mutex(unlock);
+    if (wakeup) wakeup_main_loop();
+}
+
+static inline bool
+start_framed_peer(ChildMonitor *self, PeerReadData *rd) {
+    // Convert a connection that sent FRAMED_PEER_MAGIC into a framed peer,
+    // which takes over its read buffer and its entry in talk_data.fds
+    const size_t magic_sz = sizeof(FRAMED_PEER_MAGIC) - 1;
+    if (talk_data.num_framed_peers >= PEER_LIMIT) { log_error("Too many peers want to talk, ignoring one."); return false; }
+    int flags = fcntl(rd->fd, F_GETFL);
+    if (flags == -1 || fcntl(rd->fd, F_SETFL, flags | O_NONBLOCK) == -1) { perror("Failed to make talk peer socket non-blocking"); return false; }
+    peer_mutex(lock);
+    ensure_space_for(&talk_data, framed_peers, FramedPeer, talk_data.num_framed_peers + 1, framed_peers_capacity, 8, false);
+    FramedPeer *fp = talk_data.framed_peers + talk_data.num_framed_peers++;
+    zero_at_ptr(fp);
+    peer_mutex(unlock);
+    fp->fd = rd->fd;
+    fp->read_buf = rd->data; fp->read_buf_capacity = rd->capacity; fp->read_buf_used = rd->used - magic_sz;
+    memmove(fp->read_buf, fp->read_buf + magic_sz, fp->read_buf_used);
+    fp->polled = true;
+    rd->data = NULL; rd->framed = true; rd->finished = true;
+    queue_frames(self, fp);
+    return true;
+}
+
+static inline void
+update_framed_peer_events(void) {
+    size_t count = talk_data.num_talk_fds + talk_data.num_listen_fds;
+    peer_mutex(lock);
+    for (size_t i = talk_data.num_listen_fds; i < count; i++) {
+        FramedPeer *fp = framed_peer_for_fd(talk_data.fds[i].fd);
+        if (fp) {
+            size_t unsent = fp->write_buf_used - fp->write_buf_pos;
+            bool throttled = fp->outstanding >= MAX_OUTSTANDING_REQUESTS || unsent >= MAX_UNSENT_RESPONSES;
+            talk_data.fds[i].events = (fp->read_closed || throttled ? 0 : POLLIN) | (unsent ? POLLOUT : 0);
+        }
+    }
+    peer_mutex(unlock);
+}
+
 static inline bool
 read_from_peer(ChildMonitor *self, int s) {
     bool read_finished = false;
@@ -1336,7 +1833,7 @@ read_from_peer(ChildMonitor *self, int s) {
                 children_mutex(lock);
                 ensure_space_for(self, messages, Message, self->messages_count + 1, messages_capacity, 16, true);
                 Message *m = self->messages + self->messages_count++;
-                m->data = rd->data; rd->data = NULL; m->sz = rd->used; m->fd = s;
+                m->data = rd->data; rd->data = NULL; m->sz = rd->used; m->fd = s; m->request_id = 0; m->framed = false;
                 children_mutex(unlock);
                 wakeup_main_loop();
             } else if (n < 0) {
@@ -1344,7 +1841,14 @@ read_from_peer(ChildMonitor *self, int s) {
                     perror("Error reading from talk peer");
                     failed("");
                 }
-            } else rd->used += n;
+            } else {
+                rd->used += n;
+                const size_t magic_sz = sizeof(FRAMED_PEER_MAGIC) - 1;
+                if (rd->used >= magic_sz && memcmp(rd->data, FRAMED_PEER_MAGIC, magic_sz) == 0) {
+                    read_finished = true;
+                    if (!start_framed_peer(self, rd)) failed("");
+                }
+            }
             break;
         }
     }
@@ -1395,9 +1899,14 @@ prune_finished_reads(void) {
     for (ssize_t i = talk_data.num_reads - 1; i >= 0; i--) {
         PeerReadData *rd = talk_data.reads + i;
         if (rd->finished) {
-            remove_poll_fd(rd->fd);
-            if (rd->close_socket) { nuke_socket(rd->fd); }
-            else shutdown(rd->fd, SHUT_RD);
+            if (rd->framed) {
+                // The framed peer has taken over the socket and its poll fd
+                rd->framed = false;
+            } else {
+                remove_poll_fd(rd->fd);
+                if (rd->close_socket) { nuke_socket(rd->fd); }
+                else shutdown(rd->fd, SHUT_RD);
+            }
             free(rd->data);
             ssize_t num_to_right = talk_data.num_reads - 1 - i;
             if (num_to_right > 0) memmove(talk_data.reads + i, talk_data.reads + i + 1, num_to_right * sizeof(PeerReadData));
@@ -1424,6 +1933,24 @@ prune_finished_writes(void) {
     }
 }
 
+static inline void
+prune_framed_peers(void) {
+    peer_mutex(lock);
+    for (ssize_t i = talk_data.num_framed_peers - 1; i >= 0; i--) {
+        FramedPeer *fp = talk_data.framed_peers + i;
+        bool done = fp->read_closed && !fp->outstanding && fp->write_buf_pos >= fp->write_buf_used;
+        // Failed connections are no longer polled, but are closed only once
+        // the main thread has responded to all their requests
+        if ((done || fp->failed) && fp->polled) { remove_poll_fd(fp->fd); fp->polled = false; }
+        if (done) {
+            nuke_socket(fp->fd);
+            free(fp->read_buf); free(fp->write_buf);
+            remove_i_from_array(talk_data.framed_peers, (size_t)i, talk_data.num_framed_peers);
+        }
+    }
+    peer_mutex(unlock);
+}
+
 static void
 wakeup_talk_loop(bool in_signal_handler) {
     if (talk_thread_started) wakeup_loop(&talk_data.loop_data, in_signal_handler, "talk_loop");
@@ -1467,27 +1994,42 @@ talk_loop(void *data) {
 
     while (LIKELY(!self->shutting_down)) {
         for (size_t i = 0; i < talk_data.num_listen_fds + talk_data.num_talk_fds; i++) { talk_data.fds[i].revents = 0; }
+        if (talk_data.num_framed_peers) update_framed_peer_events();
         int ret = poll(talk_data.fds, talk_data.num_listen_fds + talk_data.num_talk_fds, -1);
         if (ret > 0) {
             bool has_finished_reads = false, has_finished_writes = false;
+            TRACE_BEGIN("talk_loop");
             for (size_t i = 0; i < talk_data.num_listen_fds - 1; i++) {
                 if (talk_data.fds[i].revents & POLLIN) {if (!accept_peer(talk_data.fds[i].fd, self->shutting_down)) goto end; }
             }
             if (talk_data.fds[talk_data.num_listen_fds - 1].revents & POLLIN) drain_fd(talk_data.fds[talk_data.num_listen_fds - 1].fd);  // wakeup
             for (size_t i = talk_data.num_listen_fds; i < talk_data.num_talk_fds + talk_data.num_listen_fds; i++) {
+                FramedPeer *fp = framed_peer_for_fd(talk_data.fds[i].fd);
+                if (fp) {
+                    short revents = talk_data.fds[i].revents;
+                    if ((revents & (POLLIN | POLLHUP)) && !fp->read_closed) read_from_framed_peer(self, fp);
+                    if (revents & POLLOUT) write_to_framed_peer(fp);
+                    // A peer that has closed its end of the connection cannot receive responses
+                    if ((revents & (POLLERR | POLLNVAL)) || ((revents & POLLHUP) && fp->read_closed)) fail_framed_peer(fp);
+                    continue;
+                }
                 if (talk_data.fds[i].revents & (POLLIN | POLLHUP)) { if (read_from_peer(self, talk_data.fds[i].fd)) has_finished_reads = true; }
                 if (talk_data.fds[i].revents & POLLOUT) { if (write_to_peer(talk_data.fds[i].fd)) has_finished_writes = true; }
             }
             if (has_finished_reads) prune_finished_reads();
             if (has_finished_writes) prune_finished_writes();
+            if (talk_data.num_framed_peers) prune_framed_peers();
             peer_mutex(lock);
             if (talk_data.num_queued_writes) move_queued_writes();
             peer_mutex(unlock);
+            TRACE_END("talk_loop");
         } else if (ret < 0) { if (errno != EAGAIN && errno != EINTR) perror("poll() on talk fds failed"); }
     }
 end:
     free_loop_data(&talk_data.loop_data);
     free(talk_data.fds); free(talk_data.reads); free(talk_data.writes); free(talk_data.queued_writes);
+    for (size_t i = 0; i < talk_data.num_framed_peers; i++) { free(talk_data.framed_peers[i].read_buf); free(talk_data.framed_peers[i].write_buf); }
+    free(talk_data.framed_peers);
     return 0;
 }
 
@@ -1510,6 +2052,432 @@ add_peer_writer(int fd, const char* msg, size_t msg_sz) {
     return ok;
 }
 
+static inline void
+send_frame(int fd, uint32_t request_id, const char *msg, size_t msg_sz, bool last) {
+    // Append a frame to the responses to the peer, the last frame sent for a
+    // request means the request has been responded to
+    peer_mutex(lock);
+    FramedPeer *fp = framed_peer_for_fd(fd);
+    if (fp) {
+        if (!fp->failed) {
+            ensure_space_for(fp, write_buf, char, fp->write_buf_used + FRAME_HEADER_SZ + msg_sz, write_buf_capacity, 8192, false);
+            char *p = fp->write_buf + fp->write_buf_used;
+            write_be32(p, msg_sz); write_be32(p + 4, request_id);
+            if (msg_sz) memcpy(p + FRAME_HEADER_SZ, msg, msg_sz);
+            fp->write_buf_used += FRAME_HEADER_SZ + msg_sz;
+        }
+        if (last) fp->outstanding--;
+    }
+    peer_mutex(unlock);
+}
+
+static void
+send_frame_response(int fd, uint32_t request_id, const char *msg, size_t msg_sz) {
+    send_frame(fd, request_id, msg, msg_sz, true);
+}
+
+// Text streams {{{
+
+// Text exported from a screen and sent to a framed peer as it reads it, after
+// the response to the request, as frames with the request id of the request,
+// ending with an empty frame. This avoids building the text of the whole
+// scrollback in memory, see get_text in cmds.py
+
+typedef struct {
+    int fd;
+    uint32_t request_id;
+    Screen *screen;
+    TextExport export;
+} TextStream;
+
+static struct {
+    TextStream *streams;
+    size_t count, streams_capacity;
+} text_streams = {0};
+
+static bool
+start_text_stream(int fd, uint32_t request_id, PyObject *spec) {
+    // spec is a tuple of (screen, first line, end line, as_ansi)
+    Screen *screen; unsigned long long start, end; int as_ansi;
+    if (!PyArg_ParseTuple(spec, "O!KKp", &Screen_Type, &screen, &start, &end, &as_ansi)) return false;
+    ensure_space_for(&text_streams, streams, TextStream, text_streams.count + 1, streams_capacity, 4, false);
+    TextStream *s = text_streams.streams + text_streams.count++;
+    zero_at_ptr(s);
+    s->fd = fd; s->request_id = request_id;
+    s->screen = screen; Py_INCREF(screen);
+    s->export.next_line = start; s->export.end_line = end; s->export.as_ansi = as_ansi;
+    return true;
+}
+
+static inline bool
+peer_has_room(int fd, bool *failed) {
+    // Whether more streamed data should be sent to the peer now
+    bool ans = false;
+    peer_mutex(lock);
+    FramedPeer *fp = framed_peer_for_fd(fd);
+    if (!fp || fp->failed) *failed = true;
+    else {
+        ans = fp->write_buf_used - fp->write_buf_pos < STREAM_HIGH_WATER;
+        // Ask the talk thread to wake us up once the peer has read enough
+        if (!ans) fp->stream_waiting = true;
+    }
+    peer_mutex(unlock);
+    return ans;
+}
+
+static void
+service_text_streams(void) {
+    if (!text_streams.count) return;
+    TRACE_BEGIN("text_streams");
+    bool sent = false;
+    for (ssize_t i = text_streams.count - 1; i >= 0; i--) {
+        TextStream *s = text_streams.streams + i;
+        bool finished = false, failed = false;
+        while (!finished && peer_has_room(s->fd, &failed)) {
+            s->export.sz = 0;
+            finished = screen_export_text(s->screen, &s->export, STREAM_CHUNK_SZ);
+            if (s->export.sz) { send_frame(s->fd, s->request_id, s->export.buf, s->export.sz, false); sent = true; }
+        }
+        if (finished || failed) {
+            send_frame_response(s->fd, s->request_id, NULL, 0);
+            Py_CLEAR(s->screen); free_text_export(&s->export);
+            remove_i_from_array(text_streams.streams, (size_t)i, text_streams.count);
+            sent = true;
+        }
+    }
+    if (sent) wakeup_talk_loop(false);
+    TRACE_END("text_streams");
+}
+
+// }}}
+
+// Subscriptions {{{
+
+// The changes to windows, sent to a framed peer after the response to the
+// request, as frames with the request id of the request, each with a JSON
+// object describing the changes to a window, at most once every
+// repaint_delay, until all the windows are closed. Changes to the text of the
+// screen are found from the dirty flags of its lines, which rendering clears,
+// so they are collected before rendering, and lines that are marked dirty are
+// compared with the text of the line that was last sent. See subscribe in
+// cmds.py.
+
+typedef struct {
+    id_type id;
+    // The state that was last sent
+    unsigned long long lines_added;
+    index_type lines, columns;
+    LineBuf *linebuf;
+    uint64_t *line_hashes;
+    PyObject *title;
+    // The lines of the screen that may have changed since then
+    uint8_t *dirty_lines;
+    bool all_dirty, initial, found, has_changes;
+    // The screen and title of the window, while changes are being sent
+    Screen *screen;
+    PyObject *current_title;
+} WatchedWindow;
+
+typedef struct {
+    int fd;
+    uint32_t request_id;
+    WatchedWindow *windows;
+    size_t num_windows;
+    monotonic_t last_sent_at;
+    bool sent;
+} Subscription;
+
+static struct {
+    Subscription *subscriptions;
+    size_t count, subscriptions_capacity;
+    char *buf;
+    size_t sz, capacity;
+    Py_UCS4 *line_buf;
+    size_t line_buf_capacity;
+    char *utf8;
+    size_t utf8_capacity;
+} subscriptions = {0};
+
+// Replaced by tests, see test_update_subscriptions()
+static bool (*subscription_has_room)(int fd, bool *failed) = peer_has_room;
+static void (*subscription_send)(int fd, uint32_t request_id, const char *msg, size_t msg_sz, bool last) = send_frame;
+
+static bool
+start_subscription(int fd, uint32_t request_id, PyObject *spec) {
+    // spec is a tuple containing a tuple of window ids
+    PyObject *ids;
+    if (!PyArg_ParseTuple(spec, "O!", &PyTuple_Type, &ids)) return false;
+    ensure_space_for(&subscriptions, subscriptions, Subscription, subscriptions.count + 1, subscriptions_capacity, 4, false);
+    Subscription *s = subscriptions.subscriptions + subscriptions.count;
+    zero_at_ptr(s);
+    s->fd = fd; s->request_id = request_id;
+    s->windows = calloc(MAX(1, PyTuple_GET_SIZE(ids)), sizeof(WatchedWindow));
+    if (!s->windows) fatal("Out of memory");
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(ids); i++) {
+        WatchedWindow *ww = s->windows + s->num_windows++;
+        ww->id = PyLong_AsUnsignedLongLong(PyTuple_GET_ITEM(ids, i));
+        ww->initial = true;
+    }
+    if (PyErr_Occurred()) { free(s->windows); return false; }
+    subscriptions.count++;
+    return true;
+}
+
+static inline void
+free_watched_window(WatchedWindow *ww) {
+    free(ww->line_hashes); free(ww->dirty_lines); Py_CLEAR(ww->title);
+}
+
+static inline void
+collect_changes(WatchedWindow *ww, Screen *screen, PyObject *title) {
+    ww->found = true; ww->screen = screen; ww->current_title = title;
+    if (title != ww->title) ww->has_changes = true;
+    if (ww->initial || screen->lines != ww->lines || screen->columns != ww->columns || screen->linebuf != ww->linebuf || screen->historybuf->lines_added != ww->lines_added) {
+        // Every line may have moved
+        ww->all_dirty = true; ww->has_changes = true;
+        return;
+    }
+    if (ww->all_dirty) return;
+    for (index_type y = 0; y < screen->lines; y++) {
+        if (screen->linebuf->line_attrs[y] & TEXT_DIRTY_MASK) { ww->dirty_lines[y] = 1; ww->has_changes = true; }
+    }
+}
+
+static inline uint64_t
+line_text_hash(Line *line) {
+    // FNV-1a of the text of the line
+    uint64_t h = 14695981039346656037ull;
+#define H(x) { h ^= (x); h *= 1099511628211ull; }
+    for (index_type x = 0; x < line->xnum; x++) {
+        H(line->cpu_cells[x].ch);
+        for (unsigned c = 0; c < arraysz(line->cpu_cells[x].cc_idx); c++) H(line->cpu_cells[x].cc_idx[c]);
+    }
+#undef H
+    return h;
+}
+
+#define APPEND(data, len) { \
+    size_t _len = (len); \
+    ensure_space_for(&subscriptions, buf, char, subscriptions.sz + _len, capacity, 4096, false); \
+    memcpy(subscriptions.buf + subscriptions.sz, (data), _len); subscriptions.sz += _len; \
+}
+#define APPEND_LITERAL(x) APPEND(x, sizeof(x) - 1)
+
+static inline void
+append_format(const char *fmt, unsigned long long x) {
+    char tmp[64];
+    int n = snprintf(tmp, sizeof(tmp), fmt, x);
+    APPEND(tmp, (size_t)n);
+}
+
+static inline void
+append_json_string(const char *data, size_t sz) {
+    // data must be valid UTF-8
+    APPEND_LITERAL("\"");
+    for (size_t i = 0; i < sz; i++) {
+        unsigned char ch = data[i];
+        if (ch == '"' || ch == '\\') { char e[2] = {'\\', ch}; APPEND(e, 2); }
+        else if (ch < 0x20 || ch == 0x7f) append_format("\\u%04llx", ch);
+        else APPEND(data + i, 1);
+    }
+    APPEND_LITERAL("\"");
+}
+
+static inline void
+append_line_text(Line *line) {
+    size_t line_buf_sz = line->xnum * (1 + arraysz(line->cpu_cells->cc_idx)) + 4;
+    ensure_space_for(&subscriptions, line_buf, Py_UCS4, line_buf_sz, line_buf_capacity, line_buf_sz, false);
+    index_type num = line_as_text(line, subscriptions.line_buf, line_buf_sz);
+    ensure_space_for(&subscriptions, utf8, char, 4 * (size_t)num + 1, utf8_capacity, 4096, false);
+    size_t n = 0;
+    for (index_type i = 0; i < num; i++) n += encode_utf8(subscriptions.line_buf[i], subscriptions.utf8 + n);
+    append_json_string(subscriptions.utf8, n);
+}
+
+static inline bool
+window_changes_as_json(WatchedWindow *ww, Screen *screen, PyObject *title) {
+    // Write the changes to the window since they were last sent to
+    // subscriptions.buf, returning false if there are none
+    unsigned long long first, screen_start, end;
+    screen_text_line_numbers(screen, &first, &screen_start, &end);
+    bool has_changes = false, resized = ww->initial || screen->lines != ww->lines || screen->columns != ww->columns;
+    subscriptions.sz = 0;
+    append_format("{\"window_id\": %llu", ww->id);
+    append_format(", \"screen_start_line\": %llu", screen_start);
+    if (resized) {
+        append_format(", \"lines\": %llu", screen->lines);
+        append_format(", \"columns\": %llu", screen->columns);
+        has_changes = true;
+        ww->line_hashes = realloc(ww->line_hashes, screen->lines * sizeof(uint64_t));
+        ww->dirty_lines = realloc(ww->dirty_lines, screen->lines);
+        if (!ww->line_hashes || !ww->dirty_lines) fatal("Out of memory");
+        ww->lines = screen->lines; ww->columns = screen->columns;
+    }
+    if (ww->initial) ww->lines_added = screen_start;
+    if (ww->lines_added < screen_start) {
+        // Lines added to the scrollback, that did not scroll out of it already
+        TextExport e = {.next_line = ww->lines_added, .end_line = screen_start};
+        bool finished = screen_export_text(screen, &e, STREAM_HIGH_WATER);
+        if (e.sz) {
+            APPEND_LITERAL(", \"appended\": ");
+            append_json_string(e.buf, e.sz);
+            has_changes = true;
+        }
+        // The rest are sent next time
+        ww->lines_added = finished ? screen_start : e.next_line;
+        if (!finished) ww->has_changes = true;
+        free_text_export(&e);
+    }
+    bool first_changed = true;
+    for (index_type y = 0; y < screen->lines; y++) {
+        if (!ww->all_dirty && !ww->dirty_lines[y]) continue;
+        linebuf_init_line(screen->linebuf, y);
+        uint64_t h = line_text_hash(screen->linebuf->line);
+        if (!ww->initial && !resized && h == ww->line_hashes[y]) continue;
+        ww->line_hashes[y] = h;
+        if (first_changed) { APPEND_LITERAL(", \"changed_lines\": ["); first_changed = false; }
+        else APPEND_LITERAL(", ");
+        append_format("[%llu, ", y);
+        append_line_text(screen->linebuf->line);
+        APPEND_LITERAL("]");
+        has_changes = true;
+    }
+    if (!first_changed) APPEND_LITERAL("]");
+    memset(ww->dirty_lines, 0, ww->lines);
+    ww->all_dirty = false; ww->linebuf = screen->linebuf;
+    if (title && title != Py_None && (!ww->title || PyUnicode_Compare(title, ww->title) != 0)) {
+        Py_ssize_t sz;
+        const char *t = PyUnicode_AsUTF8AndSize(title, &sz);
+        if (t) {
+            APPEND_LITERAL(", \"title\": ");
+            append_json_string(t, sz);
+            has_changes = true;
+        } else PyErr_Clear();
+        Py_INCREF(title); Py_XSETREF(ww->title, title);
+    }
+    ww->initial = false;
+    APPEND_LITERAL("}\n");
+    return has_changes;
+}
+
+static bool
+send_subscription_changes(Subscription *s, monotonic_t now, bool *sent) {
+    // Send the changes to the windows of the subscription, if they are due
+    // and the peer has read the changes sent earlier, so that changes are
+    // coalesced for slow peers. Returns true once the subscription has ended,
+    // when all its windows are closed or its peer is gone.
+    monotonic_t interval = OPT(repaint_delay);
+    bool failed = false, has_changes = false;
+    for (size_t k = 0; k < s->num_windows; k++) {
+        WatchedWindow *ww = s->windows + k;
+        if (ww->found && ww->has_changes && now - s->last_sent_at >= interval && subscription_has_room(s->fd, &failed)) {
+            ww->has_changes = false;
+            if (window_changes_as_json(ww, ww->screen, ww->current_title)) {
+                subscription_send(s->fd, s->request_id, subscriptions.buf, subscriptions.sz, false);
+                s->sent = true;
+            }
+        }
+        ww->screen = NULL; ww->current_title = NULL;
+    }
+    subscription_has_room(s->fd, &failed);
+    if (s->sent) { s->last_sent_at = now; s->sent = false; *sent = true; }
+    for (size_t k = 0; k < s->num_windows; k++) has_changes |= s->windows[k].has_changes || !s->windows[k].found;
+    if (!has_changes && !failed) return false;
+    bool due = now - s->last_sent_at >= interval;
+    if (due || s->last_sent_at == now) {
+        for (ssize_t k = s->num_windows - 1; k >= 0; k--) {
+            WatchedWindow *ww = s->windows + k;
+            if (ww->found) continue;
+            if (!failed) {
+                subscriptions.sz = 0;
+                append_format("{\"window_id\": %llu, \"closed\": true}\n", ww->id);
+                subscription_send(s->fd, s->request_id, subscriptions.buf, subscriptions.sz, false);
+            }
+            free_watched_window(ww);
+            remove_i_from_array(s->windows, (size_t)k, s->num_windows);
+            *sent = true;
+        }
+    }
+    if (!due) set_maximum_wait(interval - (now - s->last_sent_at));
+    if (failed || !s->num_windows) {
+        subscription_send(s->fd, s->request_id, NULL, 0, true);
+        for (size_t k = 0; k < s->num_windows; k++) free_watched_window(s->windows + k);
+        free(s->windows);
+        *sent = true;
+        return true;
+    }
+    return false;
+}
+
+static void
+update_subscriptions(monotonic_t now) {
+    if (!subscriptions.count) return;
+    TRACE_BEGIN("subscriptions");
+    for (size_t i = 0; i < subscriptions.count; i++) {
+        for (size_t k = 0; k < subscriptions.subscriptions[i].num_windows; k++) subscriptions.subscriptions[i].windows[k].found = false;
+    }
+    for (size_t o = 0; o < global_state.num_os_windows; o++) {
+        OSWindow *osw = global_state.os_windows + o;
+        for (size_t t = 0; t < osw->num_tabs; t++) {
+            Tab *tab = osw->tabs + t;
+            for (size_t w = 0; w < tab->num_windows; w++) {
+                Window *window = tab->windows + w;
+                if (!window->render_data.screen) continue;
+                for (size_t i = 0; i < subscriptions.count; i++) {
+                    Subscription *s = subscriptions.subscriptions + i;
+                    for (size_t k = 0; k < s->num_windows; k++) {
+                        if (s->windows[k].id == window->id) collect_changes(s->windows + k, window->render_data.screen, window->title);
+                    }
+                }
+            }
+        }
+    }
+    bool sent = false;
+    for (ssize_t i = subscriptions.count - 1; i >= 0; i--) {
+        if (send_subscription_changes(subscriptions.subscriptions + i, now, &sent)) remove_i_from_array(subscriptions.subscriptions, (size_t)i, subscriptions.count);
+    }
+    if (sent) wakeup_talk_loop(false);
+    TRACE_END("subscriptions");
+}
+#undef APPEND_LITERAL
+#undef APPEND
+
+// }}}
+
+static void
+start_stream(int fd, uint32_t request_id, PyObject *resp) {
+    // resp is a tuple of the response, the kind of stream and the spec of the
+    // stream, see StreamedResponse in cmds.py
+    PyObject *response = PyTuple_GET_ITEM(resp, 0);
+    const char *kind = PyUnicode_Check(PyTuple_GET_ITEM(resp, 1)) ? PyUnicode_AsUTF8(PyTuple_GET_ITEM(resp, 1)) : "";
+    PyObject *spec = PyTuple_GET_ITEM(resp, 2);
+    bool ok = false;
+    // The response is sent first, as streams send data as soon as they start
+    send_frame(fd, request_id, PyBytes_AS_STRING(response), PyBytes_GET_SIZE(response), false);
+    if (kind && strcmp(kind, "text") == 0) ok = start_text_stream(fd, request_id, spec);
+    else if (kind && strcmp(kind, "subscription") == 0) ok = start_subscription(fd, request_id, spec);
+    else PyErr_Format(PyExc_ValueError, "Unknown stream kind: %s", kind ? kind : "");
+    if (!ok) {
+        PyErr_Print();
+        send_frame_response(fd, request_id, NULL, 0);
+    }
+}
+
+static void
+free_streams(void) {
+    for (size_t i = 0; i < text_streams.count; i++) {
+        Py_CLEAR(text_streams.streams[i].screen); free_text_export(&text_streams.streams[i].export);
+    }
+    free(text_streams.streams); zero_at_ptr(&text_streams);
+    for (size_t i = 0; i < subscriptions.count; i++) {
+        Subscription *s = subscriptions.subscriptions + i;
+        for (size_t k = 0; k < s->num_windows; k++) free_watched_window(s->windows + k);
+        free(s->windows);
+    }
+    free(subscriptions.subscriptions); free(subscriptions.buf); free(subscriptions.line_buf); free(subscriptions.utf8);
+    zero_at_ptr(&subscriptions);
+}
+
 static void
 send_response(int fd, const char *msg, size_t msg_sz) {
     if (msg == NULL) { shutdown(fd, SHUT_WR); safe_close(fd); return; }
@@ -1523,6 +2491,7 @@ send_response(int fd, const char *msg, size_t msg_sz) {
 static PyMethodDef methods[] = {
     METHOD(add_child, METH_VARARGS)
     METHOD(needs_write, METH_VARARGS)
+    METHOD(broadcast_to_children, METH_VARARGS)
     METHOD(start, METH_NOARGS)
     METHOD(wakeup, METH_NOARGS)
     METHOD(shutdown_monitor, METH_NOARGS)
@@ -1555,12 +2524,97 @@ safe_pipe(PyObject *self UNUSED, PyObject *args) {
     return Py_BuildValue("ii", fds[0], fds[1]);
 }
 
+static PyObject*
+frame_wait(PyObject *self UNUSED, PyObject *args) {
+    // The scheduling of frames by render(), with times in seconds, for tests
+    double now, last_render_at, frame_interval;
+    int resized = 0;
+    if (!PyArg_ParseTuple(args, "ddd|p", &now, &last_render_at, &frame_interval, &resized)) return NULL;
+    return PyFloat_FromDouble(monotonic_t_to_s_double(time_until_next_frame(
+        s_double_to_monotonic_t(now), s_double_to_monotonic_t(last_render_at), s_double_to_monotonic_t(frame_interval), resized)));
+}
+
+static PyObject *test_frames = NULL;
+static bool test_peer_has_room = true;
+
+static bool
+test_subscription_has_room(int fd UNUSED, bool *failed UNUSED) {
+    return test_peer_has_room;
+}
+
+static void
+test_subscription_send(int fd UNUSED, uint32_t request_id, const char *msg, size_t msg_sz, bool last) {
+    PyObject *f = last ? Py_BuildValue("(IO)", request_id, Py_None) : Py_BuildValue("(Iy#)", request_id, msg, (Py_ssize_t)msg_sz);
+    if (f) { PyList_Append(test_frames, f); Py_DECREF(f); }
+}
+
+static PyObject*
+test_subscribe(PyObject *self UNUSED, PyObject *args) {
+    // Start a subscription to the windows with the specified ids, for tests
+    unsigned int request_id;
+    PyObject *ids;
+    if (!PyArg_ParseTuple(args, "IO!", &request_id, &PyTuple_Type, &ids)) return NULL;
+    PyObject *spec = Py_BuildValue("(O)", ids);
+    if (!spec) return NULL;
+    bool ok = start_subscription(-1, request_id, spec);
+    Py_DECREF(spec);
+    if (!ok) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+test_update_subscriptions(PyObject *self UNUSED, PyObject *args) {
+    // Send the changes to subscribed windows, as update_subscriptions()
+    // does, for tests. windows maps window ids to (screen, title), time is in
+    // seconds. Returns the frames sent as (request_id, data), with data None
+    // for the end of a subscription.
+    PyObject *windows;
+    double now;
+    int has_room = 1;
+    if (!PyArg_ParseTuple(args, "O!d|p", &PyDict_Type, &windows, &now, &has_room)) return NULL;
+    test_frames = PyList_New(0);
+    if (!test_frames) return NULL;
+    test_peer_has_room = has_room;
+    subscription_has_room = test_subscription_has_room; subscription_send = test_subscription_send;
+    for (size_t i = 0; i < subscriptions.count; i++) {
+        Subscription *s = subscriptions.subscriptions + i;
+        for (size_t k = 0; k < s->num_windows; k++) {
+            WatchedWindow *ww = s->windows + k;
+            ww->found = false;
+            PyObject *key = PyLong_FromUnsignedLongLong(ww->id), *w;
+            if (!key) break;
+            w = PyDict_GetItem(windows, key);
+            Py_DECREF(key);
+            Screen *screen; PyObject *title;
+            if (w && PyArg_ParseTuple(w, "O!O", &Screen_Type, &screen, &title)) collect_changes(ww, screen, title);
+        }
+    }
+    bool sent = false;
+    if (!PyErr_Occurred()) {
+        for (ssize_t i = subscriptions.count - 1; i >= 0; i--) {
+            if (send_subscription_changes(subscriptions.subscriptions + i, s_double_to_monotonic_t(now), &sent)) remove_i_from_array(subscriptions.subscriptions, (size_t)i, subscriptions.count);
+        }
+    }
+    subscription_has_room = peer_has_room; subscription_send = send_frame;
+    PyObject *ans = test_frames;
+    test_frames = NULL;
+    if (PyErr_Occurred()) Py_CLEAR(ans);
+    return ans;
+}
+
 static PyMethodDef module_methods[] = {
     METHODB(safe_pipe, METH_VARARGS),
+    METHODB(frame_wait, METH_VARARGS),
+    METHODB(test_subscribe, METH_VARARGS),
+    METHODB(test_update_subscriptions, METH_VARARGS),
     {"add_timer", (PyCFunction)add_python_timer, METH_VARARGS, ""},
     {"remove_timer", (PyCFunction)remove_python_timer, METH_VARARGS, ""},
     METHODB(monitor_pid, METH_VARARGS),
     {"set_iutf8_winid", (PyCFunction)pyset_iutf8, METH_VARARGS, ""},
+    METHODB(render_os_window_now, METH_VARARGS),
+    METHODB(input_latency_stats, METH_NOARGS),
+    METHODB(reset_input_latency_stats, METH_NOARGS),
+    METHODB(set_input_latency_trace, METH_O),
     {NULL}  /* Sentinel */
 };
 
@@ -6,12 +6,14 @@
  */
 
 #include "data-types.h"
+#include "exec-child.h"
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <spawn.h>
 
 static inline char**
 serialize_string_tuple(PyObject *src) {
@@ -38,45 +40,68 @@ free_string_tuple(char** data) {
 
 extern char **environ;
 
-static inline void
-write_to_stderr(const char *text) {
-    size_t sz = strlen(text);
-    size_t written = 0;
-    while(written < sz) {
-        ssize_t amt = write(2, text + written, sz - written);
-        if (amt == 0) break;
-        if (amt < 0) {
-            if (errno == EAGAIN || errno == EINTR) continue;
-            break;
-        }
-        written += amt;
-    }
-}
-
-#define exit_on_err(m) { write_to_stderr(m); write_to_stderr(": "); write_to_stderr(strerror(errno)); exit(EXIT_FAILURE); }
-
-static inline void
-wait_for_terminal_ready(int fd) {
-    char data;
-    while(1) {
-        int ret = read(fd, &data, 1);
-        if (ret == -1 && (errno == EINTR || errno == EAGAIN)) continue;
-        break;
+static inline pid_t
+spawn_via_exec_helper(const char *helper, const char *exe, const char *cwd, const char *tty_name, char **argv, char **env, int master, int slave, int stdin_read_fd, int stdin_write_fd, int ready_read_fd, int ready_write_fd) {
+    // posix_spawn() uses vfork() or clone(CLONE_VM|CLONE_VFORK), so the cost
+    // of spawning does not grow with the memory used by kitty, as it does
+    // with fork(). The child cannot wait for the terminal to be ready before
+    // it execs, so it execs the helper, which does the rest of the setup.
+    char fds[3][16];
+    snprintf(fds[0], sizeof(fds[0]), "%d", slave);
+    snprintf(fds[1], sizeof(fds[1]), "%d", stdin_read_fd);
+    snprintf(fds[2], sizeof(fds[2]), "%d", ready_read_fd);
+    size_t argc = 0;
+    while (argv[argc]) argc++;
+    const char **helper_argv = calloc(EXEC_CHILD_NUM_ARGS + argc + 1, sizeof(char*));
+    if (!helper_argv) fatal("Out of memory");
+    const char *args[EXEC_CHILD_NUM_ARGS] = {helper, EXEC_CHILD_ARG, cwd, tty_name, fds[0], fds[1], fds[2], exe};
+    memcpy(helper_argv, args, sizeof(args));
+    memcpy(helper_argv + EXEC_CHILD_NUM_ARGS, argv, argc * sizeof(char*));
+
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t mask, defaults;
+    sigemptyset(&mask); sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT); sigaddset(&defaults, SIGTERM); sigaddset(&defaults, SIGCHLD); sigaddset(&defaults, SIGPIPE);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    // Only needed with glibc < 2.24, later versions always use clone(CLONE_VFORK)
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawn_file_actions_init(&actions);
+    // The write ends must be closed in the child for it to see EOF on them
+    int to_close[] = {master, stdin_write_fd, ready_write_fd};
+    for (size_t i = 0; i < arraysz(to_close); i++) {
+        if (to_close[i] > -1) posix_spawn_file_actions_addclose(&actions, to_close[i]);
     }
+    pid_t pid;
+    int ret = posix_spawn(&pid, helper, &actions, &attr, (char* const*)helper_argv, env);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    free(helper_argv);
+    if (ret != 0) { errno = ret; return -1; }
+    return pid;
 }
 
 static PyObject*
 spawn(PyObject *self UNUSED, PyObject *args) {
     PyObject *argv_p, *env_p;
     int master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd;
-    char *cwd, *exe;
-    if (!PyArg_ParseTuple(args, "ssO!O!iiiiii", &exe, &cwd, &PyTuple_Type, &argv_p, &PyTuple_Type, &env_p, &master, &slave, &stdin_read_fd, &stdin_write_fd, &ready_read_fd, &ready_write_fd)) return NULL;
+    char *cwd, *exe, *exec_helper = NULL;
+    if (!PyArg_ParseTuple(args, "ssO!O!iiiiii|z", &exe, &cwd, &PyTuple_Type, &argv_p, &PyTuple_Type, &env_p, &master, &slave, &stdin_read_fd, &stdin_write_fd, &ready_read_fd, &ready_write_fd, &exec_helper)) return NULL;
     char name[2048] = {0};
     if (ttyname_r(slave, name, sizeof(name) - 1) != 0) { PyErr_SetFromErrno(PyExc_OSError); return NULL; }
     char **argv = serialize_string_tuple(argv_p);
     char **env = serialize_string_tuple(env_p);
 
-    pid_t pid = fork();
+    pid_t pid = -1;
+    // Fall back to fork() if the helper cannot be executed
+    if (exec_helper) pid = spawn_via_exec_helper(exec_helper, exe, cwd, name, argv, env, master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd);
+    if (pid == -1) pid = fork();
     switch(pid) {
         case 0: {
             // child
@@ -86,54 +111,11 @@ spawn(PyObject *self UNUSED, PyObject *args) {
             SA(SIGINT); SA(SIGTERM); SA(SIGCHLD);
 #undef SA
             if (sigprocmask(SIG_SETMASK, &signals, NULL) != 0) exit_on_err("sigprocmask() in child process failed");
-            // Use only signal-safe functions (man 7 signal-safety)
-            if (chdir(cwd) != 0) { if (chdir("/") != 0) {} };  // ignore failure to chdir to /
-            if (setsid() == -1) exit_on_err("setsid() in child process failed");
-
-            // Establish the controlling terminal (see man 7 credentials)
-            int tfd = open(name, O_RDWR);
-            if (tfd == -1) exit_on_err("Failed to open controlling terminal");
-#ifdef TIOCSTTY
-            // On BSD open() does not establish the controlling terminal
-            if (ioctl(tfd, TIOCSCTTY, 0) == -1) exit_on_err("Failed to set controlling terminal with TIOCSCTTY");
-#endif
-            safe_close(tfd);
-
-            // Redirect stdin/stdout/stderr to the pty
-            if (dup2(slave, 1) == -1) exit_on_err("dup2() failed for fd number 1");
-            if (dup2(slave, 2) == -1) exit_on_err("dup2() failed for fd number 2");
-            if (stdin_read_fd > -1) {
-                if (dup2(stdin_read_fd, 0) == -1) exit_on_err("dup2() failed for fd number 0");
-                safe_close(stdin_read_fd);
-                safe_close(stdin_write_fd);
-            } else {
-                if (dup2(slave, 0) == -1) exit_on_err("dup2() failed for fd number 0");
-            }
-            safe_close(slave);
+            if (stdin_write_fd > -1) safe_close(stdin_write_fd);
             safe_close(master);
-
-            // Wait for READY_SIGNAL which indicates kitty has setup the screen object
             safe_close(ready_write_fd);
-            wait_for_terminal_ready(ready_read_fd);
-            safe_close(ready_read_fd);
-
-            // Close any extra fds inherited from parent
-            for (int c = 3; c < 201; c++) safe_close(c);
-
             environ = env;
-            // for some reason SIGPIPE is set to SIG_IGN, so reset it, needed by bash,
-            // which does not reset signal handlers on its own
-            signal(SIGPIPE, SIG_DFL);
-            execvp(exe, argv);
-            // Report the failure and exec a shell instead, so that we are not left
-            // with a forked but not exec'ed process
-            write_to_stderr("Failed to launch child: ");
-            write_to_stderr(argv[0]);
-            write_to_stderr("\nWith error: ");
-            write_to_stderr(strerror(errno));
-            write_to_stderr("\nPress Enter to exit.\n");
-            execlp("sh", "sh", "-c", "read w", NULL);
-            exit(EXIT_FAILURE);
+            exec_child(exe, argv, cwd, name, slave, stdin_read_fd, ready_read_fd);
             break;
         }
         case -1:
@@ -142,7 +124,6 @@ spawn(PyObject *self UNUSED, PyObject *args) {
         default:
             break;
     }
-#undef exit_on_err
     free_string_tuple(argv);
     free_string_tuple(env);
     if (PyErr_Occurred()) return NULL;
@@ -68,6 +68,23 @@ def checked_terminfo_dir():
     return ans
 
 
+def exec_helper():
+    # The launcher doubles as the helper that children exec to finish their
+    # setup, allowing them to be spawned with vfork(), see spawn() in
+    # child.c. It is only used when kitty was started by the launcher, so that
+    # it is always the same version of kitty.
+    ans = getattr(exec_helper, 'ans', False)
+    if ans is False:
+        ans = None
+        rpath = sys._xoptions.get('bundle_exe_dir')
+        if rpath:
+            q = os.path.join(rpath, 'kitty')
+            if os.access(q, os.X_OK):
+                ans = q
+        exec_helper.ans = ans
+    return ans
+
+
 def processes_in_group(grp):
     gmap = getattr(process_group_map, 'cached_map', None)
     if gmap is None:
@@ -226,7 +243,8 @@ class Child:
             # xterm, urxvt, konsole and gnome-terminal do not do it in my
             # testing.
             argv[0] = ('-' + exe.split('/')[-1])
-        pid = fast_data_types.spawn(exe, self.cwd, tuple(argv), env, master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd)
+        pid = fast_data_types.spawn(
+            exe, self.cwd, tuple(argv), env, master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd, exec_helper())
         os.close(slave)
         self.pid = pid
         self.child_fd = master
@@ -39,6 +39,66 @@ class UnknownLayout(ValueError):
     hide_traceback = True
 
 
+class StreamError(ValueError):
+
+    hide_traceback = True
+
+
+class StreamedResponse:
+
+    '''
+    The response to a command that is followed by data sent as it becomes
+    available, when the command is received on a framed connection, see
+    handle_cmd() in remote_control.py and start_stream() in
+    child-monitor.c. data is the data in the response and kind and spec
+    describe what is streamed. On other connections the data in the response
+    is fallback().
+    '''
+
+    kind = None
+
+    def fallback(self):
+        raise StreamError('This command needs a connection to kitty via a socket, see kitty @ --to')
+
+
+class StreamedText(StreamedResponse):
+
+    '''
+    Text from a range of lines of a screen, sent as it is read from the screen.
+    On other connections it is sent in the response.
+    '''
+
+    kind = 'text'
+
+    def __init__(self, screen, start, end, as_ansi):
+        self.screen, self.as_ansi = screen, as_ansi
+        first, screen_start, screen_end = screen.text_line_numbers()
+        self.start = max(start, first)
+        self.end = max(self.start, min(end, screen_end))
+        self.data = {'stream': True, 'start_line': self.start, 'end_line': self.end, 'screen_start_line': screen_start}
+
+    @property
+    def spec(self):
+        return self.screen, self.start, self.end, self.as_ansi
+
+    def fallback(self):
+        return self.screen.export_text(self.start, self.end, self.as_ansi).decode('utf-8')
+
+
+class WindowSubscription(StreamedResponse):
+
+    '''
+    Changes to windows, sent as they happen, until the windows are closed.
+    '''
+
+    kind = 'subscription'
+
+    def __init__(self, window_ids):
+        window_ids = tuple(window_ids)
+        self.spec = window_ids,
+        self.data = {'stream': True, 'window_ids': list(window_ids)}
+
+
 cmap = {}
 
 
@@ -298,9 +358,16 @@ def send_text(boss, window, payload):
         for tab in tabs:
             windows += tuple(tab)
     data = payload['text'].encode('utf-8') if payload['is_binary'] else parse_send_text_bytes(payload['text'])
-    for window in windows:
-        if window is not None:
-            window.write_to_child(data)
+    window_ids = tuple(w.id for w in windows if w is not None)
+    if data and window_ids:
+        # Queue the data for all the windows at once, instead of one window
+        # at a time, which matters when broadcasting to many windows
+        pending = boss.child_monitor.broadcast_to_children(data, window_ids)
+        for window_id, p in zip(window_ids, pending):
+            if p == -1:
+                print('Failed to write to child %d as it does not exist' % window_id, file=sys.stderr)
+            elif p == -2:
+                print('Failed to write to child %d as too much data is waiting to be written to it' % window_id, file=sys.stderr)
 # }}}
 
 
@@ -992,6 +1059,35 @@ getting the current selection, the result is always plain text.
 --self
 type=bool-set
 If specified get text from the window this command is run in, rather than the active window.
+
+
+--start-line
+type=int
+default=-1
+The number of the first line to get, instead of the first line of the extent.
+Lines are numbered from the first line that was ever added to the scrollback,
+so the lines added to the scrollback since text was last got can be got by
+starting at the line after the last one. The numbers of lines change only when
+the window is resized. Lines on the screen follow the lines in the
+scrollback. When this option is used, every line ends with a newline,
+unless it is continued on the next line, and only lines in the scrollback
+are got, not the lines in :opt:`scrollback_pager_history_size`.
+
+
+--end-line
+type=int
+default=-1
+The number of the line after the last line to get, instead of the end of
+the screen, see :option:`kitty @ get-text --start-line`.
+
+
+--stream
+type=bool-set
+Send the text as it is read from the scrollback, instead of all at once,
+which is much faster and needs much less memory for large scrollbacks. It
+works only when talking to kitty via a socket, see :option:`kitty @ --to`.
+Implies :option:`kitty @ get-text --start-line`, starting at the first line
+of the extent.
 ''',
     argspec=''
 )
@@ -1001,8 +1097,14 @@ def cmd_get_text(global_opts, opts, args):
     extent: One of :code:`screen`, :code:`all`, or :code:`selection`
     ansi: Boolean, if True send ANSI formatting codes
     self: Boolean, if True use window command was run in
+    start_line: The number of the first line to get, or -1 for the first line of the extent
+    end_line: The number of the line after the last line to get, or -1 for the end of the screen
+    stream: Boolean, if True send the text after the response, see :ref:`rc_streams`
     '''
-    return {'match': opts.match, 'extent': opts.extent, 'ansi': opts.ansi, 'self': opts.self}
+    return {
+        'match': opts.match, 'extent': opts.extent, 'ansi': opts.ansi, 'self': opts.self,
+        'start_line': opts.start_line, 'end_line': opts.end_line, 'stream': opts.stream
+    }
 
 
 def get_text(boss, window, payload):
@@ -1015,14 +1117,65 @@ def get_text(boss, window, payload):
     else:
         windows = [window if window and pg(payload, 'self') else boss.active_window]
     window = windows[0]
+    start, end = pg(payload, 'start_line'), pg(payload, 'end_line')
     if pg(payload, 'extent') == 'selection':
         ans = window.text_for_selection()
+    elif pg(payload, 'stream') or start > -1 or end > -1:
+        first, screen_start, screen_end = window.screen.text_line_numbers()
+        if start < 0:
+            start = first if pg(payload, 'extent') == 'all' else screen_start
+        ans = StreamedText(window.screen, start, screen_end if end < 0 else end, bool(pg(payload, 'ansi')))
+        if not pg(payload, 'stream'):
+            ans = ans.fallback()
     else:
         ans = window.as_text(as_ansi=bool(pg(payload, 'ansi')), add_history=pg(payload, 'extent') == 'all')
     return ans
 # }}}
 
 
+# subscribe {{{
+@cmd(
+    'Get the changes to windows as they happen',
+    'Print the changes to the text and titles of the specified windows (defaults to the active window)'
+    ' as they happen, until the windows are closed, as one JSON object per line. Changes are sent at most'
+    ' once per :opt:`repaint_delay` for each window, so this is much cheaper than getting the text of'
+    ' windows repeatedly. It works only when talking to kitty via a socket, see :option:`kitty @ --to`.'
+    ' Every object has the :code:`window_id` of the window that changed and'
+    ' :code:`screen_start_line`, the number of the first line on the screen, see'
+    ' :option:`kitty @ get-text --start-line`. The first object for a window has all its lines and'
+    ' title. Objects have, when they changed, :code:`lines` and :code:`columns`,'
+    ' the size of the screen, :code:`appended`, the text of the lines added to the scrollback,'
+    ' :code:`changed_lines`, a list of the line numbers on the screen and the text of the lines'
+    ' that changed, and :code:`title`. Once a window is closed :code:`closed` is true.',
+    options_spec=MATCH_WINDOW_OPTION + '''\n
+--self
+type=bool-set
+If specified subscribe to the window this command is run in, rather than the active window.
+''',
+    argspec=''
+)
+def cmd_subscribe(global_opts, opts, args):
+    '''
+    match: Which windows to subscribe to
+    self: Boolean, if True subscribe to the window the command is run in
+    stream: Boolean, must be True, the changes are sent after the response, see :ref:`rc_streams`
+    '''
+    return {'match': opts.match, 'self': opts.self, 'stream': True}
+
+
+def subscribe(boss, window, payload):
+    pg = cmd_subscribe.payload_get
+    match = pg(payload, 'match')
+    if match:
+        windows = tuple(boss.match_windows(match))
+        if not windows:
+            raise MatchError(match)
+    else:
+        windows = [window if window and pg(payload, 'self') else boss.active_window]
+    return WindowSubscription(w.id for w in windows if w is not None)
+# }}}
+
+
 # set_colors {{{
 @cmd(
     'Set terminal colors',
@@ -1247,6 +1400,93 @@ def kitten(boss, window, payload):
 # }}}
 
 
+# input_latency {{{
+@cmd(
+    'Report the latency of key presses',
+    'Report the time from key presses to the frames that display the output that'
+    ' follows them, as percentiles of the last 1024 key presses. The time is split'
+    ' into stages: :italic:`key` until the key is sent to the child, :italic:`child`'
+    ' until the child produces output, :italic:`parse` until that output is parsed,'
+    ' which includes :opt:`input_delay`, and :italic:`render` until the frame that'
+    ' displays it is shown, which includes :opt:`repaint_delay`. Use it to tune these'
+    ' and :opt:`sync_to_monitor` for your machine.',
+    options_spec='''\
+--reset
+type=bool-set
+Clear the recorded key presses after reporting them.
+
+
+--trace-file
+Append a line with the timings of every following key press, as JSON, to the
+specified file.
+
+
+--stop-trace
+type=bool-set
+Stop writing key presses to the file specified with :option:`kitty @ input-latency --trace-file`.
+''',
+    argspec=''
+)
+def cmd_input_latency(global_opts, opts, args):
+    '''
+    reset: Boolean, if True clear the recorded key presses
+    trace_file: Path to a file to write the timings of key presses to
+    stop_trace: Boolean, if True stop writing to the trace file
+    '''
+    return {'reset': opts.reset, 'trace_file': os.path.abspath(opts.trace_file) if opts.trace_file else None, 'stop_trace': opts.stop_trace}
+
+
+def input_latency(boss, window, payload):
+    from .fast_data_types import input_latency_stats, reset_input_latency_stats, set_input_latency_trace
+    pg = cmd_input_latency.payload_get
+    if pg(payload, 'stop_trace'):
+        set_input_latency_trace(None)
+    if pg(payload, 'trace_file'):
+        set_input_latency_trace(pg(payload, 'trace_file'))
+    stats = input_latency_stats()
+    if pg(payload, 'reset'):
+        reset_input_latency_stats()
+    ans = ['Latency of the last {} of {} key presses in ms'.format(stats['num_samples'], stats['count'])]
+    ans.append('{:<8}{:>9}{:>9}{:>9}{:>9}{:>9}'.format('', 'mean', 'p50', 'p90', 'p99', 'max'))
+    for stage in ('key', 'child', 'parse', 'render', 'total'):
+        s = stats[stage]
+        ans.append('{:<8}'.format(stage) + ''.join('{:>9.2f}'.format(s[k] * 1000) for k in ('mean', 'p50', 'p90', 'p99', 'max')))
+    return '\n'.join(ans)
+# }}}
+
+
+# trace {{{
+@cmd(
+    'Record a trace of what kitty is doing',
+    'Record what all of kitty\'s threads are doing: reading and parsing the output of programs,'
+    ' rendering, shaping and rasterizing text, decoding images and running python code.'
+    ' Use :code:`start` to start recording and :code:`stop` to stop recording and write'
+    ' the trace to :italic:`PATH`, by default :file:`kitty-trace.json` in the current directory.'
+    ' The trace is in the Chrome trace event format, open it with https://ui.perfetto.dev'
+    ' or :code:`chrome://tracing`.',
+    argspec='start|stop [PATH]'
+)
+def cmd_trace(global_opts, opts, args):
+    '''
+    action+: One of :code:`start` or :code:`stop`
+    path: The path to write the trace to, when stopping
+    '''
+    if not args or args[0] not in ('start', 'stop'):
+        raise SystemExit('Must specify either start or stop')
+    return {'action': args[0], 'path': os.path.abspath(args[1] if len(args) > 1 else 'kitty-trace.json')}
+
+
+def trace(boss, window, payload):
+    from .fast_data_types import start_tracing, stop_tracing, write_trace
+    if payload['action'] == 'start':
+        start_tracing()
+        return
+    stop_tracing()
+    path = cmd_trace.payload_get(payload, 'path') or os.path.abspath('kitty-trace.json')
+    return 'Wrote {} events to {}'.format(write_trace(path), path)
+# }}}
+
+
 def cli_params_for(func):
     return (func.options_spec or '\n').format, func.argspec, func.desc, '{} @ {}'.format(appname, func.name)
 
@@ -491,8 +491,12 @@ Delay (in milliseconds) between screen updates. Decreasing it, increases
 frames-per-second (FPS) at the cost of more CPU usage. The default value
 yields ~100 FPS which is more than sufficient for most uses. Note that to
 actually achieve 100 FPS you have to either set :opt:`sync_to_monitor` to no
-or use a monitor with a high refresh rate. Also, to minimize latency
-when there is pending input to be processed, repaint_delay is ignored.'''))
+or use a monitor with a high refresh rate. Also, to minimize latency,
+an OS window that has not been updated for repaint_delay is updated as soon
+as there is input for it. Every OS window is updated on its own schedule, and, with :opt:`sync_to_monitor`,
+at most once per refresh of the monitor it is on. At most repaint_delay is
+spent processing input from programs before screens are updated, so that
+a program producing a lot of output cannot delay updates to other windows.'''))
 
 o('input_delay', 3, option_type=positive_int, long_text=_('''
 Delay (in milliseconds) before input from the program running in the terminal
@@ -508,6 +512,23 @@ it limits the rendering speed to the refresh rate of your monitor. With a
 very high speed mouse/high keyboard repeat rate, you may notice some slight input latency.
 If so, set this to no.'''))
 
+o('share_image_textures', True, long_text=_('''
+Share the GPU memory of identical images displayed using the graphics
+protocol. Images with the same pixels, for example thumbnails sent
+repeatedly or to many windows, are then uploaded to the GPU only once. Set
+this to no to always upload each image separately.'''))
+
+o('image_texture_scale', 0.0, option_type=positive_float, long_text=_('''
+Limit the resolution of the GPU textures of images displayed using the
+graphics protocol. When positive, images are uploaded to the GPU only once they
+are displayed, at this many texels per screen pixel of their largest
+placement, rather than at their full resolution. Mipmaps are generated so that
+images drawn smaller than their textures look smooth. Large images displayed
+in a few cells then use much less GPU memory and upload bandwidth, at the cost
+of keeping their pixels in memory, to re-upload them should they be displayed
+at a larger size later. A value of 2 gives sharp images. The default of zero
+uploads images at their full resolution.'''))
+
 # }}}
 
 g('bell')  # {{{
@@ -7,6 +7,7 @@
 
 #include "state.h"
 #include "fonts.h"
+#include "glyph-cache.h"
 #include "unicode-data.h"
 #include <structmember.h>
 #include <stdint.h>
@@ -537,6 +538,19 @@ postscript_name_for_face(const PyObject *face_) {
     return "";
 }
 
+bool
+identity_for_face(PyObject *face_, FaceIdentity *ans) {
+    CTFace *self = (CTFace*)face_;
+    if (!self->path) return false;
+    ans->path = PyUnicode_AsUTF8(self->path);
+    if (!ans->path) { PyErr_Clear(); return false; }
+    // CoreText identifies faces in font collections by postscript name, not index
+    const char *psname = postscript_name_for_face(face_);
+    ans->index = (int)(glyph_cache_hash(0, psname, strlen(psname)) & 0x7fffffff);
+    ans->hinting = 0; ans->hintstyle = 0;
+    return true;
+}
+
 
 static PyObject *
 repr(CTFace *self) {
@@ -189,6 +189,7 @@ extern int init_Screen(PyObject *);
 extern bool init_fontconfig_library(PyObject*);
 extern bool init_desktop(PyObject*);
 extern bool init_fonts(PyObject*);
+extern bool init_decorations(PyObject*);
 extern bool init_glfw(PyObject *m);
 extern bool init_child(PyObject *m);
 extern bool init_state(PyObject *module);
@@ -198,6 +199,7 @@ extern bool init_shaders(PyObject *module);
 extern bool init_mouse(PyObject *module);
 extern bool init_kittens(PyObject *module);
 extern bool init_logging(PyObject *module);
+extern bool init_tracing(PyObject *module);
 extern bool init_png_reader(PyObject *module);
 #ifdef __APPLE__
 extern int init_CoreText(PyObject *);
@@ -218,6 +220,7 @@ PyInit_fast_data_types(void) {
 
     if (m != NULL) {
         if (!init_logging(m)) return NULL;
+        if (!init_tracing(m)) return NULL;
         if (!init_LineBuf(m)) return NULL;
         if (!init_HistoryBuf(m)) return NULL;
         if (!init_Line(m)) return NULL;
@@ -244,6 +247,7 @@ PyInit_fast_data_types(void) {
         if (!init_desktop(m)) return NULL;
 #endif
         if (!init_fonts(m)) return NULL;
+        if (!init_decorations(m)) return NULL;
 
         PyModule_AddIntConstant(m, "BOLD", BOLD_SHIFT);
         PyModule_AddIntConstant(m, "ITALIC", ITALIC_SHIFT);
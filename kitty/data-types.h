@@ -199,6 +199,9 @@ typedef struct {
     PagerHistoryBuf *pagerhist;
     Line *line;
     index_type start_of_data, count;
+    // The number of lines ever added, the most recently added line is line
+    // number lines_added - 1, counting from the first line ever added
+    unsigned long long lines_added;
 } HistoryBuf;
 
 typedef struct {
@@ -242,6 +245,7 @@ typedef struct {int x;} *SPRITE_MAP_HANDLE;
 typedef struct {FONTS_DATA_HEAD} *FONTS_DATA_HANDLE;
 
 #define PARSER_BUF_SZ (8 * 1024)
+#define APC_PAYLOAD_SZ 4096u
 #define READ_BUF_SZ (1024*1024)
 
 #define clear_sprite_position(cell) (cell).sprite_x = 0; (cell).sprite_y = 0; (cell).sprite_z = 0;
@@ -0,0 +1,801 @@
+/*
+ * decorations.c
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+// Native rasterizers for the box drawing and Powerline characters and the
+// pre-rendered underline, strikethrough, missing glyph and cursor sprites.
+// These are ports of kitty/fonts/box_drawing.py and the pre-render functions
+// in kitty/fonts/render.py and must produce identical output, which is
+// checked by the test suite.
+
+#include "decorations.h"
+#include <math.h>
+
+// Fused multiply-adds would change the anti-aliasing results slightly
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+typedef struct {
+    uint8_t *mask;
+    int width, height;
+    double dpi;
+} Canvas;
+
+typedef struct {
+    double upper, lower;
+} Limits;
+
+static double scale[4] = {0.001, 1, 1.5, 2};
+
+static inline int
+thickness(Canvas *c, unsigned int level) {
+    return (int)ceil(scale[level] * (c->dpi / 72.0));
+}
+
+static inline void
+set_pixel(Canvas *c, int x, int y, uint8_t val) {
+    if (0 <= x && x < c->width && 0 <= y && y < c->height) c->mask[y * c->width + x] = val;
+}
+
+// Line primitives {{{
+
+static void
+draw_hline(Canvas *c, int x1, int x2, int y, unsigned int level) {
+    // Draw a horizontal line between [x1, x2) centered at y with the thickness given by level
+    int sz = thickness(c, level), start = y - sz / 2;
+    for (y = start; y < start + sz; y++) {
+        for (int x = x1; x < x2; x++) set_pixel(c, x, y, 255);
+    }
+}
+
+static void
+draw_vline(Canvas *c, int y1, int y2, int x, unsigned int level) {
+    // Draw a vertical line between [y1, y2) centered at x with the thickness given by level
+    int sz = thickness(c, level), start = x - sz / 2;
+    for (x = start; x < start + sz; x++) {
+        for (int y = y1; y < y2; y++) set_pixel(c, x, y, 255);
+    }
+}
+
+static void
+half_hline(Canvas *c, unsigned int level, bool right, int extend_by) {
+    if (right) draw_hline(c, c->width / 2 - extend_by, c->width, c->height / 2, level);
+    else draw_hline(c, 0, extend_by + c->width / 2, c->height / 2, level);
+}
+
+static void
+half_vline(Canvas *c, unsigned int level, bool bottom, int extend_by) {
+    if (bottom) draw_vline(c, c->height / 2 - extend_by, c->height, c->width / 2, level);
+    else draw_vline(c, 0, c->height / 2 + extend_by, c->width / 2, level);
+}
+
+static void
+hline(Canvas *c, unsigned int level) {
+    half_hline(c, level, false, 0);
+    half_hline(c, level, true, 0);
+}
+
+static void
+vline(Canvas *c, unsigned int level) {
+    half_vline(c, level, false, 0);
+    half_vline(c, level, true, 0);
+}
+
+static inline unsigned int
+get_holes(int sz, int hole_sz, unsigned int num, int *starts) {
+    int ssz;
+    switch (num) {
+        case 1:
+            starts[0] = sz / 2; break;
+        case 2:
+            ssz = (sz - 2 * hole_sz) / 3;
+            starts[0] = ssz + hole_sz / 2; starts[1] = 2 * ssz + hole_sz / 2 + hole_sz;
+            break;
+        default:
+            num = 3;
+            ssz = (sz - 3 * hole_sz) / 4;
+            starts[0] = ssz + hole_sz / 2; starts[1] = 2 * ssz + hole_sz / 2 + hole_sz; starts[2] = 3 * ssz + 2 * hole_sz + hole_sz / 2;
+            break;
+    }
+    for (unsigned int i = 0; i < num; i++) starts[i] -= hole_sz / 2;
+    return num;
+}
+
+#define HOLE_FACTOR 8
+
+static void
+hholes(Canvas *c, unsigned int level, unsigned int num) {
+    hline(c, level);
+    int line_sz = thickness(c, level), hole_sz = c->width / HOLE_FACTOR, start = c->height / 2 - line_sz / 2, holes[3];
+    num = get_holes(c->width, hole_sz, num, holes);
+    for (int y = start; y < start + line_sz; y++) {
+        for (unsigned int h = 0; h < num; h++) {
+            for (int x = holes[h]; x < holes[h] + hole_sz; x++) set_pixel(c, x, y, 0);
+        }
+    }
+}
+
+static void
+vholes(Canvas *c, unsigned int level, unsigned int num) {
+    vline(c, level);
+    int line_sz = thickness(c, level), hole_sz = c->height / HOLE_FACTOR, start = c->width / 2 - line_sz / 2, holes[3];
+    num = get_holes(c->height, hole_sz, num, holes);
+    for (int x = start; x < start + line_sz; x++) {
+        for (unsigned int h = 0; h < num; h++) {
+            for (int y = holes[h]; y < holes[h] + hole_sz; y++) set_pixel(c, x, y, 0);
+        }
+    }
+}
+
+static void
+corner(Canvas *c, unsigned int hlevel, unsigned int vlevel, char_type which) {
+    half_hline(c, hlevel, which == 0x250c /* ┌ */ || which == 0x2514 /* └ */, thickness(c, vlevel) / 2);
+    half_vline(c, vlevel, !(which == 0x2514 /* └ */ || which == 0x2518 /* ┘ */), 0);
+}
+
+static void
+vert_t(Canvas *c, unsigned int a, unsigned int b, unsigned int d, char_type which) {
+    half_vline(c, a, false, 0);
+    half_hline(c, b, which != 0x2524 /* ┤ */, 0);
+    half_vline(c, d, true, 0);
+}
+
+static void
+horz_t(Canvas *c, unsigned int a, unsigned int b, unsigned int d, char_type which) {
+    half_hline(c, a, false, 0);
+    half_hline(c, b, true, 0);
+    half_vline(c, d, which != 0x2534 /* ┴ */, 0);
+}
+
+static void
+cross(Canvas *c, unsigned int a, unsigned int b, unsigned int d, unsigned int e) {
+    half_hline(c, a, false, 0);
+    half_hline(c, b, true, 0);
+    half_vline(c, d, false, 0);
+    half_vline(c, e, true, 0);
+}
+
+// }}}
+
+// Double lines {{{
+
+typedef enum { BOTH_LINES, FIRST_LINE_ONLY, SECOND_LINE_ONLY } WhichLines;
+
+static int
+half_dhline(Canvas *c, unsigned int level, bool right, WhichLines only) {
+    int x1 = right ? c->width / 2 : 0, x2 = right ? c->width : c->width / 2, gap = thickness(c, level + 1);
+    if (only != SECOND_LINE_ONLY) draw_hline(c, x1, x2, c->height / 2 - gap, level);
+    if (only != FIRST_LINE_ONLY) draw_hline(c, x1, x2, c->height / 2 + gap, level);
+    return gap;
+}
+
+static int
+half_dvline(Canvas *c, unsigned int level, bool bottom, WhichLines only) {
+    int y1 = bottom ? c->height / 2 : 0, y2 = bottom ? c->height : c->height / 2, gap = thickness(c, level + 1);
+    if (only != SECOND_LINE_ONLY) draw_vline(c, y1, y2, c->width / 2 - gap, level);
+    if (only != FIRST_LINE_ONLY) draw_vline(c, y1, y2, c->width / 2 + gap, level);
+    return gap;
+}
+
+static int
+dhline(Canvas *c, unsigned int level, WhichLines only) {
+    half_dhline(c, level, false, only);
+    return half_dhline(c, level, true, only);
+}
+
+static int
+dvline(Canvas *c, unsigned int level, WhichLines only) {
+    half_dvline(c, level, false, only);
+    return half_dvline(c, level, true, only);
+}
+
+static void
+dvcorner(Canvas *c, char_type which) {
+    const unsigned int level = 1;
+    half_dhline(c, level, which == 0x2552 /* ╒ */ || which == 0x2558 /* ╘ */, BOTH_LINES);
+    int gap = thickness(c, level + 1);
+    half_vline(c, level, !(which == 0x2558 /* ╘ */ || which == 0x255b /* ╛ */), gap / 2 + thickness(c, level));
+}
+
+static void
+dhcorner(Canvas *c, char_type which) {
+    const unsigned int level = 1;
+    half_dvline(c, level, !(which == 0x2559 /* ╙ */ || which == 0x255c /* ╜ */), BOTH_LINES);
+    int gap = thickness(c, level + 1);
+    half_hline(c, level, which == 0x2553 /* ╓ */ || which == 0x2559 /* ╙ */, gap / 2 + thickness(c, level));
+}
+
+static void
+dcorner(Canvas *c, char_type which) {
+    const unsigned int level = 1;
+    bool right = which == 0x2554 /* ╔ */ || which == 0x255a /* ╚ */;
+    bool top = which == 0x255a /* ╚ */ || which == 0x255d /* ╝ */;
+    int hgap = thickness(c, level + 1), vgap = thickness(c, level + 1);
+    int x1 = right ? c->width / 2 : 0, x2 = right ? c->width : c->width / 2;
+    int ydelta = top ? hgap : -hgap;
+    if (right) x1 -= vgap; else x2 += vgap;
+    draw_hline(c, x1, x2, c->height / 2 + ydelta, level);
+    if (right) x1 += 2 * vgap; else x2 -= 2 * vgap;
+    draw_hline(c, x1, x2, c->height / 2 - ydelta, level);
+    int y1 = top ? 0 : c->height / 2, y2 = top ? c->height / 2 : c->height;
+    int xdelta = right ? vgap : -vgap, yd = thickness(c, level) / 2;
+    if (top) y2 += hgap + yd; else y1 -= hgap + yd;
+    draw_vline(c, y1, y2, c->width / 2 - xdelta, level);
+    if (top) y2 -= 2 * hgap; else y1 += 2 * hgap;
+    draw_vline(c, y1, y2, c->width / 2 + xdelta, level);
+}
+
+static void
+dpip(Canvas *c, char_type which) {
+    const unsigned int level = 1;
+    if (which == 0x255f /* ╟ */ || which == 0x2562 /* ╢ */) {
+        int gap = dvline(c, level, BOTH_LINES), left = c->width / 2 - gap, right = c->width / 2 + gap;
+        if (which == 0x2562) draw_hline(c, 0, left, c->height / 2, level);
+        else draw_hline(c, right, c->width, c->height / 2, level);
+    } else {
+        int gap = dhline(c, level, BOTH_LINES), top = c->height / 2 - gap, bottom = c->height / 2 + gap;
+        if (which == 0x2567 /* ╧ */) draw_vline(c, 0, top, c->width / 2, level);
+        else draw_vline(c, bottom, c->height, c->width / 2, level);
+    }
+}
+
+static void
+inner_corner(Canvas *c, bool top, bool left) {
+    const unsigned int level = 1;
+    int hgap = thickness(c, level + 1), vgap = thickness(c, level + 1), vthick = thickness(c, level) / 2;
+    int x1 = left ? 0 : c->width / 2 + hgap - vthick, x2 = left ? c->width / 2 - hgap + vthick + 1 : c->width;
+    draw_hline(c, x1, x2, c->height / 2 + (top ? -vgap : vgap), level);
+    int y1 = top ? 0 : c->height / 2 + vgap, y2 = top ? c->height / 2 - vgap : c->height;
+    draw_vline(c, y1, y2, c->width / 2 + (left ? -hgap : hgap), level);
+}
+
+// }}}
+
+// Anti-aliased shapes {{{
+
+static void
+fill_region(Canvas *c, const Limits *xlimits, int count) {
+    for (int y = 0; y < c->height; y++) {
+        uint8_t *row = c->mask + y * c->width;
+        for (int x = 0; x < count; x++) row[x] = xlimits[x].upper <= y && y <= xlimits[x].lower ? 255 : 0;
+    }
+    // Anti-alias the boundary, simple y-axis anti-aliasing
+    for (int x = 0; x < count; x++) {
+        const double limits[2] = {xlimits[x].upper, xlimits[x].lower};
+        for (unsigned int i = 0; i < arraysz(limits); i++) {
+            const double y = limits[i];
+            for (int ypx = (int)floor(y); ypx <= (int)ceil(y); ypx++) {
+                if (0 <= ypx && ypx < c->height) {
+                    uint8_t *p = c->mask + ypx * c->width + x;
+                    *p = MIN(255, *p + (int)((1 - fabs(y - ypx)) * 255));
+                }
+            }
+        }
+    }
+}
+
+typedef struct {
+    double m, c;
+} LineEquation;
+
+static inline LineEquation
+line_equation(int x1, int y1, int x2, int y2) {
+    double m = (double)(y2 - y1) / (x2 - x1);
+    return (LineEquation){.m = m, .c = y1 - m * x1};
+}
+
+static inline double
+line_y(LineEquation l, int x) { return l.m * x + l.c; }
+
+static void
+triangle(Canvas *c, bool left) {
+    int ay1 = 0, by1 = c->height - 1, y2 = c->height / 2, x1 = left ? 0 : c->width - 1, x2 = left ? c->width - 1 : 0;
+    LineEquation upper = line_equation(x1, ay1, x2, y2), lower = line_equation(x1, by1, x2, y2);
+    Limits *xlimits = malloc(c->width * sizeof(Limits));
+    if (!xlimits) return;
+    for (int x = 0; x < c->width; x++) xlimits[x] = (Limits){line_y(upper, x), line_y(lower, x)};
+    fill_region(c, xlimits, c->width);
+    free(xlimits);
+}
+
+typedef enum { TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT } Corner;
+
+static void
+corner_triangle(Canvas *c, Corner corner) {
+    LineEquation diagonal = corner == TOP_RIGHT || corner == BOTTOM_LEFT ? line_equation(0, 0, c->width - 1, c->height - 1) : line_equation(c->width - 1, 0, 0, c->height - 1);
+    bool top = corner == TOP_RIGHT || corner == TOP_LEFT;
+    Limits *xlimits = malloc(c->width * sizeof(Limits));
+    if (!xlimits) return;
+    for (int x = 0; x < c->width; x++) {
+        double y = line_y(diagonal, x);
+        xlimits[x] = top ? (Limits){0, y} : (Limits){y, c->height - 1};
+    }
+    fill_region(c, xlimits, c->width);
+    free(xlimits);
+}
+
+static inline double fpart(double x) { return x - (long)x; }
+static inline double rfpart(double x) { return 1 - fpart(x); }
+
+static inline void
+put_aa_pixel(Canvas *c, bool steep, long x, long y, double alpha) {
+    if (steep) { long t = x; x = y; y = t; }
+    long off = x + y * c->width;
+    if (0 <= off && off < (long)c->width * c->height) c->mask[off] = (uint8_t)(long)MIN(c->mask[off] + alpha * 255, 255.);
+}
+
+static inline long
+draw_aa_endpoint(Canvas *c, bool steep, double grad, double x, double y) {
+    double xend = nearbyint(x), yend = y + grad * (xend - x), xgap = rfpart(x + 0.5);
+    long px = (long)xend, py = (long)yend;
+    put_aa_pixel(c, steep, px, py, rfpart(yend) * xgap);
+    put_aa_pixel(c, steep, px, py + 1, fpart(yend) * xgap);
+    return px;
+}
+
+static void
+antialiased_1px_line(Canvas *c, int px1, int py1, int px2, int py2) {
+    // Draw an antialiased line using the Wu algorithm
+    int x1 = px1, y1 = py1, x2 = px2, y2 = py2, dx = x2 - x1, dy = y2 - y1, t;
+    bool steep = abs(dx) < abs(dy);
+#define swap(a, b) { t = a; a = b; b = t; }
+    if (steep) { swap(x1, y1); swap(x2, y2); swap(dx, dy); swap(px1, py1); swap(px2, py2); }
+    if (x2 < x1) { swap(x1, x2); swap(y1, y2); }
+#undef swap
+    double grad = (double)dy / dx, intery = y1 + rfpart(x1) * grad;
+    long xstart = draw_aa_endpoint(c, steep, grad, px1, py1), xend = draw_aa_endpoint(c, steep, grad, px2, py2);
+    if (xstart > xend) { long tmp = xstart; xstart = xend; xend = tmp; }
+    for (long x = xstart + 1; x < xend; x++) {
+        long y = (long)intery;
+        put_aa_pixel(c, steep, x, y, rfpart(intery));
+        put_aa_pixel(c, steep, x, y + 1, fpart(intery));
+        intery += grad;
+    }
+}
+
+static void
+antialiased_line(Canvas *c, int x1, int y1, int x2, int y2, unsigned int level) {
+    int th = thickness(c, level);
+    if (th < 2) { antialiased_1px_line(c, x1, y1, x2, y2); return; }
+    int dh = th / 2;
+    for (int delta = -dh; delta < dh + (th % 2); delta++) antialiased_1px_line(c, x1, y1 + delta, x2, y2 + delta);
+}
+
+static void
+cross_line(Canvas *c, bool left) {
+    if (left) antialiased_line(c, 0, 0, c->width - 1, c->height - 1, 1);
+    else antialiased_line(c, c->width - 1, 0, 0, c->height - 1, 1);
+}
+
+static void
+half_cross_line(Canvas *c, Corner which) {
+    int my = (c->height - 1) / 2;
+    switch (which) {
+        case TOP_LEFT:
+            antialiased_line(c, 0, 0, c->width - 1, my, 1); break;
+        case BOTTOM_LEFT:
+            antialiased_line(c, c->width - 1, my, 0, c->height - 1, 1); break;
+        case TOP_RIGHT:
+            antialiased_line(c, c->width - 1, 0, 0, my, 1); break;
+        case BOTTOM_RIGHT:
+            antialiased_line(c, 0, my, c->width - 1, c->height - 1, 1); break;
+    }
+}
+
+static inline double
+cubic_bezier(const double p[4], double t) {
+    double tm1 = 1 - t, tm1_3 = tm1 * tm1 * tm1, t_3 = t * t * t;
+    return tm1_3 * p[0] + 3 * t * tm1 * (tm1 * p[1] + t * p[2]) + t_3 * p[3];
+}
+
+static bool
+find_t_for_x(const double bezier_x[4], int x, double start_t, double *ans) {
+    const double t_limit = 0.5;
+    if (fabs(cubic_bezier(bezier_x, start_t) - x) < 0.1) { *ans = start_t; return true; }
+    double increment = t_limit - start_t;
+    if (increment <= 0) { *ans = start_t; return true; }
+    while (true) {
+        double q = cubic_bezier(bezier_x, start_t + increment);
+        if (fabs(q - x) < 0.1) { *ans = start_t + increment; return true; }
+        if (q > x) {
+            increment /= 2;
+            if (increment < 1e-6) { log_error("Failed to find t for x=%d", x); return false; }
+        } else {
+            start_t += increment;
+            increment = t_limit - start_t;
+            if (increment <= 0) { *ans = start_t; return true; }
+        }
+    }
+}
+
+static bool
+D(Canvas *c, bool left) {
+    int cx = c->width - 1, c1x = cx;
+    while (true) {
+        const double bx[4] = {0, cx, cx, 0};
+        if (cubic_bezier(bx, 0.5) > c->width - 1) break;
+        c1x = cx++;
+    }
+    const double bezier_x[4] = {0, c1x, c1x, 0}, bezier_y[4] = {0, 0, c->height - 1, c->height - 1};
+    Limits *xlimits = malloc(c->width * sizeof(Limits));
+    if (!xlimits) return false;
+    int count = 0, max_x = (int)cubic_bezier(bezier_x, 0.5);
+    double last_t = 0;
+    for (int x = 0; x <= max_x && count < c->width; x++) {
+        if (x > 0 && !find_t_for_x(bezier_x, x, last_t, &last_t)) { free(xlimits); return false; }
+        double upper = cubic_bezier(bezier_y, last_t), lower = cubic_bezier(bezier_y, 1 - last_t);
+        if (fabs(upper - lower) <= 2) break;  // avoid pip on end of D
+        xlimits[count++] = (Limits){upper, lower};
+    }
+    if (left) fill_region(c, xlimits, count);
+    else {
+        Canvas m = {.mask = calloc(c->width, c->height), .width = c->width, .height = c->height, .dpi = c->dpi};
+        if (!m.mask) { free(xlimits); return false; }
+        fill_region(&m, xlimits, count);
+        for (int y = 0; y < c->height; y++) {
+            uint8_t *src = m.mask + y * c->width, *dest = c->mask + y * c->width;
+            for (int x = 0; x < c->width; x++) dest[c->width - 1 - x] = src[x];
+        }
+        free(m.mask);
+    }
+    free(xlimits);
+    return true;
+}
+
+// }}}
+
+// Blocks {{{
+
+static void
+vblock(Canvas *c, double frac, bool bottom) {
+    int num_rows = MIN(c->height, (int)nearbyint(frac * c->height)), start = bottom ? c->height - num_rows : 0;
+    memset(c->mask + start * c->width, 255, num_rows * c->width);
+}
+
+static void
+hblock(Canvas *c, double frac, bool right) {
+    int num_cols = MIN(c->width, (int)nearbyint(frac * c->width)), start = right ? c->width - num_cols : 0;
+    for (int y = 0; y < c->height; y++) memset(c->mask + y * c->width + start, 255, num_cols);
+}
+
+static void
+shade(Canvas *c, bool light, bool invert) {
+    int square_sz = MAX(1, c->width / 12), number_of_rows = c->height / square_sz, number_of_cols = c->width / square_sz;
+    uint8_t *dest = invert ? calloc(c->width, c->height) : c->mask;
+    if (!dest) return;
+    for (int r = 0; r < number_of_rows; r += 2) {
+        bool fill_even = r % 4 == 0;
+        for (int yr = 0; yr < square_sz; yr++) {
+            int y = r * square_sz + yr;
+            if (y >= c->height) break;
+            uint8_t *row = dest + c->width * y;
+            for (int col = 0; col < number_of_cols; col++) {
+                bool fill = light ? (col % 4) == (fill_even ? 0 : 2) : (col % 2 == 0) == fill_even;
+                if (!fill) continue;
+                for (int x = col * square_sz; x < (col + 1) * square_sz && x < c->width; x++) row[x] = 255;
+            }
+        }
+    }
+    if (invert) {
+        for (int q = 0; q < c->width * c->height; q++) c->mask[q] = 255 - dest[q];
+        free(dest);
+    }
+}
+
+static void
+quad(Canvas *c, bool right, bool bottom) {
+    int num_cols = c->width / 2, left = right ? num_cols : 0, rt = right ? c->width : num_cols;
+    int num_rows = c->height / 2, top = bottom ? num_rows : 0, btm = bottom ? c->height : num_rows;
+    for (int r = top; r < btm; r++) memset(c->mask + r * c->width + left, 255, rt - left);
+}
+
+// }}}
+
+#define T 1
+#define F 3
+
+static const uint8_t corner_levels[4][2] = {{T, T}, {F, T}, {T, F}, {F, F}};
+static const uint8_t cross_levels[16][4] = {
+    {T, T, T, T}, {F, T, T, T}, {T, F, T, T}, {F, F, T, T}, {T, T, F, T}, {T, T, T, F}, {T, T, F, F},
+    {F, T, F, T}, {T, F, F, T}, {F, T, T, F}, {T, F, T, F}, {F, F, F, T}, {F, F, T, F}, {F, T, F, F},
+    {T, F, F, F}, {F, F, F, F}
+};
+static const uint8_t vert_t_levels[8][3] = {{T, T, T}, {T, F, T}, {F, T, T}, {T, T, F}, {F, T, F}, {F, F, T}, {T, F, F}, {F, F, F}};
+static const uint8_t horz_t_levels[8][3] = {{T, T, T}, {F, T, T}, {T, F, T}, {F, F, T}, {T, T, F}, {F, T, F}, {T, F, F}, {F, F, F}};
+
+bool
+is_box_drawing_char(char_type ch) {
+START_ALLOW_CASE_RANGE
+    switch(ch) {
+        case 0x2500 ... 0x259f:
+        case 0xe0b0 ... 0xe0b4:
+        case 0xe0b6:
+        case 0xe0b8:
+        case 0xe0ba:
+        case 0xe0bc:
+        case 0xe0be:
+            return true;
+        default:
+            return false;
+    }
+END_ALLOW_CASE_RANGE
+}
+
+bool
+render_box_char(char_type ch, uint8_t *buf, unsigned int width, unsigned int height, double dpi) {
+    Canvas cv = {.mask = buf, .width = width, .height = height, .dpi = dpi}, *c = &cv;
+START_ALLOW_CASE_RANGE
+    switch(ch) {
+        case 0x2500: hline(c, 1); break;  // ─
+        case 0x2501: hline(c, 3); break;  // ━
+        case 0x2502: vline(c, 1); break;  // │
+        case 0x2503: vline(c, 3); break;  // ┃
+        case 0x254c: hholes(c, 1, 1); break;  // ╌
+        case 0x254d: hholes(c, 3, 1); break;  // ╍
+        case 0x2504: hholes(c, 1, 2); break;  // ┄
+        case 0x2505: hholes(c, 3, 2); break;  // ┅
+        case 0x2508: hholes(c, 1, 3); break;  // ┈
+        case 0x2509: hholes(c, 3, 3); break;  // ┉
+        case 0x254e: vholes(c, 1, 1); break;  // ╎
+        case 0x254f: vholes(c, 3, 1); break;  // ╏
+        case 0x2506: vholes(c, 1, 2); break;  // ┆
+        case 0x2507: vholes(c, 3, 2); break;  // ┇
+        case 0x250a: vholes(c, 1, 3); break;  // ┊
+        case 0x250b: vholes(c, 3, 3); break;  // ┋
+        case 0x2574: half_hline(c, 1, false, 0); break;  // ╴
+        case 0x2575: half_vline(c, 1, false, 0); break;  // ╵
+        case 0x2576: half_hline(c, 1, true, 0); break;  // ╶
+        case 0x2577: half_vline(c, 1, true, 0); break;  // ╷
+        case 0x2578: half_hline(c, 3, false, 0); break;  // ╸
+        case 0x2579: half_vline(c, 3, false, 0); break;  // ╹
+        case 0x257a: half_hline(c, 3, true, 0); break;  // ╺
+        case 0x257b: half_vline(c, 3, true, 0); break;  // ╻
+        case 0x257c: half_hline(c, 1, false, 0); half_hline(c, 3, true, 0); break;  // ╼
+        case 0x257d: half_vline(c, 1, false, 0); half_vline(c, 3, true, 0); break;  // ╽
+        case 0x257e: half_hline(c, 3, false, 0); half_hline(c, 1, true, 0); break;  // ╾
+        case 0x257f: half_vline(c, 3, false, 0); half_vline(c, 1, true, 0); break;  // ╿
+        case 0xe0b0: triangle(c, true); break;
+        case 0xe0b2: triangle(c, false); break;
+        case 0xe0b4: return D(c, true);
+        case 0xe0b6: return D(c, false);
+        case 0xe0b1: half_cross_line(c, TOP_LEFT); half_cross_line(c, BOTTOM_LEFT); break;
+        case 0xe0b3: half_cross_line(c, TOP_RIGHT); half_cross_line(c, BOTTOM_RIGHT); break;
+        case 0xe0b8: corner_triangle(c, BOTTOM_LEFT); break;
+        case 0xe0ba: corner_triangle(c, BOTTOM_RIGHT); break;
+        case 0xe0bc: corner_triangle(c, TOP_LEFT); break;
+        case 0xe0be: corner_triangle(c, TOP_RIGHT); break;
+        case 0x2550: dhline(c, 1, BOTH_LINES); break;  // ═
+        case 0x2551: dvline(c, 1, BOTH_LINES); break;  // ║
+        case 0x255e: vline(c, 1); half_dhline(c, 1, true, BOTH_LINES); break;  // ╞
+        case 0x2561: vline(c, 1); half_dhline(c, 1, false, BOTH_LINES); break;  // ╡
+        case 0x2565: hline(c, 1); half_dvline(c, 1, true, BOTH_LINES); break;  // ╥
+        case 0x2568: hline(c, 1); half_dvline(c, 1, false, BOTH_LINES); break;  // ╨
+        case 0x256a: vline(c, 1); half_dhline(c, 1, false, BOTH_LINES); half_dhline(c, 1, true, BOTH_LINES); break;  // ╪
+        case 0x256b: hline(c, 1); half_dvline(c, 1, false, BOTH_LINES); half_dvline(c, 1, true, BOTH_LINES); break;  // ╫
+        case 0x256c:  // ╬
+            inner_corner(c, true, true); inner_corner(c, true, false); inner_corner(c, false, true); inner_corner(c, false, false); break;
+        case 0x2560: inner_corner(c, true, false); inner_corner(c, false, false); dvline(c, 1, FIRST_LINE_ONLY); break;  // ╠
+        case 0x2563: inner_corner(c, true, true); inner_corner(c, false, true); dvline(c, 1, SECOND_LINE_ONLY); break;  // ╣
+        case 0x2566: inner_corner(c, false, true); inner_corner(c, false, false); dhline(c, 1, FIRST_LINE_ONLY); break;  // ╦
+        case 0x2569: inner_corner(c, true, true); inner_corner(c, true, false); dhline(c, 1, SECOND_LINE_ONLY); break;  // ╩
+        case 0x2571: cross_line(c, false); break;  // ╱
+        case 0x2572: cross_line(c, true); break;  // ╲
+        case 0x2573: cross_line(c, true); cross_line(c, false); break;  // ╳
+        case 0x2580: vblock(c, 1./2, false); break;  // ▀
+        case 0x2581 ... 0x2588: vblock(c, (ch - 0x2580) / 8., true); break;  // ▁ to █
+        case 0x2589 ... 0x258f: hblock(c, (0x2590 - ch) / 8., false); break;  // ▉ to ▏
+        case 0x2590: hblock(c, 1./2, true); break;  // ▐
+        case 0x2591: shade(c, true, false); break;  // ░
+        case 0x2592: shade(c, false, false); break;  // ▒
+        case 0x2593: shade(c, false, true); break;  // ▓
+        case 0x2594: vblock(c, 1./8, false); break;  // ▔
+        case 0x2595: hblock(c, 1./8, true); break;  // ▕
+        case 0x2596: quad(c, false, true); break;  // ▖
+        case 0x2597: quad(c, true, true); break;  // ▗
+        case 0x2598: quad(c, false, false); break;  // ▘
+        case 0x2599: quad(c, false, false); quad(c, false, true); quad(c, true, true); break;  // ▙
+        case 0x259a: quad(c, false, false); quad(c, true, true); break;  // ▚
+        case 0x259b: quad(c, false, false); quad(c, true, false); quad(c, false, true); break;  // ▛
+        case 0x259c: quad(c, false, false); quad(c, true, true); quad(c, true, false); break;  // ▜
+        case 0x259d: quad(c, true, false); break;  // ▝
+        case 0x259e: quad(c, true, false); quad(c, false, true); break;  // ▞
+        case 0x259f: quad(c, true, false); quad(c, false, true); quad(c, true, true); break;  // ▟
+        case 0x250c ... 0x251b: {  // ┌ ┐ └ ┘ and their heavy variants
+            unsigned int i = (ch - 0x250c) % 4;
+            corner(c, corner_levels[i][0], corner_levels[i][1], ch - i);
+        } break;
+        case 0x256d: corner(c, 1, 1, 0x250c); break;  // ╭
+        case 0x256e: corner(c, 1, 1, 0x2510); break;  // ╮
+        case 0x256f: corner(c, 1, 1, 0x2518); break;  // ╯
+        case 0x2570: corner(c, 1, 1, 0x2514); break;  // ╰
+        case 0x253c ... 0x254b: {  // ┼ and its variants
+            const uint8_t *l = cross_levels[ch - 0x253c];
+            cross(c, l[0], l[1], l[2], l[3]);
+        } break;
+        case 0x251c ... 0x252b: {  // ├ ┤ and their variants
+            unsigned int i = (ch - 0x251c) % 8;
+            const uint8_t *l = vert_t_levels[i];
+            vert_t(c, l[0], l[1], l[2], ch - i);
+        } break;
+        case 0x252c ... 0x253b: {  // ┬ ┴ and their variants
+            unsigned int i = (ch - 0x252c) % 8;
+            const uint8_t *l = horz_t_levels[i];
+            horz_t(c, l[0], l[1], l[2], ch - i);
+        } break;
+        case 0x2552: case 0x2555: case 0x2558: case 0x255b:  // ╒ ╕ ╘ ╛
+            dvcorner(c, ch); break;
+        case 0x2553: case 0x2556: case 0x2559: case 0x255c:  // ╓ ╖ ╙ ╜
+            dhcorner(c, ch); break;
+        case 0x2554: case 0x2557: case 0x255a: case 0x255d:  // ╔ ╗ ╚ ╝
+            dcorner(c, ch); break;
+        case 0x255f: case 0x2562: case 0x2564: case 0x2567:  // ╟ ╢ ╤ ╧
+            dpip(c, ch); break;
+        default:
+            return false;
+    }
+END_ALLOW_CASE_RANGE
+    return true;
+}
+
+#undef T
+#undef F
+
+// Pre-rendered sprites {{{
+
+static void
+add_line(Canvas *c, int position, int thickness) {
+    int y = position - thickness / 2;
+    while (thickness > 0 && -1 < y && y < c->height) {
+        thickness--;
+        memset(c->mask + c->width * y, 255, c->width);
+        y++;
+    }
+}
+
+static void
+add_dline(Canvas *c, int position, int thickness) {
+    int y1 = MIN(position - thickness, c->height - 1), y2 = MIN(position, c->height - 1);
+    int top = MIN(y1, y2), bottom = MAX(y1, y2), deficit = 2 - (bottom - top);
+    if (deficit > 0) {
+        if (bottom + deficit < c->height) bottom += deficit;
+        else if (bottom < c->height - 1) {
+            bottom += 1;
+            if (deficit > 1) top -= deficit - 1;
+        } else top -= deficit;
+    }
+    top = MAX(0, MIN(top, c->height - 1));
+    bottom = MAX(0, MIN(bottom, c->height - 1));
+    memset(c->mask + c->width * top, 255, c->width);
+    memset(c->mask + c->width * bottom, 255, c->width);
+}
+
+static void
+add_curl(Canvas *c, int position, int thickness) {
+    int max_x = c->width - 1, max_y = c->height - 1, half_height = MAX(thickness / 2, 1);
+    double xfactor = 2.0 * M_PI / max_x;
+    // Ensure all space at bottom of cell is used
+    if (position + half_height < max_y) position += max_y - (position + half_height);
+    if (position + half_height > max_y) position -= position + half_height - max_y;
+#define add_intensity(x, y, val) { \
+    int idx = c->width * MIN(y + position, max_y) + x; \
+    if (idx >= 0) c->mask[idx] = MIN(255, c->mask[idx] + val); \
+}
+    // Use the Wu antialias algorithm to draw the curve
+    // cosine waves always have slope <= 1 so are never steep
+    for (int x = 0; x < c->width; x++) {
+        double y = half_height * cos(x * xfactor);
+        int y1 = (int)floor(y), y2 = (int)ceil(y), i1 = (int)(255 * fabs(y - y1));
+        add_intensity(x, y1, 255 - i1);
+        add_intensity(x, y2, i1);
+    }
+#undef add_intensity
+}
+
+static void
+missing_glyph(Canvas *c) {
+    int hgap = thickness(c, 0) + 1, vgap = thickness(c, 0) + 1;
+    draw_hline(c, hgap, c->width - hgap + 1, vgap, 0);
+    draw_hline(c, hgap, c->width - hgap + 1, c->height - vgap, 0);
+    draw_vline(c, vgap, c->height - vgap + 1, hgap, 0);
+    draw_vline(c, vgap, c->height - vgap + 1, c->width - hgap, 0);
+}
+
+static void
+cursor_vert(Canvas *c, bool left, double width_pt, double dpi_x) {
+    int width = MAX(1, (int)nearbyint(width_pt * dpi_x / 72.0)), start = left ? 0 : MAX(0, c->width - width);
+    for (int y = 0; y < c->height; y++) {
+        for (int x = start; x < start + width; x++) set_pixel(c, x, y, 255);
+    }
+}
+
+static void
+cursor_horz(Canvas *c, bool top, double height_pt, double dpi_y) {
+    int height = MAX(1, (int)nearbyint(height_pt * dpi_y / 72.0)), start = top ? 0 : MAX(0, c->height - height);
+    for (int y = start; y < start + height && y < c->height; y++) memset(c->mask + y * c->width, 255, c->width);
+}
+
+void
+render_prerendered_sprites(uint8_t *buf, unsigned int cell_width, unsigned int cell_height, unsigned int baseline, unsigned int underline_position, unsigned int underline_thickness, double dpi_x, double dpi_y) {
+    const size_t sz = (size_t)cell_width * cell_height;
+    Canvas cv = {.mask = buf, .width = cell_width, .height = cell_height, .dpi = (dpi_x + dpi_y) / 2.0}, *c = &cv;
+    memset(buf, 0, sz * NUM_PRERENDERED_SPRITES);
+    int upos = MIN((int)underline_position, c->height - (int)underline_thickness), t = MAX(1, MIN(c->height - upos - 1, (int)underline_thickness));
+    add_line(c, upos, underline_thickness); c->mask += sz;
+    add_dline(c, upos, t); c->mask += sz;
+    add_curl(c, upos, t); c->mask += sz;
+    add_line(c, (int)(0.65 * baseline), underline_thickness); c->mask += sz;
+    missing_glyph(c); c->mask += sz;
+    cursor_vert(c, true, 1.5, dpi_x); c->mask += sz;  // beam
+    cursor_horz(c, false, 2.0, dpi_y); c->mask += sz;  // underline
+    // hollow
+    cursor_vert(c, true, 1, dpi_x); cursor_vert(c, false, 1, dpi_x); cursor_horz(c, true, 1, dpi_y); cursor_horz(c, false, 1, dpi_y);
+}
+
+// }}}
+
+// Boilerplate {{{
+
+static PyObject*
+set_box_drawing_scale(PyObject UNUSED *self, PyObject *args) {
+    double s[arraysz(scale)];
+    if (!PyArg_ParseTuple(args, "(dddd)", s, s + 1, s + 2, s + 3)) return NULL;
+    memcpy(scale, s, sizeof(scale));
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+draw_box_char(PyObject UNUSED *self, PyObject *args) {
+    unsigned int ch, width, height;
+    double dpi = 96.0;
+    if (!PyArg_ParseTuple(args, "III|d", &ch, &width, &height, &dpi)) return NULL;
+    if (!is_box_drawing_char(ch)) { PyErr_Format(PyExc_KeyError, "U+%X is not a box drawing character", ch); return NULL; }
+    PyObject *ans = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)width * height);
+    if (!ans) return NULL;
+    memset(PyBytes_AS_STRING(ans), 0, PyBytes_GET_SIZE(ans));
+    if (!render_box_char(ch, (uint8_t*)PyBytes_AS_STRING(ans), width, height, dpi)) {
+        Py_DECREF(ans);
+        PyErr_Format(PyExc_ValueError, "Failed to render U+%X at width=%u and height=%u", ch, width, height);
+        return NULL;
+    }
+    return ans;
+}
+
+static PyObject*
+draw_prerendered_sprites(PyObject UNUSED *self, PyObject *args) {
+    unsigned int cell_width, cell_height, baseline, underline_position, underline_thickness;
+    double dpi_x, dpi_y;
+    if (!PyArg_ParseTuple(args, "IIIIIdd", &cell_width, &cell_height, &baseline, &underline_position, &underline_thickness, &dpi_x, &dpi_y)) return NULL;
+    const size_t sz = (size_t)cell_width * cell_height;
+    uint8_t *buf = malloc(sz * NUM_PRERENDERED_SPRITES);
+    if (!buf) return PyErr_NoMemory();
+    render_prerendered_sprites(buf, cell_width, cell_height, baseline, underline_position, underline_thickness, dpi_x, dpi_y);
+    PyObject *ans = PyTuple_New(NUM_PRERENDERED_SPRITES);
+    for (size_t i = 0; ans && i < NUM_PRERENDERED_SPRITES; i++) {
+        PyObject *b = PyBytes_FromStringAndSize((const char*)buf + i * sz, sz);
+        if (!b) { Py_CLEAR(ans); break; }
+        PyTuple_SET_ITEM(ans, i, b);
+    }
+    free(buf);
+    return ans;
+}
+
+static PyMethodDef module_methods[] = {
+    METHODB(set_box_drawing_scale, METH_VARARGS),
+    METHODB(draw_box_char, METH_VARARGS),
+    METHODB(draw_prerendered_sprites, METH_VARARGS),
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+bool
+init_decorations(PyObject *module) {
+    if (PyModule_AddFunctions(module, module_methods) != 0) return false;
+    return true;
+}
+
+// }}}
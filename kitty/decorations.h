@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+
+// underline, double underline, curly underline, strikethrough, missing glyph,
+// beam cursor, underline cursor, hollow cursor
+#define NUM_PRERENDERED_SPRITES 8u
+
+bool is_box_drawing_char(char_type ch);
+bool render_box_char(char_type ch, uint8_t *buf, unsigned int width, unsigned int height, double dpi);
+void render_prerendered_sprites(uint8_t *buf, unsigned int cell_width, unsigned int cell_height, unsigned int baseline, unsigned int underline_position, unsigned int underline_thickness, double dpi_x, double dpi_y);
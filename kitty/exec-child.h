@@ -0,0 +1,104 @@
+/*
+ * exec-child.h
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+// The part of spawning a child that runs in the child process. It is used by
+// children forked by spawn() in child.c and by the exec helper in the
+// launcher, which children spawned with vfork() semantics exec, as they must
+// not block, or modify the memory they share with kitty, before they exec.
+// Uses only signal-safe functions (man 7 signal-safety)
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+// argv of the exec helper is: launcher, EXEC_CHILD_ARG, cwd, tty name, slave
+// fd, stdin read fd, ready read fd, exe, argv of the child
+#define EXEC_CHILD_ARG "+exec-child"
+#define EXEC_CHILD_NUM_ARGS 8
+
+static inline void
+write_to_stderr(const char *text) {
+    size_t sz = strlen(text);
+    size_t written = 0;
+    while(written < sz) {
+        ssize_t amt = write(2, text + written, sz - written);
+        if (amt == 0) break;
+        if (amt < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            break;
+        }
+        written += amt;
+    }
+}
+
+#define exit_on_err(m) { write_to_stderr(m); write_to_stderr(": "); write_to_stderr(strerror(errno)); exit(EXIT_FAILURE); }
+
+static inline void
+close_in_child(int fd) { while(close(fd) != 0 && errno == EINTR); }
+
+static inline void
+wait_for_terminal_ready(int fd) {
+    char data;
+    while(1) {
+        int ret = read(fd, &data, 1);
+        if (ret == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+        break;
+    }
+}
+
+static inline void
+exec_child(const char *exe, char *const argv[], const char *cwd, const char *tty_name, int slave, int stdin_read_fd, int ready_read_fd) {
+    if (chdir(cwd) != 0) { if (chdir("/") != 0) {} };  // ignore failure to chdir to /
+    if (setsid() == -1) exit_on_err("setsid() in child process failed");
+
+    // Establish the controlling terminal (see man 7 credentials)
+    int tfd = open(tty_name, O_RDWR);
+    if (tfd == -1) exit_on_err("Failed to open controlling terminal");
+#ifdef TIOCSCTTY
+    // On BSD open() does not establish the controlling terminal
+    if (ioctl(tfd, TIOCSCTTY, 0) == -1) exit_on_err("Failed to set controlling terminal with TIOCSCTTY");
+#endif
+    close_in_child(tfd);
+
+    // Redirect stdin/stdout/stderr to the pty
+    if (dup2(slave, 1) == -1) exit_on_err("dup2() failed for fd number 1");
+    if (dup2(slave, 2) == -1) exit_on_err("dup2() failed for fd number 2");
+    if (stdin_read_fd > -1) {
+        if (dup2(stdin_read_fd, 0) == -1) exit_on_err("dup2() failed for fd number 0");
+        close_in_child(stdin_read_fd);
+    } else {
+        if (dup2(slave, 0) == -1) exit_on_err("dup2() failed for fd number 0");
+    }
+    close_in_child(slave);
+
+    // Wait for READY_SIGNAL which indicates kitty has setup the screen object
+    wait_for_terminal_ready(ready_read_fd);
+    close_in_child(ready_read_fd);
+
+    // Close any extra fds inherited from parent
+    for (int c = 3; c < 201; c++) close_in_child(c);
+
+    // for some reason SIGPIPE is set to SIG_IGN, so reset it, needed by bash,
+    // which does not reset signal handlers on its own
+    signal(SIGPIPE, SIG_DFL);
+    execvp(exe, argv);
+    // Report the failure and exec a shell instead, so that we are not left
+    // with a forked but not exec'ed process
+    write_to_stderr("Failed to launch child: ");
+    write_to_stderr(argv[0]);
+    write_to_stderr("\nWith error: ");
+    write_to_stderr(strerror(errno));
+    write_to_stderr("\nPress Enter to exit.\n");
+    execlp("sh", "sh", "-c", "read w", NULL);
+    exit(EXIT_FAILURE);
+}
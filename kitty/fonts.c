@@ -9,6 +9,8 @@
 #include "fonts.h"
 #include "state.h"
 #include "emoji.h"
+#include "glyph-cache.h"
+#include "decorations.h"
 #include "unicode-data.h"
 
 #define MISSING_GLYPH 4
@@ -18,6 +20,7 @@
 
 typedef void (*send_sprite_to_gpu_func)(FONTS_DATA_HANDLE fg, unsigned int, unsigned int, unsigned int, pixel*);
 send_sprite_to_gpu_func current_send_sprite_to_gpu = NULL;
+FontRenderTimes font_render_times = {0};
 static PyObject *python_send_to_gpu_impl = NULL;
 extern PyTypeObject Line_Type;
 
@@ -28,6 +31,7 @@ enum {NO_FONT=-3, MISSING_FONT=-2, BLANK_FONT=-1, BOX_FONT=0};
 typedef struct {
     glyph_index data[MAX_NUM_EXTRA_GLYPHS];
 } ExtraGlyphs;
+_Static_assert(sizeof(ExtraGlyphs) == sizeof(((GlyphCacheKey*)0)->extra_glyphs), "The glyph cache key must be able to store all extra glyphs");
 
 typedef struct SpritePosition SpritePosition;
 struct SpritePosition {
@@ -70,6 +74,8 @@ typedef struct {
 
 static SymbolMap *symbol_maps = NULL;
 static size_t num_symbol_maps = 0;
+static char *glyph_cache_dir = NULL;
+static uint64_t glyph_cache_salt = 0;
 
 
 
@@ -81,8 +87,23 @@ typedef struct {
     size_t num_hb_features;
     SpecialGlyphCache special_glyph_cache[SPECIAL_GLYPH_CACHE_SIZE];
     bool bold, italic, emoji_presentation;
+    uint64_t cache_key;
 } Font;
 
+typedef struct {
+    uint64_t key;
+    int32_t font_idx;
+    uint32_t fallback_fonts_count;
+    bool is_fallback_font;
+} FontCacheEntry;
+
+typedef struct {
+    FontCacheEntry *entries;
+    size_t capacity, count;
+    // The fallback fonts checked again for text that no font had
+    unsigned long long hits, misses, rechecked_fonts;
+} FontCache;
+
 typedef struct {
     FONTS_DATA_HEAD
     id_type id;
@@ -92,6 +113,8 @@ typedef struct {
     Font *fonts;
     pixel *canvas;
     GPUSpriteTracker sprite_tracker;
+    GlyphCache *glyph_cache;
+    FontCache font_cache;
 } FontGroup;
 
 static FontGroup* font_groups = NULL;
@@ -339,6 +362,70 @@ sprite_tracker_set_layout(GPUSpriteTracker *sprite_tracker, unsigned int cell_wi
 }
 // }}}
 
+// Glyph cache {{{
+
+static inline void
+open_glyph_cache(FontGroup *fg) {
+    if (!glyph_cache_dir) return;
+    double vals[] = {fg->font_sz_in_pts, fg->logical_dpi_x, fg->logical_dpi_y, fg->cell_width, fg->cell_height, fg->baseline, fg->underline_position, fg->underline_thickness};
+    uint64_t key = glyph_cache_hash(glyph_cache_salt, vals, sizeof(vals));
+    fg->glyph_cache = glyph_cache_open(glyph_cache_dir, key, fg->cell_width, fg->cell_height);
+}
+
+static inline void
+glyph_cache_key_for(GlyphCacheKey *key, uint64_t face, glyph_index glyph, ExtraGlyphs *extra_glyphs, uint8_t ligature_index) {
+    zero_at_ptr(key);
+    key->face = face; key->glyph = glyph; key->ligature_index = ligature_index;
+    // Only the glyphs up to the terminator identify the sprite, the slots
+    // after it are left zeroed so that keys of the same sprite are identical
+    if (extra_glyphs) {
+        for (size_t i = 0; i < MAX_NUM_EXTRA_GLYPHS && extra_glyphs->data[i]; i++) key->extra_glyphs[i] = extra_glyphs->data[i];
+    }
+}
+
+static inline const pixel*
+cached_sprite(FontGroup *fg, uint64_t face, SpritePosition *sp, uint32_t *flags) {
+    GlyphCacheKey key;
+    glyph_cache_key_for(&key, face, sp->glyph, &sp->extra_glyphs, sp->ligature_index);
+    return glyph_cache_get(fg->glyph_cache, &key, flags);
+}
+
+static inline void
+cache_sprite(FontGroup *fg, uint64_t face, SpritePosition *sp, const pixel *buf) {
+    GlyphCacheKey key;
+    glyph_cache_key_for(&key, face, sp->glyph, &sp->extra_glyphs, sp->ligature_index);
+    glyph_cache_put(fg->glyph_cache, &key, sp->colored ? GLYPH_CACHE_COLORED : 0, buf);
+}
+
+#define MAX_PRERENDERED_SPRITES 32u
+
+static inline size_t
+prerendered_sprites_from_glyph_cache(FontGroup *fg, const pixel **ans) {
+    // The number of prerendered sprites is stored in the flags of the first one
+    GlyphCacheKey key;
+    uint32_t flags = 0;
+    if (!fg->glyph_cache) return 0;
+    glyph_cache_key_for(&key, GLYPH_CACHE_PRERENDERED_FACE, 0, NULL, 0);
+    if (!(ans[0] = glyph_cache_get(fg->glyph_cache, &key, &flags))) return 0;
+    size_t num = flags >> 8;
+    if (!num || num > MAX_PRERENDERED_SPRITES) return 0;
+    for (size_t i = 1; i < num; i++) {
+        glyph_cache_key_for(&key, GLYPH_CACHE_PRERENDERED_FACE, i, NULL, 0);
+        if (!(ans[i] = glyph_cache_get(fg->glyph_cache, &key, &flags))) return 0;
+    }
+    return num;
+}
+
+static inline void
+cache_prerendered_sprite(FontGroup *fg, size_t idx, size_t num, const pixel *buf) {
+    GlyphCacheKey key;
+    if (num > MAX_PRERENDERED_SPRITES) return;
+    glyph_cache_key_for(&key, GLYPH_CACHE_PRERENDERED_FACE, idx, NULL, 0);
+    glyph_cache_put(fg->glyph_cache, &key, idx ? 0 : num << 8, buf);
+}
+
+// }}}
+
 static inline PyObject*
 desc_to_face(PyObject *desc, FONTS_DATA_HANDLE fg) {
     PyObject *d = specialize_font_descriptor(desc, fg);
@@ -363,6 +450,7 @@ init_font(Font *f, PyObject *face, bool bold, bool italic, bool emoji_presentati
         copy_hb_feature(f, LIGA_FEATURE); copy_hb_feature(f, DLIG_FEATURE);
     }
     copy_hb_feature(f, CALT_FEATURE);
+    f->cache_key = glyph_cache_dir ? glyph_cache_face_key(face, bold, italic, emoji_presentation) : 0;
     return true;
 }
 
@@ -375,6 +463,8 @@ del_font(Font *f) {
 
 static inline void
 del_font_group(FontGroup *fg) {
+    glyph_cache_close(fg->glyph_cache); fg->glyph_cache = NULL;
+    free(fg->font_cache.entries); zero_at_ptr(&fg->font_cache);
     free(fg->canvas); fg->canvas = NULL;
     fg->sprite_map = free_sprite_map(fg->sprite_map);
     for (size_t i = 0; i < fg->fonts_count; i++) del_font(fg->fonts + i);
@@ -536,12 +626,121 @@ fallback_font(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell) {
 
 static inline ssize_t
 in_symbol_maps(FontGroup *fg, char_type ch) {
-    for (size_t i = 0; i < num_symbol_maps; i++) {
-        if (symbol_maps[i].left <= ch && ch <= symbol_maps[i].right) return fg->first_symbol_font_idx + symbol_maps[i].font_idx;
+    // symbol_maps is sorted and non-overlapping
+    size_t lo = 0, hi = num_symbol_maps;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ch < symbol_maps[mid].left) hi = mid;
+        else if (ch > symbol_maps[mid].right) lo = mid + 1;
+        else return fg->first_symbol_font_idx + symbol_maps[mid].font_idx;
     }
     return NO_FONT;
 }
 
+// Font cache {{{
+// Maps the text of a cell and its bold/italic/emoji presentation to the font
+// used to render it, including negative (MISSING_FONT) results, so that the
+// fonts and fontconfig do not have to be queried for every cell. Output with
+// many distinct characters, such as random bytes, would grow it without
+// bound, so it is emptied once it has FONT_CACHE_MAX_ENTRIES.
+
+#define FONT_CACHE_MAX_ENTRIES 16384u
+
+_Static_assert(sizeof(((CPUCell*)0)->cc_idx) == 2 * sizeof(uint16_t), "Update font_cache_key() for the new number of combining chars");
+
+static inline uint64_t
+font_cache_key(CPUCell *cell, bool bold, bool italic, bool emoji_presentation) {
+    return (1ull << 63) | ((uint64_t)emoji_presentation << 55) | ((uint64_t)italic << 54) | ((uint64_t)bold << 53) |
+        ((uint64_t)cell->cc_idx[1] << 37) | ((uint64_t)cell->cc_idx[0] << 21) | (cell->ch & 0x1fffff);
+}
+
+static inline FontCacheEntry*
+font_cache_probe(FontCache *c, uint64_t key) {
+    uint64_t h = key ^ (key >> 33);
+    h *= 0xff51afd7ed558ccdull; h ^= h >> 33;
+    size_t mask = c->capacity - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        if (c->entries[i].key == key || !c->entries[i].key) return c->entries + i;
+    }
+}
+
+static inline FontCacheEntry*
+font_cache_find(FontCache *c, uint64_t key) {
+    if (!c->capacity) return NULL;
+    FontCacheEntry *e = font_cache_probe(c, key);
+    return e->key ? e : NULL;
+}
+
+static inline void
+font_cache_insert(FontCache *c, uint64_t key, ssize_t font_idx, bool is_fallback_font, size_t fallback_fonts_count) {
+    if (c->count >= FONT_CACHE_MAX_ENTRIES) {
+        memset(c->entries, 0, c->capacity * sizeof(FontCacheEntry));
+        c->count = 0;
+    }
+    if ((c->count + 1) * 4 > c->capacity * 3) {
+        FontCache n = {.capacity = c->capacity ? 2 * c->capacity : 256};
+        n.entries = calloc(n.capacity, sizeof(FontCacheEntry));
+        if (!n.entries) return;
+        for (size_t i = 0; i < c->capacity; i++) {
+            if (c->entries[i].key) *font_cache_probe(&n, c->entries[i].key) = c->entries[i];
+        }
+        free(c->entries);
+        c->entries = n.entries; c->capacity = n.capacity;
+    }
+    FontCacheEntry *e = font_cache_probe(c, key);
+    if (!e->key) c->count++;
+    e->key = key; e->font_idx = font_idx; e->is_fallback_font = is_fallback_font; e->fallback_fonts_count = fallback_fonts_count;
+}
+
+// }}}
+
+
+static inline ssize_t
+font_for_text(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell, bool is_emoji_presentation, bool *is_fallback_font) {
+    ssize_t ans = -1;
+    switch(BI_VAL(gpu_cell->attrs)) {
+        case 0:
+            ans = fg->medium_font_idx; break;
+        case 1:
+            ans = fg->bold_font_idx ; break;
+        case 2:
+            ans = fg->italic_font_idx; break;
+        case 3:
+            ans = fg->bi_font_idx; break;
+    }
+    if (ans < 0) ans = fg->medium_font_idx;
+    if (!is_emoji_presentation && has_cell_text(fg->fonts + ans, cpu_cell)) return ans;
+    *is_fallback_font = true;
+    return fallback_font(fg, cpu_cell, gpu_cell);
+}
+
+static inline ssize_t
+cached_font_for_text(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell, bool is_emoji_presentation, bool *is_fallback_font) {
+    bool bold = (gpu_cell->attrs >> BOLD_SHIFT) & 1;
+    bool italic = (gpu_cell->attrs >> ITALIC_SHIFT) & 1;
+    uint64_t key = font_cache_key(cpu_cell, bold, italic, is_emoji_presentation);
+    FontCacheEntry *e = font_cache_find(&fg->font_cache, key);
+    if (e) {
+        fg->font_cache.hits++;
+        if (e->font_idx == MISSING_FONT && e->fallback_fonts_count != fg->fallback_fonts_count) {
+            // Fallback fonts loaded since this result was cached might have the text
+            for (size_t i = e->fallback_fonts_count, j = fg->first_fallback_font_idx + i; i < fg->fallback_fonts_count; i++, j++) {
+                Font *ff = fg->fonts + j;
+                fg->font_cache.rechecked_fonts++;
+                if (ff->bold == bold && ff->italic == italic && ff->emoji_presentation == is_emoji_presentation && has_cell_text(ff, cpu_cell)) {
+                    e->font_idx = j; break;
+                }
+            }
+            e->fallback_fonts_count = fg->fallback_fonts_count;
+        }
+        *is_fallback_font = e->is_fallback_font;
+        return e->font_idx;
+    }
+    fg->font_cache.misses++;
+    ssize_t ans = font_for_text(fg, cpu_cell, gpu_cell, is_emoji_presentation, is_fallback_font);
+    font_cache_insert(&fg->font_cache, key, ans, *is_fallback_font, fg->fallback_fonts_count);
+    return ans;
+}
 
 // Decides which 'font' to use for a given cell.
 //
@@ -574,21 +773,8 @@ START_ALLOW_CASE_RANGE
         default:
             ans = in_symbol_maps(fg, cpu_cell->ch);
             if (ans > -1) return ans;
-            switch(BI_VAL(gpu_cell->attrs)) {
-                case 0:
-                    ans = fg->medium_font_idx; break;
-                case 1:
-                    ans = fg->bold_font_idx ; break;
-                case 2:
-                    ans = fg->italic_font_idx; break;
-                case 3:
-                    ans = fg->bi_font_idx; break;
-            }
-            if (ans < 0) ans = fg->medium_font_idx;
             *is_emoji_presentation = has_emoji_presentation(cpu_cell, gpu_cell);
-            if (!*is_emoji_presentation && has_cell_text(fg->fonts + ans, cpu_cell)) return ans;
-            *is_fallback_font = true;
-            return fallback_font(fg, cpu_cell, gpu_cell);
+            return cached_font_for_text(fg, cpu_cell, gpu_cell, *is_emoji_presentation, is_fallback_font);
     }
 END_ALLOW_CASE_RANGE
 }
@@ -613,7 +799,7 @@ START_ALLOW_CASE_RANGE
 END_ALLOW_CASE_RANGE
 }
 
-static PyObject* box_drawing_function = NULL, *prerender_function = NULL, *descriptor_for_idx = NULL;
+static PyObject *descriptor_for_idx = NULL;
 
 void
 render_alpha_mask(uint8_t *alpha_mask, pixel* dest, Region *src_rect, Region *dest_rect, size_t src_stride, size_t dest_stride) {
@@ -643,14 +829,26 @@ render_box_cell(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell) {
     if (sp->rendered) return;
     sp->rendered = true;
     sp->colored = false;
-    PyObject *ret = PyObject_CallFunction(box_drawing_function, "IIId", cpu_cell->ch, fg->cell_width, fg->cell_height, (fg->logical_dpi_x + fg->logical_dpi_y) / 2.0);
-    if (ret == NULL) { PyErr_Print(); return; }
-    uint8_t *alpha_mask = PyLong_AsVoidPtr(PyTuple_GET_ITEM(ret, 0));
+    uint32_t flags;
+    const pixel *cached = cached_sprite(fg, GLYPH_CACHE_BOX_FACE, sp, &flags);
+    if (cached) {
+        current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sp->x, sp->y, sp->z, (pixel*)cached);
+        return;
+    }
+    uint8_t *alpha_mask = calloc(fg->cell_width, fg->cell_height);
+    if (alpha_mask == NULL) fatal("Out of memory rendering box drawing character");
+    monotonic_t start = monotonic();
+    TRACE_BEGIN("render_box_char");
+    bool ok = render_box_char(cpu_cell->ch, alpha_mask, fg->cell_width, fg->cell_height, (fg->logical_dpi_x + fg->logical_dpi_y) / 2.0);
+    TRACE_END("render_box_char");
+    font_render_times.rasterization += monotonic() - start;
+    if (!ok) log_error("Failed to render the box drawing character: U+%x at cell_width=%u and cell_height=%u", cpu_cell->ch, fg->cell_width, fg->cell_height);
     clear_canvas(fg);
     Region r = { .right = fg->cell_width, .bottom = fg->cell_height };
     render_alpha_mask(alpha_mask, fg->canvas, &r, &r, fg->cell_width, fg->cell_width);
+    free(alpha_mask);
     current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sp->x, sp->y, sp->z, fg->canvas);
-    Py_DECREF(ret);
+    if (ok) cache_sprite(fg, GLYPH_CACHE_BOX_FACE, sp, fg->canvas);
 }
 
 static inline void
@@ -701,9 +899,29 @@ render_group(FontGroup *fg, unsigned int num_cells, unsigned int num_glyphs, CPU
         return;
     }
 
+    if (fg->glyph_cache && font->cache_key) {
+        static const pixel* cached[arraysz(sprite_position)];
+        uint32_t flags[arraysz(sprite_position)];
+        unsigned int num_cached = 0;
+        while (num_cached < num_cells && (cached[num_cached] = cached_sprite(fg, font->cache_key, sprite_position[num_cached], flags + num_cached))) num_cached++;
+        if (num_cached == num_cells) {
+            for (unsigned int i = 0; i < num_cells; i++) {
+                sprite_position[i]->rendered = true;
+                sprite_position[i]->colored = (flags[i] & GLYPH_CACHE_COLORED) != 0;
+                set_cell_sprite(gpu_cells + i, sprite_position[i]);
+                current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sprite_position[i]->x, sprite_position[i]->y, sprite_position[i]->z, (pixel*)cached[i]);
+            }
+            return;
+        }
+    }
+
     clear_canvas(fg);
     bool was_colored = (gpu_cells->attrs & WIDTH_MASK) == 2 && is_emoji(cpu_cells->ch);
+    monotonic_t start = monotonic();
+    TRACE_BEGIN("render_glyphs");
     render_glyphs_in_cells(font->face, font->bold, font->italic, info, positions, num_glyphs, fg->canvas, fg->cell_width, fg->cell_height, num_cells, fg->baseline, &was_colored, (FONTS_DATA_HANDLE)fg, center_glyph);
+    TRACE_END("render_glyphs");
+    font_render_times.rasterization += monotonic() - start;
     if (PyErr_Occurred()) PyErr_Print();
 
     for (unsigned int i = 0; i < num_cells; i++) {
@@ -712,6 +930,7 @@ render_group(FontGroup *fg, unsigned int num_cells, unsigned int num_glyphs, CPU
         set_cell_sprite(gpu_cells + i, sprite_position[i]);
         pixel *buf = num_cells == 1 ? fg->canvas : extract_cell_from_canvas(fg, i, num_cells);
         current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sprite_position[i]->x, sprite_position[i]->y, sprite_position[i]->z, buf);
+        if (font->cache_key) cache_sprite(fg, font->cache_key, sprite_position[i], buf);
     }
 
 }
@@ -847,7 +1066,11 @@ check_cell_consumed(CellData *cell_data, CPUCell *last_cpu_cell) {
 
 static inline void
 shape_run(CPUCell *first_cpu_cell, GPUCell *first_gpu_cell, index_type num_cells, Font *font, bool disable_ligature) {
+    monotonic_t start = monotonic();
+    TRACE_BEGIN("shape");
     shape(first_cpu_cell, first_gpu_cell, num_cells, harfbuzz_font_for_face(font->face), font, disable_ligature);
+    TRACE_END("shape");
+    font_render_times.shaping += monotonic() - start;
 #if 0
         static char dbuf[1024];
         // You can also generate this easily using hb-shape --show-extents --cluster-level=1 --shapers=ot /path/to/font/file text
@@ -991,17 +1214,14 @@ split_run_at_offset(index_type cursor_offset, index_type *left, index_type *righ
 static inline void
 render_groups(FontGroup *fg, Font *font, bool center_glyph) {
     unsigned idx = 0;
-    ExtraGlyphs ed;
     while (idx <= G(group_idx)) {
         Group *group = G(groups) + idx;
         if (!group->num_cells) break;
+        ExtraGlyphs ed = {{0}};
         /* printf("Group: idx: %u num_cells: %u num_glyphs: %u first_glyph_idx: %u first_cell_idx: %u total_num_glyphs: %zu\n", */
         /*         idx, group->num_cells, group->num_glyphs, group->first_glyph_idx, group->first_cell_idx, group_state.num_glyphs); */
         glyph_index primary = group->num_glyphs ? G(info)[group->first_glyph_idx].codepoint : 0;
-        unsigned int i;
-        int last = -1;
-        for (i = 1; i < MIN(arraysz(ed.data) + 1, group->num_glyphs); i++) { last = i - 1; ed.data[last] = G(info)[group->first_glyph_idx + i].codepoint; }
-        if ((size_t)(last + 1) < arraysz(ed.data)) ed.data[last + 1] = 0;
+        for (unsigned int i = 1; i < MIN(arraysz(ed.data) + 1, group->num_glyphs); i++) ed.data[i - 1] = G(info)[group->first_glyph_idx + i].codepoint;
         // We dont want to render the spaces in a space ligature because
         // there exist stupid fonts like Powerline that have no space glyph,
         // so special case it: https://github.com/kovidgoyal/kitty/issues/1225
@@ -1174,6 +1394,46 @@ clear_symbol_maps(void) {
     if (symbol_maps) { free(symbol_maps); symbol_maps = NULL; num_symbol_maps = 0; }
 }
 
+static int
+cmp_boundaries(const void *a_, const void *b_) {
+    uint64_t a = *(const uint64_t*)a_, b = *(const uint64_t*)b_;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static inline bool
+normalize_symbol_maps(SymbolMap **maps, size_t *count) {
+    // Convert the symbol maps into sorted, non-overlapping ranges suitable for
+    // binary search. Where ranges overlap, the one specified first wins, as it
+    // would with a linear scan.
+    SymbolMap *symbol_maps = *maps;
+    size_t num_symbol_maps = *count;
+    if (!num_symbol_maps) return true;
+    uint64_t *boundaries = malloc(2 * num_symbol_maps * sizeof(uint64_t));
+    SymbolMap *ans = malloc(2 * num_symbol_maps * sizeof(SymbolMap));
+    if (!boundaries || !ans) { free(boundaries); free(ans); return false; }
+    size_t nb = 0, num = 0;
+    for (size_t i = 0; i < num_symbol_maps; i++) {
+        boundaries[nb++] = symbol_maps[i].left;
+        boundaries[nb++] = (uint64_t)symbol_maps[i].right + 1;
+    }
+    qsort(boundaries, nb, sizeof(uint64_t), cmp_boundaries);
+    for (size_t b = 0; b + 1 < nb; b++) {
+        if (boundaries[b] == boundaries[b + 1]) continue;
+        char_type left = boundaries[b], right = boundaries[b + 1] - 1;
+        for (size_t i = 0; i < num_symbol_maps; i++) {
+            if (symbol_maps[i].left <= left && left <= symbol_maps[i].right) {
+                if (num && ans[num - 1].font_idx == symbol_maps[i].font_idx && ans[num - 1].right + 1 == left) ans[num - 1].right = right;
+                else ans[num++] = (SymbolMap){.left = left, .right = right, .font_idx = symbol_maps[i].font_idx};
+                break;
+            }
+        }
+    }
+    free(boundaries);
+    free(symbol_maps);
+    *maps = ans; *count = num;
+    return true;
+}
+
 typedef struct {
     unsigned int main, bold, italic, bi, num_symbol_fonts;
 } DescriptorIndices;
@@ -1183,23 +1443,25 @@ DescriptorIndices descriptor_indices = {0};
 static PyObject*
 set_font_data(PyObject UNUSED *m, PyObject *args) {
     PyObject *sm;
-    Py_CLEAR(box_drawing_function); Py_CLEAR(prerender_function); Py_CLEAR(descriptor_for_idx);
-    if (!PyArg_ParseTuple(args, "OOOIIIIO!d",
-                &box_drawing_function, &prerender_function, &descriptor_for_idx,
+    Py_CLEAR(descriptor_for_idx);
+    if (!PyArg_ParseTuple(args, "OIIIIO!d",
+                &descriptor_for_idx,
                 &descriptor_indices.bold, &descriptor_indices.italic, &descriptor_indices.bi, &descriptor_indices.num_symbol_fonts,
                 &PyTuple_Type, &sm, &global_state.font_sz_in_pts)) return NULL;
-    Py_INCREF(box_drawing_function); Py_INCREF(prerender_function); Py_INCREF(descriptor_for_idx);
+    Py_INCREF(descriptor_for_idx);
     free_font_groups();
     clear_symbol_maps();
-    num_symbol_maps = PyTuple_GET_SIZE(sm);
-    symbol_maps = calloc(num_symbol_maps, sizeof(SymbolMap));
+    size_t num = PyTuple_GET_SIZE(sm);
+    symbol_maps = calloc(num, sizeof(SymbolMap));
     if (symbol_maps == NULL) return PyErr_NoMemory();
-    for (size_t s = 0; s < num_symbol_maps; s++) {
+    for (size_t s = 0; s < num; s++) {
         unsigned int left, right, font_idx;
         SymbolMap *x = symbol_maps + s;
         if (!PyArg_ParseTuple(PyTuple_GET_ITEM(sm, s), "III", &left, &right, &font_idx)) return NULL;
         x->left = left; x->right = right; x->font_idx = font_idx;
     }
+    num_symbol_maps = num;
+    if (!normalize_symbol_maps(&symbol_maps, &num_symbol_maps)) return PyErr_NoMemory();
     Py_RETURN_NONE;
 }
 
@@ -1212,20 +1474,33 @@ send_prerendered_sprites(FontGroup *fg) {
     current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, x, y, z, fg->canvas);
     do_increment(fg, &error);
     if (error != 0) { sprite_map_set_error(error); PyErr_Print(); fatal("Failed"); }
-    PyObject *args = PyObject_CallFunction(prerender_function, "IIIIIdd", fg->cell_width, fg->cell_height, fg->baseline, fg->underline_position, fg->underline_thickness, fg->logical_dpi_x, fg->logical_dpi_y);
-    if (args == NULL) { PyErr_Print(); fatal("Failed to pre-render cells"); }
-    for (ssize_t i = 0; i < PyTuple_GET_SIZE(args) - 1; i++) {
+    const pixel *cached[MAX_PRERENDERED_SPRITES];
+    size_t num_cached = prerendered_sprites_from_glyph_cache(fg, cached);
+    const size_t sz = fg->cell_width * fg->cell_height;
+    uint8_t *alpha_masks = NULL;
+    if (!num_cached) {
+        alpha_masks = malloc(sz * NUM_PRERENDERED_SPRITES);
+        if (alpha_masks == NULL) fatal("Out of memory pre-rendering cells");
+        render_prerendered_sprites(alpha_masks, fg->cell_width, fg->cell_height, fg->baseline, fg->underline_position, fg->underline_thickness, fg->logical_dpi_x, fg->logical_dpi_y);
+    }
+    size_t num = num_cached ? num_cached : NUM_PRERENDERED_SPRITES;
+    for (size_t i = 0; i < num; i++) {
         x = fg->sprite_tracker.x; y = fg->sprite_tracker.y; z = fg->sprite_tracker.z;
         if (y > 0) { fatal("Too many pre-rendered sprites for your GPU or the font size is too large"); }
         do_increment(fg, &error);
         if (error != 0) { sprite_map_set_error(error); PyErr_Print(); fatal("Failed"); }
-        uint8_t *alpha_mask = PyLong_AsVoidPtr(PyTuple_GET_ITEM(args, i));
+        if (num_cached) {
+            current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, x, y, z, (pixel*)cached[i]);
+            continue;
+        }
+        uint8_t *alpha_mask = alpha_masks + i * sz;
         clear_canvas(fg);
         Region r = { .right = fg->cell_width, .bottom = fg->cell_height };
         render_alpha_mask(alpha_mask, fg->canvas, &r, &r, fg->cell_width, fg->cell_width);
         current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, x, y, z, fg->canvas);
+        cache_prerendered_sprite(fg, i, num, fg->canvas);
     }
-    Py_CLEAR(args);
+    free(alpha_masks);
 }
 
 static inline size_t
@@ -1265,6 +1540,7 @@ initialize_font_group(FontGroup *fg) {
     }
 #undef I
     calc_cell_metrics(fg);
+    open_glyph_cache(fg);
 }
 
 
@@ -1287,8 +1563,7 @@ static void
 finalize(void) {
     Py_CLEAR(python_send_to_gpu_impl);
     clear_symbol_maps();
-    Py_CLEAR(box_drawing_function);
-    Py_CLEAR(prerender_function);
+    free(glyph_cache_dir); glyph_cache_dir = NULL;
     Py_CLEAR(descriptor_for_idx);
     free_font_groups();
     if (harfbuzz_buffer) { hb_buffer_destroy(harfbuzz_buffer); harfbuzz_buffer = NULL; }
@@ -1429,6 +1704,67 @@ create_test_font_group(PyObject *self UNUSED, PyObject *args) {
     return Py_BuildValue("II", fg->cell_width, fg->cell_height);
 }
 
+static PyObject*
+set_glyph_cache_dir(PyObject *self UNUSED, PyObject *args) {
+    const char *path = NULL, *salt = "";
+    if (!PyArg_ParseTuple(args, "z|s", &path, &salt)) return NULL;
+    free(glyph_cache_dir); glyph_cache_dir = NULL;
+    if (path) {
+        glyph_cache_dir = strdup(path);
+        if (!glyph_cache_dir) return PyErr_NoMemory();
+    }
+    glyph_cache_salt = glyph_cache_hash(0, salt, strlen(salt));
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+glyph_cache_statistics(PYNOARG) {
+    GlyphCacheStats *s = glyph_cache_stats();
+    return Py_BuildValue("{sKsKsK}", "hits", s->hits, "misses", s->misses, "stored", s->stored);
+}
+
+static PyObject*
+font_cache_statistics(PYNOARG) {
+    if (!num_font_groups) { PyErr_SetString(PyExc_RuntimeError, "must create font group first"); return NULL; }
+    FontCache *c = &font_groups->font_cache;
+    return Py_BuildValue("{sKsKsKsn}", "hits", c->hits, "misses", c->misses, "rechecked_fonts", c->rechecked_fonts, "fallback_fonts", (Py_ssize_t)font_groups->fallback_fonts_count);
+}
+
+static PyObject*
+test_normalize_symbol_maps(PyObject *self UNUSED, PyObject *args) {
+    PyObject *sm;
+    if (!PyArg_ParseTuple(args, "O!", &PyTuple_Type, &sm)) return NULL;
+    size_t num = PyTuple_GET_SIZE(sm);
+    SymbolMap *maps = calloc(MAX(1u, num), sizeof(SymbolMap));
+    if (!maps) return PyErr_NoMemory();
+    for (size_t i = 0; i < num; i++) {
+        unsigned int left, right, font_idx;
+        if (!PyArg_ParseTuple(PyTuple_GET_ITEM(sm, i), "III", &left, &right, &font_idx)) { free(maps); return NULL; }
+        maps[i] = (SymbolMap){.left = left, .right = right, .font_idx = font_idx};
+    }
+    if (!normalize_symbol_maps(&maps, &num)) { free(maps); return PyErr_NoMemory(); }
+    PyObject *ans = PyTuple_New(num);
+    for (size_t i = 0; ans && i < num; i++) {
+        PyObject *m = Py_BuildValue("IIn", maps[i].left, maps[i].right, (Py_ssize_t)maps[i].font_idx);
+        if (!m) { Py_CLEAR(ans); break; }
+        PyTuple_SET_ITEM(ans, i, m);
+    }
+    free(maps);
+    return ans;
+}
+
+static PyObject*
+test_font_cache_bound(PyObject *self UNUSED, PyObject *args) {
+    // Insert distinct keys into an empty font cache, returning its number of
+    // entries and capacity afterwards
+    unsigned long long num;
+    if (!PyArg_ParseTuple(args, "K", &num)) return NULL;
+    FontCache c = {0};
+    for (unsigned long long i = 0; i < num; i++) font_cache_insert(&c, (1ull << 63) | i, 0, false, 0);
+    free(c.entries);
+    return Py_BuildValue("nn", (Py_ssize_t)c.count, (Py_ssize_t)c.capacity);
+}
+
 static PyObject*
 free_font_data(PyObject *self UNUSED, PyObject *args UNUSED) {
     finalize();
@@ -1447,6 +1783,11 @@ static PyMethodDef module_methods[] = {
     METHODB(current_fonts, METH_NOARGS),
     METHODB(test_render_line, METH_VARARGS),
     METHODB(get_fallback_font, METH_VARARGS),
+    METHODB(set_glyph_cache_dir, METH_VARARGS),
+    METHODB(glyph_cache_statistics, METH_NOARGS),
+    METHODB(font_cache_statistics, METH_NOARGS),
+    METHODB(test_normalize_symbol_maps, METH_VARARGS),
+    METHODB(test_font_cache_bound, METH_VARARGS),
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
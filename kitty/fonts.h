@@ -18,6 +18,17 @@ typedef struct {
     size_t width, height;
 } StringCanvas;
 
+typedef struct {
+    const char *path;
+    int index, hinting, hintstyle;
+} FaceIdentity;
+
+// Time spent rendering text, accumulated across all font groups
+typedef struct {
+    monotonic_t shaping, rasterization, sprite_upload;
+} FontRenderTimes;
+extern FontRenderTimes font_render_times;
+
 // API that font backends need to implement
 typedef uint16_t glyph_index;
 unsigned int glyph_id_for_codepoint(PyObject *, char_type);
@@ -32,6 +43,7 @@ PyObject* specialize_font_descriptor(PyObject *base_descriptor, FONTS_DATA_HANDL
 PyObject* face_from_path(const char *path, int index, FONTS_DATA_HANDLE);
 PyObject* face_from_descriptor(PyObject*, FONTS_DATA_HANDLE);
 const char* postscript_name_for_face(const PyObject*);
+bool identity_for_face(PyObject*, FaceIdentity*);
 
 void sprite_tracker_current_layout(FONTS_DATA_HANDLE data, unsigned int *x, unsigned int *y, unsigned int *z);
 void render_alpha_mask(uint8_t *alpha_mask, pixel* dest, Region *src_rect, Region *dest_rect, size_t src_stride, size_t dest_stride);
@@ -4,13 +4,18 @@
 
 #
 # NOTE: to add a new glyph, add an entry to the `box_chars` dict, then update
-# the functions `font_for_cell` and `box_glyph_id` in `kitty/fonts.c`.
+# the functions `font_for_cell` and `box_glyph_id` in `kitty/fonts.c` and
+# `is_box_drawing_char` and `render_box_char` in `kitty/decorations.c`.
+# The glyphs are rendered by the native code, this module is the reference
+# implementation it is tested against.
 #
 
 import math
 from functools import partial as p
 from itertools import repeat
 
+from kitty.fast_data_types import set_box_drawing_scale
+
 scale = (0.001, 1, 1.5, 2)
 _dpi = 96.0
 
@@ -18,6 +23,7 @@ _dpi = 96.0
 def set_scale(new_scale):
     global scale
     scale = tuple(new_scale)
+    set_box_drawing_scale(scale)
 
 
 def thickness(level=1, horizontal=True):
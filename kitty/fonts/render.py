@@ -3,16 +3,18 @@
 # License: GPL v3 Copyright: 2016, Kovid Goyal <kovid at kovidgoyal.net>
 
 import ctypes
+import os
 import sys
+import time
 from functools import partial
 from math import ceil, pi, cos, floor
 
 from kitty.config import defaults
-from kitty.constants import is_macos
+from kitty.constants import cache_dir, is_macos, str_version
 from kitty.fast_data_types import (
     Screen, create_test_font_group, get_fallback_font, set_font_data,
-    set_options, set_send_sprite_to_gpu, sprite_map_set_limits,
-    test_render_line, test_shape
+    set_glyph_cache_dir, set_options, set_send_sprite_to_gpu,
+    sprite_map_set_limits, test_render_line, test_shape
 )
 from kitty.fonts.box_drawing import render_box_char, render_missing_glyph
 from kitty.utils import log_error
@@ -83,9 +85,37 @@ def dump_faces(ftypes, indices):
             log_error(face_str(face))
 
 
-def set_font_family(opts=None, override_font_size=None, debug_font_matching=False):
+def prune_glyph_cache(path, max_age=30 * 24 * 3600):
+    # Cache files are touched whenever they are used, remove the stale ones
+    # left behind by font sizes, fonts and kitty versions no longer in use
+    now = time.time()
+    for x in os.listdir(path):
+        if x.endswith('.glyphs'):
+            q = os.path.join(path, x)
+            try:
+                if now - os.stat(q).st_mtime > max_age:
+                    os.remove(q)
+            except OSError:
+                pass
+
+
+def glyph_cache_dir():
+    ans = os.path.join(cache_dir(), 'glyphs')
+    try:
+        os.makedirs(ans, exist_ok=True)
+        prune_glyph_cache(ans)
+    except OSError as err:
+        log_error('Failed to create the glyph cache directory: {} with error: {}'.format(ans, err))
+        return
+    return ans
+
+
+def set_font_family(opts=None, override_font_size=None, debug_font_matching=False, glyph_cache=None):
     global current_faces
     opts = opts or defaults
+    # The rendering of box drawing and pre-rendered sprites depends on the
+    # kitty version and options, so they are part of the cache key
+    set_glyph_cache_dir(glyph_cache, '{} {}'.format(str_version, opts.box_drawing_scale))
     sz = override_font_size or opts.font_size
     font_map = get_font_files(opts)
     current_faces = [(font_map['medium'], False, False)]
@@ -101,7 +131,7 @@ def set_font_family(opts=None, override_font_size=None, debug_font_matching=Fals
     if debug_font_matching:
         dump_faces(ftypes, indices)
     set_font_data(
-        render_box_drawing, prerender_function, descriptor_for_idx,
+        descriptor_for_idx,
         indices['bold'], indices['italic'], indices['bi'], num_symbol_fonts,
         sm, sz
     )
@@ -221,6 +251,11 @@ def render_cursor(which, cell_width=0, cell_height=0, dpi_x=0, dpi_y=0):
     return ans
 
 
+# The pre-rendered and box drawing sprites are rendered by native code in
+# kitty/decorations.c, the functions below are the reference implementations
+# it is tested against.
+
+
 def prerender_function(cell_width, cell_height, baseline, underline_position, underline_thickness, dpi_x, dpi_y):
     # Pre-render the special underline, strikethrough and missing and cursor cells
     f = partial(
@@ -242,8 +277,8 @@ def render_box_drawing(codepoint, cell_width, cell_height, dpi):
 
 class setup_for_testing:
 
-    def __init__(self, family='monospace', size=11.0, dpi=96.0):
-        self.family, self.size, self.dpi = family, size, dpi
+    def __init__(self, family='monospace', size=11.0, dpi=96.0, glyph_cache=None):
+        self.family, self.size, self.dpi, self.glyph_cache = family, size, dpi, glyph_cache
 
     def __enter__(self):
         from collections import OrderedDict
@@ -257,7 +292,7 @@ class setup_for_testing:
         sprite_map_set_limits(100000, 100)
         set_send_sprite_to_gpu(send_to_gpu)
         try:
-            set_font_family(opts)
+            set_font_family(opts, glyph_cache=self.glyph_cache)
             cell_width, cell_height = create_test_font_group(self.size, self.dpi, self.dpi)
             return sprites, cell_width, cell_height
         except Exception:
@@ -268,10 +303,12 @@ class setup_for_testing:
         set_send_sprite_to_gpu(None)
 
 
-def render_string(text, family='monospace', size=11.0, dpi=96.0):
-    with setup_for_testing(family, size, dpi) as (sprites, cell_width, cell_height):
+def render_string(text, family='monospace', size=11.0, dpi=96.0, glyph_cache=None, italic=False):
+    with setup_for_testing(family, size, dpi, glyph_cache) as (sprites, cell_width, cell_height):
         s = Screen(None, 1, len(text)*2)
         line = s.line(0)
+        if italic:
+            s.select_graphic_rendition(3)
         s.draw(text)
         test_render_line(line)
     cells = []
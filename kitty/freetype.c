@@ -279,6 +279,16 @@ postscript_name_for_face(const PyObject *face_) {
     return ps_name ? ps_name : "";
 }
 
+bool
+identity_for_face(PyObject *face_, FaceIdentity *ans) {
+    Face *self = (Face*)face_;
+    if (!self->path || !PyUnicode_Check(self->path)) return false;
+    ans->path = PyUnicode_AsUTF8(self->path);
+    if (!ans->path) { PyErr_Clear(); return false; }
+    ans->index = self->index; ans->hinting = self->hinting; ans->hintstyle = self->hintstyle;
+    return true;
+}
+
 static inline unsigned int
 calc_cell_width(Face *self) {
     unsigned int ans = 0;
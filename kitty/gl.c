@@ -171,10 +171,38 @@ unbind_program(void) {
 
 // Buffers {{{
 
+// Buffers that are re-written every time their contents change, such as the
+// cell data buffers, are streamed through a ring of slots. When
+// ARB_buffer_storage is available the ring is allocated once as immutable
+// storage and persistently mapped, and a slot is only re-used after the fence
+// inserted by the last draw that read from it has signalled. Otherwise, the
+// buffer is orphaned on every update so that the driver can hand out fresh
+// storage instead of stalling on the draw that is still reading the old one.
+#define NUM_STREAMING_SLOTS 3u
+#define STREAMING_SLOT_ALIGNMENT 256
+
+typedef struct {
+    GLint location, size;
+    GLenum data_type;
+    GLsizei stride;
+    uintptr_t offset;
+} StreamingAttribute;
+
+typedef struct {
+    bool persistent;
+    GLsizeiptr slot_size;
+    unsigned int slot;
+    uint8_t *mapping;
+    GLsync fences[NUM_STREAMING_SLOTS];
+    StreamingAttribute attributes[4];
+    size_t num_attributes;
+} StreamingBuffer;
+
 typedef struct {
     GLuint id;
     GLsizeiptr size;
     GLenum usage;
+    StreamingBuffer *streaming;
 } Buffer;
 
 
@@ -197,11 +225,20 @@ create_buffer(GLenum usage) {
     return -1;
 }
 
+static void
+free_streaming_buffer(StreamingBuffer *s) {
+    for (size_t i = 0; i < NUM_STREAMING_SLOTS; i++) {
+        if (s->fences[i]) { glDeleteSync(s->fences[i]); s->fences[i] = NULL; }
+    }
+    free(s);
+}
+
 static void
 delete_buffer(ssize_t buf_idx) {
     glDeleteBuffers(1, &(buffers[buf_idx].id));
     buffers[buf_idx].id = 0;
     buffers[buf_idx].size = 0;
+    if (buffers[buf_idx].streaming) { free_streaming_buffer(buffers[buf_idx].streaming); buffers[buf_idx].streaming = NULL; }
 }
 
 static GLuint
@@ -274,13 +311,18 @@ add_buffer_to_vao(ssize_t vao_idx, GLenum usage) {
     return vao->num_buffers - 1;
 }
 
-static void
-add_located_attribute_to_vao(ssize_t vao_idx, GLint aloc, GLint size, GLenum data_type, GLsizei stride, void *offset, GLuint divisor) {
-    VAO *vao = vaos + vao_idx;
-    if (!vao->num_buffers) fatal("You must create a buffer for this attribute first");
-    ssize_t buf = vao->buffers[vao->num_buffers - 1];
-    bind_buffer(buf);
-    glEnableVertexAttribArray(aloc);
+size_t
+add_streaming_buffer_to_vao(ssize_t vao_idx) {
+    size_t bufnum = add_buffer_to_vao(vao_idx, GL_ARRAY_BUFFER);
+    Buffer *b = buffers + vaos[vao_idx].buffers[bufnum];
+    b->streaming = calloc(1, sizeof(StreamingBuffer));
+    if (!b->streaming) fatal("Out of memory allocating streaming buffer");
+    b->streaming->persistent = GLAD_GL_ARB_buffer_storage != 0;
+    return bufnum;
+}
+
+static inline void
+set_attribute_pointer(GLint aloc, GLint size, GLenum data_type, GLsizei stride, void *offset) {
     switch(data_type) {
         case GL_BYTE:
         case GL_UNSIGNED_BYTE:
@@ -294,6 +336,21 @@ add_located_attribute_to_vao(ssize_t vao_idx, GLint aloc, GLint size, GLenum dat
             glVertexAttribPointer(aloc, size, data_type, GL_FALSE, stride, offset);
             break;
     }
+}
+
+static void
+add_located_attribute_to_vao(ssize_t vao_idx, GLint aloc, GLint size, GLenum data_type, GLsizei stride, void *offset, GLuint divisor) {
+    VAO *vao = vaos + vao_idx;
+    if (!vao->num_buffers) fatal("You must create a buffer for this attribute first");
+    ssize_t buf = vao->buffers[vao->num_buffers - 1];
+    StreamingBuffer *s = buffers[buf].streaming;
+    if (s) {
+        if (s->num_attributes >= arraysz(s->attributes)) fatal("Too many attributes in a single streaming buffer");
+        s->attributes[s->num_attributes++] = (StreamingAttribute){.location=aloc, .size=size, .data_type=data_type, .stride=stride, .offset=(uintptr_t)offset};
+    }
+    bind_buffer(buf);
+    glEnableVertexAttribArray(aloc);
+    set_attribute_pointer(aloc, size, data_type, stride, offset);
     if (divisor) {
         glVertexAttribDivisor(aloc, divisor);
     }
@@ -363,4 +420,81 @@ unmap_vao_buffer(ssize_t vao_idx, size_t bufnum) {
     unbind_buffer(buf_idx);
 }
 
+static inline void
+wait_for_fence(GLsync *fence) {
+    if (!*fence) return;
+    // Flush the command stream so the fence is guaranteed to signal
+    while (glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(*fence); *fence = NULL;
+}
+
+static inline void
+allocate_persistent_storage(Buffer *b, GLsizeiptr slot_size) {
+    StreamingBuffer *s = b->streaming;
+    // Immutable storage cannot be resized, so replace the buffer object
+    if (s->mapping) {
+        for (size_t i = 0; i < NUM_STREAMING_SLOTS; i++) wait_for_fence(s->fences + i);
+        glDeleteBuffers(1, &b->id);
+        glGenBuffers(1, &b->id);
+        glBindBuffer(b->usage, b->id);
+        s->mapping = NULL;
+    }
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    s->slot_size = slot_size;
+    b->size = slot_size * NUM_STREAMING_SLOTS;
+    glBufferStorage(b->usage, b->size, NULL, flags);
+    s->mapping = glMapBufferRange(b->usage, 0, b->size, flags);
+    if (!s->mapping) fatal("Failed to persistently map a streaming buffer");
+}
+
+void*
+map_streaming_vao_buffer(ssize_t vao_idx, size_t bufnum, GLsizeiptr size) {
+    ssize_t buf_idx = vaos[vao_idx].buffers[bufnum];
+    Buffer *b = buffers + buf_idx;
+    StreamingBuffer *s = b->streaming;
+    bind_buffer(buf_idx);
+    if (!s->persistent) {
+        // Orphan the previous storage, the driver will allocate fresh storage
+        // if the old one is still in use by a pending draw
+        b->size = size;
+        glBufferData(b->usage, size, NULL, GL_STREAM_DRAW);
+        return glMapBufferRange(b->usage, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    if (s->slot_size < size || !s->mapping) {
+        allocate_persistent_storage(b, (size + STREAMING_SLOT_ALIGNMENT - 1) & ~((GLsizeiptr)STREAMING_SLOT_ALIGNMENT - 1));
+        s->slot = 0;
+    } else s->slot = (s->slot + 1) % NUM_STREAMING_SLOTS;
+    wait_for_fence(s->fences + s->slot);
+    return s->mapping + s->slot * s->slot_size;
+}
+
+void
+unmap_streaming_vao_buffer(ssize_t vao_idx, size_t bufnum) {
+    ssize_t buf_idx = vaos[vao_idx].buffers[bufnum];
+    StreamingBuffer *s = buffers[buf_idx].streaming;
+    if (s->persistent) {
+        // Point the attributes at the slot that was just written, this also
+        // re-attaches them if the buffer object was replaced when growing
+        uintptr_t base = s->slot * s->slot_size;
+        glBindVertexArray(vaos[vao_idx].id);
+        for (size_t i = 0; i < s->num_attributes; i++) {
+            StreamingAttribute *a = s->attributes + i;
+            set_attribute_pointer(a->location, a->size, a->data_type, a->stride, (void*)(base + a->offset));
+        }
+        glBindVertexArray(0);
+    } else unmap_buffer(buf_idx);
+    unbind_buffer(buf_idx);
+}
+
+void
+fence_vao_buffers(ssize_t vao_idx) {
+    VAO *vao = vaos + vao_idx;
+    for (size_t i = 0; i < vao->num_buffers; i++) {
+        StreamingBuffer *s = buffers[vao->buffers[i]].streaming;
+        if (!s || !s->persistent || !s->mapping) continue;
+        if (s->fences[s->slot]) glDeleteSync(s->fences[s->slot]);
+        s->fences[s->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
 // }}}
@@ -217,10 +217,19 @@ dpi_change_callback(GLFWwindow *w, float x_scale UNUSED, float y_scale UNUSED) {
     OSWindow *window = global_state.callback_os_window;
     window->live_resize.in_progress = true; global_state.has_pending_resizes = true;
     window->live_resize.last_resize_event_at = monotonic();
+    window->monitor_changed = true;
     global_state.callback_os_window = NULL;
     request_tick_callback();
 }
 
+static void
+window_pos_callback(GLFWwindow *w, int x UNUSED, int y UNUSED) {
+    if (!set_callback_window(w)) return;
+    // The window may have moved to a monitor with a different refresh rate
+    global_state.callback_os_window->monitor_changed = true;
+    global_state.callback_os_window = NULL;
+}
+
 static void
 refresh_callback(GLFWwindow *w) {
     if (!set_callback_window(w)) return;
@@ -633,7 +642,8 @@ create_os_window(PyObject UNUSED *self, PyObject *args) {
     if (logo.pixels && logo.width && logo.height) glfwSetWindowIcon(glfw_window, 1, &logo);
     glfwSetCursor(glfw_window, standard_cursor);
     update_os_window_viewport(w, false);
-    // missing pos callback
+    w->monitor_changed = true;
+    glfwSetWindowPosCallback(glfw_window, window_pos_callback);
     // missing size callback
     glfwSetWindowCloseCallback(glfw_window, window_close_callback);
     glfwSetWindowRefreshCallback(glfw_window, refresh_callback);
@@ -979,6 +989,33 @@ should_os_window_close(OSWindow* w) {
     return glfwWindowShouldClose(w->handle) ? true : false;
 }
 
+void
+update_os_window_frame_interval(OSWindow *w) {
+    // Use the refresh rate of the monitor the center of the window is on.
+    // Window positions are not available on Wayland, there the first monitor
+    // is used.
+    w->monitor_changed = false;
+    w->frame_interval = 0;
+    int count = 0, x = 0, y = 0, width = 0, height = 0;
+    GLFWmonitor **monitors = glfwGetMonitors(&count);
+    if (!monitors || !count) return;
+    if (!global_state.is_wayland) {
+        glfwGetWindowPos(w->handle, &x, &y);
+        glfwGetWindowSize(w->handle, &width, &height);
+        x += width / 2; y += height / 2;
+    }
+    const GLFWvidmode *mode = NULL;
+    for (int i = 0; i < count; i++) {
+        const GLFWvidmode *m = glfwGetVideoMode(monitors[i]);
+        if (!m) continue;
+        if (!mode) mode = m;
+        int mx = 0, my = 0;
+        glfwGetMonitorPos(monitors[i], &mx, &my);
+        if (mx <= x && x < mx + m->width && my <= y && y < my + m->height) { mode = m; break; }
+    }
+    if (mode && mode->refreshRate > 0) w->frame_interval = s_to_monotonic_t(1ll) / mode->refreshRate;
+}
+
 static PyObject*
 primary_monitor_size(PYNOARG) {
     GLFWmonitor* monitor = glfwGetPrimaryMonitor();
@@ -1166,6 +1203,73 @@ stop_main_loop(void) {
     glfwStopMainLoop();
 }
 
+typedef struct {
+    PyObject *fired;
+    id_type id;
+    unsigned long idx, remaining, *pending;
+} TestTimer;
+
+static void
+test_timer_fired(id_type timer_id, void *data) {
+    TestTimer *t = data;
+    PyObject *idx = PyLong_FromUnsignedLong(t->idx);
+    if (idx) { PyList_Append(t->fired, idx); Py_DECREF(idx); }
+    if (!--t->remaining) {
+        // Repeating timers are removed from their own callback
+        remove_main_loop_timer(timer_id);
+        if (!--*t->pending) stop_main_loop();
+    }
+}
+
+static void
+test_timeout(id_type timer_id UNUSED, void *data UNUSED) { stop_main_loop(); }
+
+static void
+test_tick(void *data UNUSED) {}
+
+static PyObject*
+test_main_loop_timers(PyObject UNUSED *self, PyObject *args) {
+    // Run the main loop until the timers (interval, number of times to fire)
+    // have fired, after applying the updates (index, interval, enabled) and
+    // removing the timers whose indices are in remove. Returns the indices
+    // of the timers in the order they fired. Needs glfw_init().
+    PyObject *timers, *updates, *remove;
+    if (!PyArg_ParseTuple(args, "O!O!O!", &PyTuple_Type, &timers, &PyTuple_Type, &updates, &PyTuple_Type, &remove)) return NULL;
+    size_t num = PyTuple_GET_SIZE(timers);
+    TestTimer *t = calloc(MAX(1u, num), sizeof(TestTimer));
+    PyObject *fired = PyList_New(0);
+    if (!t || !fired) { free(t); Py_CLEAR(fired); return PyErr_NoMemory(); }
+    unsigned long pending = 0;
+    for (size_t i = 0; i < num; i++) {
+        double interval;
+        if (!PyArg_ParseTuple(PyTuple_GET_ITEM(timers, i), "dk", &interval, &t[i].remaining)) goto end;
+        t[i].fired = fired; t[i].idx = i; t[i].pending = &pending;
+        t[i].id = add_main_loop_timer(s_double_to_monotonic_t(interval), true, test_timer_fired, t + i, NULL);
+        pending++;
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(updates); i++) {
+        unsigned long idx; double interval; int enabled;
+        if (!PyArg_ParseTuple(PyTuple_GET_ITEM(updates, i), "kdp", &idx, &interval, &enabled)) goto end;
+        if (idx >= num) { PyErr_SetString(PyExc_IndexError, "Timer index out of range"); goto end; }
+        update_main_loop_timer(t[idx].id, s_double_to_monotonic_t(interval), enabled);
+        if (!enabled) pending--;
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(remove); i++) {
+        unsigned long idx = PyLong_AsUnsignedLong(PyTuple_GET_ITEM(remove, i));
+        if (PyErr_Occurred()) goto end;
+        if (idx >= num) { PyErr_SetString(PyExc_IndexError, "Timer index out of range"); goto end; }
+        remove_main_loop_timer(t[idx].id); t[idx].id = 0;
+        pending--;
+    }
+    id_type timeout = add_main_loop_timer(s_double_to_monotonic_t(10), false, test_timeout, NULL, NULL);
+    if (pending) run_main_loop(test_tick, NULL);
+    remove_main_loop_timer(timeout);
+end:
+    for (size_t i = 0; i < num; i++) { if (t[i].id && t[i].remaining) remove_main_loop_timer(t[i].id); }
+    free(t);
+    if (PyErr_Occurred()) Py_CLEAR(fired);
+    return fired;
+}
 
 static PyObject*
 test_empty_event(PYNOARG) {
@@ -1198,6 +1302,7 @@ static PyMethodDef module_methods[] = {
     METHODB(x11_display, METH_NOARGS),
     METHODB(x11_window_id, METH_O),
     METHODB(set_primary_selection, METH_VARARGS),
+    METHODB(test_main_loop_timers, METH_VARARGS),
 #ifndef __APPLE__
     METHODB(dbus_send_notification, METH_VARARGS),
 #endif
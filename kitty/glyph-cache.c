@@ -0,0 +1,216 @@
+/*
+ * glyph-cache.c
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+// A persistent, on-disk cache of rendered sprites. There is one file per font
+// group (font size, DPI and cell metrics). The file is an append-only sequence
+// of fixed size records, each a key followed by the pixels of a single cell.
+// Existing records are memory mapped when the font group is created, new
+// records are appended as glyphs are rendered.
+
+#include "glyph-cache.h"
+#include "fonts.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define MAGIC "KITTYGC"
+#define FORMAT_VERSION 1u
+#define MAX_FILE_SIZE (64u * 1024u * 1024u)
+
+typedef struct {
+    char magic[8];
+    uint32_t version, cell_width, cell_height, reserved;
+    uint64_t key;
+} FileHeader;
+
+typedef struct {
+    GlyphCacheKey key;
+    uint32_t flags, reserved;
+} RecordHeader;
+
+typedef struct {
+    const RecordHeader *record;
+    uint32_t next;
+} Entry;
+
+struct GlyphCache {
+    int fd;
+    uint8_t *map;
+    size_t map_sz, record_sz;
+    unsigned int cell_width, cell_height;
+    uint64_t key;
+    bool full;
+    Entry *entries;
+    uint32_t *buckets, num_buckets;
+};
+
+static GlyphCacheStats stats = {0};
+
+GlyphCacheStats*
+glyph_cache_stats(void) { return &stats; }
+
+uint64_t
+glyph_cache_hash(uint64_t h, const void *data, size_t sz) {
+    // FNV-1a
+    const uint8_t *p = data;
+    if (!h) h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sz; i++) { h ^= p[i]; h *= 0x100000001b3ull; }
+    return h;
+}
+
+uint64_t
+glyph_cache_face_key(PyObject *face, bool bold, bool italic, bool emoji_presentation) {
+    // The style of the font is part of the key as the same face can be used
+    // for several styles, and rendering depends on the style, for example
+    // italic glyphs are trimmed differently
+    FaceIdentity fi = {0};
+    if (!identity_for_face(face, &fi) || !fi.path || !fi.path[0]) return 0;
+    struct stat s;
+    if (stat(fi.path, &s) != 0) return 0;
+    int64_t vals[] = {s.st_size, s.st_mtime, s.st_ino, fi.index, fi.hinting, fi.hintstyle, bold, italic, emoji_presentation};
+    uint64_t h = glyph_cache_hash(0, fi.path, strlen(fi.path));
+    h = glyph_cache_hash(h, vals, sizeof(vals));
+    // Ensure the key cannot clash with the reserved face keys
+    return h < 16 ? h + 16 : h;
+}
+
+static inline uint32_t
+bucket_for(GlyphCache *self, const GlyphCacheKey *key) {
+    return glyph_cache_hash(0, key, sizeof(GlyphCacheKey)) & (self->num_buckets - 1);
+}
+
+static inline bool
+build_index(GlyphCache *self) {
+    size_t num = (self->map_sz - sizeof(FileHeader)) / self->record_sz;
+    self->num_buckets = 16;
+    while (self->num_buckets < 2 * num) self->num_buckets *= 2;
+    self->buckets = calloc(self->num_buckets, sizeof(self->buckets[0]));
+    self->entries = calloc(num + 1, sizeof(self->entries[0]));
+    if (!self->buckets || !self->entries) return false;
+    for (size_t i = 0; i < num; i++) {
+        Entry *e = self->entries + i + 1;
+        e->record = (const RecordHeader*)(self->map + sizeof(FileHeader) + i * self->record_sz);
+        uint32_t b = bucket_for(self, &e->record->key);
+        e->next = self->buckets[b];
+        self->buckets[b] = i + 1;
+    }
+    return true;
+}
+
+static inline bool
+header_is_valid(const FileHeader *h, GlyphCache *self) {
+    return memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0 && h->version == FORMAT_VERSION && h->key == self->key && h->cell_width == self->cell_width && h->cell_height == self->cell_height;
+}
+
+static inline bool
+write_all(int fd, struct iovec *iov, int count) {
+    while (count) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (count && (size_t)n >= iov->iov_len) { n -= iov->iov_len; iov++; count--; }
+        if (count) { iov->iov_base = (uint8_t*)iov->iov_base + n; iov->iov_len -= n; }
+    }
+    return true;
+}
+
+// Must be called with the file locked. Returns the size of the valid portion
+// of the file, discarding any partially written record at the end and
+// (re)initializing the file if its header does not match.
+static inline size_t
+validated_size(GlyphCache *self) {
+    struct stat s;
+    if (fstat(self->fd, &s) != 0) return 0;
+    size_t sz = s.st_size;
+    FileHeader h = {0};
+    if (sz < sizeof(FileHeader) || pread(self->fd, &h, sizeof(h), 0) != sizeof(h) || !header_is_valid(&h, self)) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = FORMAT_VERSION; h.key = self->key; h.cell_width = self->cell_width; h.cell_height = self->cell_height;
+        struct iovec iov = {.iov_base = &h, .iov_len = sizeof(h)};
+        if (ftruncate(self->fd, 0) != 0 || lseek(self->fd, 0, SEEK_SET) != 0 || !write_all(self->fd, &iov, 1)) return 0;
+        return sizeof(FileHeader);
+    }
+    size_t valid = sizeof(FileHeader) + ((sz - sizeof(FileHeader)) / self->record_sz) * self->record_sz;
+    if (valid != sz && ftruncate(self->fd, valid) != 0) return 0;
+    return valid;
+}
+
+GlyphCache*
+glyph_cache_open(const char *dir, uint64_t key, unsigned int cell_width, unsigned int cell_height) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx.glyphs", dir, (unsigned long long)key);
+    GlyphCache *self = calloc(1, sizeof(GlyphCache));
+    if (!self) return NULL;
+    self->key = key; self->cell_width = cell_width; self->cell_height = cell_height;
+    self->record_sz = sizeof(RecordHeader) + sizeof(pixel) * cell_width * cell_height;
+    self->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (self->fd < 0) { log_error("Failed to open the glyph cache at: %s with error: %s", path, strerror(errno)); free(self); return NULL; }
+    if (flock(self->fd, LOCK_EX) != 0) goto fail;
+    size_t sz = validated_size(self);
+    flock(self->fd, LOCK_UN);
+    if (!sz) goto fail;
+    // Update the modification time so that unused cache files can be pruned
+    futimens(self->fd, NULL);
+    self->map_sz = sz;
+    if (sz > sizeof(FileHeader)) {
+        self->map = mmap(NULL, sz, PROT_READ, MAP_SHARED, self->fd, 0);
+        if (self->map == MAP_FAILED) { self->map = NULL; goto fail; }
+    }
+    if (self->map && !build_index(self)) goto fail;
+    return self;
+fail:
+    log_error("Failed to initialize the glyph cache at: %s", path);
+    glyph_cache_close(self);
+    return NULL;
+}
+
+void
+glyph_cache_close(GlyphCache *self) {
+    if (!self) return;
+    if (self->map) munmap(self->map, self->map_sz);
+    if (self->fd > -1) safe_close(self->fd);
+    free(self->buckets); free(self->entries);
+    free(self);
+}
+
+const pixel*
+glyph_cache_get(GlyphCache *self, const GlyphCacheKey *key, uint32_t *flags) {
+    if (!self) return NULL;
+    if (self->map) {
+        for (uint32_t i = self->buckets[bucket_for(self, key)]; i; i = self->entries[i].next) {
+            const RecordHeader *r = self->entries[i].record;
+            if (memcmp(&r->key, key, sizeof(GlyphCacheKey)) == 0) {
+                stats.hits++;
+                *flags = r->flags;
+                return (const pixel*)(r + 1);
+            }
+        }
+    }
+    stats.misses++;
+    return NULL;
+}
+
+void
+glyph_cache_put(GlyphCache *self, const GlyphCacheKey *key, uint32_t flags, const pixel *data) {
+    if (!self || self->full) return;
+    RecordHeader r = {.key = *key, .flags = flags};
+    struct iovec iov[2] = {{.iov_base = &r, .iov_len = sizeof(r)}, {.iov_base = (void*)data, .iov_len = self->record_sz - sizeof(r)}};
+    if (flock(self->fd, LOCK_EX) != 0) return;
+    size_t sz = validated_size(self);
+    if (!sz || sz + self->record_sz > MAX_FILE_SIZE) self->full = true;
+    else if (lseek(self->fd, sz, SEEK_SET) < 0 || !write_all(self->fd, iov, arraysz(iov))) {
+        log_error("Failed to write to the glyph cache with error: %s", strerror(errno));
+        self->full = true;
+    } else stats.stored++;
+    flock(self->fd, LOCK_UN);
+}
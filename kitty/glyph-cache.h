@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+
+#define GLYPH_CACHE_MAX_EXTRA_GLYPHS 8u
+// Reserved face keys for sprites that are not rendered from a font face
+#define GLYPH_CACHE_PRERENDERED_FACE 1u
+#define GLYPH_CACHE_BOX_FACE 2u
+#define GLYPH_CACHE_COLORED 1u
+
+typedef struct {
+    uint64_t face;
+    uint16_t glyph, extra_glyphs[GLYPH_CACHE_MAX_EXTRA_GLYPHS];
+    uint8_t ligature_index, reserved[5];
+} GlyphCacheKey;
+
+typedef struct {
+    unsigned long long hits, misses, stored;
+} GlyphCacheStats;
+
+typedef struct GlyphCache GlyphCache;
+
+uint64_t glyph_cache_hash(uint64_t h, const void *data, size_t sz);
+uint64_t glyph_cache_face_key(PyObject *face, bool bold, bool italic, bool emoji_presentation);
+GlyphCache* glyph_cache_open(const char *dir, uint64_t key, unsigned int cell_width, unsigned int cell_height);
+void glyph_cache_close(GlyphCache*);
+const pixel* glyph_cache_get(GlyphCache*, const GlyphCacheKey*, uint32_t *flags);
+void glyph_cache_put(GlyphCache*, const GlyphCacheKey*, uint32_t flags, const pixel*);
+GlyphCacheStats* glyph_cache_stats(void);
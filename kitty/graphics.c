@@ -13,18 +13,311 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include <zlib.h>
 #include <structmember.h>
 #include "png-reader.h"
+#include "threading.h"
 PyTypeObject GraphicsManager_Type;
 
 #define STORAGE_LIMIT (320u * (1024u * 1024u))
+// The number of layers of array textures all OpenGL 3.3 implementations support
+#define MAX_FRAMES 256u
+#define NO_IMAGE SIZE_MAX
 
 #define REPORT_ERROR(...) { log_error(__VA_ARGS__); }
 
 
 static bool send_to_gpu = true;
+// When positive, textures are no larger than needed to display the largest
+// placement of their image at this many texels per pixel, see
+// update_needed_texture_size()
+static double texture_scale = 0;
+
+// Shared textures {{{
+
+// Textures are shared between all images, in all graphics managers, that have
+// identical pixel data, so that tools that send the same images repeatedly or
+// to many windows, upload them only once. Images are looked up by a 128 bit
+// hash of their decoded pixels, made of two 64 bit hashes with different
+// seeds, so that images are practically never mistaken for each other without
+// keeping a copy of the pixels of every texture to compare them.
+
+struct SharedTexture {
+    // The dimensions of the image and of the texture, which is smaller if it
+    // was downscaled. The textures of animated images have a layer per frame,
+    // see ensure_frame_layers().
+    uint32_t texture_id, width, height, texture_width, texture_height, num_layers;
+    uint64_t hash[2];
+    bool is_opaque, in_store;
+    size_t refcnt, gpu_sz;
+    SharedTexture *next;
+};
+
+static struct {
+    bool enabled;
+    SharedTexture **buckets;
+    size_t num_buckets, count;
+} texture_store = {.enabled = true};
+
+static struct {
+    unsigned long long textures, references, gpu_bytes, uploads, upload_bytes, shared;
+    monotonic_t upload_time;
+} texture_stats = {0};
+
+static inline uint64_t
+rotl64(uint64_t x, unsigned int r) { return (x << r) | (x >> (64 - r)); }
+
+#define P1 11400714785074694791ull
+#define P2 14029467366897019727ull
+#define P3 1609587929392839161ull
+#define P4 9650029242287828579ull
+#define P5 2870177450012600261ull
+
+static inline uint64_t
+hash_round(uint64_t acc, uint64_t input) {
+    return rotl64(acc + input * P2, 31) * P1;
+}
+
+static inline uint64_t
+read64(const uint8_t *p) { uint64_t ans; memcpy(&ans, p, sizeof(ans)); return ans; }
+
+static uint64_t
+image_data_hash(const uint8_t *p, size_t sz, uint64_t seed) {
+    // The XXH64 algorithm, reading words in native byte order, which is fine
+    // as the hashes never leave this process
+    uint64_t h;
+    size_t i = 0;
+    if (sz >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        for (; i + 32 <= sz; i += 32) {
+            v1 = hash_round(v1, read64(p + i)); v2 = hash_round(v2, read64(p + i + 8));
+            v3 = hash_round(v3, read64(p + i + 16)); v4 = hash_round(v4, read64(p + i + 24));
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = (h ^ hash_round(0, v1)) * P1 + P4; h = (h ^ hash_round(0, v2)) * P1 + P4;
+        h = (h ^ hash_round(0, v3)) * P1 + P4; h = (h ^ hash_round(0, v4)) * P1 + P4;
+    } else h = seed + P5;
+    h += sz;
+    for (; i + 8 <= sz; i += 8) h = rotl64(h ^ hash_round(0, read64(p + i)), 27) * P1 + P4;
+    for (; i < sz; i++) h = rotl64(h ^ (p[i] * P5), 11) * P1;
+    h ^= h >> 33; h *= P2; h ^= h >> 29; h *= P3; h ^= h >> 32;
+    return h;
+}
+
+#undef P1
+#undef P2
+#undef P3
+#undef P4
+#undef P5
+
+static inline void
+texture_hash(const LoadData *ld, uint64_t hash[2]) {
+    hash[0] = image_data_hash(ld->data, ld->data_sz, 0);
+    hash[1] = image_data_hash(ld->data, ld->data_sz, 0x9e3779b97f4a7c15ull);
+}
+
+static inline SharedTexture**
+texture_bucket(const uint64_t hash[2]) {
+    return texture_store.buckets + (hash[0] & (texture_store.num_buckets - 1));
+}
+
+static inline SharedTexture*
+find_texture(const uint64_t hash[2], const LoadData *ld, uint32_t width, uint32_t height, uint32_t texture_width, uint32_t texture_height) {
+    // Any texture of the image that is at least as large as needed will do
+    if (!texture_store.count) return NULL;
+    for (SharedTexture *t = *texture_bucket(hash); t; t = t->next) {
+        if (
+            t->hash[0] == hash[0] && t->hash[1] == hash[1] && t->width == width && t->height == height &&
+            t->is_opaque == ld->is_opaque && t->texture_width >= texture_width && t->texture_height >= texture_height
+        ) return t;
+    }
+    return NULL;
+}
+
+static inline void
+add_to_store(SharedTexture *t) {
+    if (texture_store.count >= texture_store.num_buckets) {
+        size_t old_num = texture_store.num_buckets;
+        SharedTexture **old = texture_store.buckets;
+        texture_store.num_buckets = MAX(64u, 2 * old_num);
+        texture_store.buckets = calloc(texture_store.num_buckets, sizeof(texture_store.buckets[0]));
+        if (!texture_store.buckets) fatal("Out of memory allocating shared texture store");
+        for (size_t i = 0; i < old_num; i++) {
+            for (SharedTexture *q = old[i], *next; q; q = next) {
+                next = q->next;
+                SharedTexture **b = texture_bucket(q->hash);
+                q->next = *b; *b = q;
+            }
+        }
+        free(old);
+    }
+    SharedTexture **b = texture_bucket(t->hash);
+    t->next = *b; *b = t; t->in_store = true;
+    texture_store.count++;
+}
+
+static inline void
+remove_from_store(SharedTexture *t) {
+    if (!t->in_store) return;
+    for (SharedTexture **q = texture_bucket(t->hash); *q; q = &(*q)->next) {
+        if (*q == t) { *q = t->next; break; }
+    }
+    t->next = NULL; t->in_store = false;
+    texture_store.count--;
+}
+
+static inline void
+release_texture(Image *img) {
+    SharedTexture *t = img->texture;
+    img->texture = NULL; img->texture_id = 0;
+    if (!t) return;
+    texture_stats.references--;
+    if (--t->refcnt) return;
+    remove_from_store(t);
+    if (t->texture_id) free_texture(&t->texture_id);
+    texture_stats.textures--; texture_stats.gpu_bytes -= t->gpu_sz;
+    free(t);
+}
+
+static uint8_t*
+downscale_pixels(const LoadData *ld, uint32_t width, uint32_t height, uint32_t dest_width, uint32_t dest_height) {
+    // A box filter, every destination pixel is the average of the source
+    // pixels it covers, weighted by their alpha so that the colors of
+    // transparent pixels do not bleed into their neighbours
+    const size_t channels = ld->is_opaque ? 3 : 4;
+    uint8_t *ans = malloc(channels * dest_width * dest_height);
+    if (!ans) return NULL;
+    uint8_t *dest = ans;
+    for (uint32_t dy = 0; dy < dest_height; dy++) {
+        uint32_t y0 = (uint64_t)dy * height / dest_height, y1 = MAX(y0 + 1, (uint64_t)(dy + 1) * height / dest_height);
+        for (uint32_t dx = 0; dx < dest_width; dx++, dest += channels) {
+            uint32_t x0 = (uint64_t)dx * width / dest_width, x1 = MAX(x0 + 1, (uint64_t)(dx + 1) * width / dest_width);
+            uint64_t sum[4] = {0}, count = (uint64_t)(x1 - x0) * (y1 - y0);
+            for (uint32_t y = y0; y < y1; y++) {
+                const uint8_t *src = ld->data + channels * ((size_t)y * width + x0);
+                if (channels == 3) {
+                    for (uint32_t x = x0; x < x1; x++, src += 3) { sum[0] += src[0]; sum[1] += src[1]; sum[2] += src[2]; }
+                } else {
+                    for (uint32_t x = x0; x < x1; x++, src += 4) {
+                        sum[0] += src[0] * src[3]; sum[1] += src[1] * src[3]; sum[2] += src[2] * src[3]; sum[3] += src[3];
+                    }
+                }
+            }
+            if (channels == 3) {
+                for (size_t c = 0; c < 3; c++) dest[c] = (sum[c] + count / 2) / count;
+            } else {
+                for (size_t c = 0; c < 3; c++) dest[c] = sum[3] ? (sum[c] + sum[3] / 2) / sum[3] : 0;
+                dest[3] = (sum[3] + count / 2) / count;
+            }
+        }
+    }
+    return ans;
+}
+
+static inline void
+upload_texture(Image *img, const LoadData *ld, uint32_t texture_width, uint32_t texture_height) {
+    uint64_t hash[2] = {0};
+    if (texture_store.enabled) {
+        texture_hash(ld, hash);
+        SharedTexture *t = find_texture(hash, ld, img->width, img->height, texture_width, texture_height);
+        if (t) {
+            if (t != img->texture) {
+                release_texture(img);
+                t->refcnt++; texture_stats.references++; texture_stats.shared++;
+                img->texture = t; img->texture_id = t->texture_id;
+            }
+            return;
+        }
+    }
+    const uint8_t *data = ld->data;
+    uint8_t *downscaled = NULL;
+    bool is_4byte_aligned = ld->is_4byte_aligned;
+    monotonic_t start = monotonic();
+    if (texture_width < img->width || texture_height < img->height) {
+        downscaled = downscale_pixels(ld, img->width, img->height, texture_width, texture_height);
+        if (downscaled) { data = downscaled; is_4byte_aligned = !ld->is_opaque || texture_width % 4 == 0; }
+        else { texture_width = img->width; texture_height = img->height; }
+    }
+    SharedTexture *t = img->texture;
+    if (t && t->refcnt == 1) {
+        // Re-use the texture of a re-transmitted image, as before
+        remove_from_store(t);
+        texture_stats.gpu_bytes -= t->gpu_sz;
+    } else {
+        release_texture(img);
+        t = calloc(1, sizeof(SharedTexture));
+        if (!t) fatal("Out of memory allocating shared texture");
+        t->refcnt = 1;
+        texture_stats.textures++; texture_stats.references++;
+        img->texture = t;
+    }
+    bool mipmaps = texture_scale > 0;
+    send_image_to_gpu(&t->texture_id, data, texture_width, texture_height, ld->is_opaque, is_4byte_aligned, mipmaps);
+    texture_stats.upload_time += monotonic() - start;
+    texture_stats.uploads++; texture_stats.upload_bytes += (ld->is_opaque ? 3u : 4u) * texture_width * texture_height;
+    free(downscaled);
+    t->width = img->width; t->height = img->height; t->is_opaque = ld->is_opaque;
+    t->hash[0] = hash[0]; t->hash[1] = hash[1];
+    t->texture_width = texture_width; t->texture_height = texture_height; t->num_layers = 1;
+    t->gpu_sz = 4u * texture_width * texture_height;  // textures are always RGBA
+    if (mipmaps) t->gpu_sz += t->gpu_sz / 3;
+    texture_stats.gpu_bytes += t->gpu_sz;
+    img->texture_id = t->texture_id;
+    if (texture_store.enabled) add_to_store(t);
+}
+
+static void
+ensure_frame_layers(Image *img, uint32_t num_layers) {
+    // Animated images have a full resolution texture of their own, with a
+    // layer per frame, whose number of layers is doubled as frames are added
+    SharedTexture *t = img->texture;
+    if (t && t->num_layers >= num_layers) return;
+    uint32_t capacity = t && t->num_layers > 1 ? 2 * t->num_layers : 2;
+    while (capacity < num_layers) capacity *= 2;
+    monotonic_t start = monotonic();
+    // The layers are copied on the GPU, unless the texture was downscaled, then
+    // the first frame is uploaded from the pixels that were kept
+    bool copy = t && t->texture_width == img->width && t->texture_height == img->height;
+    uint32_t texture_id = copy ? t->texture_id : 0;
+    realloc_image_texture(&texture_id, img->width, img->height, capacity, copy ? t->num_layers : 0);
+    if (!copy && img->load_data.data) {
+        send_image_layer_to_gpu(texture_id, img->load_data.data, img->width, img->height, 0, img->load_data.is_opaque, img->load_data.is_4byte_aligned);
+        texture_stats.uploads++; texture_stats.upload_bytes += (img->load_data.is_opaque ? 3u : 4u) * img->width * img->height;
+    }
+    texture_stats.upload_time += monotonic() - start;
+    if (t && t->refcnt == 1) {
+        remove_from_store(t);
+        free_texture(&t->texture_id);
+        texture_stats.gpu_bytes -= t->gpu_sz;
+    } else {
+        // Frames are never shared
+        release_texture(img);
+        t = calloc(1, sizeof(SharedTexture));
+        if (!t) fatal("Out of memory allocating shared texture");
+        t->refcnt = 1;
+        texture_stats.textures++; texture_stats.references++;
+        img->texture = t;
+    }
+    t->texture_id = texture_id; t->num_layers = capacity; t->hash[0] = 0; t->hash[1] = 0;
+    t->width = t->texture_width = img->width; t->height = t->texture_height = img->height;
+    t->gpu_sz = 4u * img->width * img->height * capacity;
+    texture_stats.gpu_bytes += t->gpu_sz;
+    img->texture_id = texture_id;
+    img->upload_pending = false;
+}
+
+static inline void
+upload_frame(Image *img, const LoadData *ld, uint32_t layer) {
+    ensure_frame_layers(img, layer + 1);
+    monotonic_t start = monotonic();
+    send_image_layer_to_gpu(img->texture_id, ld->data, img->width, img->height, layer, ld->is_opaque, ld->is_4byte_aligned);
+    texture_stats.upload_time += monotonic() - start;
+    texture_stats.uploads++; texture_stats.upload_bytes += (ld->is_opaque ? 3u : 4u) * img->width * img->height;
+}
+
+// }}}
 
 GraphicsManager*
 grman_alloc() {
@@ -37,15 +330,11 @@ grman_alloc() {
         PyErr_NoMemory();
         Py_CLEAR(self); return NULL;
     }
+    self->storage_limit = STORAGE_LIMIT;
+    for (size_t i = 0; i < arraysz(self->lru); i++) self->lru[i].head = self->lru[i].tail = NO_IMAGE;
     return self;
 }
 
-static inline void
-free_refs_data(Image *img) {
-    free(img->refs); img->refs = NULL;
-    img->refcnt = 0; img->refcap = 0;
-}
-
 static inline void
 free_load_data(LoadData *ld) {
     free(ld->buf); ld->buf_used = 0; ld->buf_capacity = 0;
@@ -53,87 +342,262 @@ free_load_data(LoadData *ld) {
 
     if (ld->mapped_file) munmap(ld->mapped_file, ld->mapped_file_sz);
     ld->mapped_file = NULL; ld->mapped_file_sz = 0;
+
+    if (ld->zstream) { inflateEnd(ld->zstream); free(ld->zstream); }
+    ld->zstream = NULL;
+    ld->data = NULL;
 }
 
 static inline void
 free_image(GraphicsManager *self, Image *img) {
-    if (img->texture_id) free_texture(&img->texture_id);
-    free_refs_data(img);
+    release_texture(img);
     free_load_data(&(img->load_data));
+    free(img->frame_gaps); img->frame_gaps = NULL;
+    if (img->animation_running) self->num_running_animations--;
     self->used_storage -= img->used_storage;
 }
 
 
+static inline void cancel_decode_job(DecodeJob *job);
+static void unwatch_animations(GraphicsManager *self);
+static inline void remove_frames(GraphicsManager *self, Image *img);
+
 static void
 dealloc(GraphicsManager* self) {
     size_t i;
+    if (self->decode_job) cancel_decode_job(self->decode_job);
+    unwatch_animations(self);
     if (self->images) {
         for (i = 0; i < self->image_count; i++) free_image(self, self->images + i);
         free(self->images);
     }
+    free(self->images_by_client_id.entries); free(self->images_by_internal_id.entries);
+    free(self->trim_candidates);
+    free(self->refs);
+    for (i = 0; i < self->num_shm_channels; i++) {
+        munmap(self->shm_channels[i].addr, self->shm_channels[i].sz);
+        safe_close(self->shm_channels[i].fd);
+    }
+    free(self->shm_channels);
     free(self->render_data);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
 static id_type internal_id_counter = 1;
 
+// Image lookup {{{
+// Images are found by id using open addressing hash maps from the id to the
+// index of the image in the images array. Images are removed by moving the
+// last image into the hole, so that removals are O(1) as well.
+
+static inline ImageIdMapEntry*
+id_map_probe(ImageIdMap *m, id_type key) {
+    uint64_t h = key ^ (key >> 33);
+    h *= 0xff51afd7ed558ccdull; h ^= h >> 33;
+    size_t mask = m->capacity - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        if (m->entries[i].key == key || !m->entries[i].key) return m->entries + i;
+    }
+}
+
+static inline size_t
+id_map_get(ImageIdMap *m, id_type key) {
+    if (!m->count) return NO_IMAGE;
+    ImageIdMapEntry *e = id_map_probe(m, key);
+    return e->key ? e->idx : NO_IMAGE;
+}
+
+static inline void
+id_map_set(ImageIdMap *m, id_type key, size_t idx) {
+    if ((m->count + 1) * 4 > m->capacity * 3) {
+        ImageIdMap n = {.capacity = m->capacity ? 2 * m->capacity : 64};
+        n.entries = calloc(n.capacity, sizeof(ImageIdMapEntry));
+        if (!n.entries) fatal("Out of memory allocating image id map");
+        for (size_t i = 0; i < m->capacity; i++) {
+            if (m->entries[i].key) *id_map_probe(&n, m->entries[i].key) = m->entries[i];
+        }
+        n.count = m->count;
+        free(m->entries);
+        *m = n;
+    }
+    ImageIdMapEntry *e = id_map_probe(m, key);
+    if (!e->key) m->count++;
+    e->key = key; e->idx = idx;
+}
+
+static inline void
+id_map_remove(ImageIdMap *m, id_type key) {
+    if (!m->count) return;
+    ImageIdMapEntry *e = id_map_probe(m, key);
+    if (!e->key) return;
+    // Shift back the entries that follow in the probe sequence, so that no
+    // tombstones are needed
+    size_t mask = m->capacity - 1, hole = e - m->entries;
+    for (size_t i = (hole + 1) & mask; m->entries[i].key; i = (i + 1) & mask) {
+        uint64_t h = m->entries[i].key ^ (m->entries[i].key >> 33);
+        h *= 0xff51afd7ed558ccdull; h ^= h >> 33;
+        size_t home = h & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            m->entries[hole] = m->entries[i];
+            hole = i;
+        }
+    }
+    m->entries[hole].key = 0;
+    m->count--;
+}
+
 static inline Image*
 img_by_internal_id(GraphicsManager *self, id_type id) {
-    for (size_t i = 0; i < self->image_count; i++) {
-        if (self->images[i].internal_id == id) return self->images + i;
-    }
-    return NULL;
+    size_t idx = id_map_get(&self->images_by_internal_id, id);
+    return idx == NO_IMAGE ? NULL : self->images + idx;
 }
 
 static inline Image*
 img_by_client_id(GraphicsManager *self, uint32_t id) {
-    for (size_t i = 0; i < self->image_count; i++) {
-        if (self->images[i].client_id == id) return self->images + i;
-    }
-    return NULL;
+    if (!id) return NULL;
+    size_t idx = id_map_get(&self->images_by_client_id, id);
+    return idx == NO_IMAGE ? NULL : self->images + idx;
 }
 
+// }}}
+
+// Least recently used lists {{{
+
+enum { UNREFERENCED_LRU, REFERENCED_LRU };
+
 static inline void
-remove_image(GraphicsManager *self, size_t idx) {
-    free_image(self, self->images + idx);
-    remove_i_from_array(self->images, idx, self->image_count);
-    self->layers_dirty = true;
+lru_unlink(GraphicsManager *self, size_t idx) {
+    Image *img = self->images + idx;
+    ImageLRU *l = self->lru + img->lru_list;
+    if (img->lru_prev == NO_IMAGE) l->head = img->lru_next; else self->images[img->lru_prev].lru_next = img->lru_next;
+    if (img->lru_next == NO_IMAGE) l->tail = img->lru_prev; else self->images[img->lru_next].lru_prev = img->lru_prev;
 }
 
 static inline void
-remove_images(GraphicsManager *self, bool(*predicate)(Image*), id_type skip_image_internal_id) {
-    for (size_t i = self->image_count; i-- > 0;) {
-        Image *img = self->images + i;
-        if (img->internal_id != skip_image_internal_id && predicate(img)) {
-            remove_image(self, i);
-        }
+lru_push_front(GraphicsManager *self, size_t idx) {
+    Image *img = self->images + idx;
+    img->lru_list = img->refcnt ? REFERENCED_LRU : UNREFERENCED_LRU;
+    ImageLRU *l = self->lru + img->lru_list;
+    img->lru_prev = NO_IMAGE; img->lru_next = l->head;
+    if (l->head == NO_IMAGE) l->tail = idx; else self->images[l->head].lru_prev = idx;
+    l->head = idx;
+}
+
+static inline void
+touch_image(GraphicsManager *self, Image *img) {
+    img->atime = monotonic();
+    size_t idx = img - self->images;
+    lru_unlink(self, idx);
+    lru_push_front(self, idx);
+}
+
+static inline void
+image_moved(GraphicsManager *self, size_t to) {
+    Image *img = self->images + to;
+    id_map_set(&self->images_by_internal_id, img->internal_id, to);
+    if (img->client_id) id_map_set(&self->images_by_client_id, img->client_id, to);
+    ImageLRU *l = self->lru + img->lru_list;
+    if (img->lru_prev == NO_IMAGE) l->head = to; else self->images[img->lru_prev].lru_next = to;
+    if (img->lru_next == NO_IMAGE) l->tail = to; else self->images[img->lru_next].lru_prev = to;
+}
+
+// }}}
+
+// Placements {{{
+
+// Scrolling rebases all placements before row_offset can overflow
+#define MAX_ROW_OFFSET (1 << 30)
+
+static inline int64_t
+abs_row(GraphicsManager *self, int64_t screen_row) {
+    return screen_row - self->row_offset;
+}
+
+static inline size_t
+ref_lower_bound(GraphicsManager *self, int64_t row) {
+    // The index of the first placement whose start_row is >= row
+    size_t lo = 0, hi = self->num_refs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (self->refs[mid].start_row < row) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
 }
 
+static inline void
+sort_refs(ImageRef *refs, size_t count) {
+    // Insertion sort, the placements are almost always already sorted
+    for (size_t i = 1; i < count; i++) {
+        if (refs[i - 1].start_row <= refs[i].start_row) continue;
+        ImageRef r = refs[i];
+        size_t j = i;
+        for (; j > 0 && refs[j - 1].start_row > r.start_row; j--) refs[j] = refs[j - 1];
+        refs[j] = r;
+    }
+}
 
-// Loading image data {{{
+static inline void
+refs_removed(GraphicsManager *self) {
+    if (!self->num_refs) { self->row_offset = 0; self->max_ref_rows = 0; }
+}
 
-static bool
-trim_predicate(Image *img) {
-    return !img->data_loaded || !img->refcnt;
+static inline void
+remove_refs_of_image(GraphicsManager *self, Image *img) {
+    if (!img->refcnt) return;
+    size_t w = 0;
+    for (size_t i = 0; i < self->num_refs; i++) {
+        if (self->refs[i].image_id == img->internal_id) continue;
+        if (w != i) self->refs[w] = self->refs[i];
+        w++;
+    }
+    self->num_refs = w;
+    img->refcnt = 0;
+    refs_removed(self);
+    self->layers_dirty = true;
 }
 
+static inline void
+rebase_refs(GraphicsManager *self) {
+    for (size_t i = 0; i < self->num_refs; i++) self->refs[i].start_row += self->row_offset;
+    self->row_offset = 0;
+}
 
-static int
-oldest_last(const void* a, const void *b) {
-    monotonic_t ans = ((Image*)(b))->atime - ((Image*)(a))->atime;
-    return ans < 0 ? -1 : (ans == 0 ? 0 : 1);
+// }}}
+
+static inline void
+remove_image(GraphicsManager *self, size_t idx) {
+    Image *img = self->images + idx;
+    remove_refs_of_image(self, img);
+    id_map_remove(&self->images_by_internal_id, img->internal_id);
+    if (img->client_id) id_map_remove(&self->images_by_client_id, img->client_id);
+    lru_unlink(self, idx);
+    free_image(self, img);
+    size_t last = --self->image_count;
+    if (idx != last) {
+        self->images[idx] = self->images[last];
+        image_moved(self, idx);
+    }
+    self->layers_dirty = true;
 }
 
+
+// Loading image data {{{
+
 static inline void
 apply_storage_quota(GraphicsManager *self, size_t storage_limit, id_type currently_added_image_internal_id) {
-    // First remove unreferenced images, even if they have an id
-    remove_images(self, trim_predicate, currently_added_image_internal_id);
-    if (self->used_storage < storage_limit) return;
-
-    qsort(self->images, self->image_count, sizeof(self->images[0]), oldest_last);
-    while (self->used_storage > storage_limit && self->image_count > 0) {
-        remove_image(self, self->image_count - 1);
+    // Evict unreferenced images, even if they have an id, then referenced
+    // images, least recently used first
+    for (unsigned int l = UNREFERENCED_LRU; l <= REFERENCED_LRU && self->used_storage > storage_limit; l++) {
+        size_t idx = self->lru[l].tail;
+        while (idx != NO_IMAGE && self->used_storage > storage_limit) {
+            size_t prev = self->images[idx].lru_prev;
+            if (l == UNREFERENCED_LRU && self->images[idx].internal_id == currently_added_image_internal_id) { idx = prev; continue; }
+            remove_image(self, idx);
+            // The last image was moved into the hole
+            if (prev == self->image_count) prev = idx;
+            idx = prev;
+        }
     }
     if (!self->image_count) self->used_storage = 0;  // sanity check
 }
@@ -141,17 +605,54 @@ apply_storage_quota(GraphicsManager *self, size_t storage_limit, id_type current
 static char add_response[512] = {0};
 static bool has_add_respose = false;
 
+static inline void
+vformat_response(char *buf, size_t sz, const char *code, const char *fmt, va_list args) {
+    int num = snprintf(buf, sz, "%s:", code);
+    vsnprintf(buf + num, sz - num, fmt, args);
+}
+
 static inline void
 set_add_response(const char *code, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    size_t sz = sizeof(add_response)/sizeof(add_response[0]);
-    int num = snprintf(add_response, sz, "%s:", code);
-    vsnprintf(add_response + num, sz - num, fmt, args);
+    vformat_response(add_response, arraysz(add_response), code, fmt, args);
     va_end(args);
     has_add_respose = true;
 }
 
+enum FORMATS { RGB=24, RGBA=32, PNG=100 };
+
+// The data of an image that needs to be decompressed/decoded. Decoding happens
+// either inline or in one of the decoder threads, so it must not touch any
+// global state.
+struct DecodeJob {
+    GraphicsCommand command;
+    uint32_t response_id;
+    bool is_query;
+    id_type image_id;
+    uint32_t width, height, format;
+    unsigned char compressed;
+    LoadData load_data;
+    ImageTimings timings;
+    bool ok, done, cancelled, wakeup_main_loop;
+    char error[sizeof(add_response)];
+    DecodeJob *next;
+};
+
+static inline void
+free_decode_job(DecodeJob *job) {
+    free_load_data(&job->load_data);
+    free(job);
+}
+
+static inline void
+set_decode_error(DecodeJob *job, const char *code, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vformat_response(job->error, arraysz(job->error), code, fmt, args);
+    va_end(args);
+}
+
 // Decode formats {{{
 #define ABRT(code, ...) { set_add_response(#code, __VA_ARGS__); goto err; }
 
@@ -170,17 +671,87 @@ mmap_img_file(GraphicsManager UNUSED *self, Image *img, int fd, size_t sz, off_t
 err:
     return false;
 }
+#undef ABRT
+
+// Shared memory channels {{{
+
+// Clients that transmit new frames of an image many times a second, such as
+// video previews, register a shared memory object for the image once, then
+// transmit each frame by only giving its offset and size in the object, see
+// handle_add_command(). Uncompressed frames are uploaded directly from the
+// mapping. The client owns the object, it is never unlinked, and may resize
+// it at any time, so the mapping is checked against the object before every
+// frame, see refresh_shm_channel().
+
+#define MAX_SHM_CHANNELS 64u
+#define ABRT(code, ...) { set_add_response(#code, __VA_ARGS__); goto err; }
+
+static inline ShmChannel*
+shm_channel_for(GraphicsManager *self, uint32_t client_id) {
+    for (size_t i = 0; i < self->num_shm_channels; i++) {
+        if (self->shm_channels[i].client_id == client_id) return self->shm_channels + i;
+    }
+    return NULL;
+}
 
+static inline void
+release_shm_channel(GraphicsManager *self, uint32_t client_id) {
+    ShmChannel *c = shm_channel_for(self, client_id);
+    if (!c) return;
+    munmap(c->addr, c->sz);
+    safe_close(c->fd);
+    size_t i = c - self->shm_channels;
+    remove_i_from_array(self->shm_channels, i, self->num_shm_channels);
+}
+
+static ShmChannel*
+register_shm_channel(GraphicsManager *self, uint32_t client_id, const char *name) {
+    release_shm_channel(self, client_id);
+    // Release the oldest channel rather than have clients pin unlimited memory
+    if (self->num_shm_channels >= MAX_SHM_CHANNELS) release_shm_channel(self, self->shm_channels[0].client_id);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) ABRT(EBADF, "Failed to open shared memory object %s for graphics transmission with error: [%d] %s", name, errno, strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) { safe_close(fd); ABRT(EBADF, "Failed to fstat() the shared memory object %s with error: [%d] %s", name, errno, strerror(errno)); }
+    if (st.st_size <= 0) { safe_close(fd); ABRT(EINVAL, "The shared memory object %s is empty", name); }
+    void *addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) { safe_close(fd); ABRT(EBADF, "Failed to map the shared memory object %s with size: %zu with error: [%d] %s", name, (size_t)st.st_size, errno, strerror(errno)); }
+    ensure_space_for(self, shm_channels, ShmChannel, self->num_shm_channels + 1, shm_channels_capacity, 4, false);
+    ShmChannel *c = self->shm_channels + self->num_shm_channels++;
+    c->client_id = client_id; c->fd = fd; c->addr = addr; c->sz = st.st_size;
+    return c;
+err:
+    return NULL;
+}
+
+static bool
+refresh_shm_channel(ShmChannel *c) {
+    // Reading pages of the mapping beyond the current end of the object
+    // raises SIGBUS, so follow any resizing by the client before every frame
+    struct stat st;
+    if (fstat(c->fd, &st) != 0) ABRT(EBADF, "Failed to fstat() the shared memory object with error: [%d] %s", errno, strerror(errno));
+    if ((size_t)st.st_size == c->sz) return true;
+    if (st.st_size <= 0) ABRT(EINVAL, "The shared memory object is empty");
+    void *addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (addr == MAP_FAILED) ABRT(EBADF, "Failed to map the shared memory object with size: %zu with error: [%d] %s", (size_t)st.st_size, errno, strerror(errno));
+    munmap(c->addr, c->sz);
+    c->addr = addr; c->sz = st.st_size;
+    return true;
+err:
+    return false;
+}
+
+#undef ABRT
+// }}}
 
 static inline const char*
-zlib_strerror(int ret) {
+zlib_strerror(int ret, char *buf, size_t bufsz) {
 #define Z(x) case x: return #x;
-    static char buf[128];
     switch(ret) {
         case Z_ERRNO:
             return strerror(errno);
         default:
-            snprintf(buf, sizeof(buf)/sizeof(buf[0]), "Unknown error: %d", ret);
+            snprintf(buf, bufsz, "Unknown error: %d", ret);
             return buf;
         Z(Z_STREAM_ERROR);
         Z(Z_DATA_ERROR);
@@ -191,27 +762,35 @@ zlib_strerror(int ret) {
 #undef Z
 }
 
+#define ABRT(code, ...) { set_decode_error(job, #code, __VA_ARGS__); goto err; }
+
 static inline bool
-inflate_zlib(GraphicsManager UNUSED *self, Image *img, uint8_t *buf, size_t bufsz) {
+inflate_zlib(DecodeJob *job, uint8_t *buf, size_t bufsz) {
     bool ok = false;
     z_stream z;
-    uint8_t *decompressed = malloc(img->load_data.data_sz);
+    char ebuf[128];
+    uint8_t *decompressed = malloc(job->load_data.data_sz);
     if (decompressed == NULL) fatal("Out of memory allocating decompression buffer");
     z.zalloc = Z_NULL;
     z.zfree = Z_NULL;
     z.opaque = Z_NULL;
     z.avail_in = bufsz;
     z.next_in = (Bytef*)buf;
-    z.avail_out = img->load_data.data_sz;
+    z.avail_out = job->load_data.data_sz;
     z.next_out = decompressed;
     int ret;
-    if ((ret = inflateInit(&z)) != Z_OK) ABRT(ENOMEM, "Failed to initialize inflate with error: %s", zlib_strerror(ret));
-    if ((ret = inflate(&z, Z_FINISH)) != Z_STREAM_END) ABRT(EINVAL, "Failed to inflate image data with error: %s", zlib_strerror(ret));
+    monotonic_t start = monotonic();
+    if ((ret = inflateInit(&z)) != Z_OK) ABRT(ENOMEM, "Failed to initialize inflate with error: %s", zlib_strerror(ret, ebuf, sizeof(ebuf)));
+    TRACE_BEGIN("inflate");
+    ret = inflate(&z, Z_FINISH);
+    TRACE_END("inflate");
+    job->timings.inflate += monotonic() - start;
+    if (ret != Z_STREAM_END) ABRT(EINVAL, "Failed to inflate image data with error: %s", zlib_strerror(ret, ebuf, sizeof(ebuf)));
     if (z.avail_out) ABRT(EINVAL, "Image data size post inflation does not match expected size");
-    free_load_data(&img->load_data);
-    img->load_data.buf_capacity = img->load_data.data_sz;
-    img->load_data.buf = decompressed;
-    img->load_data.buf_used = img->load_data.data_sz;
+    free_load_data(&job->load_data);
+    job->load_data.buf_capacity = job->load_data.data_sz;
+    job->load_data.buf = decompressed;
+    job->load_data.buf_used = job->load_data.data_sz;
     ok = true;
 err:
     inflateEnd(&z);
@@ -220,51 +799,355 @@ err:
 }
 
 static void
-png_error_handler(const char *code, const char *msg) {
-    set_add_response(code, "%s", msg);
+png_error_handler(void *job, const char *code, const char *msg) {
+    set_decode_error(job, code, "%s", msg);
 }
 
 static inline bool
-inflate_png(GraphicsManager UNUSED *self, Image *img, uint8_t *buf, size_t bufsz) {
-    png_read_data d = {.err_handler=png_error_handler};
+inflate_png(DecodeJob *job, uint8_t *buf, size_t bufsz) {
+    png_read_data d = {.err_handler=png_error_handler, .err_handler_data=job};
+    monotonic_t start = monotonic();
+    TRACE_BEGIN("inflate_png");
     inflate_png_inner(&d, buf, bufsz);
+    TRACE_END("inflate_png");
+    job->timings.png += monotonic() - start;
     if (d.ok) {
-        free_load_data(&img->load_data);
-        img->load_data.buf = d.decompressed;
-        img->load_data.buf_capacity = d.sz;
-        img->load_data.buf_used = d.sz;
-        img->load_data.data_sz = d.sz;
-        img->width = d.width; img->height = d.height;
+        free_load_data(&job->load_data);
+        job->load_data.buf = d.decompressed;
+        job->load_data.buf_capacity = d.sz;
+        job->load_data.buf_used = d.sz;
+        job->load_data.data_sz = d.sz;
+        job->width = d.width; job->height = d.height;
     }
     else free(d.decompressed);
     free(d.row_pointers);
     return d.ok;
 }
+
+static bool
+decode_image_data(DecodeJob *job) {
+    LoadData *ld = &job->load_data;
+    uint8_t *buf; size_t bufsz;
+#define IB { if (ld->buf) { buf = ld->buf; bufsz = ld->buf_used; } else { buf = ld->mapped_file; bufsz = ld->mapped_file_sz; } }
+    if (job->compressed == 'z') {
+        IB;
+        if (!inflate_zlib(job, buf, bufsz)) return false;
+    }
+    if (job->format == PNG) {
+        IB;
+        if (!inflate_png(job, buf, bufsz)) return false;
+    }
+#undef IB
+    ld->data = ld->buf;
+    if (ld->buf_used < ld->data_sz) ABRT(ENODATA, "Insufficient image data: %zu < %zu", ld->buf_used, ld->data_sz);
+    if (ld->mapped_file) {
+        munmap(ld->mapped_file, ld->mapped_file_sz);
+        ld->mapped_file = NULL; ld->mapped_file_sz = 0;
+    }
+    return true;
+err:
+    return false;
+}
 #undef ABRT
 // }}}
 
+// Decoder threads {{{
+
+#define decoders_mutex(op) pthread_mutex_##op(&decoders.lock);
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup, finished;
+    pthread_t *threads;
+    unsigned int num_threads;
+    bool shutting_down;
+    DecodeJob *head, *tail;
+} decoders = {0};
+
+static void*
+decode_worker(void UNUSED *data) {
+    set_thread_name("KittyImgDecode");
+    decoders_mutex(lock);
+    while (true) {
+        while (!decoders.head && !decoders.shutting_down) pthread_cond_wait(&decoders.wakeup, &decoders.lock);
+        DecodeJob *job = decoders.head;
+        if (job == NULL) break;  // shutting down and all queued jobs are done
+        decoders.head = job->next;
+        if (!decoders.head) decoders.tail = NULL;
+        if (!job->cancelled) {
+            decoders_mutex(unlock);
+            TRACE_BEGIN("decode_image");
+            bool ok = decode_image_data(job);
+            TRACE_END("decode_image");
+            decoders_mutex(lock);
+            job->ok = ok;
+        }
+        if (job->cancelled) free_decode_job(job);
+        else {
+            job->done = true;
+            pthread_cond_broadcast(&decoders.finished);
+            if (job->wakeup_main_loop) {
+                decoders_mutex(unlock);
+                wakeup_main_loop();
+                decoders_mutex(lock);
+            }
+        }
+    }
+    decoders_mutex(unlock);
+    return NULL;
+}
+
+static void
+stop_decoders(void) {
+    if (!decoders.num_threads) return;
+    decoders_mutex(lock);
+    decoders.shutting_down = true;
+    pthread_cond_broadcast(&decoders.wakeup);
+    decoders_mutex(unlock);
+    for (unsigned int i = 0; i < decoders.num_threads; i++) pthread_join(decoders.threads[i], NULL);
+    free(decoders.threads); decoders.threads = NULL;
+    decoders.num_threads = 0;
+    decoders.shutting_down = false;
+}
+
+static int
+start_decoders(unsigned int num) {
+    decoders.threads = calloc(num, sizeof(pthread_t));
+    if (!decoders.threads) return ENOMEM;
+    for (; decoders.num_threads < num; decoders.num_threads++) {
+        int ret = pthread_create(decoders.threads + decoders.num_threads, NULL, decode_worker, NULL);
+        if (ret != 0) { stop_decoders(); return ret; }
+    }
+    return 0;
+}
+
+static inline void
+queue_decode_job(DecodeJob *job) {
+    // Only wake up the main loop if there is one, decodes can also be waited
+    // for by polling, which is what the tests do
+    job->wakeup_main_loop = global_state.num_os_windows > 0;
+    job->next = NULL;
+    decoders_mutex(lock);
+    if (decoders.tail) decoders.tail->next = job;
+    else decoders.head = job;
+    decoders.tail = job;
+    pthread_cond_signal(&decoders.wakeup);
+    decoders_mutex(unlock);
+}
+
+static inline void
+cancel_decode_job(DecodeJob *job) {
+    decoders_mutex(lock);
+    if (job->done) free_decode_job(job);
+    else job->cancelled = true;
+    decoders_mutex(unlock);
+}
+
+bool
+grman_decode_finished(GraphicsManager *self) {
+    decoders_mutex(lock);
+    bool ans = self->decode_job->done;
+    decoders_mutex(unlock);
+    return ans;
+}
+
+void
+grman_wait_for_decode(GraphicsManager *self) {
+    // Decode the image inline if no decoder thread has started on it yet,
+    // otherwise wait for the decoder thread to finish it
+    DecodeJob *job = self->decode_job, *prev = NULL, *q;
+    decoders_mutex(lock);
+    for (q = decoders.head; q && q != job; q = q->next) prev = q;
+    if (q) {
+        if (prev) prev->next = q->next;
+        else decoders.head = q->next;
+        if (decoders.tail == q) decoders.tail = prev;
+        decoders_mutex(unlock);
+        bool ok = decode_image_data(job);
+        decoders_mutex(lock);
+        job->ok = ok; job->done = true;
+    }
+    while (!job->done) pthread_cond_wait(&decoders.finished, &decoders.lock);
+    decoders_mutex(unlock);
+}
+
+// }}}
+
 static bool
 add_trim_predicate(Image *img) {
     return !img->data_loaded || (!img->client_id && !img->refcnt);
 }
 
+static inline void
+add_trim_candidate(GraphicsManager *self, Image *img) {
+    // Only images that are being or were just added can fail to load or end
+    // up without an id and without references, anonymous images that lose
+    // their references are removed immediately, see filter_refs()
+    ensure_space_for(self, trim_candidates, id_type, self->num_trim_candidates + 1, trim_candidates_capacity, 16, false);
+    self->trim_candidates[self->num_trim_candidates++] = img->internal_id;
+}
+
+static inline void
+trim_added_images(GraphicsManager *self) {
+    for (size_t i = 0; i < self->num_trim_candidates; i++) {
+        size_t idx = id_map_get(&self->images_by_internal_id, self->trim_candidates[i]);
+        if (idx != NO_IMAGE && add_trim_predicate(self->images + idx)) remove_image(self, idx);
+    }
+    self->num_trim_candidates = 0;
+}
+
 static inline Image*
 find_or_create_image(GraphicsManager *self, uint32_t id, bool *existing) {
-    if (id) {
-        for (size_t i = 0; i < self->image_count; i++) {
-            if (self->images[i].client_id == id) {
-                *existing = true;
-                return self->images + i;
-            }
-        }
-    }
+    Image *ans = img_by_client_id(self, id);
+    if (ans) { *existing = true; return ans; }
     *existing = false;
     ensure_space_for(self, images, Image, self->image_count + 1, images_capacity, 64, true);
-    Image *ans = self->images + self->image_count++;
+    size_t idx = self->image_count++;
+    ans = self->images + idx;
     zero_at_ptr(ans);
+    ans->internal_id = internal_id_counter++;
+    ans->client_id = id;
+    id_map_set(&self->images_by_internal_id, ans->internal_id, idx);
+    if (id) id_map_set(&self->images_by_client_id, id, idx);
+    lru_push_front(self, idx);
     return ans;
 }
 
+static inline DecodeJob*
+create_decode_job(Image *img, unsigned char compressed, uint32_t fmt) {
+    DecodeJob *job = calloc(1, sizeof(DecodeJob));
+    if (job == NULL) fatal("Out of memory allocating image decode job");
+    job->image_id = img->internal_id;
+    job->compressed = compressed; job->format = fmt;
+    job->width = img->width; job->height = img->height;
+    job->load_data = img->load_data;
+    zero_at_ptr(&img->load_data);
+    job->timings = img->timings;
+    return job;
+}
+
+static inline void
+take_decoded_data(Image *img, DecodeJob *job) {
+    img->load_data = job->load_data;
+    zero_at_ptr(&job->load_data);
+    img->width = job->width; img->height = job->height;
+    img->timings = job->timings;
+}
+
+static inline void
+upload_image(GraphicsManager *self, Image *img) {
+    uint32_t width = img->width, height = img->height;
+    if (texture_scale > 0 && img->needed_width) { width = MIN(width, img->needed_width); height = MIN(height, img->needed_height); }
+    monotonic_t start = monotonic();
+    TRACE_BEGIN("upload_image");
+    upload_texture(img, &img->load_data, width, height);
+    TRACE_END("upload_image");
+    img->timings.upload += monotonic() - start;
+    img->upload_pending = false;
+    // The pixels are kept to re-upload a downscaled texture at a higher
+    // resolution, should a larger placement need it
+    bool downscaled = img->texture->texture_width < img->width || img->texture->texture_height < img->height;
+    if (!downscaled) free_load_data(&img->load_data);
+    self->used_storage -= img->used_storage;
+    img->used_storage = img->texture->gpu_sz + (downscaled ? img->load_data.data_sz : 0);
+    self->used_storage += img->used_storage;
+}
+
+static inline void
+update_needed_texture_size(GraphicsManager *self, Image *img, const ImageRef *ref, CellPixelSize cell) {
+    // The texture of an image needs texture_scale texels per pixel of its
+    // largest placement. Animated images are always at full resolution.
+    if (texture_scale <= 0 || img->num_frames > 1 || !ref->src_width || !ref->src_height) return;
+    double width = ref->num_cols ? (double)ref->num_cols * cell.width : ref->src_width;
+    double height = ref->num_rows ? (double)ref->num_rows * cell.height : ref->src_height;
+    uint32_t needed_width = (uint32_t)MIN((double)img->width, ceil(img->width * texture_scale * width / ref->src_width));
+    uint32_t needed_height = (uint32_t)MIN((double)img->height, ceil(img->height * texture_scale * height / ref->src_height));
+    needed_width = MAX(MAX(needed_width, 1u), img->needed_width); needed_height = MAX(MAX(needed_height, 1u), img->needed_height);
+    if (needed_width == img->needed_width && needed_height == img->needed_height) return;
+    img->needed_width = needed_width; img->needed_height = needed_height;
+    if (send_to_gpu && img->data_loaded && (!img->texture || img->texture->texture_width < needed_width || img->texture->texture_height < needed_height)) {
+        img->upload_pending = true; self->has_pending_uploads = true;
+    }
+}
+
+static inline bool
+finish_image_load(GraphicsManager *self, Image *img, bool upload_now) {
+    size_t required_sz = (img->load_data.is_opaque ? 3 : 4) * img->width * img->height;
+    if (img->load_data.data_sz != required_sz) {
+        set_add_response("EINVAL", "Image dimensions: %ux%u do not match data size: %zu, expected size: %zu", img->width, img->height, img->load_data.data_sz, required_sz);
+        img->data_loaded = false;
+        return false;
+    }
+    if (LIKELY(img->data_loaded)) {
+        self->used_storage += required_sz;
+        img->used_storage = required_sz;
+        // Frames are uploaded as a layer of the texture of their image, see add_frame()
+        if (LIKELY(send_to_gpu) && !img->is_frame) {
+            // With texture_scale the image is uploaded when it is placed, at
+            // the resolution needed by its placements
+            if (texture_scale > 0) release_texture(img);
+            else if (upload_now) upload_image(self, img);
+            else { img->upload_pending = true; self->has_pending_uploads = true; }
+        }
+        img->timings.load = monotonic() - img->timings.started_at;
+    }
+    return true;
+}
+
+static inline bool
+start_streaming_inflate(Image *img) {
+    LoadData *ld = &img->load_data;
+    int ret;
+    ld->buf_capacity = ld->data_sz;
+    ld->buf = malloc(ld->buf_capacity);
+    ld->zstream = calloc(1, sizeof(z_stream));
+    if (ld->buf == NULL || ld->zstream == NULL) { set_add_response("ENOMEM", "Out of memory"); return false; }
+    ld->buf_used = 0;
+    if ((ret = inflateInit(ld->zstream)) != Z_OK) {
+        free(ld->zstream); ld->zstream = NULL;
+        char ebuf[128];
+        set_add_response("ENOMEM", "Failed to initialize inflate with error: %s", zlib_strerror(ret, ebuf, sizeof(ebuf)));
+        return false;
+    }
+    ld->zstream->next_out = ld->buf;
+    ld->zstream->avail_out = ld->data_sz;
+    return true;
+}
+
+static inline bool
+inflate_chunk(Image *img, const uint8_t *payload, size_t payload_sz, bool is_last) {
+    LoadData *ld = &img->load_data;
+    z_stream *z = ld->zstream;
+    char ebuf[128];
+    z->next_in = (Bytef*)payload;
+    z->avail_in = payload_sz;
+    monotonic_t start = monotonic();
+    int ret = inflate(z, is_last ? Z_FINISH : Z_NO_FLUSH);
+    img->timings.inflate += monotonic() - start;
+    ld->buf_used = ld->data_sz - z->avail_out;
+    if (is_last) {
+        if (ret != Z_STREAM_END) {
+            set_add_response("EINVAL", "Failed to inflate image data with error: %s", zlib_strerror(ret, ebuf, sizeof(ebuf)));
+            return false;
+        }
+        if (z->avail_out) { set_add_response("EINVAL", "Image data size post inflation does not match expected size"); return false; }
+        inflateEnd(z); free(z); ld->zstream = NULL;
+        return true;
+    }
+    switch(ret) {
+        case Z_OK:
+        case Z_BUF_ERROR:
+            // The payload is not kept around, so all of it must have been consumed
+            if (z->avail_in) { set_add_response("EINVAL", "Image data size post inflation does not match expected size"); return false; }
+            break;
+        case Z_STREAM_END:
+            break;
+        default:
+            set_add_response("EINVAL", "Failed to inflate image data with error: %s", zlib_strerror(ret, ebuf, sizeof(ebuf)));
+            return false;
+    }
+    return true;
+}
 
 static Image*
 handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_t *payload, bool *is_dirty, uint32_t iid) {
@@ -274,7 +1157,6 @@ handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_
     bool existing, init_img = true;
     Image *img = NULL;
     unsigned char tt = g->transmission_type ? g->transmission_type : 'd';
-    enum FORMATS { RGB=24, RGBA=32, PNG=100 };
     uint32_t fmt = g->format ? g->format : RGBA;
     if (tt == 'd' && self->loading_image) init_img = false;
     if (init_img) {
@@ -282,20 +1164,34 @@ handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_
         self->last_init_graphics_command.id = iid;
         self->loading_image = 0;
         if (g->data_width > 10000 || g->data_height > 10000) ABRT(EINVAL, "Image too large");
-        remove_images(self, add_trim_predicate, 0);
-        img = find_or_create_image(self, iid, &existing);
+        trim_added_images(self);
+        uint32_t width = g->data_width, height = g->data_height;
+        bool is_frame = g->action == 'f';
+        if (is_frame) {
+            // Frames are loaded into an anonymous image, which is added to the
+            // frames of the image with the id once loaded, see add_frame()
+            Image *parent = img_by_client_id(self, iid);
+            if (!parent || !parent->data_loaded) ABRT(ENOENT, "Frame refers to non-existent image with id: %u", iid);
+            if (parent->num_frames >= MAX_FRAMES) ABRT(EFBIG, "Too many frames in image with id: %u", iid);
+            if (!width) width = parent->width;
+            if (!height) height = parent->height;
+        }
+        img = find_or_create_image(self, is_frame ? 0 : iid, &existing);
         if (existing) {
             free_load_data(&img->load_data);
             img->data_loaded = false;
-            free_refs_data(img);
+            remove_refs_of_image(self, img);
+            remove_frames(self, img);
             *is_dirty = true;
             self->layers_dirty = true;
-        } else {
-            img->internal_id = internal_id_counter++;
-            img->client_id = iid;
         }
-        img->atime = monotonic(); img->used_storage = 0;
-        img->width = g->data_width; img->height = g->data_height;
+        add_trim_candidate(self, img);
+        touch_image(self, img);
+        self->used_storage -= img->used_storage; img->used_storage = 0;
+        img->width = width; img->height = height; img->is_frame = is_frame;
+        zero_at_ptr(&img->timings);
+        img->timings.started_at = monotonic();
+        img->needed_width = 0; img->needed_height = 0;
         switch(fmt) {
             case PNG:
                 if (g->data_sz > MAX_DATA_SZ) ABRT(EINVAL, "PNG data size too large");
@@ -305,7 +1201,7 @@ handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_
                 break;
             case RGB:
             case RGBA:
-                img->load_data.data_sz = g->data_width * g->data_height * (fmt / 8);
+                img->load_data.data_sz = img->width * img->height * (fmt / 8);
                 if (!img->load_data.data_sz) ABRT(EINVAL, "Zero width/height not allowed");
                 img->load_data.is_4byte_aligned = fmt == RGBA || (img->width % 4 == 0);
                 img->load_data.is_opaque = fmt == RGB;
@@ -315,17 +1211,24 @@ handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_
         }
         if (tt == 'd') {
             if (g->more) self->loading_image = img->internal_id;
-            img->load_data.buf_capacity = img->load_data.data_sz + (g->compressed ? 1024 : 10);  // compression header
-            img->load_data.buf = malloc(img->load_data.buf_capacity);
-            img->load_data.buf_used = 0;
-            if (img->load_data.buf == NULL) {
-                ABRT(ENOMEM, "Out of memory");
-                img->load_data.buf_capacity = 0; img->load_data.buf_used = 0;
+            if (g->more && g->compressed == 'z' && fmt != PNG) {
+                // Inflate the chunks as they arrive, directly into a buffer
+                // of the final size, instead of accumulating the compressed data
+                if (!start_streaming_inflate(img)) { self->loading_image = 0; img->data_loaded = false; return NULL; }
+            } else {
+                img->load_data.buf_capacity = img->load_data.data_sz + (g->compressed ? 1024 : 10);  // compression header
+                img->load_data.buf = malloc(img->load_data.buf_capacity);
+                img->load_data.buf_used = 0;
+                if (img->load_data.buf == NULL) {
+                    ABRT(ENOMEM, "Out of memory");
+                    img->load_data.buf_capacity = 0; img->load_data.buf_used = 0;
+                }
             }
         }
     } else {
         self->last_init_graphics_command.more = g->more;
         self->last_init_graphics_command.payload_sz = g->payload_sz;
+        self->last_init_graphics_command.payload_decode_time = g->payload_decode_time;
         g = &self->last_init_graphics_command;
         tt = g->transmission_type ? g->transmission_type : 'd';
         fmt = g->format ? g->format : RGBA;
@@ -337,8 +1240,19 @@ handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_
     }
     int fd;
     static char fname[2056] = {0};
+    bool inflated = false;
+    ShmChannel *channel;
+    const uint8_t *frame = NULL;
+    size_t frame_sz = 0;
+    img->timings.base64 += g->payload_decode_time;
     switch(tt) {
         case 'd':  // direct
+            img->timings.transmitted_bytes += g->payload_sz;
+            if (img->load_data.zstream) {
+                if (!inflate_chunk(img, payload, g->payload_sz, !g->more)) { self->loading_image = 0; img->data_loaded = false; return NULL; }
+                if (!g->more) { img->data_loaded = true; self->loading_image = 0; inflated = true; }
+                break;
+            }
             if (img->load_data.buf_capacity - img->load_data.buf_used < g->payload_sz) {
                 if (img->load_data.buf_used + g->payload_sz > MAX_DATA_SZ || fmt != PNG) ABRT(EFBIG, "Too much data");
                 img->load_data.buf_capacity = MIN(2 * img->load_data.buf_capacity, MAX_DATA_SZ);
@@ -362,69 +1276,85 @@ handle_add_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_
             if (fd == -1) ABRT(EBADF, "Failed to open file %s for graphics transmission with error: [%d] %s", fname, errno, strerror(errno));
             img->data_loaded = mmap_img_file(self, img, fd, g->data_sz, g->data_offset);
             safe_close(fd);
+            img->timings.transmitted_bytes += img->load_data.mapped_file_sz;
             if (tt == 't') {
                 if (global_state.boss) { call_boss(safe_delete_temp_file, "s", fname); }
                 else unlink(fname);
             }
             else if (tt == 's') shm_unlink(fname);
             break;
+        case 'S': // A frame in a registered POSIX shared memory object
+            if (!g->id) ABRT(EINVAL, "Shared memory channels require an image id");
+            if (g->payload_sz) {
+                if (g->payload_sz > 2048) ABRT(EINVAL, "Filename too long");
+                snprintf(fname, sizeof(fname)/sizeof(fname[0]), "%.*s", (int)g->payload_sz, payload);
+                channel = register_shm_channel(self, g->id, fname);
+                if (!channel) { self->loading_image = 0; img->data_loaded = false; return NULL; }
+            } else {
+                channel = shm_channel_for(self, g->id);
+                if (!channel) ABRT(ENOENT, "No shared memory object registered for image id: %u", g->id);
+                if (!refresh_shm_channel(channel)) { self->loading_image = 0; img->data_loaded = false; return NULL; }
+            }
+            if (g->data_offset >= channel->sz) ABRT(EINVAL, "Offset: %u is outside the shared memory object of size: %zu", g->data_offset, channel->sz);
+            frame = channel->addr + g->data_offset;
+            frame_sz = g->data_sz ? g->data_sz : channel->sz - g->data_offset;
+            if (frame_sz > channel->sz - g->data_offset) ABRT(EINVAL, "Size: %zu at offset: %u is outside the shared memory object of size: %zu", frame_sz, g->data_offset, channel->sz);
+            img->timings.transmitted_bytes += frame_sz;
+            if (g->compressed || fmt == PNG) {
+                // Decoding can outlive the frame, so it works on a copy
+                img->load_data.buf = malloc(frame_sz);
+                if (!img->load_data.buf) ABRT(ENOMEM, "Out of memory");
+                memcpy(img->load_data.buf, frame, frame_sz);
+                img->load_data.buf_capacity = frame_sz; img->load_data.buf_used = frame_sz;
+            }
+            img->data_loaded = true;
+            break;
         default:
             ABRT(EINVAL, "Unknown transmission type: %c", g->transmission_type);
     }
     if (!img->data_loaded) return NULL;
     self->loading_image = 0;
-    bool needs_processing = g->compressed || fmt == PNG;
+    bool needs_processing = (g->compressed && !inflated) || fmt == PNG;
     if (needs_processing) {
-        uint8_t *buf; size_t bufsz;
-#define IB { if (img->load_data.buf) { buf = img->load_data.buf; bufsz = img->load_data.buf_used; } else { buf = img->load_data.mapped_file; bufsz = img->load_data.mapped_file_sz; } }
-        switch(g->compressed) {
-            case 'z':
-                IB;
-                if (!inflate_zlib(self, img, buf, bufsz)) {
-                    img->data_loaded = false; return NULL;
-                }
-                break;
-            case 0:
-                break;
-            default:
-                ABRT(EINVAL, "Unknown image compression: %c", g->compressed);
-        }
-        switch(fmt) {
-            case PNG:
-                IB;
-                if (!inflate_png(self, img, buf, bufsz)) {
-                    img->data_loaded = false; return NULL;
-                }
-                break;
-            default: break;
-        }
-#undef IB
-        img->load_data.data = img->load_data.buf;
-        if (img->load_data.buf_used < img->load_data.data_sz) {
-            ABRT(ENODATA, "Insufficient image data: %zu < %zu", img->load_data.buf_used, img->load_data.data_sz);
-        }
-        if (img->load_data.mapped_file) {
-            munmap(img->load_data.mapped_file, img->load_data.mapped_file_sz);
-            img->load_data.mapped_file = NULL; img->load_data.mapped_file_sz = 0;
+        if (g->compressed && g->compressed != 'z') ABRT(EINVAL, "Unknown image compression: %c", g->compressed);
+        DecodeJob *job = create_decode_job(img, g->compressed, fmt);
+        if (decoders.num_threads) {
+            // The job is queued by grman_handle_command() once it knows how to respond
+            img->decode_pending = true;
+            self->decode_job = job;
+            return img;
         }
+        TRACE_BEGIN("decode_image");
+        bool ok = decode_image_data(job);
+        TRACE_END("decode_image");
+        if (ok) take_decoded_data(img, job);
+        else { snprintf(add_response, arraysz(add_response), "%s", job->error); has_add_respose = true; }
+        free_decode_job(job);
+        if (!ok) { img->data_loaded = false; return NULL; }
     } else {
         if (tt == 'd') {
             if (img->load_data.buf_used < img->load_data.data_sz) {
                 ABRT(ENODATA, "Insufficient image data: %zu < %zu",  img->load_data.buf_used, img->load_data.data_sz);
             } else img->load_data.data = img->load_data.buf;
+        } else if (tt == 'S') {
+            if (frame_sz < img->load_data.data_sz) {
+                ABRT(ENODATA, "Insufficient image data: %zu < %zu",  frame_sz, img->load_data.data_sz);
+            } else img->load_data.data = (uint8_t*)frame;
         } else {
             if (img->load_data.mapped_file_sz < img->load_data.data_sz) {
                 ABRT(ENODATA, "Insufficient image data: %zu < %zu",  img->load_data.mapped_file_sz, img->load_data.data_sz);
             } else img->load_data.data = img->load_data.mapped_file;
         }
     }
-    size_t required_sz = (img->load_data.is_opaque ? 3 : 4) * img->width * img->height;
-    if (img->load_data.data_sz != required_sz) ABRT(EINVAL, "Image dimensions: %ux%u do not match data size: %zu, expected size: %zu", img->width, img->height, img->load_data.data_sz, required_sz);
-    if (LIKELY(img->data_loaded && send_to_gpu)) {
-        send_image_to_gpu(&img->texture_id, img->load_data.data, img->width, img->height, img->load_data.is_opaque, img->load_data.is_4byte_aligned);
-        free_load_data(&img->load_data);
-        self->used_storage += required_sz;
-        img->used_storage = required_sz;
+    if (!finish_image_load(self, img, true)) return NULL;
+    if (frame && img->load_data.data == frame) {
+        // The frame was not uploaded and the client can overwrite it at any
+        // time, so keep a copy
+        img->load_data.buf = malloc(img->load_data.data_sz);
+        if (!img->load_data.buf) ABRT(ENOMEM, "Out of memory");
+        memcpy(img->load_data.buf, frame, img->load_data.data_sz);
+        img->load_data.buf_capacity = img->load_data.data_sz; img->load_data.buf_used = img->load_data.data_sz;
+        img->load_data.data = img->load_data.buf;
     }
     return img;
 #undef MAX_DATA_SZ
@@ -482,31 +1412,42 @@ handle_put_command(GraphicsManager *self, const GraphicsCommand *g, Cursor *c, b
     if (img == NULL) img = img_by_client_id(self, g->id);
     if (img == NULL) { set_add_response("ENOENT", "Put command refers to non-existent image with id: %u", g->id); return; }
     if (!img->data_loaded) { set_add_response("ENOENT", "Put command refers to image with id: %u that could not load its data", g->id); return; }
-    ensure_space_for(img, refs, ImageRef, img->refcnt + 1, refcap, 16, true);
     *is_dirty = true;
     self->layers_dirty = true;
+    if (self->row_offset > MAX_ROW_OFFSET || self->row_offset < -MAX_ROW_OFFSET) rebase_refs(self);
+    int32_t start_row = (int32_t)abs_row(self, c->y);
     ImageRef *ref = NULL;
-    for (size_t i=0; i < img->refcnt; i++) {
-        if ((unsigned)img->refs[i].start_row == c->x && (unsigned)img->refs[i].start_column == c->y) {
-            ref = img->refs + i;
+    size_t i = ref_lower_bound(self, start_row);
+    for (; i < self->num_refs && self->refs[i].start_row == start_row; i++) {
+        if (self->refs[i].image_id == img->internal_id && self->refs[i].start_column == (int32_t)c->x) {
+            ref = self->refs + i;
             break;
         }
     }
     if (ref == NULL) {
-        ref = img->refs + img->refcnt++;
+        // Placements are almost always added below all existing ones, so this
+        // is an append
+        ensure_space_for(self, refs, ImageRef, self->num_refs + 1, refs_capacity, 64, false);
+        memmove(self->refs + i + 1, self->refs + i, (self->num_refs - i) * sizeof(ImageRef));
+        self->num_refs++;
+        ref = self->refs + i;
         zero_at_ptr(ref);
+        ref->image_id = img->internal_id;
+        img->refcnt++;
     }
-    img->atime = monotonic();
+    touch_image(self, img);
     ref->src_x = g->x_offset; ref->src_y = g->y_offset; ref->src_width = g->width ? g->width : img->width; ref->src_height = g->height ? g->height : img->height;
     ref->src_width = MIN(ref->src_width, img->width - (img->width > ref->src_x ? ref->src_x : img->width));
     ref->src_height = MIN(ref->src_height, img->height - (img->height > ref->src_y ? ref->src_y : img->height));
     ref->z_index = g->z_index;
-    ref->start_row = c->y; ref->start_column = c->x;
+    ref->start_row = start_row; ref->start_column = c->x;
     ref->cell_x_offset = MIN(g->cell_x_offset, cell.width - 1);
     ref->cell_y_offset = MIN(g->cell_y_offset, cell.height - 1);
     ref->num_cols = g->num_cells; ref->num_rows = g->num_lines;
     update_src_rect(ref, img);
     update_dest_rect(ref, g->num_cells, g->num_lines, cell);
+    self->max_ref_rows = MAX(self->max_ref_rows, ref->effective_num_rows);
+    update_needed_texture_size(self, img, ref, cell);
     // Move the cursor, the screen will take care of ensuring it is in bounds
     c->x += ref->effective_num_cols; c->y += ref->effective_num_rows - 1;
 }
@@ -539,11 +1480,18 @@ gpu_data_for_centered_image(ImageRenderData *ans, unsigned int screen_width_px,
 
 bool
 grman_update_layers(GraphicsManager *self, unsigned int scrolled_by, float screen_left, float screen_top, float dx, float dy, unsigned int num_cols, unsigned int num_rows, CellPixelSize cell) {
+    if (self->has_pending_uploads) {
+        // Images decoded in the background are uploaded on the next frame
+        self->has_pending_uploads = false;
+        for (size_t i = 0; i < self->image_count; i++) {
+            if (self->images[i].upload_pending) upload_image(self, self->images + i);
+        }
+    }
     if (self->last_scrolled_by != scrolled_by) self->layers_dirty = true;
     self->last_scrolled_by = scrolled_by;
     if (!self->layers_dirty) return false;
     self->layers_dirty = false;
-    size_t i, j;
+    size_t i;
     self->num_of_negative_refs = 0; self->num_of_positive_refs = 0;
     Image *img; ImageRef *ref;
     ImageRect r;
@@ -553,11 +1501,14 @@ grman_update_layers(GraphicsManager *self, unsigned int scrolled_by, float scree
     float screen_height_px = num_rows * cell.height;
     float y0 = screen_top - dy * scrolled_by;
 
-    // Iterate over all visible refs and create render data
+    // Iterate over the refs in the rows that can be visible and create render data
     self->count = 0;
-    for (i = 0; i < self->image_count; i++) { img = self->images + i; for (j = 0; j < img->refcnt; j++) { ref = img->refs + j;
-        r.top = y0 - ref->start_row * dy - dy * (float)ref->cell_y_offset / (float)cell.height;
-        if (ref->num_rows > 0) r.bottom = y0 - (ref->start_row + (int32_t)ref->num_rows) * dy;
+    size_t end = ref_lower_bound(self, abs_row(self, (int64_t)num_rows - scrolled_by));
+    for (i = ref_lower_bound(self, abs_row(self, -(int64_t)scrolled_by - self->max_ref_rows)); i < end; i++) {
+        ref = self->refs + i;
+        int32_t start_row = ref->start_row + self->row_offset;
+        r.top = y0 - start_row * dy - dy * (float)ref->cell_y_offset / (float)cell.height;
+        if (ref->num_rows > 0) r.bottom = y0 - (start_row + (int32_t)ref->num_rows) * dy;
         else r.bottom = r.top - screen_height * (float)ref->src_height / screen_height_px;
         if (r.top <= screen_bottom || r.bottom >= screen_top) continue;  // not visible
 
@@ -565,6 +1516,7 @@ grman_update_layers(GraphicsManager *self, unsigned int scrolled_by, float scree
         if (ref->num_cols > 0) r.right = screen_left + (ref->start_column + (int32_t)ref->num_cols) * dx;
         else r.right = r.left + screen_width * (float)ref->src_width / screen_width_px;
 
+        img = img_by_internal_id(self, ref->image_id);
         if (ref->z_index < 0) self->num_of_negative_refs++; else self->num_of_positive_refs++;
         ensure_space_for(self, render_data, ImageRenderData, self->count + 1, capacity, 64, true);
         ImageRenderData *rd = self->render_data + self->count;
@@ -572,8 +1524,8 @@ grman_update_layers(GraphicsManager *self, unsigned int scrolled_by, float scree
         set_vertex_data(rd, ref, &r);
         self->count++;
         rd->z_index = ref->z_index; rd->image_id = img->internal_id;
-        rd->texture_id = img->texture_id;
-    }}
+        rd->texture_id = img->texture_id; rd->layer = img->current_frame;
+    }
     if (!self->count) return false;
     // Sort visible refs in draw order (z-index, img)
     qsort(self->render_data, self->count, sizeof(self->render_data[0]), cmp_by_zindex_and_image);
@@ -592,27 +1544,242 @@ grman_update_layers(GraphicsManager *self, unsigned int scrolled_by, float scree
 
 // }}}
 
-// Image lifetime/scrolling {{{
+// Animation {{{
+
+// The frames of animated images are the layers of their texture, so advancing
+// an animation only changes the layer of its render data. The animations of
+// all graphics managers are advanced by a single main loop timer.
+
+#define DEFAULT_FRAME_GAP 40u
+#define MIN_FRAME_GAP 10u
+
+static struct {
+    GraphicsManager **managers;
+    size_t count, capacity;
+    id_type timer;
+} animations = {0};
+
+static inline uint32_t
+frame_gap(int32_t gap) {
+    return gap > 0 ? MAX((uint32_t)gap, MIN_FRAME_GAP) : DEFAULT_FRAME_GAP;
+}
+
+static inline void
+ensure_first_frame(Image *img) {
+    // Still images only get an entry for their gap when they get frames
+    if (img->num_frames) return;
+    ensure_space_for(img, frame_gaps, uint32_t, 1, frames_capacity, 4, false);
+    img->frame_gaps[0] = DEFAULT_FRAME_GAP;
+    img->num_frames = 1;
+}
 
 static inline void
-filter_refs(GraphicsManager *self, const void* data, bool free_images, bool (*filter_func)(ImageRef*, Image*, const void*, CellPixelSize), CellPixelSize cell) {
-    self->layers_dirty = self->image_count > 0;
-    for (size_t i = self->image_count; i-- > 0;) {
+frame_shown(GraphicsManager *self, Image *img) {
+    for (size_t i = 0; i < self->count; i++) {
+        ImageRenderData *rd = self->render_data + i;
+        if (rd->image_id == img->internal_id) { rd->layer = img->current_frame; self->frame_changed = true; }
+    }
+}
+
+static monotonic_t
+advance_animations(GraphicsManager *self, monotonic_t now) {
+    // Shows the frames that are due at now and returns the time until the next
+    // frame is due, or -1 if no animation is running
+    if (!self->num_running_animations) return -1;
+    monotonic_t wait = MONOTONIC_T_MAX;
+    for (size_t i = 0; i < self->image_count; i++) {
         Image *img = self->images + i;
-        for (size_t j = img->refcnt; j-- > 0;) {
-            ImageRef *ref = img->refs + j;
-            if (filter_func(ref, img, data, cell)) {
-                remove_i_from_array(img->refs, j, img->refcnt);
-            }
+        if (!img->animation_running) continue;
+        size_t frame = img->current_frame;
+        monotonic_t gap = ms_to_monotonic_t(img->frame_gaps[frame]);
+        // At most one loop of the animation is played per tick, frames are
+        // dropped after a stall rather than played quickly
+        for (size_t n = 0; n < img->num_frames && now - img->current_frame_shown_at >= gap; n++) {
+            img->current_frame_shown_at += gap;
+            frame = (frame + 1) % img->num_frames;
+            gap = ms_to_monotonic_t(img->frame_gaps[frame]);
+        }
+        if (now - img->current_frame_shown_at >= gap) img->current_frame_shown_at = now;
+        if (frame != img->current_frame) { img->current_frame = frame; frame_shown(self, img); }
+        wait = MIN(wait, img->current_frame_shown_at + gap - now);
+    }
+    return wait;
+}
+
+static void
+animation_timer_callback(id_type timer_id UNUSED, void *data UNUSED) {
+    monotonic_t now = monotonic(), wait = MONOTONIC_T_MAX;
+    size_t w = 0;
+    bool frame_changed = false;
+    for (size_t i = 0; i < animations.count; i++) {
+        monotonic_t manager_wait = advance_animations(animations.managers[i], now);
+        if (animations.managers[i]->frame_changed) frame_changed = true;
+        if (manager_wait < 0) continue;
+        animations.managers[w++] = animations.managers[i];
+        wait = MIN(wait, manager_wait);
+    }
+    animations.count = w;
+    // The new frames are drawn by the next render, which needs a tick of the
+    // main loop when the windows are otherwise idle
+    if (frame_changed) request_tick_callback();
+    update_main_loop_timer(animations.timer, w ? wait : ms_to_monotonic_t(DEFAULT_FRAME_GAP), w > 0);
+}
+
+static inline void
+watch_animations(GraphicsManager *self) {
+    for (size_t i = 0; i < animations.count; i++) {
+        if (animations.managers[i] == self) return;
+    }
+    ensure_space_for(&animations, managers, GraphicsManager*, animations.count + 1, capacity, 8, false);
+    animations.managers[animations.count++] = self;
+    // Without a main loop, animations are only advanced by the tests
+    if (!global_state.num_os_windows) return;
+    if (!animations.timer) animations.timer = add_main_loop_timer(ms_to_monotonic_t(DEFAULT_FRAME_GAP), true, animation_timer_callback, NULL, NULL);
+    update_main_loop_timer(animations.timer, ms_to_monotonic_t(MIN_FRAME_GAP), true);
+}
+
+static void
+unwatch_animations(GraphicsManager *self) {
+    for (size_t i = 0; i < animations.count; i++) {
+        if (animations.managers[i] == self) { remove_i_from_array(animations.managers, i, animations.count); break; }
+    }
+}
+
+static inline void
+start_animation(GraphicsManager *self, Image *img) {
+    if (img->animation_running || img->num_frames < 2) return;
+    img->animation_running = true;
+    img->current_frame_shown_at = monotonic();
+    if (!self->num_running_animations++) watch_animations(self);
+}
+
+static inline void
+stop_animation(GraphicsManager *self, Image *img) {
+    if (!img->animation_running) return;
+    img->animation_running = false;
+    self->num_running_animations--;
+}
+
+static inline void
+remove_frames(GraphicsManager *self, Image *img) {
+    // For re-transmitted images, that are still images again
+    stop_animation(self, img);
+    if (img->texture && img->texture->num_layers > 1) release_texture(img);
+    free(img->frame_gaps); img->frame_gaps = NULL;
+    img->num_frames = 0; img->frames_capacity = 0; img->current_frame = 0;
+}
+
+static Image*
+add_frame(GraphicsManager *self, const GraphicsCommand *g, Image *frame) {
+    // Appends the pixels of frame, the anonymous image a frame command was
+    // loaded into, to the frames of the image with the id of the command and
+    // removes it
+    Image *img = img_by_client_id(self, g->id);
+    bool ok = false;
+    if (!img || !img->data_loaded) set_add_response("ENOENT", "Frame refers to non-existent image with id: %u", g->id);
+    else if (frame->width != img->width || frame->height != img->height) set_add_response("EINVAL", "Frame dimensions: %ux%u do not match image dimensions: %ux%u", frame->width, frame->height, img->width, img->height);
+    else if (img->num_frames >= MAX_FRAMES) set_add_response("EFBIG", "Too many frames in image with id: %u", g->id);
+    else {
+        ensure_first_frame(img);
+        ensure_space_for(img, frame_gaps, uint32_t, img->num_frames + 1, frames_capacity, 4, false);
+        img->frame_gaps[img->num_frames] = frame_gap(g->z_index);
+        if (LIKELY(send_to_gpu)) {
+            upload_frame(img, &frame->load_data, img->num_frames);
+            // Pixels kept for a downscaled texture are in the first layer now
+            free_load_data(&img->load_data);
         }
-        if (img->refcnt == 0 && (free_images || img->client_id == 0)) remove_image(self, i);
+        img->num_frames++;
+        self->used_storage -= img->used_storage;
+        img->used_storage = img->texture ? img->texture->gpu_sz : img->used_storage + frame->used_storage;
+        self->used_storage += img->used_storage;
+        touch_image(self, img);
+        ok = true;
     }
+    remove_image(self, frame - self->images);
+    return ok ? img_by_client_id(self, g->id) : NULL;
+}
+
+static void
+handle_animation_command(GraphicsManager *self, const GraphicsCommand *g) {
+    has_add_respose = false;
+    Image *img = img_by_client_id(self, g->id);
+    if (img == NULL) { set_add_response("ENOENT", "Animation command refers to non-existent image with id: %u", g->id); return; }
+    size_t num_frames = MAX(1u, img->num_frames);
+    if (g->num_lines) {
+        if (g->num_lines > num_frames) { set_add_response("ENOENT", "Animation command refers to non-existent frame: %u of image with id: %u", g->num_lines, g->id); return; }
+        ensure_first_frame(img);
+        img->frame_gaps[g->num_lines - 1] = frame_gap(g->z_index);
+    }
+    if (g->num_cells) {
+        if (g->num_cells > num_frames) { set_add_response("ENOENT", "Animation command refers to non-existent frame: %u of image with id: %u", g->num_cells, g->id); return; }
+        img->current_frame = g->num_cells - 1;
+        img->current_frame_shown_at = monotonic();
+        frame_shown(self, img);
+    }
+    switch (g->data_width) {
+        case 1: stop_animation(self, img); break;
+        case 2: start_animation(self, img); break;
+    }
+}
+
+// }}}
+
+// Image lifetime/scrolling {{{
+
+static inline void
+remove_unreferenced_images(GraphicsManager *self) {
+    while (self->lru[UNREFERENCED_LRU].tail != NO_IMAGE) remove_image(self, self->lru[UNREFERENCED_LRU].tail);
+}
+
+typedef bool (*ref_filter_func)(ImageRef*, Image*, const void*, CellPixelSize);
+
+static inline void
+filter_ref_range(GraphicsManager *self, const void* data, bool free_images, ref_filter_func filter_func, CellPixelSize cell, size_t start, size_t end) {
+    if (self->image_count) self->layers_dirty = true;
+    size_t w = start;
+    for (size_t i = start; i < end; i++) {
+        ImageRef *ref = self->refs + i;
+        size_t idx = id_map_get(&self->images_by_internal_id, ref->image_id);
+        Image *img = self->images + idx;
+        // The filters work with screen rows
+        ref->start_row += self->row_offset;
+        bool remove = filter_func(ref, img, data, cell);
+        ref->start_row -= self->row_offset;
+        if (!remove) {
+            if (w != i) self->refs[w] = *ref;
+            w++;
+            continue;
+        }
+        if (--img->refcnt == 0) {
+            if (free_images || img->client_id == 0) remove_image(self, idx);
+            else { lru_unlink(self, idx); lru_push_front(self, idx); }
+        }
+    }
+    if (w < end) {
+        memmove(self->refs + w, self->refs + end, (self->num_refs - end) * sizeof(ImageRef));
+        self->num_refs -= end - w;
+        refs_removed(self);
+    }
+    // Filters can move placements, but only within the rows they were
+    // selected from
+    sort_refs(self->refs + start, w - start);
+    if (free_images) remove_unreferenced_images(self);
+}
+
+static inline void
+filter_refs(GraphicsManager *self, const void* data, bool free_images, ref_filter_func filter_func, CellPixelSize cell) {
+    filter_ref_range(self, data, free_images, filter_func, cell, 0, self->num_refs);
+}
+
+static inline void
+filter_refs_in_rows(GraphicsManager *self, const void* data, bool free_images, ref_filter_func filter_func, CellPixelSize cell, int64_t first_row, int64_t last_row) {
+    // Only the placements that start in the screen rows [first_row, last_row] are filtered
+    filter_ref_range(self, data, free_images, filter_func, cell, ref_lower_bound(self, abs_row(self, first_row)), ref_lower_bound(self, abs_row(self, last_row) + 1));
 }
 
 static inline bool
 scroll_filter_func(ImageRef *ref, Image UNUSED *img, const void *data, CellPixelSize cell UNUSED) {
     ScrollData *d = (ScrollData*)data;
-    ref->start_row += d->amt;
     return ref->start_row + (int32_t)ref->effective_num_rows <= d->limit;
 }
 
@@ -659,7 +1826,16 @@ scroll_filter_margins_func(ImageRef* ref, Image* img, const void* data, CellPixe
 
 void
 grman_scroll_images(GraphicsManager *self, const ScrollData *data, CellPixelSize cell) {
-    filter_refs(self, data, true, data->has_margins ? scroll_filter_margins_func : scroll_filter_func, cell);
+    if (data->has_margins) {
+        filter_refs_in_rows(self, data, true, scroll_filter_margins_func, cell, data->margin_top, data->margin_bottom);
+        return;
+    }
+    if (self->num_refs) {
+        self->row_offset += data->amt;
+        if (self->row_offset > MAX_ROW_OFFSET || self->row_offset < -MAX_ROW_OFFSET) rebase_refs(self);
+    }
+    // Only placements that start above the limit can have scrolled off it
+    filter_refs_in_rows(self, data, true, scroll_filter_func, cell, INT32_MIN, data->limit);
 }
 
 static inline bool
@@ -674,7 +1850,8 @@ clear_all_filter_func(ImageRef *ref UNUSED, Image UNUSED *img, const void UNUSED
 
 void
 grman_clear(GraphicsManager *self, bool all, CellPixelSize cell) {
-    filter_refs(self, NULL, true, all ? clear_all_filter_func : clear_filter_func, cell);
+    if (all) filter_refs(self, NULL, true, clear_all_filter_func, cell);
+    else filter_refs_in_rows(self, NULL, true, clear_filter_func, cell, -(int64_t)self->max_ref_rows, INT32_MAX);
 }
 
 static inline bool
@@ -720,21 +1897,29 @@ handle_delete_command(GraphicsManager *self, const GraphicsCommand *g, Cursor *c
 #define I(u, data, func) filter_refs(self, data, g->delete_action == u, func, cell); *is_dirty = true; break
 #define D(l, u, data, func) case l: case u: I(u, data, func)
 #define G(l, u, func) D(l, u, g, func)
+// Only placements that start in the rows that intersect row y can match
+#define IY(u, data, func) filter_refs_in_rows(self, data, g->delete_action == u, func, cell, (int64_t)(data)->y_offset - 1 - self->max_ref_rows, (int64_t)(data)->y_offset - 1); *is_dirty = true; break
+#define Y(l, u, func) case l: case u: IY(u, g, func)
         case 0:
         D('a', 'A', NULL, clear_filter_func);
-        D('i', 'I', &g->id, id_filter_func);
-        G('p', 'P', point_filter_func);
-        G('q', 'Q', point3d_filter_func);
+        case 'i':
+        case 'I':
+            if (g->delete_action == 'I') release_shm_channel(self, g->id);
+            I('I', &g->id, id_filter_func);
+        Y('p', 'P', point_filter_func);
+        Y('q', 'Q', point3d_filter_func);
         G('x', 'X', x_filter_func);
-        G('y', 'Y', y_filter_func);
+        Y('y', 'Y', y_filter_func);
         G('z', 'Z', z_filter_func);
         case 'c':
         case 'C':
             d.x_offset = c->x + 1; d.y_offset = c->y + 1;
-            I('C', &d, point_filter_func);
+            IY('C', &d, point_filter_func);
         default:
             REPORT_ERROR("Unknown graphics command delete action: %c", g->delete_action);
             break;
+#undef Y
+#undef IY
 #undef G
 #undef D
 #undef I
@@ -750,19 +1935,58 @@ grman_resize(GraphicsManager *self, index_type UNUSED old_lines, index_type UNUS
 
 void
 grman_rescale(GraphicsManager *self, CellPixelSize cell) {
-    ImageRef *ref; Image *img;
+    ImageRef *ref;
     self->layers_dirty = true;
-    for (size_t i = self->image_count; i-- > 0;) {
-        img = self->images + i;
-        for (size_t j = img->refcnt; j-- > 0;) {
-            ref = img->refs + j;
-            ref->cell_x_offset = MIN(ref->cell_x_offset, cell.width - 1);
-            ref->cell_y_offset = MIN(ref->cell_y_offset, cell.height - 1);
-            update_dest_rect(ref, ref->num_cols, ref->num_rows, cell);
-        }
+    self->max_ref_rows = 0;
+    for (size_t i = 0; i < self->num_refs; i++) {
+        ref = self->refs + i;
+        ref->cell_x_offset = MIN(ref->cell_x_offset, cell.width - 1);
+        ref->cell_y_offset = MIN(ref->cell_y_offset, cell.height - 1);
+        update_dest_rect(ref, ref->num_cols, ref->num_rows, cell);
+        self->max_ref_rows = MAX(self->max_ref_rows, ref->effective_num_rows);
+        update_needed_texture_size(self, img_by_internal_id(self, ref->image_id), ref, cell);
     }
 }
 
+static inline const char*
+finish_add_command(GraphicsManager *self, Image *image, bool data_loaded, uint32_t response_id, const GraphicsCommand *init_command, bool is_query, Cursor *c, bool *is_dirty, CellPixelSize cell) {
+    if (init_command->action == 'f' && image && image->data_loaded) {
+        image = add_frame(self, init_command, image);
+        data_loaded = image != NULL;
+    }
+    const char *ret = create_add_response(self, data_loaded, response_id);
+    if (init_command->action == 'T' && image && image->data_loaded) handle_put_command(self, init_command, c, is_dirty, image, cell);
+    id_type added_image_id = image ? image->internal_id : 0;
+    if (is_query) trim_added_images(self);
+    if (self->used_storage > self->storage_limit) apply_storage_quota(self, self->storage_limit, added_image_id);
+    return ret;
+}
+
+const char*
+grman_handle_decoded_image(GraphicsManager *self, Cursor *c, bool *is_dirty, CellPixelSize cell) {
+    DecodeJob *job = self->decode_job;
+    self->decode_job = NULL;
+    has_add_respose = false;
+    Image *img = img_by_internal_id(self, job->image_id);
+    bool data_loaded = job->ok;
+    if (!job->ok) {
+        snprintf(add_response, arraysz(add_response), "%s", job->error); has_add_respose = true;
+    }
+    if (img) {
+        img->decode_pending = false;
+        if (job->ok) {
+            take_decoded_data(img, job);
+            if (!finish_image_load(self, img, false)) img = NULL;
+        } else { img->data_loaded = false; add_trim_candidate(self, img); img = NULL; }
+        self->layers_dirty = true;
+    }
+    // If the image was deleted while it was being decoded, respond as it would
+    // have been responded to before the deletion
+    const char *ret = finish_add_command(self, img, data_loaded, job->response_id, &job->command, job->is_query, c, is_dirty, cell);
+    free_decode_job(job);
+    return ret;
+}
+
 const char*
 grman_handle_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_t *payload, Cursor *c, bool *is_dirty, CellPixelSize cell) {
     const char *ret = NULL;
@@ -771,15 +1995,22 @@ grman_handle_command(GraphicsManager *self, const GraphicsCommand *g, const uint
         case 0:
         case 't':
         case 'T':
+        case 'f':
         case 'q': {
             uint32_t iid = g->id, q_iid = iid;
             if (g->action == 'q') { iid = 0; if (!q_iid) { REPORT_ERROR("Query graphics command without image id"); break; } }
             Image *image = handle_add_command(self, g, payload, is_dirty, iid);
-            ret = create_add_response(self, image != NULL, g->action == 'q' ? q_iid: self->last_init_graphics_command.id);
-            if (self->last_init_graphics_command.action == 'T' && image && image->data_loaded) handle_put_command(self, &self->last_init_graphics_command, c, is_dirty, image, cell);
-            id_type added_image_id = image ? image->internal_id : 0;
-            if (g->action == 'q') remove_images(self, add_trim_predicate, 0);
-            if (self->used_storage > STORAGE_LIMIT) apply_storage_quota(self, STORAGE_LIMIT, added_image_id);
+            uint32_t response_id = g->action == 'q' ? q_iid: self->last_init_graphics_command.id;
+            if (self->decode_job) {
+                // The response is sent and the image is placed once decoding
+                // is done, see screen_image_decode_pending()
+                self->decode_job->response_id = response_id;
+                self->decode_job->is_query = g->action == 'q';
+                self->decode_job->command = self->last_init_graphics_command;
+                queue_decode_job(self->decode_job);
+                break;
+            }
+            ret = finish_add_command(self, image, image != NULL, response_id, &self->last_init_graphics_command, g->action == 'q', c, is_dirty, cell);
             break;
         }
         case 'p':
@@ -793,6 +2024,14 @@ grman_handle_command(GraphicsManager *self, const GraphicsCommand *g, const uint
         case 'd':
             handle_delete_command(self, g, c, is_dirty, cell);
             break;
+        case 'a':
+            if (!g->id) {
+                REPORT_ERROR("Animation graphics command without image id");
+                break;
+            }
+            handle_animation_command(self, g);
+            ret = create_add_response(self, true, g->id);
+            break;
         default:
             REPORT_ERROR("Unknown graphics command action: %c", g->action);
             break;
@@ -812,8 +2051,18 @@ new(PyTypeObject UNUSED *type, PyObject UNUSED *args, PyObject UNUSED *kwds) {
 static inline PyObject*
 image_as_dict(Image *img) {
 #define U(x) #x, img->x
-    return Py_BuildValue("{sI sI sI sI sK sI sO sO sN}",
-        U(texture_id), U(client_id), U(width), U(height), U(internal_id), U(refcnt),
+    PyObject *frame_gaps = PyTuple_New(img->num_frames);
+    if (!frame_gaps) return NULL;
+    for (size_t i = 0; i < img->num_frames; i++) PyTuple_SET_ITEM(frame_gaps, i, PyLong_FromUnsignedLong(img->frame_gaps[i]));
+    const ImageTimings *t = &img->timings;
+#define T(x) #x, monotonic_t_to_s_double(t->x)
+    PyObject *timings = Py_BuildValue("{sd sd sd sd sd sn}", T(base64), T(inflate), T(png), T(upload), T(load), "transmitted_bytes", (Py_ssize_t)t->transmitted_bytes);
+#undef T
+    if (!timings) { Py_DECREF(frame_gaps); return NULL; }
+    return Py_BuildValue("{sI sI sI sI sK sI sI sI sn sn sN sO sN sO sO sN}",
+        U(texture_id), U(client_id), U(width), U(height), U(internal_id), U(refcnt), U(needed_width), U(needed_height),
+        "num_frames", (Py_ssize_t)MAX(1u, img->num_frames), "current_frame", (Py_ssize_t)img->current_frame, "frame_gaps", frame_gaps,
+        "animation_running", img->animation_running ? Py_True : Py_False, "timings", timings,
         "data_loaded", img->data_loaded ? Py_True : Py_False,
         "is_4byte_aligned", img->load_data.is_4byte_aligned ? Py_True : Py_False,
         "data", Py_BuildValue("y#", img->load_data.data, img->load_data.data_sz)
@@ -827,9 +2076,8 @@ image_as_dict(Image *img) {
 
 W(image_for_client_id) {
     unsigned long id = PyLong_AsUnsignedLong(args);
-    bool existing = false;
-    Image *img = find_or_create_image(self, id, &existing);
-    if (!existing) { Py_RETURN_NONE; }
+    Image *img = img_by_client_id(self, id);
+    if (!img) { Py_RETURN_NONE; }
     return image_as_dict(img);
 }
 
@@ -862,6 +2110,102 @@ W(set_send_to_gpu) {
     Py_RETURN_NONE;
 }
 
+W(set_image_texture_scale) {
+    double scale = PyFloat_AsDouble(args);
+    if (PyErr_Occurred()) return NULL;
+    texture_scale = MAX(0, scale);
+    Py_RETURN_NONE;
+}
+
+W(set_image_texture_sharing) {
+    texture_store.enabled = PyObject_IsTrue(args) ? true : false;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+pyimage_texture_stats(PyObject UNUSED *self, PyObject UNUSED *args) {
+#define U(x) #x, texture_stats.x
+    return Py_BuildValue("{sK sK sK sK sK sK sd}",
+        U(textures), U(references), U(gpu_bytes), U(uploads), U(upload_bytes), U(shared),
+        "upload_time", monotonic_t_to_s_double(texture_stats.upload_time));
+#undef U
+}
+
+static PyObject*
+pytest_texture_store(PyObject UNUSED *self, PyObject *args) {
+    // Look up the pixels of images in the store of shared textures, adding
+    // the ones not found, with the first half of their hashes the same for
+    // all of them. Returns the index of the image whose texture each image
+    // would share.
+    PyObject *images;
+    if (!PyArg_ParseTuple(args, "O!", &PyTuple_Type, &images)) return NULL;
+    size_t num = PyTuple_GET_SIZE(images);
+    SharedTexture **added = calloc(MAX(1u, num), sizeof(SharedTexture*));
+    PyObject *ans = PyTuple_New(num);
+    if (!added || !ans) { free(added); Py_CLEAR(ans); return PyErr_NoMemory(); }
+    for (size_t i = 0; i < num; i++) {
+        PyObject *pixels = PyTuple_GET_ITEM(images, i);
+        if (!PyBytes_Check(pixels)) { PyErr_SetString(PyExc_TypeError, "The pixels of images must be bytes"); Py_CLEAR(ans); break; }
+        LoadData ld = {.data = (uint8_t*)PyBytes_AS_STRING(pixels), .data_sz = PyBytes_GET_SIZE(pixels), .is_opaque = true};
+        uint64_t hash[2];
+        texture_hash(&ld, hash);
+        hash[0] = 0;
+        SharedTexture *t = find_texture(hash, &ld, 1, 1, 1, 1);
+        if (!t) {
+            if (!(t = calloc(1, sizeof(SharedTexture)))) { PyErr_NoMemory(); Py_CLEAR(ans); break; }
+            t->width = t->height = t->texture_width = t->texture_height = 1; t->is_opaque = true;
+            t->hash[0] = hash[0]; t->hash[1] = hash[1];
+            add_to_store(t);
+            added[i] = t;
+        }
+        size_t owner = 0;
+        while (owner <= i && added[owner] != t) owner++;
+        // A texture of an image that was not passed in is reported as None
+        if (owner > i) { Py_INCREF(Py_None); PyTuple_SET_ITEM(ans, i, Py_None); }
+        else PyTuple_SET_ITEM(ans, i, PyLong_FromSize_t(owner));
+    }
+    for (size_t i = 0; i < num; i++) {
+        if (added[i]) { remove_from_store(added[i]); free(added[i]); }
+    }
+    free(added);
+    return ans;
+}
+
+static PyObject*
+pytest_downscale_pixels(PyObject UNUSED *self, PyObject *args) {
+    const char *data; Py_ssize_t sz;
+    unsigned int width, height, dest_width, dest_height;
+    int is_opaque;
+    if (!PyArg_ParseTuple(args, "y#IIIIp", &data, &sz, &width, &height, &dest_width, &dest_height, &is_opaque)) return NULL;
+    if ((size_t)sz != (is_opaque ? 3u : 4u) * width * height) { PyErr_SetString(PyExc_ValueError, "The size of the pixel data does not match the dimensions"); return NULL; }
+    if (!dest_width || !dest_height || dest_width > width || dest_height > height) { PyErr_SetString(PyExc_ValueError, "Invalid destination dimensions"); return NULL; }
+    LoadData ld = {.data = (uint8_t*)data, .data_sz = sz, .is_opaque = is_opaque};
+    uint8_t *pixels = downscale_pixels(&ld, width, height, dest_width, dest_height);
+    if (!pixels) return PyErr_NoMemory();
+    PyObject *ans = PyBytes_FromStringAndSize((const char*)pixels, (is_opaque ? 3u : 4u) * dest_width * dest_height);
+    free(pixels);
+    return ans;
+}
+
+W(set_image_decode_threads) {
+    unsigned long num = PyLong_AsUnsignedLong(args);
+    if (PyErr_Occurred()) return NULL;
+    stop_decoders();
+    if (num) {
+        int ret = start_decoders(MIN(num, 64ul));
+        if (ret != 0) return PyErr_Format(PyExc_OSError, "Failed to start image decoder threads with error: %s", strerror(ret));
+    }
+    Py_RETURN_NONE;
+}
+
+W(advance_animations) {
+    // Advances the animations as if the given number of seconds had passed
+    double seconds = PyFloat_AsDouble(args);
+    if (PyErr_Occurred()) return NULL;
+    monotonic_t wait = advance_animations(self, monotonic() + s_double_to_monotonic_t(seconds));
+    return PyFloat_FromDouble(wait < 0 ? -1 : monotonic_t_to_s_double(wait));
+}
+
 W(update_layers) {
     unsigned int scrolled_by, sx, sy; float xstart, ystart, dx, dy;
     CellPixelSize cell;
@@ -872,7 +2216,7 @@ W(update_layers) {
         ImageRenderData *r = self->render_data + i;
 #define R(offset) Py_BuildValue("{sf sf sf sf}", "left", r->vertices[offset + 8], "top", r->vertices[offset + 1], "right", r->vertices[offset], "bottom", r->vertices[offset + 5])
         PyTuple_SET_ITEM(ans, i,
-            Py_BuildValue("{sN sN sI si sK}", "src_rect", R(0), "dest_rect", R(2), "group_count", r->group_count, "z_index", r->z_index, "image_id", r->image_id)
+            Py_BuildValue("{sN sN sI si sK sI}", "src_rect", R(0), "dest_rect", R(2), "group_count", r->group_count, "z_index", r->z_index, "image_id", r->image_id, "layer", r->layer)
         );
 #undef R
     }
@@ -884,14 +2228,29 @@ W(update_layers) {
 static PyMethodDef methods[] = {
     M(image_for_client_id, METH_O),
     M(update_layers, METH_VARARGS),
+    M(advance_animations, METH_O),
     {NULL}  /* Sentinel */
 };
 
 static PyMemberDef members[] = {
     {"image_count", T_UINT, offsetof(GraphicsManager, image_count), 0, "image_count"},
+    {"used_storage", T_PYSSIZET, offsetof(GraphicsManager, used_storage), READONLY, "used_storage"},
+    {"storage_limit", T_PYSSIZET, offsetof(GraphicsManager, storage_limit), 0, "storage_limit"},
+    {"placement_count", T_PYSSIZET, offsetof(GraphicsManager, num_refs), READONLY, "placement_count"},
     {NULL},
 };
 
+static PyObject*
+decode_pending_get(GraphicsManager *self, void UNUSED *closure) {
+    if (self->decode_job) { Py_RETURN_TRUE; }
+    Py_RETURN_FALSE;
+}
+
+static PyGetSetDef getsets[] = {
+    {"decode_pending", (getter)decode_pending_get, NULL, "True while an image is being decoded in the background", NULL},
+    {NULL}  /* Sentinel */
+};
+
 PyTypeObject GraphicsManager_Type = {
     PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "fast_data_types.GraphicsManager",
@@ -902,18 +2261,38 @@ PyTypeObject GraphicsManager_Type = {
     .tp_new = new,
     .tp_methods = methods,
     .tp_members = members,
+    .tp_getset = getsets,
 };
 
 static PyMethodDef module_methods[] = {
     M(shm_write, METH_VARARGS),
     M(shm_unlink, METH_VARARGS),
     M(set_send_to_gpu, METH_O),
+    M(set_image_decode_threads, METH_O),
+    M(set_image_texture_sharing, METH_O),
+    M(set_image_texture_scale, METH_O),
+    M(image_texture_stats, METH_NOARGS),
+    M(test_texture_store, METH_VARARGS),
+    M(test_downscale_pixels, METH_VARARGS),
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
 
 bool
 init_graphics(PyObject *module) {
+    int ret;
+    if ((ret = pthread_mutex_init(&decoders.lock, NULL)) != 0) {
+        PyErr_Format(PyExc_RuntimeError, "Failed to create image decoders mutex: %s", strerror(ret));
+        return false;
+    }
+    if ((ret = pthread_cond_init(&decoders.wakeup, NULL)) != 0 || (ret = pthread_cond_init(&decoders.finished, NULL)) != 0) {
+        PyErr_Format(PyExc_RuntimeError, "Failed to create image decoders condition variable: %s", strerror(ret));
+        return false;
+    }
+    if (Py_AtExit(stop_decoders) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to register the image decoders at exit handler");
+        return false;
+    }
     if (PyType_Ready(&GraphicsManager_Type) < 0) return false;
     if (PyModule_AddObject(module, "GraphicsManager", (PyObject *)&GraphicsManager_Type) != 0) return false;
     if (PyModule_AddFunctions(module, module_methods) != 0) return false;
@@ -14,6 +14,7 @@ typedef struct {
     uint32_t width, height, x_offset, y_offset, data_height, data_width, num_cells, num_lines, cell_x_offset, cell_y_offset;
     int32_t z_index;
     size_t payload_sz;
+    monotonic_t payload_decode_time;
 } GraphicsCommand;
 
 typedef struct {
@@ -23,12 +24,24 @@ typedef struct {
     uint8_t *mapped_file;
     size_t mapped_file_sz;
 
+    // Used to inflate the chunks of compressed, chunked, direct transmissions
+    // as they arrive
+    struct z_stream_s *zstream;
+
     size_t data_sz;
     uint8_t *data;
     bool is_4byte_aligned;
     bool is_opaque;
 } LoadData;
 
+typedef struct {
+    // The time taken by each stage of loading an image. load is the time from
+    // the first command of its transmission until its data was loaded, and
+    // uploaded unless the upload was deferred.
+    monotonic_t started_at, base64, inflate, png, upload, load;
+    size_t transmitted_bytes;
+} ImageTimings;
+
 typedef struct {
     float left, top, right, bottom;
 } ImageRect;
@@ -37,31 +50,77 @@ typedef struct {
     uint32_t src_width, src_height, src_x, src_y;
     uint32_t cell_x_offset, cell_y_offset, num_cols, num_rows, effective_num_rows, effective_num_cols;
     int32_t z_index;
+    // start_row is relative to GraphicsManager::row_offset
     int32_t start_row, start_column;
     ImageRect src_rect;
+    id_type image_id;
 } ImageRef;
 
 
+typedef struct SharedTexture SharedTexture;
+
 typedef struct {
     uint32_t texture_id, client_id, width, height;
+    // The texture size needed by the largest placement, see
+    // update_needed_texture_size()
+    uint32_t needed_width, needed_height;
     id_type internal_id;
+    SharedTexture *texture;
 
-    bool data_loaded;
+    bool data_loaded, decode_pending, upload_pending;
     LoadData load_data;
-
-    ImageRef *refs;
-    size_t refcnt, refcap;
+    ImageTimings timings;
+
+    // Animated images have more than one frame, the first frame is the image
+    // itself. The frames are the layers of its texture, see add_frame().
+    uint32_t *frame_gaps;  // in ms
+    size_t num_frames, frames_capacity, current_frame;
+    monotonic_t current_frame_shown_at;
+    bool animation_running;
+    // Images that hold a frame while it is loaded, see handle_add_command()
+    bool is_frame;
+
+    // Number of placements of this image in GraphicsManager::refs
+    size_t refcnt;
     monotonic_t atime;
     size_t used_storage;
+    // Neighbours in the least recently used list the image is in, see
+    // apply_storage_quota()
+    size_t lru_prev, lru_next;
+    unsigned int lru_list;
 } Image;
 
+typedef struct {
+    id_type key;
+    size_t idx;
+} ImageIdMapEntry;
+
+typedef struct {
+    ImageIdMapEntry *entries;
+    size_t capacity, count;
+} ImageIdMap;
+
+typedef struct {
+    size_t head, tail;
+} ImageLRU;
+
 typedef struct {
     float vertices[16];
-    uint32_t texture_id, group_count;
+    // layer is the current frame of animated images
+    uint32_t texture_id, group_count, layer;
     int z_index;
     id_type image_id;
 } ImageRenderData;
 
+typedef struct DecodeJob DecodeJob;
+
+typedef struct {
+    uint32_t client_id;
+    int fd;
+    uint8_t *addr;
+    size_t sz;
+} ShmChannel;
+
 typedef struct {
     PyObject_HEAD
 
@@ -74,7 +133,31 @@ typedef struct {
     bool layers_dirty;
     size_t num_of_negative_refs, num_of_positive_refs;
     unsigned int last_scrolled_by;
-    size_t used_storage;
+    size_t used_storage, storage_limit;
+    DecodeJob *decode_job;
+    bool has_pending_uploads;
+    ImageIdMap images_by_client_id, images_by_internal_id;
+    // Unreferenced and referenced images, most recently used first
+    ImageLRU lru[2];
+    // Images that might have to be trimmed when the next image is added
+    id_type *trim_candidates;
+    size_t num_trim_candidates, trim_candidates_capacity;
+    // The placements of all images, sorted by start_row. The screen row of a
+    // placement is its start_row + row_offset, so scrolling the whole screen
+    // only changes row_offset.
+    ImageRef *refs;
+    size_t num_refs, refs_capacity;
+    int32_t row_offset;
+    // Upper bound on the effective_num_rows of the placements
+    uint32_t max_ref_rows;
+    // Shared memory objects registered for repeated transmissions, by image id
+    ShmChannel *shm_channels;
+    size_t num_shm_channels, shm_channels_capacity;
+    // Number of images whose animation is running, see advance_animations()
+    size_t num_running_animations;
+    // Set when the current frame of a visible animated image changes, only
+    // the layers of the render data change then
+    bool frame_changed;
 } GraphicsManager;
 
 
@@ -87,6 +170,9 @@ typedef struct {
 GraphicsManager* grman_alloc(void);
 void grman_clear(GraphicsManager*, bool, CellPixelSize fg);
 const char* grman_handle_command(GraphicsManager *self, const GraphicsCommand *g, const uint8_t *payload, Cursor *c, bool *is_dirty, CellPixelSize fg);
+bool grman_decode_finished(GraphicsManager *self);
+void grman_wait_for_decode(GraphicsManager *self);
+const char* grman_handle_decoded_image(GraphicsManager *self, Cursor *c, bool *is_dirty, CellPixelSize fg);
 bool grman_update_layers(GraphicsManager *self, unsigned int scrolled_by, float screen_left, float screen_top, float dx, float dy, unsigned int num_cols, unsigned int num_rows, CellPixelSize);
 void grman_scroll_images(GraphicsManager *self, const ScrollData*, CellPixelSize fg);
 void grman_resize(GraphicsManager*, index_type, index_type, index_type, index_type);
@@ -1,10 +1,13 @@
 #version GLSL_VERSION
 #define ALPHA_TYPE
 
-uniform sampler2D image;
 #ifdef ALPHA_MASK
+uniform sampler2D image;
 uniform uint fg;
 #else
+// The frames of animated images are the layers of their texture
+uniform sampler2DArray image;
+uniform float layer;
 uniform float inactive_text_alpha;
 #endif
 
@@ -25,10 +28,11 @@ vec3 color_to_vec(uint c) {
 
 
 void main() {
-    color = texture(image, texcoord);
 #ifdef ALPHA_MASK
+    color = texture(image, texcoord);
     color = vec4(color_to_vec(fg), color.r);
 #else
+    color = texture(image, vec3(texcoord, layer));
     color.a *= inactive_text_alpha;
 #ifdef PREMULT
     color = vec4(color.rgb * color.a, color.a);
@@ -219,6 +219,7 @@ historybuf_push(HistoryBuf *self) {
         pagerhist_push(self);
         self->start_of_data = (self->start_of_data + 1) % self->ynum;
     } else self->count++;
+    self->lines_added++;
     return idx;
 }
 
@@ -467,6 +468,7 @@ void historybuf_rewrap(HistoryBuf *self, HistoryBuf *other) {
             memcpy(other->segments[i].line_attrs, self->segments[i].line_attrs, SEGMENT_SIZE * sizeof(line_attrs_type));
         }
         other->count = self->count; other->start_of_data = self->start_of_data;
+        other->lines_added = self->lines_added;
         return;
     }
     if (other->pagerhist && other->xnum != self->xnum && other->pagerhist->end != other->pagerhist->start)
@@ -477,6 +479,9 @@ void historybuf_rewrap(HistoryBuf *self, HistoryBuf *other) {
         rewrap_inner(self, other, self->count, NULL, &x, &y);
         for (index_type i = 0; i < other->count; i++) *attrptr(other, (other->start_of_data + i) % other->ynum) |= TEXT_DIRTY_MASK;
     }
+    // Lines are renumbered so that the most recently added line keeps its
+    // number, unless rewrapping created more lines than were ever added
+    other->lines_added = MAX(self->lines_added, (unsigned long long)other->count);
 }
 
 static PyObject*
@@ -124,6 +124,7 @@ update_ime_position(OSWindow *os_window, Window* w, Screen *screen) {
 
 void
 on_key_input(GLFWkeyevent *ev) {
+    monotonic_t key_at = monotonic();
     Window *w = active_window();
     int action = ev->action, native_key = ev->native_key, key = ev->key, mods = ev->mods;
     const char *text = ev->text ? ev->text : "";
@@ -144,6 +145,7 @@ on_key_input(GLFWkeyevent *ev) {
         case 2:  // commit text
             if (*text) {
                 schedule_write_to_child(w->id, 1, text, strlen(text));
+                start_input_latency_probe(screen, key_at);
                 debug("committed pre-edit text: %s\n", text);
             } else debug("committed pre-edit text: (null)\n");
             return;
@@ -197,6 +199,7 @@ on_key_input(GLFWkeyevent *ev) {
             send_key_to_child(w, key, mods, action);
             debug("sent key to child\n");
         }
+        if (action != GLFW_RELEASE) start_input_latency_probe(screen, key_at);
     } else {
         debug("ignoring as keyboard mode does not allow %s events\n", action == GLFW_RELEASE ? "release" : "repeat");
     }
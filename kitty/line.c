@@ -226,13 +226,12 @@ cell_as_utf8_for_fallback(CPUCell *cell, char *buf) {
 
 
 
-PyObject*
-unicode_in_range(Line *self, index_type start, index_type limit, bool include_cc, char leading_char) {
-    size_t n = 0;
-    static Py_UCS4 buf[4096];
+static inline index_type
+text_in_range(Line *self, index_type start, index_type limit, bool include_cc, char leading_char, Py_UCS4 *buf, index_type buflen) {
+    index_type n = 0;
     if (leading_char) buf[n++] = leading_char;
     char_type previous_width = 0;
-    for(index_type i = start; i < limit && n < arraysz(buf) - 2 - arraysz(self->cpu_cells->cc_idx); i++) {
+    for(index_type i = start; i < limit && n < buflen - 2 - arraysz(self->cpu_cells->cc_idx); i++) {
         char_type ch = self->cpu_cells[i].ch;
         if (ch == 0) {
             if (previous_width == 2) { previous_width = 0; continue; };
@@ -249,6 +248,13 @@ unicode_in_range(Line *self, index_type start, index_type limit, bool include_cc
         }
         previous_width = self->gpu_cells[i].attrs & WIDTH_MASK;
     }
+    return n;
+}
+
+PyObject*
+unicode_in_range(Line *self, index_type start, index_type limit, bool include_cc, char leading_char) {
+    static Py_UCS4 buf[4096];
+    index_type n = text_in_range(self, start, limit, include_cc, leading_char, buf, arraysz(buf));
     return PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND, buf, n);
 }
 
@@ -257,6 +263,13 @@ line_as_unicode(Line* self) {
     return unicode_in_range(self, 0, xlimit_for_line(self), true, 0);
 }
 
+index_type
+line_as_text(Line *self, Py_UCS4 *buf, index_type buflen) {
+    // The same text as line_as_unicode(), buf must have space for at least
+    // the number of cells in the line times the number of codepoints in a cell
+    return text_in_range(self, 0, xlimit_for_line(self), true, 0, buf, buflen);
+}
+
 static PyObject*
 sprite_at(Line* self, PyObject *x) {
 #define sprite_at_doc "[x] -> Return the sprite in the specified cell"
@@ -23,7 +23,7 @@ from .fast_data_types import (
     set_default_window_icon, set_options
 )
 from .fonts.box_drawing import set_scale
-from .fonts.render import set_font_family
+from .fonts.render import glyph_cache_dir, set_font_family
 from .utils import (
     detach, log_error, single_instance, startup_notification_handler,
     unix_socket_paths
@@ -140,7 +140,7 @@ def _run_app(opts, args, bad_lines=()):
 def run_app(opts, args, bad_lines=()):
     set_scale(opts.box_drawing_scale)
     set_options(opts, is_wayland(), args.debug_gl, args.debug_font_fallback)
-    set_font_family(opts, debug_font_matching=args.debug_font_fallback)
+    set_font_family(opts, debug_font_matching=args.debug_font_fallback, glyph_cache=glyph_cache_dir())
     try:
         _run_app(opts, args, bad_lines)
     finally:
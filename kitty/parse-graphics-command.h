@@ -12,8 +12,7 @@ static inline void parse_graphics_code(Screen *screen,
   uint64_t lcode;
   bool is_negative;
   zero_at_ptr(&g);
-  size_t sz;
-  static uint8_t payload[4096];
+  const uint8_t *payload = screen->apc_payload.buf;
 
   enum KEYS {
     action = 'a',
@@ -130,7 +129,8 @@ static inline void parse_graphics_code(Screen *screen,
       case action: {
         g.action = screen->parser_buf[pos++] & 0xff;
         if (g.action != 'q' && g.action != 'd' && g.action != 't' &&
-            g.action != 'T' && g.action != 'p') {
+            g.action != 'T' && g.action != 'p' && g.action != 'f' &&
+            g.action != 'a') {
           REPORT_ERROR("Malformed GraphicsCommand control block, unknown flag "
                        "value for action: 0x%x",
                        g.action);
@@ -158,7 +158,8 @@ static inline void parse_graphics_code(Screen *screen,
       case transmission_type: {
         g.transmission_type = screen->parser_buf[pos++] & 0xff;
         if (g.transmission_type != 's' && g.transmission_type != 'f' &&
-            g.transmission_type != 't' && g.transmission_type != 'd') {
+            g.transmission_type != 't' && g.transmission_type != 'd' &&
+            g.transmission_type != 'S') {
           REPORT_ERROR("Malformed GraphicsCommand control block, unknown flag "
                        "value for transmission_type: 0x%x",
                        g.transmission_type);
@@ -267,18 +268,9 @@ static inline void parse_graphics_code(Screen *screen,
       }
       break;
 
-    case PAYLOAD: {
-      sz = screen->parser_buf_pos - pos;
-      const char *err = base64_decode(screen->parser_buf + pos, sz, payload,
-                                      sizeof(payload), &g.payload_sz);
-      if (err != NULL) {
-        REPORT_ERROR(
-            "Failed to parse GraphicsCommand command payload with error: %s",
-            err);
-        return;
-      }
+    case PAYLOAD:
       pos = screen->parser_buf_pos;
-    } break;
+      break;
 
     } // end switch
   }   // end while
@@ -296,6 +288,19 @@ static inline void parse_graphics_code(Screen *screen,
     REPORT_ERROR(
         "Malformed GraphicsCommand control block, expecting a flag value");
     return;
+
+  case PAYLOAD: {
+    const char *err = base64_decoder_finish(&screen->apc_payload.decoder);
+    if (err != NULL) {
+      REPORT_ERROR(
+          "Failed to parse GraphicsCommand command payload with error: %s",
+          err);
+      return;
+    }
+    g.payload_sz = screen->apc_payload.decoder.dest_sz;
+    g.payload_decode_time = screen->apc_payload.decode_time;
+  } break;
+
   default:
     break;
   }
@@ -975,6 +975,61 @@ accumulate_oth(Screen *screen, uint32_t ch, PyObject DUMP_UNUSED *dump_callback)
     return false;
 }
 
+static inline void
+start_apc_payload(Screen *screen) {
+    screen->apc_payload.active = true;
+    screen->apc_payload.decode_time = 0;
+    base64_decoder_init(&screen->apc_payload.decoder, screen->apc_payload.buf, APC_PAYLOAD_SZ);
+}
+
+static inline void
+decode_apc_payload(Screen *screen, uint32_t ch) {
+    // Only the bytes around an ESC in the payload, or non-ASCII bytes in
+    // latin1 mode, are decoded one at a time, see _parse_bytes()
+    uint8_t b = ch & 0xff;
+    monotonic_t start = monotonic();
+    base64_decode_chunk(&screen->apc_payload.decoder, &b, 1);
+    screen->apc_payload.decode_time += monotonic() - start;
+}
+
+static inline bool
+accumulate_apc(Screen *screen, uint32_t ch, PyObject DUMP_UNUSED *dump_callback) {
+    // The payload of graphics commands is base64 decoded as it is received,
+    // only the control data and a trailing ESC are kept in parser_buf
+    if (screen->parser_buf_pos == 0) screen->apc_payload.active = false;
+    if (!screen->apc_payload.active) {
+        if (accumulate_oth(screen, ch, dump_callback)) return true;
+        if (ch == ';' && screen->parser_buf[0] == 'G') start_apc_payload(screen);
+        return false;
+    }
+    bool after_esc = screen->parser_buf[screen->parser_buf_pos - 1] == ESC;
+    switch(ch) {
+        case ST:
+            return true;
+        case ESC_ST:
+            if (after_esc) { screen->parser_buf_pos--; return true; }
+            break;
+        case ESC:
+            if (after_esc) decode_apc_payload(screen, ESC);
+            else screen->parser_buf[screen->parser_buf_pos++] = ESC;
+            return false;
+    }
+    if (after_esc) { screen->parser_buf_pos--; decode_apc_payload(screen, ESC); }
+    decode_apc_payload(screen, ch);
+    return false;
+}
+
+static inline size_t
+decode_raw_apc_payload(Screen *screen, const uint8_t *buf, size_t len) {
+    // Bulk decode the ASCII run at the start of buf, stopping at anything that
+    // needs the full parser: an ESC or a multi-byte UTF-8 sequence (ST)
+    size_t n = 0;
+    while (n < len && buf[n] < 0x80 && buf[n] != ESC) n++;
+    monotonic_t start = monotonic();
+    base64_decode_chunk(&screen->apc_payload.decoder, buf, n);
+    screen->apc_payload.decode_time += monotonic() - start;
+    return n;
+}
 
 static inline bool
 accumulate_csi(Screen *screen, uint32_t ch, PyObject DUMP_UNUSED *dump_callback) {
@@ -1056,7 +1111,7 @@ END_ALLOW_CASE_RANGE
             if (accumulate_osc(screen, codepoint, dump_callback)) { dispatch_osc(screen, dump_callback); SET_STATE(0); } \
             break; \
         case APC: \
-            if (accumulate_oth(screen, codepoint, dump_callback)) { dispatch_apc(screen, dump_callback); SET_STATE(0); } \
+            if (accumulate_apc(screen, codepoint, dump_callback)) { dispatch_apc(screen, dump_callback); SET_STATE(0); watch_for_pending; } \
             break; \
         case PM: \
             if (accumulate_oth(screen, codepoint, dump_callback)) { dispatch_pm(screen, dump_callback); SET_STATE(0); } \
@@ -1073,40 +1128,28 @@ END_ALLOW_CASE_RANGE
 
 extern uint32_t *latin1_charset;
 
-static inline void
-_parse_bytes(Screen *screen, const uint8_t *buf, Py_ssize_t len, PyObject DUMP_UNUSED *dump_callback) {
-    uint32_t prev = screen->utf8_state;
-    for (unsigned int i = 0; i < (unsigned int)len; i++) {
-        if (screen->use_latin1) {
-            dispatch_unicode_char(latin1_charset[buf[i]], ;);
-        } else {
-            switch (decode_utf8(&screen->utf8_state, &screen->utf8_codepoint, buf[i])) {
-                case UTF8_ACCEPT:
-                    dispatch_unicode_char(screen->utf8_codepoint, ;);
-                    break;
-                case UTF8_REJECT:
-                    screen->utf8_state = UTF8_ACCEPT;
-                    if (prev != UTF8_ACCEPT && i > 0) i--;
-                    break;
-            }
-            prev = screen->utf8_state;
-        }
-    }
-FLUSH_DRAW;
-}
-
+// Parses bytes until either all are consumed or parsing has to be paused,
+// because an image is being decoded or, if watch_for_pending is true, pending
+// mode was started. Returns the number of bytes consumed.
 static inline size_t
-_parse_bytes_watching_for_pending(Screen *screen, const uint8_t *buf, Py_ssize_t len, PyObject DUMP_UNUSED *dump_callback) {
+_parse_bytes(Screen *screen, const uint8_t *buf, Py_ssize_t len, bool watch_for_pending, PyObject DUMP_UNUSED *dump_callback) {
+#define STOP_PARSING if ((watch_for_pending && screen->pending_mode.activated_at) || screen->grman->decode_job) goto end
     uint32_t prev = screen->utf8_state;
     size_t i = 0;
     while(i < (size_t)len) {
+        // ASCII is the same in UTF-8 and latin1, so graphics command payloads
+        // are bulk decoded in both modes
+        if (screen->parser_state == APC && screen->apc_payload.active && screen->parser_buf_pos && (screen->use_latin1 || screen->utf8_state == UTF8_ACCEPT) && screen->parser_buf[screen->parser_buf_pos - 1] != ESC) {
+            i += decode_raw_apc_payload(screen, buf + i, len - i);
+            if (i >= (size_t)len) break;
+        }
         uint8_t ch = buf[i++];
         if (screen->use_latin1) {
-            dispatch_unicode_char(latin1_charset[ch], if (screen->pending_mode.activated_at) goto end);
+            dispatch_unicode_char(latin1_charset[ch], STOP_PARSING);
         } else {
             switch (decode_utf8(&screen->utf8_state, &screen->utf8_codepoint, ch)) {
                 case UTF8_ACCEPT:
-                    dispatch_unicode_char(screen->utf8_codepoint, if (screen->pending_mode.activated_at) goto end);
+                    dispatch_unicode_char(screen->utf8_codepoint, STOP_PARSING);
                     break;
                 case UTF8_REJECT:
                     screen->utf8_state = UTF8_ACCEPT;
@@ -1119,6 +1162,7 @@ _parse_bytes_watching_for_pending(Screen *screen, const uint8_t *buf, Py_ssize_t
 end:
 FLUSH_DRAW;
     return i;
+#undef STOP_PARSING
 }
 
 
@@ -1196,7 +1240,7 @@ end:
 #undef COPY_STOP_BUF
 }
 
-static inline void
+static inline size_t
 do_parse_bytes(Screen *screen, const uint8_t *read_buf, const size_t read_buf_sz, monotonic_t now, PyObject *dump_callback DUMP_UNUSED) {
     enum STATE {START, PARSE_PENDING, PARSE_READ_BUF, QUEUE_PENDING};
     enum STATE state = START;
@@ -1205,6 +1249,7 @@ do_parse_bytes(Screen *screen, const uint8_t *read_buf, const size_t read_buf_sz
     do {
         switch(state) {
             case START:
+                if (screen_image_decode_pending(screen)) return read_buf_pos;
                 if (screen->pending_mode.activated_at) {
                     if (screen->pending_mode.activated_at + screen->pending_mode.wait_time < now) {
                         screen->pending_mode.activated_at = 0;
@@ -1215,16 +1260,24 @@ do_parse_bytes(Screen *screen, const uint8_t *read_buf, const size_t read_buf_sz
                 }
                 break;
 
-            case PARSE_PENDING:
-                _parse_bytes(screen, screen->pending_mode.buf, screen->pending_mode.used, dump_callback);
+            case PARSE_PENDING: {
+                size_t consumed = _parse_bytes(screen, screen->pending_mode.buf, screen->pending_mode.used, false, dump_callback);
+                if (consumed < screen->pending_mode.used) {
+                    // paused for an image decode, keep the rest of the pending bytes for later
+                    screen->pending_mode.used -= consumed;
+                    memmove(screen->pending_mode.buf, screen->pending_mode.buf + consumed, screen->pending_mode.used);
+                    screen->pending_mode.activated_at = 0;
+                    state = START;
+                    break;
+                }
                 screen->pending_mode.used = 0; screen->pending_mode.state = 0;
                 screen->pending_mode.activated_at = 0;  // ignore any pending starts in the pending bytes
                 state = START;
-                break;
+            }   break;
 
             case PARSE_READ_BUF:
                 screen->pending_mode.activated_at = 0; screen->pending_mode.state = 0;
-                read_buf_pos += _parse_bytes_watching_for_pending(screen, read_buf + read_buf_pos, read_buf_sz - read_buf_pos, dump_callback);
+                read_buf_pos += _parse_bytes(screen, read_buf + read_buf_pos, read_buf_sz - read_buf_pos, true, dump_callback);
                 state = START;
                 break;
 
@@ -1245,7 +1298,7 @@ do_parse_bytes(Screen *screen, const uint8_t *read_buf, const size_t read_buf_sz
             }   break;
         }
     } while(read_buf_pos < read_buf_sz || (!screen->pending_mode.activated_at && screen->pending_mode.used));
-
+    return read_buf_pos;
 }
 
 // }}}
@@ -1267,8 +1320,10 @@ FNAME(parse_bytes)(PyObject UNUSED *self, PyObject *args) {
 #else
     if (!PyArg_ParseTuple(args, "O!y*", &Screen_Type, &screen, &pybuf)) return NULL;
 #endif
-    do_parse_bytes(screen, pybuf.buf, pybuf.len, monotonic(), dump_callback);
-    Py_RETURN_NONE;
+    // Returns the number of bytes consumed, which is less than the number
+    // passed in when parsing is paused for an image decode
+    size_t consumed = do_parse_bytes(screen, pybuf.buf, pybuf.len, monotonic(), dump_callback);
+    return PyLong_FromSize_t(consumed);
 }
 
 
@@ -1279,8 +1334,9 @@ FNAME(parse_worker)(Screen *screen, PyObject *dump_callback, monotonic_t now) {
         Py_XDECREF(PyObject_CallFunction(dump_callback, "sy#", "bytes", screen->read_buf, screen->read_buf_sz)); PyErr_Clear();
     }
 #endif
-    do_parse_bytes(screen, screen->read_buf, screen->read_buf_sz, now, dump_callback);
-    screen->read_buf_sz = 0;
+    size_t consumed = do_parse_bytes(screen, screen->read_buf, screen->read_buf_sz, now, dump_callback);
+    if (consumed < screen->read_buf_sz) memmove(screen->read_buf, screen->read_buf + consumed, screen->read_buf_sz - consumed);
+    screen->read_buf_sz -= consumed;
 }
 #undef FNAME
 // }}}
@@ -8,7 +8,7 @@
 
 #include "data-types.h"
 #include <png.h>
-typedef void(*png_error_handler_func)(const char*, const char*);
+typedef void(*png_error_handler_func)(void*, const char*, const char*);
 typedef struct {
     uint8_t *decompressed;
     bool ok;
@@ -16,6 +16,7 @@ typedef struct {
     int width, height;
     size_t sz;
     png_error_handler_func err_handler;
+    void *err_handler_data;
 } png_read_data;
 
 void inflate_png_inner(png_read_data *d, const uint8_t *buf, size_t bufsz);
@@ -5,19 +5,20 @@
 import json
 import os
 import re
+import struct
 import sys
 import types
 from functools import partial
 from contextlib import suppress
 
 from .cli import emph, parse_args
-from .cmds import cmap, parse_subcommand_cli
+from .cmds import StreamedResponse, cmap, parse_subcommand_cli
 from .constants import appname, version
 from .fast_data_types import read_command_response
 from .utils import TTYIO, parse_address_spec
 
 
-def handle_cmd(boss, window, cmd):
+def handle_cmd(boss, window, cmd, allow_streams=False):
     cmd = json.loads(cmd)
     v = cmd['version']
     no_response = cmd.get('no_response', False)
@@ -34,6 +35,8 @@ def handle_cmd(boss, window, cmd):
         if no_response:  # don't report errors if --no-response was used
             return
         raise
+    if isinstance(ans, StreamedResponse) and not allow_streams:
+        ans = ans.fallback()
     response = {'ok': True}
     if ans is not None:
         response['data'] = ans
@@ -96,6 +99,84 @@ class SocketIO:
         return m.group(1)
 
 
+class FramedConnection:
+
+    '''
+    A connection to kitty on which any number of commands can be sent, without
+    waiting for the responses to earlier ones, see rc_protocol.rst. Responses
+    are received in the order the commands were sent, with the request id
+    returned by send() and the response, which is None for commands sent with
+    no_response.
+    '''
+
+    magic = b'kitty-rc-frames\n'
+    header = struct.Struct('>II')
+
+    def __init__(self, to):
+        self.family, self.address = parse_address_spec(to)[:2]
+        self.last_request_id = 0
+        self.buf = b''
+        self.pending = []
+
+    def __enter__(self):
+        import socket
+        self.socket = socket.socket(self.family)
+        self.socket.setblocking(True)
+        self.socket.connect(self.address)
+        self.socket.sendall(self.magic)
+        return self
+
+    def __exit__(self, *a):
+        self.socket.close()
+
+    def send(self, cmd, payload=None, no_response=False):
+        send = {'cmd': cmd, 'version': version, 'no_response': no_response}
+        if payload is not None:
+            send['payload'] = payload
+        data = json.dumps(send).encode('utf-8')
+        self.last_request_id = (self.last_request_id + 1) & 0xffffffff
+        self.socket.sendall(self.header.pack(len(data), self.last_request_id) + data)
+        return self.last_request_id
+
+    def recv_frame(self):
+        if self.pending:
+            return self.pending.pop(0)
+        while True:
+            if len(self.buf) >= self.header.size:
+                sz, request_id = self.header.unpack_from(self.buf)
+                end = self.header.size + sz
+                if len(self.buf) >= end:
+                    data, self.buf = self.buf[self.header.size:end], self.buf[end:]
+                    return request_id, data
+            data = self.socket.recv(65536)
+            if not data:
+                raise EOFError('kitty closed the connection')
+            self.buf += data
+
+    def recv(self):
+        request_id, data = self.recv_frame()
+        return request_id, (json.loads(data.decode('utf-8')) if data else None)
+
+    def recv_stream(self, request_id):
+        '''
+        Yield the chunks of text sent after the response to the command with
+        request_id, when its response has data with stream set. Responses to
+        other commands received meanwhile are returned by later calls to recv().
+        '''
+        others = []
+        try:
+            while True:
+                rid, data = self.recv_frame()
+                if rid != request_id:
+                    others.append((rid, data))
+                elif not data:
+                    break
+                else:
+                    yield data
+        finally:
+            self.pending.extend(others)
+
+
 class RCIO(TTYIO):
 
     def recv(self, timeout):
@@ -126,6 +207,21 @@ def do_io(to, send, no_response):
     return response
 
 
+def do_stream_io(to, send, output):
+    # Send a command whose response may be followed by streamed text, which
+    # is written to output as it is received
+    with FramedConnection(to) as conn:
+        request_id = conn.send(send['cmd'], send.get('payload'))
+        response = conn.recv()[1]
+        data = response.get('data')
+        if response.get('ok') and isinstance(data, dict) and data.get('stream'):
+            del response['data']
+            for chunk in conn.recv_stream(request_id):
+                output.write(chunk)
+            output.flush()
+    return response
+
+
 all_commands = tuple(sorted(cmap))
 cli_msg = (
         'Control {appname} by sending it commands. Set the'
@@ -172,7 +268,10 @@ def main(args):
     send['no_response'] = no_response
     if not global_opts.to and 'KITTY_LISTEN_ON' in os.environ:
         global_opts.to = os.environ['KITTY_LISTEN_ON']
-    response = do_io(global_opts.to, send, no_response)
+    if global_opts.to and not no_response and isinstance(payload, dict) and payload.get('stream'):
+        response = do_stream_io(global_opts.to, send, sys.stdout.buffer)
+    else:
+        response = do_io(global_opts.to, send, no_response)
     if no_response:
         return
     if not response.get('ok'):
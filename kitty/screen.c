@@ -572,10 +572,8 @@ cursor_within_margins(Screen *self) {
     return self->margin_top <= self->cursor->y && self->cursor->y <= self->margin_bottom;
 }
 
-void
-screen_handle_graphics_command(Screen *self, const GraphicsCommand *cmd, const uint8_t *payload) {
-    unsigned int x = self->cursor->x, y = self->cursor->y;
-    const char *response = grman_handle_command(self->grman, cmd, payload, self->cursor, &self->is_dirty, self->cell_size);
+static inline void
+graphics_command_done(Screen *self, const char *response, unsigned int x, unsigned int y) {
     if (response != NULL) write_escape_code_to_child(self, APC, response);
     if (x != self->cursor->x || y != self->cursor->y) {
         bool in_margins = cursor_within_margins(self);
@@ -584,6 +582,26 @@ screen_handle_graphics_command(Screen *self, const GraphicsCommand *cmd, const u
         screen_ensure_bounds(self, false, in_margins);
     }
 }
+
+void
+screen_handle_graphics_command(Screen *self, const GraphicsCommand *cmd, const uint8_t *payload) {
+    unsigned int x = self->cursor->x, y = self->cursor->y;
+    const char *response = grman_handle_command(self->grman, cmd, payload, self->cursor, &self->is_dirty, self->cell_size);
+    graphics_command_done(self, response, x, y);
+}
+
+bool
+screen_image_decode_pending(Screen *self) {
+    // While an image is being decoded in the background, parsing is paused so
+    // that responses and cursor movement happen in the same order as the
+    // commands were received
+    if (!self->grman->decode_job) return false;
+    if (!grman_decode_finished(self->grman)) return true;
+    unsigned int x = self->cursor->x, y = self->cursor->y;
+    const char *response = grman_handle_decoded_image(self->grman, self->cursor, &self->is_dirty, self->cell_size);
+    graphics_command_done(self, response, x, y);
+    return false;
+}
 // }}}
 
 // Modes {{{
@@ -592,6 +610,12 @@ screen_handle_graphics_command(Screen *self, const GraphicsCommand *cmd, const u
 void
 screen_toggle_screen_buffer(Screen *self) {
     bool to_alt = self->linebuf == self->main_linebuf;
+    // An image being decoded is finished before switching, so that it is added
+    // to, and placed on, the screen its command was received for
+    if (self->grman->decode_job) {
+        grman_wait_for_decode(self->grman);
+        screen_image_decode_pending(self);
+    }
     grman_clear(self->alt_grman, true, self->cell_size);  // always clear the alt buffer graphics to free up resources, since it has to be cleared when switching back to it anyway
     if (to_alt) {
         linebuf_clear(self->alt_linebuf, BLANK_CHAR);
@@ -1715,6 +1739,72 @@ deactivate_overlay_line(Screen *self) {
 }
 
 
+// }}}
+
+// Text export {{{
+
+// Lines are numbered from the first line ever added to the scrollback, so that
+// the number of a line does not change as lines scroll into the scrollback,
+// allowing text to be exported a range of lines at a time. The lines on the
+// screen follow the lines in the scrollback.
+
+void
+screen_text_line_numbers(Screen *self, unsigned long long *first, unsigned long long *screen_start, unsigned long long *end) {
+    *screen_start = self->historybuf->lines_added;
+    *first = *screen_start - self->historybuf->count;
+    *end = *screen_start + self->lines;
+}
+
+static inline Line*
+export_line(Screen *self, unsigned long long lnum, Line *hline) {
+    HistoryBuf *hb = self->historybuf;
+    if (lnum < hb->lines_added) {
+        hline->xnum = hb->xnum;
+        historybuf_init_line(hb, (index_type)(hb->lines_added - 1 - lnum), hline);
+        return hline;
+    }
+    linebuf_init_line(self->linebuf, (index_type)(lnum - hb->lines_added));
+    return self->linebuf->line;
+}
+
+bool
+screen_export_text(Screen *self, TextExport *e, size_t min_sz) {
+    // Append the text of lines, as UTF-8, to e->buf until it holds at least
+    // min_sz bytes. Every line ends with a newline, unless it is continued on
+    // the next line. Lines that have been removed from the scrollback are
+    // skipped. Returns true once all lines before e->end_line are exported.
+    unsigned long long first, screen_start, end;
+    screen_text_line_numbers(self, &first, &screen_start, &end);
+    if (e->next_line < first) e->next_line = first;
+    unsigned long long limit = MIN(end, e->end_line);
+    size_t line_buf_sz = self->columns * 100;
+    ensure_space_for(e, line_buf, Py_UCS4, line_buf_sz, line_buf_capacity, line_buf_sz, false);
+    Line hline = {0};
+    while (e->next_line < limit && e->sz < min_sz) {
+        Line *line = export_line(self, e->next_line, &hline);
+        index_type num;
+        if (e->as_ansi) {
+            bool truncated;
+            // Formatting carries over from the previous line, which may
+            // have been exported by an earlier call
+            const GPUCell *prev_cell = &e->prev_cell;
+            num = line_as_ansi(line, e->line_buf, line_buf_sz - 2, &truncated, &prev_cell);
+            e->prev_cell = *prev_cell;
+        } else num = line_as_text(line, e->line_buf, line_buf_sz);
+        ensure_space_for(e, buf, char, e->sz + 4 * (size_t)num + 1, capacity, 65536, false);
+        for (index_type i = 0; i < num; i++) e->sz += encode_utf8(e->line_buf[i], e->buf + e->sz);
+        e->next_line++;
+        if (e->next_line >= end || !export_line(self, e->next_line, &hline)->continued) e->buf[e->sz++] = '\n';
+    }
+    return e->next_line >= limit;
+}
+
+void
+free_text_export(TextExport *e) {
+    free(e->buf); free(e->line_buf);
+    zero_at_ptr(e);
+}
+
 // }}}
 
 // Python interface {{{
@@ -1758,6 +1848,25 @@ as_text_alternate(Screen *self, PyObject *args) {
     return ans;
 }
 
+static PyObject*
+text_line_numbers(Screen *self, PyObject *a UNUSED) {
+    unsigned long long first, screen_start, end;
+    screen_text_line_numbers(self, &first, &screen_start, &end);
+    return Py_BuildValue("KKK", first, screen_start, end);
+}
+
+static PyObject*
+export_text(Screen *self, PyObject *args) {
+    TextExport e = {0};
+    int as_ansi = 0;
+    if (!PyArg_ParseTuple(args, "KK|p", &e.next_line, &e.end_line, &as_ansi)) return NULL;
+    e.as_ansi = as_ansi;
+    screen_export_text(self, &e, SIZE_MAX);
+    PyObject *ans = PyBytes_FromStringAndSize(e.buf ? e.buf : "", e.sz);
+    free_text_export(&e);
+    return ans;
+}
+
 
 static PyObject*
 screen_wcswidth(PyObject UNUSED *self, PyObject *str) {
@@ -2281,6 +2390,8 @@ screen_is_emoji_presentation_base(PyObject UNUSED *self, PyObject *code_) {
 static PyMethodDef methods[] = {
     MND(line, METH_O)
     MND(visual_line, METH_VARARGS)
+    MND(text_line_numbers, METH_NOARGS)
+    MND(export_text, METH_VARARGS)
     MND(draw, METH_O)
     MND(cursor_position, METH_VARARGS)
     MND(set_mode, METH_VARARGS)
@@ -2368,6 +2479,7 @@ static PyMemberDef members[] = {
     {"margin_top", T_UINT, offsetof(Screen, margin_top), READONLY, "margin_top"},
     {"margin_bottom", T_UINT, offsetof(Screen, margin_bottom), READONLY, "margin_bottom"},
     {"history_line_added_count", T_UINT, offsetof(Screen, history_line_added_count), 0, "history_line_added_count"},
+    {"window_id", T_ULONGLONG, offsetof(Screen, window_id), 0, "window_id"},
     {NULL}
 };
 
@@ -8,6 +8,7 @@
 
 #include "graphics.h"
 #include "monotonic.h"
+#include "charsets.h"
 
 typedef enum ScrollTypes { SCROLL_LINE = -999999, SCROLL_PAGE, SCROLL_FULL } ScrollType;
 
@@ -92,9 +93,23 @@ typedef struct {
 
     uint32_t parser_buf[PARSER_BUF_SZ];
     unsigned int parser_state, parser_text_start, parser_buf_pos;
+    struct {
+        // The base64 payload of APC escape codes is decoded as it is received
+        // rather than being accumulated in parser_buf
+        bool active;
+        Base64Decoder decoder;
+        uint8_t buf[APC_PAYLOAD_SZ + 2];
+        // Time spent decoding the payload in bulk, see decode_raw_apc_payload()
+        monotonic_t decode_time;
+    } apc_payload;
     bool parser_has_pending_text;
     uint8_t read_buf[READ_BUF_SZ], *write_buf;
     monotonic_t new_input_at;
+    // The time a key press was sent to the child and the times the output
+    // that followed it was read and parsed, until the frame that displays it
+    // is swapped, see start_input_latency_probe() in child-monitor.c.
+    // Protected by read_buf_lock
+    struct { monotonic_t key_at, write_at, read_at, parse_at; } input_latency;
     size_t read_buf_sz, write_buf_sz, write_buf_used;
     pthread_mutex_t read_buf_lock, write_buf_lock;
 
@@ -111,6 +126,18 @@ typedef struct {
 
 } Screen;
 
+// The state of an export of the text of a range of lines, see
+// screen_export_text()
+typedef struct {
+    unsigned long long next_line, end_line;
+    bool as_ansi;
+    GPUCell prev_cell;
+    char *buf;
+    size_t sz, capacity;
+    Py_UCS4 *line_buf;
+    size_t line_buf_capacity;
+} TextExport;
+
 
 void parse_worker(Screen *screen, PyObject *dump_callback, monotonic_t now);
 void parse_worker_dump(Screen *screen, PyObject *dump_callback, monotonic_t now);
@@ -191,12 +218,16 @@ Line* screen_visual_line(Screen *self, index_type y);
 unsigned long screen_current_char_width(Screen *self);
 void screen_mark_url(Screen *self, index_type start_x, index_type start_y, index_type end_x, index_type end_y);
 void screen_handle_graphics_command(Screen *self, const GraphicsCommand *cmd, const uint8_t *payload);
+bool screen_image_decode_pending(Screen *self);
 bool screen_open_url(Screen*);
 void screen_dirty_sprite_positions(Screen *self);
 void screen_rescale_images(Screen *self);
 void screen_report_size(Screen *, unsigned int which);
 void screen_manipulate_title_stack(Screen *, unsigned int op, unsigned int which);
 void screen_draw_overlay_text(Screen *self, const char *utf8_text);
+void screen_text_line_numbers(Screen *self, unsigned long long *first, unsigned long long *screen_start, unsigned long long *end);
+bool screen_export_text(Screen *self, TextExport *e, size_t min_sz);
+void free_text_export(TextExport *e);
 #define DECLARE_CH_SCREEN_HANDLER(name) void screen_##name(Screen *screen);
 DECLARE_CH_SCREEN_HANDLER(bell)
 DECLARE_CH_SCREEN_HANDLER(backspace)
@@ -121,6 +121,7 @@ ensure_sprite_map(FONTS_DATA_HANDLE fg) {
 
 void
 send_sprite_to_gpu(FONTS_DATA_HANDLE fg, unsigned int x, unsigned int y, unsigned int z, pixel *buf) {
+    monotonic_t start = monotonic();
     SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
     unsigned int xnum, ynum, znum;
     sprite_tracker_current_layout(fg, &xnum, &ynum, &znum);
@@ -129,18 +130,47 @@ send_sprite_to_gpu(FONTS_DATA_HANDLE fg, unsigned int x, unsigned int y, unsigne
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     x *= sprite_map->cell_width; y *= sprite_map->cell_height;
     glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, z, sprite_map->cell_width, sprite_map->cell_height, 1, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, buf);
+    font_render_times.sprite_upload += monotonic() - start;
 }
 
 void
-send_image_to_gpu(GLuint *tex_id, const void* data, GLsizei width, GLsizei height, bool is_opaque, bool is_4byte_aligned) {
+send_image_to_gpu(GLuint *tex_id, const void* data, GLsizei width, GLsizei height, bool is_opaque, bool is_4byte_aligned, bool mipmaps) {
+    // Images are array textures with a single layer, so that they are drawn
+    // by the same programs as animated images, whose frames are the layers
     if (!(*tex_id)) { glGenTextures(1, tex_id);  }
-    glBindTexture(GL_TEXTURE_2D, *tex_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *tex_id);
     glPixelStorei(GL_UNPACK_ALIGNMENT, is_4byte_aligned ? 4 : 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, is_opaque ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, mipmaps ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, 1, 0, is_opaque ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, data);
+    if (mipmaps) glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+void
+realloc_image_texture(GLuint *tex_id, GLsizei width, GLsizei height, unsigned int num_layers, unsigned int num_layers_to_copy) {
+    // Replaces *tex_id by a texture with room for num_layers frames, that has
+    // a copy of the first num_layers_to_copy layers of it. The caller frees the
+    // old texture.
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, width, height, num_layers);
+    if (*tex_id && num_layers_to_copy) copy_image_sub_data(*tex_id, tex, width, height, num_layers_to_copy);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    *tex_id = tex;
+}
+
+void
+send_image_layer_to_gpu(GLuint tex_id, const void* data, GLsizei width, GLsizei height, unsigned int layer, bool is_opaque, bool is_4byte_aligned) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, is_4byte_aligned ? 4 : 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, is_opaque ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, data);
 }
 
 // }}}
@@ -185,11 +215,11 @@ create_cell_vao() {
             /*size=*/size, /*dtype=*/dtype, /*stride=*/stride, /*offset=*/offset, /*divisor=*/1);
 #define A1(name, size, dtype, offset) A(name, size, dtype, (void*)(offsetof(GPUCell, offset)), sizeof(GPUCell))
 
-    add_buffer_to_vao(vao_idx, GL_ARRAY_BUFFER);
+    add_streaming_buffer_to_vao(vao_idx);
     A1(sprite_coords, 4, GL_UNSIGNED_SHORT, sprite_x);
     A1(colors, 3, GL_UNSIGNED_INT, fg);
 
-    add_buffer_to_vao(vao_idx, GL_ARRAY_BUFFER);
+    add_streaming_buffer_to_vao(vao_idx);
     A(is_selected, 1, GL_UNSIGNED_BYTE, NULL, 0);
 
     size_t bufnum = add_buffer_to_vao(vao_idx, GL_UNIFORM_BUFFER);
@@ -211,7 +241,7 @@ create_graphics_vao() {
 struct CellUniformData {
     bool constants_set;
     bool alpha_mask_fg_set;
-    GLint gploc, gpploc, cploc, cfploc, fg_loc;
+    GLint gploc, gpploc, cploc, cfploc, fg_loc, glayerloc, gplayerloc;
     GLfloat prev_inactive_text_alpha;
 };
 
@@ -282,12 +312,18 @@ cell_update_uniform_block(ssize_t vao_idx, Screen *screen, int uniform_buffer, G
     unmap_vao_buffer(vao_idx, uniform_buffer); rd = NULL;
 }
 
+static inline monotonic_t
+font_render_time_since(const FontRenderTimes *before) {
+    return (font_render_times.shaping - before->shaping) + (font_render_times.rasterization - before->rasterization) + (font_render_times.sprite_upload - before->sprite_upload);
+}
+
 static inline bool
-cell_prepare_to_render(ssize_t vao_idx, ssize_t gvao_idx, Screen *screen, GLfloat xstart, GLfloat ystart, GLfloat dx, GLfloat dy, FONTS_DATA_HANDLE fonts_data) {
+cell_prepare_to_render(ssize_t vao_idx, ssize_t gvao_idx, Screen *screen, GLfloat xstart, GLfloat ystart, GLfloat dx, GLfloat dy, FONTS_DATA_HANDLE fonts_data, RenderTimes *times) {
     size_t sz;
     CELL_BUFFERS;
     void *address;
     bool changed = false;
+    monotonic_t start, mapped;
 
     ensure_sprite_map(fonts_data);
 
@@ -297,9 +333,14 @@ cell_prepare_to_render(ssize_t vao_idx, ssize_t gvao_idx, Screen *screen, GLfloa
 
     if (screen->reload_all_gpu_data || screen->scroll_changed || screen->is_dirty || (disable_ligatures && cursor_pos_changed)) {
         sz = sizeof(GPUCell) * screen->lines * screen->columns;
-        address = alloc_and_map_vao_buffer(vao_idx, sz, cell_data_buffer, GL_STREAM_DRAW, GL_WRITE_ONLY);
+        start = monotonic();
+        address = map_streaming_vao_buffer(vao_idx, cell_data_buffer, sz);
+        mapped = monotonic();
+        FontRenderTimes font_times = font_render_times;
         screen_update_cell_data(screen, address, fonts_data, disable_ligatures && cursor_pos_changed);
-        unmap_vao_buffer(vao_idx, cell_data_buffer); address = NULL;
+        unmap_streaming_vao_buffer(vao_idx, cell_data_buffer); address = NULL;
+        // Shaping, rasterization and sprite uploads are recorded on their own
+        times->map += mapped - start; times->cell_data += monotonic() - mapped - font_render_time_since(&font_times);
         changed = true;
     }
 
@@ -310,9 +351,12 @@ cell_prepare_to_render(ssize_t vao_idx, ssize_t gvao_idx, Screen *screen, GLfloa
 
     if (screen->reload_all_gpu_data || screen_is_selection_dirty(screen)) {
         sz = screen->lines * screen->columns;
-        address = alloc_and_map_vao_buffer(vao_idx, sz, selection_buffer, GL_STREAM_DRAW, GL_WRITE_ONLY);
+        start = monotonic();
+        address = map_streaming_vao_buffer(vao_idx, selection_buffer, sz);
+        mapped = monotonic();
         screen_apply_selection(screen, address, sz);
-        unmap_vao_buffer(vao_idx, selection_buffer); address = NULL;
+        unmap_streaming_vao_buffer(vao_idx, selection_buffer); address = NULL;
+        times->map += mapped - start; times->cell_data += monotonic() - mapped;
         changed = true;
     }
 
@@ -320,6 +364,12 @@ cell_prepare_to_render(ssize_t vao_idx, ssize_t gvao_idx, Screen *screen, GLfloa
         send_graphics_data_to_gpu(screen->grman->count, gvao_idx, screen->grman->render_data);
         changed = true;
     }
+    if (screen->grman->frame_changed) {
+        // Only the layers of the render data changed, they are not part of
+        // the vertex data
+        screen->grman->frame_changed = false;
+        changed = true;
+    }
     return changed;
 }
 
@@ -328,12 +378,23 @@ draw_graphics(int program, ssize_t vao_idx, ssize_t gvao_idx, ImageRenderData *d
     bind_program(program);
     bind_vertex_array(gvao_idx);
     glActiveTexture(GL_TEXTURE0 + GRAPHICS_UNIT);
+    // The alpha mask is a plain texture, images are array textures and the
+    // layer drawn is the current frame of animated images
+    GLint layer_loc = -1;
+    if (program == GRAPHICS_PROGRAM) layer_loc = cell_uniform_data.glayerloc;
+    else if (program == GRAPHICS_PREMULT_PROGRAM) layer_loc = cell_uniform_data.gplayerloc;
+    uint32_t layer = 0;
+    if (layer_loc != -1) glUniform1f(layer_loc, 0);
 
     GLuint base = 4 * start;
     glEnable(GL_SCISSOR_TEST);
     for (GLuint i=0; i < count;) {
         ImageRenderData *rd = data + start + i;
-        glBindTexture(GL_TEXTURE_2D, rd->texture_id);
+        if (layer_loc == -1) glBindTexture(GL_TEXTURE_2D, rd->texture_id);
+        else {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, rd->texture_id);
+            if (rd->layer != layer) { layer = rd->layer; glUniform1f(layer_loc, layer); }
+        }
         // You could reduce the number of draw calls by using
         // glDrawArraysInstancedBaseInstance but Apple chose to abandon OpenGL
         // before implementing it.
@@ -457,6 +518,8 @@ set_cell_uniforms(float current_inactive_text_alpha, bool force) {
     if (!cell_uniform_data.constants_set || force) {
         cell_uniform_data.gploc = glGetUniformLocation(program_id(GRAPHICS_PROGRAM), "inactive_text_alpha");
         cell_uniform_data.gpploc = glGetUniformLocation(program_id(GRAPHICS_PREMULT_PROGRAM), "inactive_text_alpha");
+        cell_uniform_data.glayerloc = glGetUniformLocation(program_id(GRAPHICS_PROGRAM), "layer");
+        cell_uniform_data.gplayerloc = glGetUniformLocation(program_id(GRAPHICS_PREMULT_PROGRAM), "layer");
         cell_uniform_data.cploc = glGetUniformLocation(program_id(CELL_PROGRAM), "inactive_text_alpha");
         cell_uniform_data.cfploc = glGetUniformLocation(program_id(CELL_FG_PROGRAM), "inactive_text_alpha");
 #define S(prog, name, val, type) { bind_program(prog); glUniform##type(glGetUniformLocation(program_id(prog), #name), val); }
@@ -488,7 +551,7 @@ bool
 send_cell_data_to_gpu(ssize_t vao_idx, ssize_t gvao_idx, GLfloat xstart, GLfloat ystart, GLfloat dx, GLfloat dy, Screen *screen, OSWindow *os_window) {
     bool changed = false;
     if (os_window->fonts_data) {
-        if (cell_prepare_to_render(vao_idx, gvao_idx, screen, xstart, ystart, dx, dy, os_window->fonts_data)) changed = true;
+        if (cell_prepare_to_render(vao_idx, gvao_idx, screen, xstart, ystart, dx, dy, os_window->fonts_data, &os_window->render_timings.current)) changed = true;
     }
     return changed;
 }
@@ -496,6 +559,7 @@ send_cell_data_to_gpu(ssize_t vao_idx, ssize_t gvao_idx, GLfloat xstart, GLfloat
 void
 draw_cells(ssize_t vao_idx, ssize_t gvao_idx, GLfloat xstart, GLfloat ystart, GLfloat dx, GLfloat dy, Screen *screen, OSWindow *os_window, bool is_active_window, bool can_be_focused) {
     CELL_BUFFERS;
+    monotonic_t start = monotonic();
     bool inverted = screen_invert_colors(screen);
 
     cell_update_uniform_block(vao_idx, screen, uniform_buffer, xstart, ystart, dx, dy, &screen->cursor_render_info, inverted, os_window);
@@ -528,6 +592,8 @@ draw_cells(ssize_t vao_idx, ssize_t gvao_idx, GLfloat xstart, GLfloat ystart, GL
         if (screen->grman->num_of_negative_refs) draw_cells_interleaved(vao_idx, gvao_idx, screen);
         else draw_cells_simple(vao_idx, gvao_idx, screen);
     }
+    fence_vao_buffers(vao_idx);
+    os_window->render_timings.current.draw_calls += monotonic() - start;
 }
 // }}}
 
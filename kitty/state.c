@@ -686,6 +686,33 @@ PYWRAP1(background_opacity_of) {
     Py_RETURN_NONE;
 }
 
+static PyObject*
+frame_histogram(const unsigned long long *histogram) {
+    PyObject *ans = PyTuple_New(FRAME_HISTOGRAM_SIZE);
+    if (!ans) return NULL;
+    for (size_t i = 0; i < FRAME_HISTOGRAM_SIZE; i++) {
+        PyObject *count = PyLong_FromUnsignedLongLong(histogram[i]);
+        if (!count) { Py_DECREF(ans); return NULL; }
+        PyTuple_SET_ITEM(ans, i, count);
+    }
+    return ans;
+}
+
+PYWRAP1(os_window_render_timings) {
+    id_type os_window_id = PyLong_AsUnsignedLongLong(args);
+    WITH_OS_WINDOW(os_window_id)
+        RenderTimings *rt = &os_window->render_timings;
+#define S(which, field) #field, monotonic_t_to_s_double(rt->which.field)
+#define T(which) S(which, map), S(which, cell_data), S(which, draw_calls), S(which, shaping), S(which, rasterization), S(which, sprite_upload)
+        return Py_BuildValue("{sK s{sdsdsdsdsdsd} s{sdsdsdsdsdsd} sN sN sd}", "num_frames", rt->num_frames, "last", T(last), "total", T(total),
+            "frame_times", frame_histogram(rt->frame_times), "frame_intervals", frame_histogram(rt->frame_intervals),
+            "frame_interval", monotonic_t_to_s_double(os_window->frame_interval));
+#undef S
+#undef T
+    END_WITH_OS_WINDOW
+    Py_RETURN_NONE;
+}
+
 static inline bool
 fix_window_idx(Tab *tab, id_type window_id, unsigned int *window_idx) {
     for (id_type fix = 0; fix < tab->num_windows; fix++) {
@@ -866,6 +893,7 @@ static PyMethodDef module_methods[] = {
     MW(mark_tab_bar_dirty, METH_O),
     MW(change_background_opacity, METH_VARARGS),
     MW(background_opacity_of, METH_O),
+    MW(os_window_render_timings, METH_O),
     MW(update_window_visibility, METH_VARARGS),
     MW(global_font_size, METH_VARARGS),
     MW(os_window_font_size, METH_VARARGS),
@@ -8,6 +8,7 @@
 #include "data-types.h"
 #include "screen.h"
 #include "monotonic.h"
+#include "tracing.h"
 
 #define OPT(name) global_state.opts.name
 
@@ -123,6 +124,26 @@ typedef struct {
     unsigned int width, height, num_of_resize_events;
 } LiveResizeInfo;
 
+// CPU time spent rendering an OS window, none of it counted in more than one
+// field. map is waiting for and mapping GPU buffers, cell_data is filling
+// them with the cell and selection data of screens, other than shaping and
+// rasterizing text and uploading the sprites, and draw_calls is issuing the
+// GL commands that draw cells, which does not include the time the GPU takes
+// to execute them.
+typedef struct {
+    monotonic_t map, cell_data, draw_calls, shaping, rasterization, sprite_upload;
+} RenderTimes;
+
+// Bucket 0 of the frame histograms counts frames under 1ms, bucket i those
+// from 2^(i-1) to 2^i ms and the last bucket all longer ones
+#define FRAME_HISTOGRAM_SIZE 12
+
+typedef struct {
+    RenderTimes current, last, total;
+    unsigned long long num_frames;
+    unsigned long long frame_times[FRAME_HISTOGRAM_SIZE], frame_intervals[FRAME_HISTOGRAM_SIZE];
+    monotonic_t last_frame_at;
+} RenderTimings;
 
 typedef struct {
     void *handle;
@@ -155,6 +176,10 @@ typedef struct {
     monotonic_t last_render_frame_received_at;
     id_type last_focused_counter;
     ssize_t gvao_idx;
+    RenderTimings render_timings;
+    // Each OS window is rendered on its own schedule, see render() in child-monitor.c
+    monotonic_t last_render_at, frame_interval;
+    bool monitor_changed;
 } OSWindow;
 
 
@@ -181,7 +206,9 @@ typedef struct {
 extern GlobalState global_state;
 
 #define call_boss(name, ...) if (global_state.boss) { \
+    TRACE_BEGIN("boss." #name); \
     PyObject *cret_ = PyObject_CallMethod(global_state.boss, #name, __VA_ARGS__); \
+    TRACE_END("boss." #name); \
     if (cret_ == NULL) { PyErr_Print(); } \
     else Py_DECREF(cret_); \
 }
@@ -204,6 +231,7 @@ void destroy_os_window(OSWindow *w);
 void focus_os_window(OSWindow *w, bool also_raise);
 void set_os_window_title(OSWindow *w, const char *title);
 OSWindow* os_window_for_kitty_window(id_type);
+void update_os_window_frame_interval(OSWindow *w);
 OSWindow* add_os_window(void);
 OSWindow* current_os_window(void);
 void os_window_regions(OSWindow*, Region *main, Region *tab_bar);
@@ -217,13 +245,16 @@ void draw_cells(ssize_t, ssize_t, float, float, float, float, Screen *, OSWindow
 void draw_centered_alpha_mask(ssize_t gvao_idx, size_t screen_width, size_t screen_height, size_t width, size_t height, uint8_t *canvas);
 void update_surface_size(int, int, uint32_t);
 void free_texture(uint32_t*);
-void send_image_to_gpu(uint32_t*, const void*, int32_t, int32_t, bool, bool);
+void send_image_to_gpu(uint32_t*, const void*, int32_t, int32_t, bool, bool, bool);
+void realloc_image_texture(uint32_t*, int32_t, int32_t, unsigned int, unsigned int);
+void send_image_layer_to_gpu(uint32_t, const void*, int32_t, int32_t, unsigned int, bool, bool);
 void send_sprite_to_gpu(FONTS_DATA_HANDLE fg, unsigned int, unsigned int, unsigned int, pixel*);
 void blank_canvas(float, color_type);
 void blank_os_window(OSWindow *);
 void set_titlebar_color(OSWindow *w, color_type color);
 FONTS_DATA_HANDLE load_fonts_data(double, double, double);
 void send_prerendered_sprites_for_window(OSWindow *w);
+void start_input_latency_probe(Screen *screen, monotonic_t key_at);
 #ifdef __APPLE__
 void get_cocoa_key_equivalent(int, int, unsigned short*, int*);
 typedef enum {
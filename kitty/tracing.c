@@ -0,0 +1,213 @@
+/*
+ * tracing.c
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#include "tracing.h"
+#include "monotonic.h"
+#include "threading.h"
+#include <unistd.h>
+
+#if defined(FREEBSD_SET_NAME)
+void pthread_get_name_np(pthread_t tid, char *name, size_t len);
+#else
+extern int pthread_getname_np(pthread_t, char *name, size_t len);
+#endif
+
+#define TRACE_RING_SIZE (1u << 16)
+
+typedef struct {
+    monotonic_t at;
+    const char *name;
+    long long value;
+    TraceEventType type;
+} TraceEvent;
+
+typedef struct TraceRing {
+    TraceEvent events[TRACE_RING_SIZE];
+    // The number of events ever recorded, only written by the thread that
+    // owns the ring
+    atomic_ullong head;
+    unsigned long tid;
+    char thread_name[32];
+    struct TraceRing *next;
+} TraceRing;
+
+atomic_bool tracing_active = false;
+static _Thread_local TraceRing *thread_ring = NULL;
+// Rings are created by their threads the first time they record an event and
+// are never freed, as threads may be recording into them until exit
+static _Atomic(TraceRing*) rings = NULL;
+static atomic_ulong next_tid = 1;
+static monotonic_t tracing_started_at = 0;
+static pthread_t main_thread;
+
+static inline TraceRing*
+create_ring(void) {
+    TraceRing *r = calloc(1, sizeof(TraceRing));
+    if (!r) return NULL;
+    r->tid = atomic_fetch_add(&next_tid, 1);
+    if (pthread_equal(pthread_self(), main_thread)) snprintf(r->thread_name, sizeof(r->thread_name), "KittyMain");
+    else {
+#if defined(FREEBSD_SET_NAME)
+        pthread_get_name_np(pthread_self(), r->thread_name, sizeof(r->thread_name));
+#else
+        if (pthread_getname_np(pthread_self(), r->thread_name, sizeof(r->thread_name)) != 0) r->thread_name[0] = 0;
+#endif
+        if (!r->thread_name[0]) snprintf(r->thread_name, sizeof(r->thread_name), "Thread-%lu", r->tid);
+    }
+    r->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &r->next, r));
+    return r;
+}
+
+void
+record_trace_event(TraceEventType type, const char *name, long long value) {
+    TraceRing *r = thread_ring;
+    if (UNLIKELY(!r)) { if (!(r = thread_ring = create_ring())) return; }
+    unsigned long long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    TraceEvent *e = r->events + (head % TRACE_RING_SIZE);
+    e->at = monotonic(); e->name = name; e->value = value; e->type = type;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static PyObject*
+start_tracing(PyObject *self UNUSED, PyObject *args UNUSED) {
+    tracing_started_at = monotonic();
+    atomic_store(&tracing_active, true);
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+stop_tracing(PyObject *self UNUSED, PyObject *args UNUSED) {
+    atomic_store(&tracing_active, false);
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+is_tracing(PyObject *self UNUSED, PyObject *args UNUSED) {
+    if (atomic_load(&tracing_active)) Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static inline void
+write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char ch = *s;
+        if (ch == '"' || ch == '\\') fprintf(f, "\\%c", ch);
+        else if (ch < 0x20) fprintf(f, "\\u%04x", ch);
+        else fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+static inline void
+find_unmatched_spans(const TraceRing *r, unsigned long long start, unsigned long long head, bool *skip, unsigned long long *open) {
+    // Spans that began before the first event written, or that have not
+    // ended yet, cannot be shown by trace viewers, so their events are
+    // skipped. Spans are properly nested, so an end event matches the last
+    // begin event that was not yet matched.
+    size_t depth = 0;
+    for (unsigned long long i = start; i < head; i++) {
+        const TraceEvent *e = r->events + (i % TRACE_RING_SIZE);
+        if (e->at < tracing_started_at) { skip[i - start] = true; continue; }
+        if (e->type == TRACE_BEGIN_EVENT) open[depth++] = i;
+        else if (e->type == TRACE_END_EVENT) {
+            if (depth) depth--;
+            else skip[i - start] = true;
+        }
+    }
+    while (depth) skip[open[--depth] - start] = true;
+}
+
+static PyObject*
+write_trace(PyObject *self UNUSED, PyObject *args) {
+    // Write the events recorded since tracing was last started as Chrome
+    // trace JSON, returning the number of events written. Events that are
+    // about to be overwritten are skipped if tracing is still active.
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path)) return NULL;
+    bool *skip = malloc(TRACE_RING_SIZE * sizeof(bool));
+    unsigned long long *open = malloc(TRACE_RING_SIZE * sizeof(unsigned long long));
+    if (!skip || !open) { free(skip); free(open); return PyErr_NoMemory(); }
+    FILE *f = fopen(path, "w");
+    if (!f) { free(skip); free(open); return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path); }
+    unsigned long long count = 0, margin = atomic_load(&tracing_active) ? TRACE_RING_SIZE / 16 : 0;
+    int pid = getpid();
+    bool first = true;
+#define SEP fprintf(f, first ? "\n" : ",\n"); first = false;
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (TraceRing *r = atomic_load(&rings); r; r = r->next) {
+        SEP; fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %lu, \"args\": {\"name\": ", pid, r->tid);
+        write_json_string(f, r->thread_name);
+        fprintf(f, "}}");
+        unsigned long long head = atomic_load_explicit(&r->head, memory_order_acquire);
+        unsigned long long start = head > TRACE_RING_SIZE - margin ? head - (TRACE_RING_SIZE - margin) : 0;
+        memset(skip, 0, (head - start) * sizeof(bool));
+        find_unmatched_spans(r, start, head, skip, open);
+        for (unsigned long long i = start; i < head; i++) {
+            if (skip[i - start]) continue;
+            const TraceEvent *e = r->events + (i % TRACE_RING_SIZE);
+            SEP;
+            fprintf(f, "{\"name\": ");
+            write_json_string(f, e->name);
+            fprintf(f, ", \"ph\": \"%s\", \"ts\": %.3f, \"pid\": %d, \"tid\": %lu",
+                    e->type == TRACE_BEGIN_EVENT ? "B" : (e->type == TRACE_END_EVENT ? "E" : "C"), e->at / 1e3, pid, r->tid);
+            if (e->type == TRACE_COUNTER_EVENT) fprintf(f, ", \"args\": {\"value\": %lld}", e->value);
+            fprintf(f, "}");
+            count++;
+        }
+    }
+#undef SEP
+    free(skip); free(open);
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    return PyLong_FromUnsignedLongLong(count);
+}
+
+typedef struct {
+    const char *name, *events;
+} TestTraceThread;
+
+static void*
+test_trace_thread_main(void *data) {
+    const TestTraceThread *t = data;
+    set_thread_name(t->name);
+    for (const char *p = t->events; *p; p++) {
+        if (*p == 'B') TRACE_BEGIN("test_span");
+        else if (*p == 'E') TRACE_END("test_span");
+    }
+    return NULL;
+}
+
+static PyObject*
+test_trace_thread(PyObject *self UNUSED, PyObject *args) {
+    // Record the begin (B) and end (E) events in events in a new thread with
+    // the specified name
+    TestTraceThread t;
+    if (!PyArg_ParseTuple(args, "ss", &t.name, &t.events)) return NULL;
+    pthread_t thread;
+    int ret = pthread_create(&thread, NULL, test_trace_thread_main, &t);
+    if (ret != 0) { errno = ret; return PyErr_SetFromErrno(PyExc_OSError); }
+    pthread_join(thread, NULL);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+    METHODB(start_tracing, METH_NOARGS),
+    METHODB(stop_tracing, METH_NOARGS),
+    METHODB(is_tracing, METH_NOARGS),
+    METHODB(write_trace, METH_VARARGS),
+    METHODB(test_trace_thread, METH_VARARGS),
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+bool
+init_tracing(PyObject *module) {
+    main_thread = pthread_self();
+    if (PyModule_AddFunctions(module, module_methods) != 0) return false;
+    return true;
+}
@@ -0,0 +1,31 @@
+/*
+ * tracing.h
+ * Copyright (C) 2020 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+// Tracing of what kitty's threads are doing, that can be turned on and off at
+// runtime with start_tracing() and stop_tracing(). Events are recorded in a
+// ring buffer per thread, without locking, and written out by write_trace() in
+// the Chrome trace event format, which can be loaded into Perfetto or
+// chrome://tracing. When tracing is off a trace point costs a single branch.
+// Names must be string literals as only pointers to them are recorded.
+
+#include "data-types.h"
+#include <stdatomic.h>
+
+typedef enum { TRACE_BEGIN_EVENT, TRACE_END_EVENT, TRACE_COUNTER_EVENT } TraceEventType;
+
+extern atomic_bool tracing_active;
+void record_trace_event(TraceEventType type, const char *name, long long value);
+
+#define TRACE_EVENT(type, name, value) do { \
+    if (UNLIKELY(atomic_load_explicit(&tracing_active, memory_order_relaxed))) record_trace_event(type, name, value); \
+} while(0)
+// Spans on the same thread must be properly nested
+#define TRACE_BEGIN(name) TRACE_EVENT(TRACE_BEGIN_EVENT, name, 0)
+#define TRACE_END(name) TRACE_EVENT(TRACE_END_EVENT, name, 0)
+#define TRACE_COUNTER(name, value) TRACE_EVENT(TRACE_COUNTER_EVENT, name, (long long)(value))
@@ -19,10 +19,10 @@ from .fast_data_types import (
     CELL_SPECIAL_PROGRAM, CSI, DCS, DECORATION, DIM,
     GRAPHICS_ALPHA_MASK_PROGRAM, GRAPHICS_PREMULT_PROGRAM, GRAPHICS_PROGRAM,
     OSC, REVERSE, SCROLL_FULL, SCROLL_LINE, SCROLL_PAGE, STRIKETHROUGH, Screen,
-    add_window, cell_size_for_window, compile_program, get_clipboard_string,
-    init_cell_program, set_clipboard_string, set_titlebar_color,
-    set_window_render_data, update_window_title, update_window_visibility,
-    viewport_for_window
+    add_timer, add_window, cell_size_for_window, compile_program,
+    get_clipboard_string, init_cell_program, set_clipboard_string,
+    set_titlebar_color, set_window_render_data, update_window_title,
+    update_window_visibility, viewport_for_window
 )
 from .keys import defines, extended_key_event, keyboard_mode_name
 from .rgb import to_color
@@ -107,6 +107,53 @@ def setup_colors(screen, opts):
     ))
 
 
+class ScreenPool:
+
+    # Screens, with their line buffers and scrollback, created when kitty is
+    # idle, after a window has been created, for the next windows, so that
+    # creating them, for example for kitty --single-instance, does not have to
+    # wait for the allocations. A screen can only be used by a window with the
+    # same scrollback and cell size as the windows it was created for. Screens
+    # are created with the size new windows last had, as resizing a screen
+    # allocates it again, and dropped once new windows have another size.
+
+    size = 2
+    refill_delay = 0.5
+
+    def __init__(self):
+        self.key = None
+        self.screens = []
+        self.refill_timer = None
+        self.lines, self.columns = 24, 80
+
+    def take(self, callbacks, scrollback_lines, cell_width, cell_height, window_id):
+        key = scrollback_lines, cell_width, cell_height
+        if key != self.key:
+            self.key, self.screens = key, []
+        screen = self.screens.pop() if self.screens else None
+        if screen is None:
+            screen = Screen(callbacks, self.lines, self.columns, scrollback_lines, cell_width, cell_height, window_id)
+        else:
+            screen.callbacks, screen.window_id = callbacks, window_id
+        if self.refill_timer is None:
+            self.refill_timer = add_timer(self.refill, self.refill_delay, False)
+        return screen
+
+    def refill(self, timer_id):
+        self.refill_timer = None
+        scrollback_lines, cell_width, cell_height = self.key
+        while len(self.screens) < self.size:
+            self.screens.append(Screen(None, self.lines, self.columns, scrollback_lines, cell_width, cell_height))
+
+    def window_laid_out(self, lines, columns):
+        # Called with the size of new windows when they are first laid out
+        if (lines, columns) != (self.lines, self.columns):
+            self.lines, self.columns, self.screens = lines, columns, []
+
+
+screen_pool = ScreenPool()
+
+
 def text_sanitizer(as_ansi, add_wrap_markers):
     pat = getattr(text_sanitizer, 'pat', None)
     if pat is None:
@@ -157,7 +204,7 @@ class Window:
         self.is_visible_in_layout = True
         self.child, self.opts = child, opts
         cell_width, cell_height = cell_size_for_window(self.os_window_id)
-        self.screen = Screen(self, 24, 80, opts.scrollback_lines, cell_width, cell_height, self.id)
+        self.screen = screen_pool.take(self, opts.scrollback_lines, cell_width, cell_height, self.id)
         if copy_colors_from is not None:
             self.screen.copy_colors_from(copy_colors_from.screen)
         else:
@@ -236,7 +283,10 @@ class Window:
             return
         if self.needs_layout or new_geometry.xnum != self.screen.columns or new_geometry.ynum != self.screen.lines:
             boss = get_boss()
-            self.screen.resize(new_geometry.ynum, new_geometry.xnum)
+            if new_geometry.xnum != self.screen.columns or new_geometry.ynum != self.screen.lines:
+                self.screen.resize(new_geometry.ynum, new_geometry.xnum)
+            if self.needs_layout:
+                screen_pool.window_laid_out(self.screen.lines, self.screen.columns)
             current_pty_size = (
                 self.screen.lines, self.screen.columns,
                 max(0, new_geometry.right - new_geometry.left), max(0, new_geometry.bottom - new_geometry.top))
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Measure the time taken to create a font group and render a screenful of
+# text, with a cold and a warm on disk glyph cache. Run it with:
+#   python3 -m kitty_tests.bench_glyph_cache
+
+import shutil
+import tempfile
+from argparse import ArgumentParser
+from time import monotonic
+
+
+def sample_text(num_cjk):
+    ascii_text = ''.join(map(chr, range(33, 127)))
+    box = ''.join(map(chr, range(0x2500, 0x2580)))
+    cjk = ''.join(map(chr, range(0x4e00, 0x4e00 + num_cjk)))
+    return ascii_text + box + cjk
+
+
+def render_text(text, family, size, dpi, glyph_cache, columns=100):
+    from kitty.fast_data_types import Screen, test_render_line
+    from kitty.fonts.render import setup_for_testing
+    start = monotonic()
+    with setup_for_testing(family, size, dpi, glyph_cache):
+        s = Screen(None, 1, columns)
+        for i in range(0, len(text), columns // 2):
+            s.reset()
+            s.draw(text[i:i + columns // 2])
+            test_render_line(s.line(0))
+    return monotonic() - start
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark startup rendering with the on disk glyph cache')
+    parser.add_argument('--family', default='monospace', help='The font family to use')
+    parser.add_argument('--size', default=11.0, type=float, help='The font size in pts')
+    parser.add_argument('--dpi', default=96.0, type=float, help='The DPI')
+    parser.add_argument('--cjk', default=3000, type=int, help='Number of CJK characters to render')
+    parser.add_argument('--repeat', default=5, type=int, help='Number of warm runs')
+    args = parser.parse_args()
+    from kitty.fast_data_types import glyph_cache_statistics
+    text = sample_text(args.cjk)
+    tdir = tempfile.mkdtemp()
+    try:
+        uncached = render_text(text, args.family, args.size, args.dpi, None)
+        cold = render_text(text, args.family, args.size, args.dpi, tdir)
+        warm = min(render_text(text, args.family, args.size, args.dpi, tdir) for i in range(args.repeat))
+        stats = glyph_cache_statistics()
+    finally:
+        shutil.rmtree(tdir)
+    print('Rendered {} characters'.format(len(text)))
+    print('No cache:   {:.1f} ms'.format(uncached * 1000))
+    print('Cold cache: {:.1f} ms'.format(cold * 1000))
+    print('Warm cache: {:.1f} ms ({:.1f}x faster than no cache)'.format(warm * 1000, uncached / max(warm, 1e-9)))
+    print('Cache statistics:', stats)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Transmit images via the graphics protocol with every transmission medium
+# (direct, file, temporary file and shared memory) and format (RGB, RGBA, PNG
+# and zlib compressed RGBA), at several sizes and chunk sizes, and report the
+# throughput and the time per image spent in each stage of loading, from the
+# timings kitty records for every image. Images are uploaded in an offscreen
+# OS window, see bench_render.py, unless --no-render is used. Run it with:
+#   python3 -m kitty_tests.bench_graphics
+
+import os
+import struct
+import tempfile
+import zlib
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+from time import monotonic
+
+from .bench_image_decode import png_chunk
+from .bench_render import percentile
+
+MODES = {'direct': 'd', 'file': 'f', 'temp': 't', 'shm': 's'}
+FORMATS = ('RGB', 'RGBA', 'PNG', 'zlib')
+STAGES = ('base64', 'inflate', 'png', 'upload')
+
+
+def pixels(size, channels):
+    row = bytes((x * 7 + c * 50) & 0xff if c < 3 else 255 for x in range(size) for c in range(channels))
+    # Shift every row by a pixel so that the data does not compress too well
+    return b''.join(row[y * channels % len(row):] + row[:y * channels % len(row)] for y in range(size))
+
+
+def image_data(fmt, size):
+    if fmt == 'RGB':
+        return pixels(size, 3)
+    if fmt == 'RGBA':
+        return pixels(size, 4)
+    if fmt == 'zlib':
+        return zlib.compress(pixels(size, 4), 6)
+    data, stride = pixels(size, 4), size * 4
+    rows = b''.join(b'\0' + data[y * stride:(y + 1) * stride] for y in range(size))
+    return b'\x89PNG\r\n\x1a\n' + png_chunk(b'IHDR', struct.pack('>IIBBBBB', size, size, 8, 6, 0, 0, 0)) + png_chunk(
+        b'IDAT', zlib.compress(rows, 6)) + png_chunk(b'IEND', b'')
+
+
+def commands(mode, fmt, size, data, num_images, chunk_size, tdir):
+    # The escape codes to transmit each image, files and shared memory objects
+    # are created up front so that only their loading is timed
+    from kitty.fast_data_types import shm_write
+    keys = 'a=t,i=1,f={},s={},v={},t={}{}'.format(
+        {'RGB': 24, 'PNG': 100}.get(fmt, 32), size, size, MODES[mode], ',o=z' if fmt == 'zlib' else '').encode('ascii')
+    if mode == 'direct':
+        payload = standard_b64encode(data)
+        ans = []
+        for pos in range(0, len(payload), chunk_size):
+            more = int(pos + chunk_size < len(payload))
+            ans.append(b'\033_G%s%s;%s\033\\' % (keys + b',' if pos == 0 else b'', b'm=%d' % more, payload[pos:pos + chunk_size]))
+        return [b''.join(ans)] * num_images
+    names = []
+    if mode == 'file':
+        path = os.path.join(tdir, 'image')
+        with open(path, 'wb') as f:
+            f.write(data)
+        names = [path] * num_images
+    elif mode == 'temp':
+        for i in range(num_images):
+            fd, path = tempfile.mkstemp(dir=tdir, prefix='tty-graphics-protocol-')
+            with open(fd, 'wb') as f:
+                f.write(data)
+            names.append(path)
+    else:
+        for i in range(num_images):
+            names.append('/kitty-bench-graphics-{}-{}'.format(os.getpid(), i))
+            shm_write(names[-1], data)
+    return [b'\033_G%s;%s\033\\' % (keys, standard_b64encode(name.encode('utf-8'))) for name in names]
+
+
+def run(screen, cmds, pixel_bytes):
+    from kitty.fast_data_types import parse_bytes
+    times, stages = [], {k: [] for k in STAGES + ('load',)}
+    stream_bytes = 0
+    for cmd in cmds:
+        start = monotonic()
+        parse_bytes(screen, cmd)
+        times.append(monotonic() - start)
+        stream_bytes += len(cmd)
+        img = screen.grman.image_for_client_id(1)
+        if img is None or not img['data_loaded']:
+            raise SystemExit('Failed to load image')
+        for k, v in stages.items():
+            v.append(img['timings'][k])
+    total = sum(times)
+    return len(cmds) * pixel_bytes / total, stream_bytes / total, times, stages
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark the throughput of the graphics protocol and the time spent in each stage of loading images')
+    parser.add_argument('--images', default=20, type=int, help='Number of images to transmit for every combination of medium, format and size')
+    parser.add_argument('--sizes', default='64,512', help='Comma separated widths (and heights) of the images in pixels')
+    parser.add_argument('--chunk-sizes', default='1024,4096', help='Comma separated sizes of the base64 encoded chunks of direct transmissions')
+    parser.add_argument('--modes', default=','.join(MODES), help='Comma separated transmission mediums to use')
+    parser.add_argument('--formats', default=','.join(FORMATS), help='Comma separated image formats to use')
+    parser.add_argument('--no-render', action='store_true', help='Do not upload images, useful when OSMesa is not available')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import set_image_texture_sharing, set_options
+    opts = defaults
+    set_options(opts)
+    # Every image is identical, do not let them share a texture
+    set_image_texture_sharing(False)
+    if args.no_render:
+        from .bench_image_decode import ParseOnly
+        target = ParseOnly(opts)
+    else:
+        from kitty.fonts.box_drawing import set_scale
+        from kitty.fonts.render import set_font_family
+        from kitty.main import init_glfw_module
+        from .bench_render import RenderWindow
+        set_scale(opts.box_drawing_scale)
+        set_font_family(opts)
+        os.environ.setdefault('LIBGL_ALWAYS_SOFTWARE', '1')
+        init_glfw_module('osmesa')
+        target = RenderWindow(opts, 1280, 800)
+    screen = target.screen
+    ms, mb = 1000, 1024 * 1024
+    print('Transmitting {} images for every combination, throughput is in MB/s of pixels and of escape codes, times are in ms per image'.format(args.images))
+    with tempfile.TemporaryDirectory() as tdir:
+        for size in map(int, args.sizes.split(',')):
+            for fmt in args.formats.split(','):
+                data = image_data(fmt, size)
+                pixel_bytes = size * size * (3 if fmt == 'RGB' else 4)
+                for mode in args.modes.split(','):
+                    for chunk_size in (map(int, args.chunk_sizes.split(',')) if mode == 'direct' else (0,)):
+                        cmds = commands(mode, fmt, size, data, args.images, chunk_size, tdir)
+                        pixel_rate, stream_rate, times, stages = run(screen, cmds, pixel_bytes)
+                        name = '{} {}{} {}x{}'.format(mode, 'chunks of {} '.format(chunk_size) if chunk_size else '', fmt, size, size)
+                        print('{:<36} {:7.1f} MB/s {:7.1f} MB/s  parse mean: {:.3f} p95: {:.3f}  load: {:.3f}  {}'.format(
+                            name, pixel_rate / mb, stream_rate / mb, sum(times) / len(times) * ms, percentile(times, 0.95) * ms,
+                            sum(stages['load']) / len(times) * ms,
+                            ' '.join('{}: {:.3f}'.format(k, sum(stages[k]) / len(times) * ms) for k in STAGES)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Stream many PNG images, interleaved with text, through the graphics protocol
+# and measure the frame latency, with images decoded on the main thread and in
+# the background decoder threads. Frames are rendered in an offscreen OS
+# window, see bench_render.py, unless --no-render is used. Run it with:
+#   python3 -m kitty_tests.bench_image_decode
+
+import os
+import struct
+import zlib
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+from time import monotonic, sleep
+
+from .bench_render import percentile, sample_lines
+
+
+def png_chunk(kind, data):
+    return struct.pack('>I', len(data)) + kind + data + struct.pack('>I', zlib.crc32(kind + data) & 0xffffffff)
+
+
+def make_png(width, height, seed):
+    rows = []
+    for y in range(height):
+        row = bytearray(width * 4)
+        for x in range(width):
+            row[x*4:x*4+4] = ((x + seed) & 0xff, (y * 3 + seed) & 0xff, (x ^ y) & 0xff, 255)
+        rows.append(b'\0' + bytes(row))
+    return b'\x89PNG\r\n\x1a\n' + png_chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0)) + png_chunk(
+        b'IDAT', zlib.compress(b''.join(rows), 6)) + png_chunk(b'IEND', b'')
+
+
+def image_stream(num_images, size, columns, chunk_size=4096):
+    ans = []
+    pngs = [make_png(size, size, i) for i in range(min(num_images, 4))]
+    for i in range(num_images):
+        data = standard_b64encode(pngs[i % len(pngs)])
+        for line in sample_lines(columns, 2, i):
+            ans.append(line.encode('utf-8') + b'\r\n')
+        for pos in range(0, len(data), chunk_size):
+            chunk = data[pos:pos + chunk_size]
+            more = int(pos + chunk_size < len(data))
+            if pos:
+                ans.append(b'\033_Gm=%d;%s\033\\' % (more, chunk))
+            else:
+                ans.append(b'\033_Ga=T,f=100,i=%d,c=8,r=4,m=%d;%s\033\\' % (i % 64 + 1, more, chunk))
+    return b''.join(ans)
+
+
+class ParseOnly:
+
+    def __init__(self, opts, columns=120, lines=40):
+        from kitty.fast_data_types import Screen, set_send_to_gpu
+        set_send_to_gpu(False)
+        self.screen = Screen(None, lines, columns, opts.scrollback_lines, 10, 20)
+
+    def render(self):
+        pass
+
+
+def run(target, stream, bytes_per_frame, num_threads):
+    from kitty.fast_data_types import parse_bytes, set_image_decode_threads
+    set_image_decode_threads(num_threads)
+    target.screen.reset()
+    frame_times = []
+    pos, start = 0, monotonic()
+    try:
+        while pos < len(stream):
+            frame_start = monotonic()
+            end = min(len(stream), pos + bytes_per_frame)
+            # parse_bytes() consumes less than it is given while parsing is
+            # paused for an image decode, the rest is re-sent in the next frame,
+            # just as the child monitor leaves it in the read buffer
+            pos += parse_bytes(target.screen, stream[pos:end])
+            target.render()
+            frame_times.append(monotonic() - frame_start)
+            if frame_times[-1] < 0.001:
+                sleep(0.001 - frame_times[-1])
+        # Wait for the last decode to be handled
+        while target.screen.grman.decode_pending:
+            sleep(0.0005)
+            parse_bytes(target.screen, b'')
+    finally:
+        set_image_decode_threads(0)
+    return frame_times, monotonic() - start
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark frame latency while streaming images via the graphics protocol')
+    parser.add_argument('--images', default=200, type=int, help='Number of images to stream')
+    parser.add_argument('--size', default=512, type=int, help='Width and height of the images in pixels')
+    parser.add_argument('--bytes-per-frame', default=256 * 1024, type=int, help='Bytes of the stream to parse per frame')
+    parser.add_argument(
+        '--threads', default=max(1, min(4, (os.cpu_count() or 1) - 1)), type=int,
+        help='Number of decoder threads to compare against decoding on the main thread')
+    parser.add_argument('--no-render', action='store_true', help='Only parse, do not render frames, useful when OSMesa is not available')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import set_options
+    opts = defaults
+    set_options(opts)
+    if args.no_render:
+        target = ParseOnly(opts)
+    else:
+        from kitty.fast_data_types import render_os_window_now
+        from kitty.fonts.box_drawing import set_scale
+        from kitty.fonts.render import set_font_family
+        from kitty.main import init_glfw_module
+        from .bench_render import RenderWindow
+        set_scale(opts.box_drawing_scale)
+        set_font_family(opts)
+        os.environ.setdefault('LIBGL_ALWAYS_SOFTWARE', '1')
+        init_glfw_module('osmesa')
+        target = RenderWindow(opts, 1280, 800)
+        target.render = lambda: render_os_window_now(target.os_window_id)
+    stream = image_stream(args.images, args.size, target.screen.columns)
+    print('Streaming {} {}x{} PNG images, {:.1f} MB'.format(args.images, args.size, args.size, len(stream) / (1024 * 1024)))
+    ms = 1000
+    for threads in (0, args.threads):
+        frame_times, total = run(target, stream, args.bytes_per_frame, threads)
+        print('{}: {} frames in {:.2f} s, frame latency mean: {:.2f} ms median: {:.2f} ms p95: {:.2f} ms max: {:.2f} ms'.format(
+            'main thread' if threads == 0 else '{} decoder threads'.format(threads), len(frame_times), total,
+            sum(frame_times) / len(frame_times) * ms, percentile(frame_times, 0.5) * ms, percentile(frame_times, 0.95) * ms, max(frame_times) * ms))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Send the same set of thumbnails, repeatedly, to several windows via the
+# graphics protocol and report the GPU memory used and the time spent
+# uploading textures, with and without sharing of identical textures. Images
+# are uploaded in an offscreen OS window, see bench_render.py, so OSMesa is
+# required. Run it with:
+#   python3 -m kitty_tests.bench_image_dedup
+
+import os
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+
+from .bench_render import RenderWindow
+
+
+def thumbnail(size, seed):
+    pixels = bytearray(size * size * 4)
+    for y in range(size):
+        for x in range(size):
+            pixels[(y * size + x) * 4:(y * size + x + 1) * 4] = ((x + seed) & 0xff, (y + 3 * seed) & 0xff, (x ^ y ^ seed) & 0xff, 255)
+    return standard_b64encode(bytes(pixels))
+
+
+def transmit(image_id, data, size, chunk_size=4096):
+    ans = []
+    for pos in range(0, len(data), chunk_size):
+        chunk = data[pos:pos + chunk_size]
+        more = int(pos + chunk_size < len(data))
+        if pos:
+            ans.append(b'\033_Gm=%d;%s\033\\' % (more, chunk))
+        else:
+            ans.append(b'\033_Ga=T,f=32,s=%d,v=%d,i=%d,c=4,r=2,m=%d;%s\033\\' % (size, size, image_id, more, chunk))
+    return b''.join(ans)
+
+
+def run(opts, window, thumbnails, size, num_windows, repeat, share):
+    from kitty.fast_data_types import (
+        Screen, image_texture_stats, parse_bytes, set_image_texture_sharing
+    )
+    set_image_texture_sharing(share)
+    before = image_texture_stats()
+    screens = [Screen(None, window.screen.lines, window.screen.columns, opts.scrollback_lines, 10, 20) for i in range(num_windows)]
+    image_id = 1
+    for r in range(repeat):
+        for s in screens:
+            for data in thumbnails:
+                parse_bytes(s, transmit(image_id, data, size))
+                # Uploads of placed images are done when the layers are updated
+                # if image_texture_scale is used
+                s.grman.update_layers(0, -1, 1, 2 / s.columns, 2 / s.lines, s.columns, s.lines, 10, 20)
+                image_id += 1
+    after = image_texture_stats()
+    del screens
+    return {k: after[k] - before[k] for k in after}
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark GPU memory and upload time for images repeatedly sent to many windows')
+    parser.add_argument('--windows', default=8, type=int, help='Number of windows to send the images to')
+    parser.add_argument('--images', default=16, type=int, help='Number of distinct images')
+    parser.add_argument('--repeat', default=4, type=int, help='Number of times each window is sent the images')
+    parser.add_argument('--size', default=128, type=int, help='Width and height of the images in pixels')
+    parser.add_argument('--texture-scale', default=0, type=float, help='The value of the image_texture_scale option')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import set_image_texture_scale, set_options
+    from kitty.fonts.box_drawing import set_scale
+    from kitty.fonts.render import set_font_family
+    from kitty.main import init_glfw_module
+    opts = defaults
+    set_scale(opts.box_drawing_scale)
+    set_options(opts)
+    set_image_texture_scale(args.texture_scale)
+    set_font_family(opts)
+    os.environ.setdefault('LIBGL_ALWAYS_SOFTWARE', '1')
+    init_glfw_module('osmesa')
+    window = RenderWindow(opts, 1280, 800)
+    thumbnails = [thumbnail(args.size, i) for i in range(args.images)]
+    print('Sending {} {}x{} images {} times to {} windows'.format(args.images, args.size, args.size, args.repeat, args.windows))
+    mb = 1024 * 1024
+    for share in (False, True):
+        s = run(opts, window, thumbnails, args.size, args.windows, args.repeat, share)
+        print('{}: {} textures, {:.1f} MB of GPU memory, {} uploads of {:.1f} MB in {:.1f} ms, {} shared'.format(
+            'shared textures' if share else 'separate textures', s['textures'], s['gpu_bytes'] / mb,
+            s['uploads'], s['upload_bytes'] / mb, s['upload_time'] * 1000, s['shared']))
+
+
+if __name__ == '__main__':
+    main()
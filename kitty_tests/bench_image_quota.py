@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Add many small images, such as the tiles sent by sixel-like tools, via the
+# graphics protocol under a tight storage quota, so that nearly every add
+# evicts an image, and measure the time taken per add. Run it with:
+#   python3 -m kitty_tests.bench_image_quota
+
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+from time import monotonic
+
+from .bench_render import percentile
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark adding many small images under a tight storage quota')
+    parser.add_argument('--images', default=100000, type=int, help='Number of images to add')
+    parser.add_argument('--size', default=8, type=int, help='Width and height of the images in pixels')
+    parser.add_argument('--quota', default=5000, type=int, help='Number of images that fit in the storage quota')
+    parser.add_argument('--put-every', default=4, type=int, help='Display every nth image, the rest are only transmitted')
+    parser.add_argument('--batch', default=1000, type=int, help='Number of images added per timed batch')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import Screen, parse_bytes, set_options, set_send_to_gpu
+    set_options(defaults)
+    set_send_to_gpu(False)
+    s = Screen(None, 40, 120, 0, 10, 20)
+    image_sz = args.size * args.size * 4
+    s.grman.storage_limit = args.quota * image_sz
+    payload = standard_b64encode(b'\x80' * image_sz)
+    batch_times = []
+    start = monotonic()
+    for b in range(0, args.images, args.batch):
+        data = []
+        for i in range(b + 1, min(args.images, b + args.batch) + 1):
+            action = 'T' if i % args.put_every == 0 else 't'
+            data.append(b'\033_Ga=%s,f=32,s=%d,v=%d,i=%d;%s\033\\' % (action.encode('ascii'), args.size, args.size, i, payload))
+        data = b''.join(data)
+        bstart = monotonic()
+        parse_bytes(s, data)
+        batch_times.append((monotonic() - bstart) / args.batch)
+    total = monotonic() - start
+    us = 1e6
+    print('Added {} {}x{} images with room for {} in {:.2f} s, {} images stored, {} bytes used'.format(
+        args.images, args.size, args.size, args.quota, total, s.grman.image_count, s.grman.used_storage))
+    print('Time per add, mean: {:.1f} us median: {:.1f} us p95: {:.1f} us max: {:.1f} us, first batch: {:.1f} us last batch: {:.1f} us'.format(
+        sum(batch_times) / len(batch_times) * us, percentile(batch_times, 0.5) * us, percentile(batch_times, 0.95) * us,
+        max(batch_times) * us, batch_times[0] * us, batch_times[-1] * us))
+
+
+if __name__ == '__main__':
+    main()
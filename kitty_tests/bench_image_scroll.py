@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Fill the scrollback with many image placements, as in a notebook style
+# session, then scroll text and measure the time taken per scrolled line and
+# per update of the render layers, with the screen at the bottom and scrolled
+# back into the history. Run it with:
+#   python3 -m kitty_tests.bench_image_scroll
+
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+from time import monotonic
+
+from .bench_render import percentile
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark scrolling with many image placements in the scrollback')
+    parser.add_argument('--placements', default=5000, type=int, help='Number of image placements in the scrollback')
+    parser.add_argument('--lines', default=20000, type=int, help='Number of lines to scroll')
+    parser.add_argument('--scrollback', default=100000, type=int, help='Number of lines of scrollback')
+    parser.add_argument('--rows', default=4, type=int, help='Number of rows each placement covers')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import Screen, parse_bytes, set_options, set_send_to_gpu
+    set_options(defaults)
+    set_send_to_gpu(False)
+    cw, ch = 10, 20
+    s = Screen(None, 40, 120, args.scrollback, cw, ch)
+    dx, dy = 2 / s.columns, 2 / s.lines
+    payload = standard_b64encode(b'\x80' * 16 * 16 * 4)
+    data = [b'\033_Ga=t,f=32,s=16,v=16,i=1;%s\033\\' % payload]
+    for i in range(args.placements):
+        data.append(b'output %d\r\n\033_Ga=p,i=1,c=8,r=%d\033\\\r\n' % (i, args.rows))
+    parse_bytes(s, b''.join(data))
+
+    def update_layers(scrolled_by):
+        s.grman.update_layers(scrolled_by, -1, 1, dx, dy, s.columns, s.lines, cw, ch)
+
+    print('Scrolling {} lines with {} placements in {} lines of scrollback'.format(args.lines, s.grman.placement_count, s.historybuf.count))
+    us = 1e6
+    for scrolled_by in (0, s.historybuf.count // 2):
+        scroll_times, layer_times = [], []
+        for i in range(args.lines):
+            start = monotonic()
+            parse_bytes(s, b'line\r\n')
+            mid = monotonic()
+            update_layers(scrolled_by)
+            scroll_times.append(mid - start), layer_times.append(monotonic() - mid)
+        print('{}: per scrolled line mean: {:.2f} us p95: {:.2f} us, per layer update mean: {:.2f} us p95: {:.2f} us'.format(
+            'at the bottom' if scrolled_by == 0 else 'scrolled back {} lines'.format(scrolled_by),
+            sum(scroll_times) / len(scroll_times) * us, percentile(scroll_times, 0.95) * us,
+            sum(layer_times) / len(layer_times) * us, percentile(layer_times, 0.95) * us))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Measure the time to get the screen of a new window, and resize it to the
+# size of the window, as its first layout does, creating it, as windows did,
+# and from the screens created ahead of time by ScreenPool in window.py.
+# With --kitty, also measure the time from running kitty --single-instance
+# until the child of its window is running, which needs a display, and which
+# can be compared between builds of kitty. Run it with:
+#   python3 -m kitty_tests.bench_new_window
+
+import os
+import subprocess
+import tempfile
+from argparse import ArgumentParser
+from time import monotonic, sleep
+
+from .bench_render import percentile
+
+
+def screens(windows, lines, columns):
+    from kitty.config import defaults
+    from kitty.fast_data_types import Screen, set_options
+    from kitty.main import init_glfw_module
+    from kitty.window import ScreenPool, setup_colors
+    from kitty_tests import Callbacks
+    set_options(defaults)
+    init_glfw_module('osmesa')
+    callbacks = Callbacks()
+    opts = defaults
+
+    def created(window_id):
+        screen = Screen(callbacks, 24, 80, opts.scrollback_lines, 10, 20, window_id)
+        screen.resize(lines, columns)
+        return screen
+
+    pool = ScreenPool()
+    pool.size = windows
+    pool.take(callbacks, opts.scrollback_lines, 10, 20, 1)
+    pool.window_laid_out(lines, columns)
+    pool.refill(None)
+
+    def pooled(window_id):
+        screen = pool.take(callbacks, opts.scrollback_lines, 10, 20, window_id)
+        # As done by Window.set_geometry()
+        if (screen.lines, screen.columns) != (lines, columns):
+            screen.resize(lines, columns)
+        return screen
+
+    ms = 1000
+    print('Getting the screens of {} windows of {}x{} cells, with {} lines of scrollback'.format(
+        windows, columns, lines, opts.scrollback_lines))
+    for name, func in (('created', created), ('from ScreenPool', pooled)):
+        times, keep = [], []
+        for i in range(windows):
+            st = monotonic()
+            screen = func(i + 2)
+            setup_colors(screen, opts)
+            times.append(monotonic() - st)
+            keep.append(screen)
+        print('  {:<16} mean: {:.3f} ms p95: {:.3f} ms'.format(name, sum(times) / len(times) * ms, percentile(times, 0.95) * ms))
+
+
+def single_instance(kitty, windows):
+    group = 'bench-new-window-{}'.format(os.getpid())
+    ms = 1000
+    with tempfile.TemporaryDirectory() as tdir:
+        def run(i, wait, keep_open=0):
+            path = os.path.join(tdir, str(i))
+            os.mkfifo(path)
+            st = monotonic()
+            p = subprocess.Popen([kitty, '--single-instance', '--instance-group', group, 'sh', '-c', 'echo ready > "$0"; sleep $1', path, str(keep_open)])
+            with open(path) as f:
+                f.read()
+            ready = monotonic() - st
+            if wait:
+                p.wait()
+            return p, ready
+
+        # The first kitty is the instance that the others open windows in, its
+        # window is kept open so that it does not quit
+        instance, ready = run(0, False, 1000000)
+        print('Starting the instance: {:.1f} ms'.format(ready * ms))
+        sleep(1)
+        times = []
+        try:
+            for i in range(windows):
+                times.append(run(i + 1, True)[1])
+                sleep(0.5)
+        finally:
+            instance.terminate()
+            instance.wait()
+        print('Open to child running with --single-instance, {} windows: mean: {:.1f} ms p95: {:.1f} ms'.format(
+            windows, sum(times) / len(times) * ms, percentile(times, 0.95) * ms))
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark creating windows')
+    parser.add_argument('--windows', default=50, type=int, help='Number of windows to create')
+    parser.add_argument('--lines', default=50, type=int, help='Number of lines in the windows')
+    parser.add_argument('--columns', default=200, type=int, help='Number of columns in the windows')
+    parser.add_argument('--kitty', help='Path to a kitty to open windows in with --single-instance, needs a display')
+    args = parser.parse_args()
+    screens(args.windows, args.lines, args.columns)
+    if args.kitty:
+        single_instance(args.kitty, min(args.windows, 20))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Send remote control commands to kitty from a load generator process, with a
+# connection per command, as kitty @ does, and on a single connection with
+# framing, waiting for every response and with many commands in flight, and
+# report the commands per second and the latency of commands. By default the
+# commands are sent to a headless kitty, without any windows, run by this
+# script, use --to to send them to a running kitty instead. Run it with:
+#   python3 -m kitty_tests.bench_remote_control
+
+import json
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+from argparse import ArgumentParser
+from time import monotonic
+
+from .bench_render import percentile
+
+
+def check_response(response):
+    if not response or not response.get('ok'):
+        raise SystemExit('Command failed: {!r}'.format(response))
+
+
+def payload_for(cmd):
+    # The payload kitty @ cmd sends
+    from kitty.cmds import cmap, parse_subcommand_cli
+    from kitty.remote_control import parse_rc_args
+    func = cmap[cmd]
+    global_opts = parse_rc_args(['@'])[0]
+    opts, items = parse_subcommand_cli(func, [cmd])
+    return func(global_opts, opts, items)
+
+
+def one_connection_per_command(to, cmd, payload, num_commands):
+    from kitty.constants import version
+    from kitty.remote_control import SocketIO, encode_send
+    send = {'cmd': cmd, 'version': version}
+    if payload is not None:
+        send['payload'] = payload
+    data = encode_send(send)
+    latencies = []
+    for i in range(num_commands):
+        start = monotonic()
+        io = SocketIO(to)
+        with io:
+            io.send(data)
+            response = io.recv(timeout=10)
+        latencies.append(monotonic() - start)
+        check_response(json.loads(response.decode('utf-8')))
+    return latencies
+
+
+def framed(to, cmd, payload, num_commands, in_flight):
+    from kitty.remote_control import FramedConnection
+    latencies, sent_at = [], {}
+    with FramedConnection(to) as conn:
+        sent = 0
+        while len(latencies) < num_commands:
+            while sent < num_commands and len(sent_at) < in_flight:
+                sent_at[conn.send(cmd, payload)] = monotonic()
+                sent += 1
+            request_id, response = conn.recv()
+            latencies.append(monotonic() - sent_at.pop(request_id))
+            check_response(response)
+    return latencies
+
+
+def run_client(args):
+    ms = 1000
+    payload = payload_for(args.command)
+    modes = [('connection per command', lambda: one_connection_per_command(args.to, args.command, payload, args.commands))]
+    for n in map(int, args.in_flight.split(',')):
+        modes.append(('framed, {} in flight'.format(n), lambda n=n: framed(args.to, args.command, payload, args.commands, n)))
+    print('Sending {} {} commands'.format(args.commands, args.command))
+    for name, func in modes:
+        start = monotonic()
+        latencies = func()
+        total = monotonic() - start
+        print('{:<28} {:8.0f} commands/s  latency median: {:.3f} ms p95: {:.3f} ms p99: {:.3f} ms'.format(
+            name, len(latencies) / total, percentile(latencies, 0.5) * ms, percentile(latencies, 0.95) * ms, percentile(latencies, 0.99) * ms))
+    sys.stdout.flush()
+
+
+def serve(args):
+    # A kitty without any windows, that handles remote control commands on a
+    # socket with the same code as kitty does
+    from kitty.boss import Boss
+    from kitty.config import defaults
+    from kitty.fast_data_types import ChildMonitor, add_timer, set_boss, set_options
+    from kitty.main import init_glfw_module
+
+    class Server:
+        _handle_remote_command = Boss._handle_remote_command
+        peer_message_received = Boss.peer_message_received
+        peer_frame_received = Boss.peer_frame_received
+
+        def __init__(self, opts):
+            self.opts = opts
+
+    opts = defaults
+    set_options(opts)
+    init_glfw_module('osmesa')
+    with tempfile.TemporaryDirectory() as tdir:
+        path = os.path.join(tdir, 'kitty')
+        s = socket.socket(socket.AF_UNIX)
+        s.bind(path)
+        s.listen()
+        s.setblocking(False)
+        child_monitor = ChildMonitor(lambda window_id: None, None, -1, s.fileno())
+        set_boss(Server(opts))
+        client = subprocess.Popen([
+            sys.executable, '-m', 'kitty_tests.bench_remote_control', '--to', 'unix:' + path,
+            '--commands', str(args.commands), '--in-flight', args.in_flight, '--command', args.command])
+
+        def check_client(timer_id):
+            if client.poll() is not None:
+                # There is no way to stop the main loop of a kitty without
+                # windows, other than exiting
+                os._exit(client.returncode)
+
+        add_timer(check_client, 0.05, True)
+        child_monitor.start()
+        child_monitor.main_loop()
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark the number of remote control commands per second kitty can handle')
+    parser.add_argument('--commands', default=2000, type=int, help='Number of commands to send in every mode')
+    parser.add_argument('--in-flight', default='1,16,128', help='Comma separated numbers of framed commands to send without waiting for responses')
+    parser.add_argument('--command', default='input-latency', help='The remote control command to send, it must not need any arguments')
+    parser.add_argument('--to', help='The address of a running kitty to send commands to, as for kitty @ --to')
+    args = parser.parse_args()
+    if args.to:
+        run_client(args)
+    else:
+        serve(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Measure the time taken to render frames of synthetic screen contents in an
+# offscreen OS window, using the OSMesa GLFW backend, so that no display or GPU
+# is needed. Requires the OSMesa library to be installed. Run it with:
+#   python3 -m kitty_tests.bench_render
+# or
+#   kitty +runpy 'from kitty_tests.bench_render import main; main()'
+
+import json
+import os
+import sys
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+from time import monotonic
+
+from kitty.constants import WindowGeometry
+
+FIELDS = ('map', 'cell_data', 'shaping', 'rasterization', 'sprite_upload', 'draw_calls')
+
+
+def sample_lines(columns, count, seed=0):
+    words = 'the quick brown fox jumps over lazy dogs ═══ λ→ 漢字 kitty'.split()
+    ans = []
+    for i in range(count):
+        parts, n, k = [], 0, seed + i
+        while n < columns - 10:
+            w = words[k % len(words)]
+            parts.append('\x1b[{}m{}\x1b[m'.format(31 + k % 7, w))
+            n += len(w) + 1
+            k += 3
+        ans.append(' '.join(parts))
+    return ans
+
+
+def scrolling_text(screen, frame):
+    return ''.join(x + '\r\n' for x in sample_lines(screen.columns, 4, frame))
+
+
+def full_redraw(screen, frame):
+    lines = sample_lines(screen.columns, screen.lines, frame)
+    return '\x1b[H' + ''.join('\x1b[{};1H{}\x1b[K'.format(y + 1, x) for y, x in enumerate(lines))
+
+
+def images(screen, frame, size=64):
+    ans = [scrolling_text(screen, frame)]
+    pixel = bytes(((frame * 13) % 256, (frame * 7) % 256, 128, 255))
+    data = standard_b64encode(pixel * (size * size)).decode('ascii')
+    image_id = frame % 8 + 1
+    y, x = frame % max(1, screen.lines - 4) + 1, (frame * 5) % max(1, screen.columns - 8) + 1
+    ans.append('\x1b7\x1b[{};{}H'.format(y, x))
+    ans.append('\x1b_Ga=T,q=2,f=32,i={},s={},v={};{}\x1b\\'.format(image_id, size, size, data))
+    ans.append('\x1b8')
+    return ''.join(ans)
+
+
+def selections(screen, frame):
+    if frame == 0:
+        return full_redraw(screen, frame)
+    screen.start_selection(frame % screen.columns, 0)
+    screen.update_selection((frame * 3) % screen.columns, frame % screen.lines, False)
+    return ''
+
+
+SCENARIOS = {
+    'scroll': scrolling_text,
+    'redraw': full_redraw,
+    'images': images,
+    'selection': selections,
+}
+
+
+class RenderWindow:
+
+    def __init__(self, opts, width, height):
+        from kitty.fast_data_types import (
+            Screen, add_tab, add_window, cell_size_for_window, create_os_window,
+            set_active_window, set_window_render_data, update_window_visibility,
+            viewport_for_window
+        )
+        from kitty.main import load_all_shaders
+        from kitty.window import calculate_gl_geometry
+        self.os_window_id = create_os_window(
+            lambda *a: (width, height), lambda *a: None, 'bench', 'kitty', 'kitty', load_all_shaders)
+        self.tab_id = add_tab(self.os_window_id)
+        self.window_id = add_window(self.os_window_id, self.tab_id, 'bench')
+        cw, ch = cell_size_for_window(self.os_window_id)
+        central, tab_bar, vw, vh = viewport_for_window(self.os_window_id)[:4]
+        columns, lines = max(1, vw // cw), max(1, vh // ch)
+        self.screen = Screen(None, lines, columns, opts.scrollback_lines, cw, ch, self.window_id)
+        g = WindowGeometry(0, 0, columns * cw, lines * ch, columns, lines)
+        sg = calculate_gl_geometry(g, vw, vh, cw, ch)
+        set_window_render_data(self.os_window_id, self.tab_id, self.window_id, 0, sg.xstart, sg.ystart, sg.dx, sg.dy, self.screen, *g[:4])
+        update_window_visibility(self.os_window_id, self.tab_id, self.window_id, 0, True)
+        set_active_window(self.os_window_id, self.tab_id, 0)
+
+    def timings(self):
+        from kitty.fast_data_types import os_window_render_timings
+        return os_window_render_timings(self.os_window_id)['total']
+
+    def frame_times(self):
+        from kitty.fast_data_types import os_window_render_timings
+        return os_window_render_timings(self.os_window_id)['frame_times']
+
+    def run(self, scenario, num_frames):
+        from kitty.fast_data_types import parse_bytes, render_os_window_now
+        self.screen.reset()
+        before, before_histogram = self.timings(), self.frame_times()
+        frame_times = []
+        for frame in range(num_frames):
+            start = monotonic()
+            data = scenario(self.screen, frame)
+            if data:
+                parse_bytes(self.screen, data.encode('utf-8'))
+            render_os_window_now(self.os_window_id)
+            frame_times.append(monotonic() - start)
+        after = self.timings()
+        breakdown = {k: (after[k] - before[k]) / num_frames for k in FIELDS}
+        histogram = [a - b for a, b in zip(self.frame_times(), before_histogram)]
+        return frame_times, breakdown, histogram
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def histogram_labels(size):
+    # The buckets of the frame histograms kitty records, see state.h
+    return ['<1ms'] + ['{}-{}ms'.format(2 ** (i - 1), 2 ** i) for i in range(1, size - 1)] + ['>{}ms'.format(2 ** (size - 2))]
+
+
+def summarize(name, frame_times, breakdown, histogram):
+    return {
+        'scenario': name, 'frames': len(frame_times),
+        'mean': sum(frame_times) / len(frame_times), 'median': percentile(frame_times, 0.5),
+        'p95': percentile(frame_times, 0.95), 'max': max(frame_times), 'breakdown': breakdown,
+        'render_histogram': dict(zip(histogram_labels(len(histogram)), histogram)),
+    }
+
+
+def print_summary(s):
+    ms = 1000
+    print('{scenario}: {frames} frames, mean: {0:.2f} ms median: {1:.2f} ms p95: {2:.2f} ms max: {3:.2f} ms'.format(
+        s['mean'] * ms, s['median'] * ms, s['p95'] * ms, s['max'] * ms, **s))
+    print('  ' + '  '.join('{}: {:.3f} ms'.format(k, s['breakdown'][k] * ms) for k in FIELDS))
+    print('  render times: ' + '  '.join('{}: {}'.format(k, v) for k, v in s['render_histogram'].items() if v))
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark the render pipeline in an offscreen OS window')
+    parser.add_argument('--width', default=1280, type=int, help='Width of the OS window in pixels')
+    parser.add_argument('--height', default=800, type=int, help='Height of the OS window in pixels')
+    parser.add_argument('--frames', default=200, type=int, help='Number of frames to render per scenario')
+    parser.add_argument('--scenario', action='append', choices=tuple(SCENARIOS), help='Scenario to run, can be specified multiple times. Defaults to all')
+    parser.add_argument('--json', action='store_true', help='Output the results as JSON')
+    parser.add_argument(
+        '--max-frame-time', default=0, type=float,
+        help='Exit with an error if the mean frame time of any scenario, in ms, exceeds this value. Useful for catching regressions in CI')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import set_options
+    from kitty.fonts.box_drawing import set_scale
+    from kitty.fonts.render import set_font_family
+    from kitty.main import init_glfw_module
+    opts = defaults
+    set_scale(opts.box_drawing_scale)
+    set_options(opts)
+    set_font_family(opts)
+    os.environ.setdefault('LIBGL_ALWAYS_SOFTWARE', '1')
+    init_glfw_module('osmesa')
+    w = RenderWindow(opts, args.width, args.height)
+    results = []
+    for name in args.scenario or SCENARIOS:
+        results.append(summarize(name, *w.run(SCENARIOS[name], args.frames)))
+    if args.json:
+        print(json.dumps(results, indent=2))
+    else:
+        print('Rendered {} x {} cells'.format(w.screen.columns, w.screen.lines))
+        for s in results:
+            print_summary(s)
+    if args.max_frame_time > 0:
+        slow = [s['scenario'] for s in results if s['mean'] * 1000 > args.max_frame_time]
+        if slow:
+            print('Mean frame time exceeded {} ms for: {}'.format(args.max_frame_time, ', '.join(slow)), file=sys.stderr)
+            raise SystemExit(1)
+
+
+if __name__ == '__main__':
+    main()
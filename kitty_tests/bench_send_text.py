@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Send text to the children of many windows at once, as kitty @ send-text
+# --match does when broadcasting, by queueing it for one window at a time and
+# with broadcast_to_children(), and report the time kitty spends queueing it
+# and the throughput until the children have read it. The children are
+# sockets read by this script, with a sleeping process standing in for the
+# process of every window. Run it with:
+#   python3 -m kitty_tests.bench_send_text
+
+import os
+import selectors
+import socket
+import subprocess
+from argparse import ArgumentParser
+from time import monotonic, sleep
+
+from .bench_render import percentile
+
+
+def drain(sockets, expected):
+    sel = selectors.DefaultSelector()
+    received = {}
+    for s in sockets:
+        sel.register(s, selectors.EVENT_READ)
+        received[s] = 0
+    remaining = len(sockets)
+    while remaining:
+        ready = sel.select(10)
+        if not ready:
+            raise SystemExit('Timed out waiting for the text to be written to the windows')
+        for key, events in ready:
+            s = key.fileobj
+            data = s.recv(1024 * 1024)
+            if not data:
+                raise SystemExit('The connection to a window was closed')
+            received[s] += len(data)
+            if received[s] == expected:
+                sel.unregister(s)
+                remaining -= 1
+    sel.close()
+
+
+def per_window(child_monitor, data, window_ids):
+    for window_id in window_ids:
+        child_monitor.needs_write(window_id, data)
+
+
+def broadcast(child_monitor, data, window_ids):
+    child_monitor.broadcast_to_children(data, window_ids)
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark sending text to the children of many windows at once')
+    parser.add_argument('--windows', default=100, type=int, help='Number of windows to send text to')
+    parser.add_argument('--sends', default=1000, type=int, help='Number of times to send the text in every mode')
+    parser.add_argument('--size', default=32, type=int, help='Size of the text, in bytes')
+    args = parser.parse_args()
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import ChildMonitor, Screen, set_options
+    from kitty.main import init_glfw_module
+    from kitty_tests import Callbacks
+    set_options(defaults)
+    init_glfw_module('osmesa')
+    child_monitor = ChildMonitor(lambda window_id: None, None)
+    sleeper = subprocess.Popen(['sleep', '1000000'], start_new_session=True)
+    callbacks = Callbacks()
+    window_ids = tuple(range(1, args.windows + 1))
+    ours = []
+    for window_id in window_ids:
+        a, b = socket.socketpair()
+        screen = Screen(callbacks, 24, 80, 0, 10, 20, window_id, callbacks)
+        child_monitor.add_child(window_id, sleeper.pid, os.dup(a.fileno()), screen)
+        a.close()
+        ours.append(b)
+    child_monitor.start()
+    # Children are added by the I/O thread
+    while not all(child_monitor.needs_write(window_id, b'') for window_id in window_ids):
+        sleep(0.01)
+    data = b'x' * (args.size - 1) + b'\r'
+    ms = 1000
+    print('Sending {} bytes {} times to {} windows'.format(len(data), args.sends, args.windows))
+    try:
+        for name, func in (('one window at a time', per_window), ('broadcast_to_children', broadcast)):
+            times = []
+            start = monotonic()
+            for i in range(args.sends):
+                st = monotonic()
+                func(child_monitor, data, window_ids)
+                times.append(monotonic() - st)
+            drain(ours, len(data) * args.sends)
+            total = monotonic() - start
+            print('{:<24} queueing mean: {:.3f} ms p95: {:.3f} ms  {:8.1f} MB/s to the children'.format(
+                name, sum(times) / len(times) * ms, percentile(times, 0.95) * ms,
+                len(data) * args.sends * args.windows / total / (1024 * 1024)))
+    finally:
+        child_monitor.shutdown_monitor()
+        sleeper.kill()
+        sleeper.wait()
+    # The windows are not removed, exit without cleaning up after them
+    os._exit(0)
+
+
+if __name__ == '__main__':
+    main()
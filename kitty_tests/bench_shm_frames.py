@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Stream frames of an animation from a producer process, as a live plot or
+# video preview does, via a new POSIX shared memory object per frame (t=s) and
+# via a shared memory object registered once (t=S), and report the frame rate
+# and the time spent per frame in kitty. Frames are rendered in an offscreen
+# OS window, see bench_render.py, unless --no-render is used. Run it with:
+#   python3 -m kitty_tests.bench_shm_frames
+
+import os
+import subprocess
+import sys
+from argparse import ArgumentParser
+from base64 import standard_b64encode
+from time import monotonic
+
+from .bench_render import percentile
+
+
+def frame_data(width, height, n):
+    row = bytes(((x + n) & 0xff, (x * 3 + n) & 0xff, n & 0xff, 255)[c] for x in range(width) for c in range(4))
+    return row * height
+
+
+def produce(mode, num_frames, width, height):
+    from multiprocessing import resource_tracker
+    from multiprocessing.shared_memory import SharedMemory
+    out = sys.stdout.buffer
+    sz = width * height * 4
+    frames = [frame_data(width, height, n) for n in range(8)]
+    # Frames are displayed at the top left corner, restoring the cursor so
+    # that they are displayed at the same place
+    cmd = '\0337\033_Ga=T,f=32,s={},v={},i=1,t={}{{}}\033\\\0338'.format(width, height, mode)
+    if mode == 'S':
+        # Two slots, the frame in one is overwritten while the other is displayed
+        shm = SharedMemory(create=True, size=2 * sz)
+        try:
+            for n in range(num_frames):
+                offset = (n % 2) * sz
+                shm.buf[offset:offset + sz] = frames[n % len(frames)]
+                key = ',O={},S={}'.format(offset, sz)
+                if n == 0:
+                    key += ';' + standard_b64encode(('/' + shm.name).encode('utf-8')).decode('ascii')
+                out.write(cmd.format(key).encode('ascii'))
+            out.flush()
+        finally:
+            shm.close(), shm.unlink()
+    else:
+        for n in range(num_frames):
+            # The terminal unlinks the object once it has read the frame
+            shm = SharedMemory(create=True, size=sz)
+            shm.buf[:sz] = frames[n % len(frames)]
+            name = standard_b64encode(('/' + shm.name).encode('utf-8')).decode('ascii')
+            shm.close()
+            # Stop the resource tracker from unlinking the object on exit
+            resource_tracker.unregister(shm._name, 'shared_memory')
+            out.write(cmd.format(';' + name).encode('ascii'))
+        out.flush()
+
+
+def consume(target, mode, args):
+    from kitty.fast_data_types import parse_bytes
+    p = subprocess.Popen(
+        [sys.executable, '-m', 'kitty_tests.bench_shm_frames', '--produce', mode, '--frames', str(args.frames),
+         '--size', str(args.size)], stdout=subprocess.PIPE)
+    frame_times = []
+    num_frames, last = 0, b''
+    start = monotonic()
+    while True:
+        data = os.read(p.stdout.fileno(), 65536)
+        if not data:
+            break
+        fstart = monotonic()
+        parse_bytes(target.screen, data)
+        target.render()
+        # Frames end with the restore cursor escape code
+        frames = (last + data).count(b'\033\\\0338')
+        last = data[-2:]
+        if frames:
+            num_frames += frames
+            frame_times.append((monotonic() - fstart) / frames)
+    total = monotonic() - start
+    p.wait()
+    return num_frames, total, frame_times
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark the frame rate of an animation sent via shared memory')
+    parser.add_argument('--frames', default=1000, type=int, help='Number of frames to send')
+    parser.add_argument('--size', default=256, type=int, help='Width and height of the frames in pixels')
+    parser.add_argument('--no-render', action='store_true', help='Only parse, do not render frames, useful when OSMesa is not available')
+    parser.add_argument('--produce', choices=('s', 'S'), help='Used internally to run the producer process')
+    args = parser.parse_args()
+    if args.produce:
+        return produce(args.produce, args.frames, args.size, args.size)
+
+    from kitty.config import defaults
+    from kitty.fast_data_types import set_options
+    opts = defaults
+    set_options(opts)
+    if args.no_render:
+        from .bench_image_decode import ParseOnly
+        target = ParseOnly(opts)
+    else:
+        from kitty.fast_data_types import render_os_window_now
+        from kitty.fonts.box_drawing import set_scale
+        from kitty.fonts.render import set_font_family
+        from kitty.main import init_glfw_module
+        from .bench_render import RenderWindow
+        set_scale(opts.box_drawing_scale)
+        set_font_family(opts)
+        os.environ.setdefault('LIBGL_ALWAYS_SOFTWARE', '1')
+        init_glfw_module('osmesa')
+        target = RenderWindow(opts, 1280, 800)
+        target.render = lambda: render_os_window_now(target.os_window_id)
+    print('Sending {} {}x{} frames'.format(args.frames, args.size, args.size))
+    us = 1e6
+    for mode in 'sS':
+        target.screen.reset()
+        num_frames, total, frame_times = consume(target, mode, args)
+        print('{}: {} frames at {:.0f} frames per second, time per frame in kitty mean: {:.1f} us median: {:.1f} us p95: {:.1f} us'.format(
+            'new object per frame (t=s)' if mode == 's' else 'registered object (t=S)', num_frames, num_frames / total,
+            sum(frame_times) / max(1, len(frame_times)) * us, percentile(frame_times, 0.5) * us, percentile(frame_times, 0.95) * us))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+# Spawn children in a pty, as opening a window does, with fork() and with
+# vfork() semantics via the exec helper in the launcher, while the memory
+# used by this process is grown to the sizes kitty reaches with large
+# scrollbacks, and report the time kitty is blocked spawning and the time
+# until the child has produced output. The exec helper is the launcher built
+# by setup.py, in kitty/launcher. Run it with:
+#   python3 -m kitty_tests.bench_spawn
+
+import os
+import resource
+import sys
+from argparse import ArgumentParser
+from time import monotonic
+
+from .bench_render import percentile
+
+
+def spawn_once(exec_helper):
+    from kitty.child import openpty, remove_cloexec
+    from kitty.fast_data_types import spawn
+    master, slave = openpty()
+    ready_read_fd, ready_write_fd = os.pipe()
+    remove_cloexec(ready_read_fd)
+    env = tuple('{}={}'.format(k, v) for k, v in os.environ.items())
+    start = monotonic()
+    pid = spawn('echo', os.getcwd(), ('echo', 'ready'), env, master, slave, -1, -1, ready_read_fd, ready_write_fd, exec_helper)
+    spawned = monotonic()
+    os.close(slave), os.close(ready_read_fd), os.close(ready_write_fd)
+    output = b''
+    while b'ready' not in output:
+        try:
+            data = os.read(master, 4096)
+        except OSError:
+            data = b''
+        if not data:
+            raise SystemExit('The child produced no output: {!r}'.format(output))
+        output += data
+    done = monotonic()
+    os.waitpid(pid, 0)
+    os.close(master)
+    return spawned - start, done - start
+
+
+def rss():
+    ans = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return ans if sys.platform == 'darwin' else ans * 1024
+
+
+def main():
+    parser = ArgumentParser(description='Benchmark the latency of spawning the child of a window against the memory used by kitty')
+    parser.add_argument('--spawns', default=50, type=int, help='Number of children to spawn for each memory size')
+    parser.add_argument('--rss', default='0,256,1024', help='Comma separated amounts of memory to allocate, in MB')
+    parser.add_argument('--helper', help='Path to the exec helper, defaults to the launcher in kitty/launcher')
+    args = parser.parse_args()
+
+    helper = args.helper or os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), 'kitty', 'launcher', 'kitty')
+    methods = [('fork', None)]
+    if os.access(helper, os.X_OK):
+        methods.append(('vfork', helper))
+    else:
+        print('No exec helper found at {}, build the launcher with setup.py to benchmark vfork'.format(helper))
+    ms, mb = 1000, 1024 * 1024
+    ballast = []
+    for size in map(int, args.rss.split(',')):
+        if size:
+            b = bytearray(size * mb)
+            # Touch every page so that it is resident and has to be mapped in the child
+            b[::4096] = b'\x01' * len(range(0, len(b), 4096))
+            ballast.append(b)
+        print('RSS: {:.0f} MB'.format(rss() / mb))
+        for name, exec_helper in methods:
+            blocked, ready = [], []
+            for i in range(args.spawns):
+                b, r = spawn_once(exec_helper)
+                blocked.append(b), ready.append(r)
+            print('  {:<6} blocked mean: {:.3f} ms p95: {:.3f} ms  output mean: {:.3f} ms p95: {:.3f} ms'.format(
+                name, sum(blocked) / len(blocked) * ms, percentile(blocked, 0.95) * ms, sum(ready) / len(ready) * ms, percentile(ready, 0.95) * ms))
+
+
+if __name__ == '__main__':
+    main()
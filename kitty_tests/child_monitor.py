@@ -0,0 +1,438 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+import json
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from . import BaseTest
+
+magic = b'kitty-rc-frames\n'
+header = struct.Struct('>II')
+
+
+def frame(request_id, cmd, **payload):
+    from kitty.constants import version
+    data = json.dumps({'cmd': cmd, 'version': version, 'payload': payload}).encode('utf-8')
+    return header.pack(len(data), request_id) + data
+
+
+class FrameReader:
+
+    def __init__(self, s):
+        self.socket, self.buf = s, b''
+
+    def __call__(self, count=None):
+        # Read frames until count frames have been read, or the connection is
+        # closed
+        frames = []
+        while count is None or len(frames) < count:
+            if len(self.buf) >= header.size:
+                sz, request_id = header.unpack_from(self.buf)
+                if len(self.buf) >= header.size + sz:
+                    frames.append((request_id, self.buf[header.size:header.size + sz]))
+                    self.buf = self.buf[header.size + sz:]
+                    continue
+            data = self.socket.recv(65536)
+            if not data:
+                break
+            self.buf += data
+        return frames
+
+
+def serve(path, scrollback_lines):
+    # A kitty without any windows, that handles remote control commands on a
+    # socket at path, with the same code as kitty does, with an active window
+    # for get-text that has scrollback_lines lines of scrollback. It exits
+    # once the process that ran it does.
+    from kitty.boss import Boss
+    from kitty.config import defaults
+    from kitty.fast_data_types import ChildMonitor, Screen, add_timer, set_boss, set_options
+    from kitty.main import init_glfw_module
+    from kitty.window import Window
+    from kitty_tests import Callbacks
+
+    class ActiveWindow:
+        as_text = Window.as_text
+
+    class Server:
+        _handle_remote_command = Boss._handle_remote_command
+        peer_message_received = Boss.peer_message_received
+        peer_frame_received = Boss.peer_frame_received
+
+        def __init__(self, opts):
+            self.opts = opts
+
+    opts = defaults._replace(scrollback_lines=scrollback_lines)
+    set_options(opts)
+    init_glfw_module('osmesa')
+    callbacks = Callbacks()
+    screen = Screen(callbacks, 24, 80, scrollback_lines, 10, 20, 1, callbacks)
+    for i in range(scrollback_lines + screen.lines):
+        screen.draw('line {} '.format(i) + 'x' * (i % 150))
+        screen.carriage_return(), screen.linefeed()
+    server = Server(opts)
+    server.active_window = ActiveWindow()
+    server.active_window.screen = screen
+    s = socket.socket(socket.AF_UNIX)
+    s.bind(path)
+    s.listen()
+    s.setblocking(False)
+    child_monitor = ChildMonitor(lambda window_id: None, None, -1, s.fileno())
+    set_boss(server)
+    parent = os.getppid()
+
+    def check_parent(timer_id):
+        # There is no way to stop the main loop of a kitty without windows,
+        # other than exiting
+        if os.getppid() != parent:
+            os._exit(0)
+
+    add_timer(check_parent, 0.1, True)
+    child_monitor.start()
+    print('ready', flush=True)
+    child_monitor.main_loop()
+
+
+def present_animation(duration):
+    # Play an animated image in an offscreen OS window, with the main loop of
+    # kitty, printing the number of frames rendered before and after
+    import base64
+    from kitty.config import defaults
+    from kitty.fast_data_types import ChildMonitor, add_timer, os_window_render_timings, parse_bytes, render_os_window_now, set_options
+    from kitty.fonts.render import set_font_family
+    from kitty.main import init_glfw_module
+    from .bench_render import RenderWindow
+    set_options(defaults)
+    set_font_family(defaults)
+    init_glfw_module('osmesa')
+    w = RenderWindow(defaults, 400, 300)
+    child_monitor = ChildMonitor(lambda window_id: None, None)
+
+    def gr(cmd, payload=b''):
+        parse_bytes(w.screen, '\033_G{},q=2;{}\033\\'.format(cmd, base64.standard_b64encode(payload).decode('ascii')).encode('ascii'))
+
+    def rendered():
+        return sum(os_window_render_timings(w.os_window_id)['frame_times'])
+
+    gr('a=T,f=24,i=1,s=4,v=2', b'x' * 24)
+    gr('a=f,f=24,i=1,z=20', b'y' * 24)
+    render_os_window_now(w.os_window_id)
+    before = rendered()
+    gr('a=a,i=1,s=2')
+
+    def done(timer_id):
+        print(json.dumps({'before': before, 'after': rendered()}), flush=True)
+        os._exit(0)
+
+    add_timer(done, duration, False)
+    child_monitor.main_loop()
+
+
+def skip_without_osmesa(self):
+    import ctypes
+    for name in ('libOSMesa.so.8', 'libOSMesa.so.6', 'libOSMesa.so', 'libOSMesa-8.so', 'libOSMesa.8.dylib'):
+        try:
+            ctypes.CDLL(name)
+            return
+        except OSError:
+            pass
+    self.skipTest('The OSMesa library is not available')
+
+
+class TestChildMonitor(BaseTest):
+
+    def test_frame_scheduling(self):
+        from kitty.fast_data_types import frame_wait
+        interval = 0.016
+        # The first frame and frames after resizes are rendered at once
+        self.ae(frame_wait(10, 0, interval), 0)
+        self.ae(frame_wait(10, 9.999, interval, True), 0)
+        # An OS window that has been idle for a frame is rendered at once
+        self.ae(frame_wait(10, 10 - interval, interval), 0)
+        self.ae(frame_wait(10, 9, interval), 0)
+        # Otherwise it waits for its deadline, however much input it has
+        self.assertAlmostEqual(frame_wait(10, 9.99, interval), 0.006, places=6)
+        self.assertAlmostEqual(frame_wait(10, 10, interval), interval, places=6)
+
+
+    def test_headless_render(self):
+        # Render in an offscreen OS window with the OSMesa GLFW backend, as
+        # bench_render does, which needs the OSMesa library
+        skip_without_osmesa(self)
+        from .bench_render import FIELDS, SCENARIOS
+        num_frames = 5
+        p = subprocess.run(
+            [sys.executable, '-m', 'kitty_tests.bench_render', '--frames', str(num_frames), '--width', '400', '--height', '300', '--json'],
+            stdout=subprocess.PIPE, cwd=os.path.dirname(os.path.dirname(os.path.abspath(__file__))), check=True)
+        results = {r['scenario']: r for r in json.loads(p.stdout.decode('utf-8'))}
+        self.ae(set(results), set(SCENARIOS))
+        for name, r in results.items():
+            self.ae(r['frames'], num_frames)
+            self.ae(set(r['breakdown']), set(FIELDS))
+            for field, t in r['breakdown'].items():
+                self.assertGreaterEqual(t, 0, '{} of {}'.format(field, name))
+            self.assertGreater(sum(r['render_histogram'].values()), 0)
+            # No time is counted twice
+            self.assertLessEqual(sum(r['breakdown'].values()), r['mean'])
+        # Every frame of full redraws fills the cell data and draws it
+        self.assertGreater(results['redraw']['breakdown']['cell_data'], 0)
+        self.assertGreater(results['redraw']['breakdown']['draw_calls'], 0)
+
+    def test_main_loop_timers(self):
+        # Timers are run by the event loop of the OSMesa GLFW backend, which is
+        # initialized in another process so as not to affect the other tests
+        from kitty.constants import glfw_path
+        if not os.path.exists(glfw_path('osmesa')):
+            self.skipTest('The OSMesa GLFW backend is not built')
+        # (interval, number of times to fire)
+        timers = ((0.2, 1), (0.04, 1), (0.075, 1), (0.05, 3), (0.03, 1), (0.06, 1), (0.01, 1), (0.3, 1))
+        # The timer that would fire last is rescheduled to fire first, one
+        # timer is disabled and one removed
+        updates = ((7, 0.001, True), (5, 0.06, False))
+        remove = (4,)
+        code = 'from kitty.main import init_glfw_module; init_glfw_module("osmesa");' \
+            'from kitty.fast_data_types import test_main_loop_timers as t; print(t({!r}, {!r}, {!r}))'.format(timers, updates, remove)
+        p = subprocess.run([sys.executable, '-c', code], stdout=subprocess.PIPE, check=True,
+                           cwd=os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+        self.ae(p.stdout.decode('utf-8').strip(), str([7, 6, 1, 3, 2, 3, 3, 0]))
+
+    def test_animation_rendering(self):
+        # The frames of an animation are rendered while nothing else happens
+        skip_without_osmesa(self)
+        p = subprocess.run(
+            [sys.executable, '-c', 'from kitty_tests.child_monitor import present_animation; present_animation(0.5)'],
+            stdout=subprocess.PIPE, cwd=os.path.dirname(os.path.dirname(os.path.abspath(__file__))), check=True, timeout=30)
+        r = json.loads(p.stdout.decode('utf-8').strip().splitlines()[-1])
+        # With 40 and 20ms between frames, many more than the renders of
+        # the state check every second
+        self.assertGreater(r['after'] - r['before'], 5)
+
+    def test_broadcast_to_children(self):
+        from kitty.fast_data_types import ChildMonitor, Screen
+        from . import Callbacks
+        child_monitor = ChildMonitor(lambda window_id: None, None)
+        sleeper = subprocess.Popen(['sleep', '1000000'], start_new_session=True)
+        window_ids = (1, 2)
+        for window_id in window_ids:
+            # The sockets stand in for the ptys of the children, and are not
+            # read from
+            a, b = socket.socketpair()
+            self.addCleanup(b.close)
+            fd = os.dup(a.fileno())
+            a.close()
+            os.set_blocking(fd, False)
+            callbacks = Callbacks()
+            child_monitor.add_child(window_id, sleeper.pid, fd, Screen(callbacks, 5, 5, 0, 10, 20, window_id, callbacks))
+        child_monitor.start()
+        try:
+            # Children are added by the I/O thread
+            while not all(child_monitor.needs_write(window_id, b'') for window_id in window_ids):
+                time.sleep(0.01)
+            # Unknown windows
+            self.ae(child_monitor.broadcast_to_children(b'', (1, 3, 2)), (0, -1, 0))
+            self.ae(child_monitor.broadcast_to_children(b'', ()), ())
+            # The data is queued once for every time a window is specified,
+            # the children may have read some of it meanwhile
+            p1, p1_again, _ = child_monitor.broadcast_to_children(b'ab', (1, 1, 2))
+            self.assertLessEqual(p1, 2)
+            self.assertLessEqual(p1_again, p1 + 2)
+            self.assertGreater(p1_again, 0)
+            # Data that would make more than 100 MiB wait is dropped
+            data = b'x' * (51 * 1024 * 1024)
+            self.assertGreater(child_monitor.broadcast_to_children(data, (1,))[0], 0)
+            p1, p2 = child_monitor.broadcast_to_children(data, (1, 2))
+            self.ae(p1, -2)
+            self.assertGreater(p2, 0)
+        finally:
+            child_monitor.shutdown_monitor()
+            sleeper.kill()
+            sleeper.wait()
+
+    def test_subscriptions(self):
+        from kitty.fast_data_types import test_subscribe, test_update_subscriptions
+        s1 = self.create_screen(cols=5, lines=3, scrollback=10)
+        s2 = self.create_screen(cols=5, lines=3, scrollback=10)
+        s1.draw('ab')
+        test_subscribe(7, (1, 2))
+        now = 100
+
+        def changes(windows, after=1, has_room=True):
+            nonlocal now
+            now += after
+            frames = test_update_subscriptions(windows, now, has_room)
+            self.ae({f[0] for f in frames}, {7} if frames else set())
+            return [f[1] if f[1] is None else json.loads(f[1].decode('utf-8')) for f in frames]
+
+        # The first changes have all lines and the title
+        windows = {1: (s1, 'one'), 2: (s2, None)}
+        self.ae(changes(windows), [
+            {'window_id': 1, 'screen_start_line': 0, 'lines': 3, 'columns': 5, 'changed_lines': [[0, 'ab'], [1, ''], [2, '']], 'title': 'one'},
+            {'window_id': 2, 'screen_start_line': 0, 'lines': 3, 'columns': 5, 'changed_lines': [[0, ''], [1, ''], [2, '']]}])
+        # Lines that are dirty, but whose text is unchanged, are not sent
+        self.ae(changes(windows), [])
+        s1.cursor_position(1, 1), s1.draw('ab')
+        self.ae(changes(windows), [])
+        # Strings are escaped
+        s1.draw('"\\')
+        windows[1] = (s1, 'a "\\\x01')
+        self.ae(changes(windows), [{'window_id': 1, 'screen_start_line': 0, 'changed_lines': [[0, 'ab"\\']], 'title': 'a "\\\x01'}])
+        # Changes are sent at most once per repaint_delay, and are combined
+        # while the peer has not read the changes sent earlier
+        s1.draw('c')
+        self.ae(changes(windows, after=0.001), [])
+        self.ae(changes(windows, has_room=False), [])
+        s2.draw('d')
+        self.ae(changes(windows), [
+            {'window_id': 1, 'screen_start_line': 0, 'changed_lines': [[0, 'ab"\\c']]},
+            {'window_id': 2, 'screen_start_line': 0, 'changed_lines': [[0, 'd']]}])
+        # Lines added to the scrollback
+        for i in range(3):
+            s1.carriage_return(), s1.linefeed(), s1.draw(str(i))
+        self.ae(changes(windows), [{'window_id': 1, 'screen_start_line': 1, 'appended': 'ab"\\c\n', 'changed_lines': [[0, '0'], [1, '1'], [2, '2']]}])
+        # Resizes
+        s2.resize(2, 4)
+        self.ae(changes(windows), [{'window_id': 2, 'screen_start_line': 0, 'lines': 2, 'columns': 4, 'changed_lines': [[0, 'd'], [1, '']]}])
+        # Closed windows, the subscription ends once all are closed
+        del windows[2]
+        self.ae(changes(windows), [{'window_id': 2, 'closed': True}])
+        self.ae(changes({}), [{'window_id': 1, 'closed': True}, None])
+        self.ae(changes({}), [])
+        # Long lines are sent whole
+        s = self.create_screen(cols=5000, lines=1, scrollback=0)
+        s.draw('\u20ac\u0301' * 5000)
+        test_subscribe(7, (3,))
+        self.ae(changes({3: (s, None)})[0]['changed_lines'], [[0, '\u20ac\u0301' * 5000]])
+        self.ae(changes({}), [{'window_id': 3, 'closed': True}, None])
+
+
+class TestTalkSocket(BaseTest):
+
+    scrollback_lines = 25000
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tdir = tempfile.TemporaryDirectory()
+        cls.path = os.path.join(cls.tdir.name, 'kitty')
+        cls.server = subprocess.Popen([
+            sys.executable, '-c', 'from kitty_tests.child_monitor import serve; serve({!r}, {})'.format(cls.path, cls.scrollback_lines)],
+            stdout=subprocess.PIPE)
+        if cls.server.stdout.readline() != b'ready\n':
+            raise RuntimeError('The server failed to start')
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.kill()
+        cls.server.wait()
+        cls.server.stdout.close()
+        cls.tdir.cleanup()
+
+    def connect(self):
+        s = socket.socket(socket.AF_UNIX)
+        s.settimeout(10)
+        s.connect(self.path)
+        self.addCleanup(s.close)
+        return s, FrameReader(s)
+
+    def assert_responses(self, frames, request_ids):
+        self.ae([f[0] for f in frames], list(request_ids))
+        for request_id, data in frames:
+            self.assertTrue(json.loads(data.decode('utf-8'))['ok'])
+
+    def test_framed_peers(self):
+        # Magic and frames split across sends
+        s, read_frames = self.connect()
+        f = frame(1, 'input-latency')
+        for chunk in (magic[:5], magic[5:] + f[:3], f[3:header.size + 5], f[header.size + 5:]):
+            s.sendall(chunk)
+            time.sleep(0.02)
+        self.assert_responses(read_frames(1), (1,))
+
+        # A peer that closes its end of the connection gets the responses to
+        # all the requests it sent, then the connection is closed
+        s, read_frames = self.connect()
+        s.sendall(magic + b''.join(frame(i, 'input-latency') for i in range(1, 51)))
+        s.shutdown(socket.SHUT_WR)
+        self.assert_responses(read_frames(), range(1, 51))
+
+        # Too large frames close the connection, without responses
+        s, read_frames = self.connect()
+        s.sendall(magic + header.pack(1024 * 1024 + 1, 1) + b'x' * 100)
+        self.ae(read_frames(), [])
+        s, read_frames = self.connect()
+        s.sendall(magic + frame(1, 'input-latency'))
+        self.assert_responses(read_frames(1), (1,))
+
+    def test_framed_peer_backpressure(self):
+        # kitty stops reading from a peer that does not read the responses,
+        # so sending to it eventually blocks, instead of kitty queueing
+        # responses forever
+        s, read_frames = self.connect()
+        s.sendall(magic)
+        max_requests = 50000
+        frames = [frame(i, 'get-text') for i in range(1, max_requests + 1)]
+        data = b''.join(frames)
+        s.setblocking(False)
+        pos, blocked_at = 0, None
+        while pos < len(data):
+            try:
+                pos += s.send(data[pos:pos + 65536])
+                blocked_at = None
+            except BlockingIOError:
+                if blocked_at is None:
+                    blocked_at = time.monotonic()
+                elif time.monotonic() - blocked_at > 1:
+                    break
+                time.sleep(0.01)
+        self.assertLess(pos, len(data), 'kitty read all requests without their responses being read')
+        # Once the responses are read, the requests are all responded to
+        sent, end = 0, 0
+        for f in frames:
+            end += len(f)
+            if end > pos:
+                break
+            sent += 1
+        s.settimeout(10)
+        frames = read_frames(sent)
+        self.assert_responses(frames, range(1, sent + 1))
+
+    def test_text_streams(self):
+        chunk_sz = 64 * 1024
+        s, read_frames = self.connect()
+        s.sendall(magic + frame(1, 'get-text', extent='all', stream=True))
+        (request_id, data), = read_frames(1)
+        data = json.loads(data.decode('utf-8'))['data']
+        self.assertTrue(data['stream'])
+        # The text, which is larger than kitty lets wait to be sent, is sent
+        # only as it is read, so a command sent after the stream has started
+        # is responded to before the stream ends
+        time.sleep(0.2)
+        s.sendall(frame(2, 'input-latency'))
+        time.sleep(0.2)
+        chunks, others = [], []
+        while True:
+            (request_id, chunk), = read_frames(1)
+            if request_id == 2:
+                self.assertTrue(json.loads(chunk.decode('utf-8'))['ok'])
+                others.append(len(chunks))
+                continue
+            self.ae(request_id, 1)
+            if not chunk:
+                break
+            chunks.append(chunk)
+        self.ae(len(others), 1)
+        self.assertLess(others[0], len(chunks))
+        self.assertGreater(len(chunks), 1024 * 1024 // chunk_sz)
+        # Chunks are as large as they can be without splitting lines
+        for chunk in chunks[:-1]:
+            self.assertGreaterEqual(len(chunk), chunk_sz)
+            self.assertLess(len(chunk), chunk_sz + 4 * 80 + 1)
+        s.sendall(frame(3, 'get-text', start_line=data['start_line'], end_line=data['end_line']))
+        (request_id, data), = read_frames(1)
+        self.ae(b''.join(chunks).decode('utf-8'), json.loads(data.decode('utf-8'))['data'])
@@ -2,17 +2,24 @@
 # vim:fileencoding=utf-8
 # License: GPL v3 Copyright: 2017, Kovid Goyal <kovid at kovidgoyal.net>
 
+import os
+import shutil
 import sys
+import tempfile
 import unittest
 
 from kitty.constants import is_macos
 from kitty.fast_data_types import (
-    DECAWM, get_fallback_font, sprite_map_set_layout, sprite_map_set_limits,
-    test_render_line, test_sprite_position_for, wcwidth
+    DECAWM, Screen, draw_box_char, draw_prerendered_sprites,
+    font_cache_statistics, get_fallback_font, glyph_cache_statistics,
+    sprite_map_set_layout, sprite_map_set_limits, test_font_cache_bound,
+    test_normalize_symbol_maps, test_render_line, test_sprite_position_for,
+    wcwidth
 )
 from kitty.fonts.box_drawing import box_chars
 from kitty.fonts.render import (
-    coalesce_symbol_maps, render_string, setup_for_testing, shape_string
+    coalesce_symbol_maps, prerender_function, render_box_drawing,
+    render_string, setup_for_testing, shape_string
 )
 
 from . import BaseTest
@@ -56,6 +63,21 @@ class Rendering(BaseTest):
         test_render_line(line)
         self.assertEqual(len(self.sprites), prerendered + len(box_chars))
 
+    def test_native_decorations(self):
+        for width, height, dpi in ((8, 17, 96.0), (13, 27, 144.0), (21, 45, 240.0)):
+            for ch in box_chars:
+                expected = bytes(render_box_drawing(ord(ch), width, height, dpi)[1])
+                self.ae(draw_box_char(ord(ch), width, height, dpi), expected, 'Rendering of {!r} (U+{:X}) at {}x{} and dpi: {} differs'.format(
+                    ch, ord(ch), width, height, dpi))
+            for baseline, underline_position, underline_thickness in ((height - 4, height - 3, 1), (height - 6, height - 2, 3)):
+                args = width, height, baseline, underline_position, underline_thickness, dpi, dpi
+                expected = tuple(map(bytes, prerender_function(*args)[-1]))
+                actual = draw_prerendered_sprites(*args)
+                self.ae(len(actual), len(expected), 'Number of pre-rendered sprites with args: {} differs'.format(args))
+                for i, (a, b) in enumerate(zip(actual, expected)):
+                    self.ae(a, b, 'Pre-rendered sprite {} with args: {} differs'.format(i, args))
+        self.assertRaises(KeyError, draw_box_char, ord('a'), 8, 17)
+
     def test_font_rendering(self):
         render_string('ab\u0347\u0305你好|\U0001F601|\U0001F64f|\U0001F63a|')
         text = 'He\u0347\u0305llo\u0341, w\u0302or\u0306l\u0354d!'
@@ -69,6 +91,85 @@ class Rendering(BaseTest):
         cells = render_string(text)[-1]
         self.ae(len(cells), sz)
 
+    def test_glyph_cache(self):
+        tdir = tempfile.mkdtemp()
+        try:
+            text = 'ab\u2500\u2502你好'
+            before = glyph_cache_statistics()
+            cold = render_string(text, glyph_cache=tdir)
+            self.assertTrue(os.listdir(tdir))
+            middle = glyph_cache_statistics()
+            self.ae(middle['hits'], before['hits'])
+            self.assertGreater(middle['stored'], before['stored'])
+            warm = render_string(text, glyph_cache=tdir)
+            after = glyph_cache_statistics()
+            self.ae(after['stored'], middle['stored'])
+            self.ae(after['hits'] - middle['hits'], middle['stored'] - before['stored'])
+            self.ae(cold, warm)
+            # Glyphs of a face used for several styles are cached separately
+            # for each style
+            render_string('ab', glyph_cache=tdir)
+            regular = glyph_cache_statistics()
+            italic = render_string('ab', glyph_cache=tdir, italic=True)
+            self.ae(glyph_cache_statistics()['stored'] - regular['stored'], 2)
+            self.ae(italic, render_string('ab', italic=True))
+            # A group is cached under the same key whatever groups with
+            # more glyphs were rendered before it
+            render_string('bx\u0301\u0302b', glyph_cache=tdir)
+            stored = glyph_cache_statistics()['stored']
+            render_string('b', glyph_cache=tdir)
+            self.ae(glyph_cache_statistics()['stored'], stored)
+        finally:
+            shutil.rmtree(tdir)
+
+    def test_font_cache(self):
+
+        def render(text):
+            s = Screen(None, 1, 10)
+            s.draw(text)
+            test_render_line(s.line(0))
+            return font_cache_statistics()
+
+        missing = '\U0010FFFD'
+        before = render(missing)
+        after = render(missing)
+        self.ae(after['misses'], before['misses'])
+        self.ae(after['hits'], before['hits'] + 1)
+        self.ae(after['rechecked_fonts'], before['rechecked_fonts'])
+        # Text that no font had is checked again only against the fallback
+        # fonts loaded after it was cached
+        for q in '\u05d0\u0627\u4f60\U0001F600':
+            added = render(q)
+            if added['fallback_fonts'] > after['fallback_fonts']:
+                break
+        else:
+            self.skipTest('No fallback fonts available')
+        for i in range(2):
+            now = render(missing)
+            self.ae(now['misses'], added['misses'])
+            self.ae(now['rechecked_fonts'], after['rechecked_fonts'] + added['fallback_fonts'] - after['fallback_fonts'])
+
+    def test_font_cache_bound(self):
+        self.ae(test_font_cache_bound(0), (0, 0))
+        self.ae(test_font_cache_bound(100), (100, 256))
+        # Text with many distinct characters does not grow the cache without
+        # bound, it is emptied once full
+        count, capacity = test_font_cache_bound(100000)
+        self.assertLess(count, 100000)
+        self.ae(test_font_cache_bound(1000000)[1], capacity)
+        self.assertLessEqual(capacity, 32768)
+
+    def test_normalize_symbol_maps(self):
+        self.ae(test_normalize_symbol_maps(()), ())
+        # The map specified first wins where maps overlap
+        self.ae(test_normalize_symbol_maps(((1, 10, 0), (5, 15, 1))), ((1, 10, 0), (11, 15, 1)))
+        self.ae(test_normalize_symbol_maps(((5, 15, 1), (1, 10, 0))), ((1, 4, 0), (5, 15, 1)))
+        self.ae(test_normalize_symbol_maps(((1, 20, 0), (5, 6, 1))), ((1, 20, 0),))
+        self.ae(test_normalize_symbol_maps(((5, 6, 1), (1, 20, 0))), ((1, 4, 0), (5, 6, 1), (7, 20, 0)))
+        # Adjacent ranges of the same font are merged, gaps are kept
+        self.ae(test_normalize_symbol_maps(((16, 20, 1), (1, 10, 1), (11, 15, 1), (30, 30, 2))), ((1, 20, 1), (30, 30, 2)))
+        self.ae(test_normalize_symbol_maps(((0x10ffff, 0x10ffff, 0), (0, 0, 1))), ((0, 0, 1), (0x10ffff, 0x10ffff, 0)))
+
     def test_shaping(self):
 
         def groups(text, path=None):
@@ -3,14 +3,18 @@
 # License: GPL v3 Copyright: 2016, Kovid Goyal <kovid at kovidgoyal.net>
 
 import os
+import struct
 import tempfile
+import time
 import unittest
 import zlib
 from base64 import standard_b64decode, standard_b64encode
 from io import BytesIO
 
 from kitty.fast_data_types import (
-    load_png_data, parse_bytes, set_send_to_gpu, shm_unlink, shm_write
+    load_png_data, parse_bytes, set_image_decode_threads,
+    set_image_texture_scale, set_send_to_gpu, shm_unlink, shm_write,
+    test_downscale_pixels, test_texture_store
 )
 
 from . import BaseTest
@@ -159,6 +163,18 @@ class TestGraphics(BaseTest):
         img = g.image_for_client_id(1)
         self.ae(img['data'], random_data)
 
+        # Test many compressed chunks, inflated as they arrive
+        self.assertIsNone(l(compressed_random_data[:7], s=24, v=32, o='z', m=1))
+        for i in range(7, len(compressed_random_data), 97):
+            self.assertIsNone(l(compressed_random_data[i:i+97], m=1))
+        self.ae(l(b'', m=0), 'OK')
+        img = g.image_for_client_id(1)
+        self.ae(img['data'], random_data)
+        self.assertIsNone(l(compressed_random_data[:b], s=24, v=32, o='z', m=1))
+        self.ae(l(b'', m=0).partition(':')[0], 'EINVAL')
+        self.assertIsNone(l(zlib.compress(random_data + b'extra')[:b], s=24, v=32, o='z', m=1))
+        self.ae(l(zlib.compress(random_data + b'extra')[b:], m=0).partition(':')[0], 'EINVAL')
+
         # Test loading from file
         f = tempfile.NamedTemporaryFile()
         f.write(random_data), f.flush()
@@ -178,6 +194,49 @@ class TestGraphics(BaseTest):
             FileNotFoundError, shm_unlink, name
         )  # check that file was deleted
 
+    def test_shm_channel(self):
+        s, g, pl, sl = load_helpers(self)
+        sz = 24 * 32 * 4
+        f1 = byte_block(sz)
+        f2 = bytes(reversed(f1))
+        name = '/kitty-test-shm-channel'
+        shm_write(name, f1 + f2)
+        try:
+            sl(name, s=24, v=32, t='S', S=sz, expecting_data=f1)
+        finally:
+            shm_unlink(name)
+        # Frames are transmitted without a name, the object remains mapped
+        # after the client unlinks it
+        sl(b'', s=24, v=32, t='S', O=sz, expecting_data=f2)
+        sl(b'', s=24, v=32, t='S', S=sz, expecting_data=f1)
+        self.assertTrue(pl(b'', s=24, v=32, t='S', O=2 * sz).startswith('EINVAL'))
+        self.assertTrue(pl(b'', s=24, v=32, t='S', O=sz + 1, S=sz).startswith('EINVAL'))
+        self.assertTrue(pl(b'', s=24, v=32, t='S', O=sz + 1).startswith('ENODATA'))
+        self.assertTrue(pl(b'', s=24, v=32, t='S', i=2).startswith('ENOENT'))
+        # The client can resize the object after registering it
+        shm_write(name, f1 + f2)
+        try:
+            sl(name, s=24, v=32, t='S', i=3, S=sz, expecting_data=f1)
+            shm_write(name, f2)
+            self.assertTrue(pl(b'', s=24, v=32, t='S', i=3, O=sz).startswith('EINVAL'))
+            sl(b'', s=24, v=32, t='S', i=3, expecting_data=f2)
+            shm_write(name, f1 + f2 + f1)
+            sl(b'', s=24, v=32, t='S', i=3, O=2 * sz, expecting_data=f1)
+        finally:
+            shm_unlink(name)
+        # Compressed frames
+        compressed = zlib.compress(f2)
+        shm_write(name, compressed)
+        try:
+            sl(name, s=24, v=32, t='S', o='z', i=2, expecting_data=f2)
+        finally:
+            shm_unlink(name)
+        sl(b'', s=24, v=32, t='S', o='z', i=2, S=len(compressed), expecting_data=f2)
+        # Deleting the image and its data releases the object
+        send_command(s, 'a=d,d=I,i=1')
+        self.assertTrue(pl(b'', s=24, v=32, t='S').startswith('ENOENT'))
+        sl(b'', s=24, v=32, t='S', o='z', i=2, expecting_data=f2)
+
     @unittest.skipIf(Image is None, 'PIL not available, skipping PNG tests')
     def test_load_png(self):
         s, g, l, sl = load_helpers(self)
@@ -216,6 +275,51 @@ class TestGraphics(BaseTest):
         # test error handling for loading bad png data
         self.assertRaisesRegex(ValueError, '[EBADPNG]', load_png_data, b'dsfsdfsfsfd')
 
+    def test_image_timings(self):
+        s, g, l, sl = load_helpers(self)
+        random_data = byte_block(3 * 1024)
+        compressed = zlib.compress(random_data)
+        b = len(compressed) // 2
+        self.assertIsNone(l(compressed[:b], s=24, v=32, o='z', m=1))
+        self.ae(l(compressed[b:], m=0), 'OK')
+        t = g.image_for_client_id(1)['timings']
+        self.ae(t['transmitted_bytes'], len(compressed))
+        self.assertGreater(t['inflate'], 0)
+        self.assertGreaterEqual(t['load'], t['inflate'] + t['base64'])
+        self.ae((t['png'], t['upload']), (0, 0))
+        # Re-transmitting resets the timings
+        sl(random_data, s=24, v=32)
+        t = g.image_for_client_id(1)['timings']
+        self.ae((t['transmitted_bytes'], t['inflate']), (len(random_data), 0))
+        # The payload is decoded, and timed, in latin1 mode as well
+        parse_bytes(s, b'\033%@')
+        sl(random_data, s=24, v=32)
+        t = g.image_for_client_id(1)['timings']
+        self.assertGreater(t['base64'], 0)
+        parse_bytes(s, b'\033%G')
+
+    def test_downscale_pixels(self):
+
+        def rgb(*pixels):
+            return bytes(bytearray(c for p in pixels for c in p))
+
+        # Every pixel is the average of the pixels it covers
+        self.ae(test_downscale_pixels(rgb((0, 10, 255), (10, 20, 255), (20, 30, 0), (31, 40, 0)), 2, 2, 1, 1, True), rgb((15, 25, 128)))
+        self.ae(test_downscale_pixels(rgb((0, 0, 0), (30, 60, 90), (50, 100, 150)), 3, 1, 2, 1, True), rgb((0, 0, 0), (40, 80, 120)))
+        self.ae(test_downscale_pixels(rgb((1, 2, 3), (4, 5, 6)), 1, 2, 1, 2, True), rgb((1, 2, 3), (4, 5, 6)))
+        # The colors of transparent pixels do not bleed into their neighbours
+        self.ae(test_downscale_pixels(rgb((255, 0, 0, 255), (0, 0, 255, 0)), 2, 1, 1, 1, False), rgb((255, 0, 0, 128)))
+        self.ae(test_downscale_pixels(rgb((255, 0, 0, 51), (0, 0, 255, 204)), 1, 2, 1, 1, False), rgb((51, 0, 204, 128)))
+        self.ae(test_downscale_pixels(rgb((255, 0, 0, 0), (0, 0, 255, 0)), 2, 1, 1, 1, False), rgb((0, 0, 0, 0)))
+        self.assertRaises(ValueError, test_downscale_pixels, b'abc', 2, 1, 1, 1, True)
+        self.assertRaises(ValueError, test_downscale_pixels, b'abcdef', 2, 1, 3, 1, True)
+
+    def test_texture_store(self):
+        # Images share a texture only if all of their hashes are the same,
+        # not only the half used to find them in the store
+        self.ae(test_texture_store((b'abc', b'abd', b'abc', b'ab', b'abd')), (0, 1, 0, 3, 1))
+        self.ae(test_texture_store(()), ())
+
     def test_image_put(self):
         cw, ch = 10, 20
         s, dx, dy, put_image, put_ref, layers, rect_eq = put_helpers(self, cw, ch)
@@ -335,3 +439,218 @@ class TestGraphics(BaseTest):
         put_image(s, cw, ch, z=9)
         delete('Z', z=9)
         self.ae(s.grman.image_count, 0)
+
+    def test_placements_in_history(self):
+        cw, ch = 10, 20
+        s, dx, dy, put_image, put_ref, layers, rect_eq = put_helpers(self, cw, ch)
+        s = self.create_screen(10, 5, scrollback=50, cell_width=cw, cell_height=ch)
+        for i in range(40):
+            put_image(s, cw, ch)
+            s.carriage_return(), s.linefeed()
+        self.ae(s.grman.image_count, 40), self.ae(s.grman.placement_count, 40)
+        self.ae(len(layers(s)), 4)
+        l0 = layers(s, scrolled_by=10)
+        self.ae(len(l0), 5)
+        rect_eq(l0[0]['dest_rect'], -1, 1, -1 + dx, 1 - dy)
+        rect_eq(l0[4]['dest_rect'], -1, 1 - 4 * dy, -1 + dx, 1 - 5 * dy)
+        self.ae(len(layers(s, scrolled_by=36)), 5)
+        self.ae(len(layers(s, scrolled_by=37)), 4)
+        # Placing the same image in the same cell replaces the placement
+        s.cursor_position(1, 1)
+        put_ref(s)
+        s.cursor_position(1, 1)
+        put_ref(s)
+        self.ae(s.grman.placement_count, 41)
+        # Deleting by row only removes the placements intersecting the row
+        send_command(s, 'a=d,d=y,y=1')
+        self.ae(s.grman.image_count, 40), self.ae(s.grman.placement_count, 39)
+        send_command(s, 'a=d,d=Y,y=4')
+        self.ae(s.grman.image_count, 38), self.ae(s.grman.placement_count, 38)
+        # Placements are removed when they scroll off the top of the scrollback
+        s.cursor_position(s.lines, 1)
+        for i in range(14):
+            s.index()
+        self.ae(s.grman.image_count, 38)
+        s.index()
+        self.ae(s.grman.image_count, 37), self.ae(s.grman.placement_count, 37)
+        self.ae(len(layers(s, scrolled_by=50)), 5)
+        s.reset()
+        self.ae(len(layers(s)), 0), self.ae(len(layers(s, scrolled_by=50)), 5)
+
+    def test_texture_scale(self):
+        cw, ch = 10, 20
+        s, dx, dy, put_image, put_ref, layers, rect_eq = put_helpers(self, cw, ch)
+        set_image_texture_scale(2)
+        try:
+            iid = put_image(s, 40, 20, num_cols=1, num_lines=1)[0]
+            img = s.grman.image_for_client_id(iid)
+            self.ae((img['needed_width'], img['needed_height']), (20, 20))
+            # The needed texture is never larger than the image
+            put_ref(s, num_cols=3, num_lines=1)
+            img = s.grman.image_for_client_id(iid)
+            self.ae((img['needed_width'], img['needed_height']), (40, 20))
+            # A smaller placement does not shrink the needed texture
+            put_ref(s, num_cols=1, num_lines=1)
+            img = s.grman.image_for_client_id(iid)
+            self.ae((img['needed_width'], img['needed_height']), (40, 20))
+            # Re-transmitting the image resets the needed texture
+            send_command(s, 'a=T,f=24,i=%d,s=40,v=20,c=1,r=1' % iid, b'x' * 40 * 20 * 3)
+            img = s.grman.image_for_client_id(iid)
+            self.ae((img['needed_width'], img['needed_height']), (20, 20))
+        finally:
+            set_image_texture_scale(0)
+
+    def test_animation(self):
+        cw, ch = 10, 20
+        s, dx, dy, put_image, put_ref, layers, rect_eq = put_helpers(self, cw, ch)
+        g = s.grman
+        iid = put_image(s, 4, 2)[0]
+
+        def frame(payload=b'y' * 4 * 2 * 3, **kw):
+            kw.setdefault('i', iid)
+            return parse_response(send_command(s, 'a=f,f=24,' + ','.join('%s=%s' % (k, v) for k, v in kw.items()), payload))
+
+        def animate(**kw):
+            kw.setdefault('i', iid)
+            return parse_response(send_command(s, 'a=a,' + ','.join('%s=%s' % (k, v) for k, v in kw.items())))
+
+        self.ae(frame(z=100), 'OK')
+        self.ae(frame(z=200, s=4, v=2), 'OK')
+        self.ae(g.image_count, 1)
+        img = g.image_for_client_id(iid)
+        self.ae((img['num_frames'], img['current_frame'], img['frame_gaps']), (3, 0, (40, 100, 200)))
+        self.assertTrue(frame(s=2, v=2, payload=b'y' * 2 * 2 * 3).startswith('EINVAL'))
+        self.assertTrue(frame(i=99).startswith('ENOENT'))
+        self.ae(g.image_count, 1)
+        # Frames are only displayed by changing the layer of the render data
+        self.ae(animate(c=2), 'OK')
+        self.ae(layers(s)[0]['layer'], 1)
+        self.ae(animate(r=1, z=100), 'OK')
+        self.ae(g.image_for_client_id(iid)['frame_gaps'], (100, 100, 200))
+        self.assertTrue(animate(c=4).startswith('ENOENT'))
+        self.ae(animate(s=2), 'OK')
+        self.assertTrue(g.image_for_client_id(iid)['animation_running'])
+        self.assertAlmostEqual(g.advance_animations(0.15), 0.15, delta=0.02)
+        self.ae(g.image_for_client_id(iid)['current_frame'], 2)
+        self.ae(layers(s)[0]['layer'], 2)
+        g.advance_animations(0.35)
+        self.ae(g.image_for_client_id(iid)['current_frame'], 0)
+        self.ae(animate(s=1), 'OK')
+        self.ae(g.advance_animations(1), -1)
+        # Re-transmitting the image removes its frames
+        send_command(s, 'a=T,f=24,i=%d,s=4,v=2' % iid, b'x' * 4 * 2 * 3)
+        img = g.image_for_client_id(iid)
+        self.ae((img['num_frames'], img['current_frame'], img['animation_running']), (1, 0, False))
+
+    def test_storage_quota(self):
+        s = self.create_screen()
+        g = s.grman
+        sz = 10 * 10 * 4
+        g.storage_limit = 3 * sz
+
+        def add(i):
+            self.ae(parse_response(send_command(s, 'a=t,f=32,s=10,v=10,i=%d' % i, b'x' * sz)), 'OK')
+
+        def put(i):
+            self.ae(parse_response(send_command(s, 'a=p,i=%d' % i)), 'OK')
+
+        def present():
+            return {i for i in range(1, 20) if g.image_for_client_id(i) is not None}
+
+        for i in range(1, 4):
+            add(i)
+        put(1)
+        self.ae(g.used_storage, 3 * sz)
+        # Unreferenced images are evicted first, least recently used first
+        add(4)
+        self.ae(present(), {1, 3, 4})
+        add(5)
+        self.ae(present(), {1, 4, 5})
+        put(4), put(5)
+        # Then referenced images, least recently used first
+        add(6)
+        self.ae(present(), {4, 5, 6})
+        self.ae(g.used_storage, 3 * sz)
+        add(4)
+        self.ae(g.used_storage, 3 * sz)
+        # Eviction keeps the id lookups consistent
+        g.storage_limit = 50 * sz
+        for i in range(100, 1000):
+            add(i)
+            if i % 3 == 0:
+                put(i)
+        self.ae(g.image_count, 50)
+        self.ae(g.used_storage, 50 * sz)
+        alive = [i for i in range(100, 1000) if g.image_for_client_id(i) is not None]
+        self.ae(len(alive), 50)
+        for i in alive:
+            self.ae(g.image_for_client_id(i)['client_id'], i)
+        self.assertIn(999, alive)
+
+    def test_background_decode(self):
+        cw, ch = 10, 20
+        s = self.create_screen(10, 5, cell_width=cw, cell_height=ch)
+        w, h = 2 * cw, ch
+        data = standard_b64encode(zlib.compress(byte_block(w * h * 4))).decode('ascii')
+        cmds = '\033_Ga=T,o=z,i=1,s={},v={};{}\033\\'.format(w, h, data)
+        cmds += 'x\033_Ga=q,i=2,s=1,v=1;{}\033\\'.format(standard_b64encode(b'abcd').decode('ascii'))
+        cmds += '\033_Ga=t,o=z,i=3,s=1,v=1;{}\033\\'.format(standard_b64encode(b'bad').decode('ascii'))
+        cmds = cmds.encode('ascii')
+        set_image_decode_threads(2)
+        try:
+            s.callbacks.clear()
+            end_at = time.monotonic() + 10
+            while cmds and time.monotonic() < end_at:
+                cmds = cmds[parse_bytes(s, cmds):]
+                if cmds:
+                    time.sleep(0.001)
+            # Parsing an empty buffer handles the result of the last decode
+            while time.monotonic() < end_at and s.callbacks.wtcbuf.count(b'\033\\') < 3:
+                parse_bytes(s, b'')
+                time.sleep(0.001)
+        finally:
+            set_image_decode_threads(0)
+        self.ae(cmds, b'')
+        responses = [parse_response(x + b'\033\\') for x in s.callbacks.wtcbuf.split(b'\033\\') if x]
+        self.ae(responses[:2], ['OK', 'OK'])
+        self.ae(responses[2].partition(':')[0], 'EINVAL')
+        # The text after the image is drawn after the cursor was moved by the placement
+        self.ae(str(s.line(0)), '  x')
+        self.assertFalse(s.grman.image_for_client_id(3)['data_loaded'])
+        img = s.grman.image_for_client_id(1)
+        self.ae(img['data'], byte_block(w * h * 4))
+
+    def test_decode_across_screen_switch(self):
+        s = self.create_screen()
+
+        def chunk(tag, data):
+            return struct.pack('>I', len(data)) + tag + data + struct.pack('>I', zlib.crc32(tag + data))
+
+        # A PNG large enough that it is still being decoded when the screen is
+        # switched
+        w = h = 2000
+        png = b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', struct.pack('>IIBBBBB', w, h, 8, 6, 0, 0, 0))
+        png += chunk(b'IDAT', zlib.compress((b'\0' + b'\xff' * (w * 4)) * h)) + chunk(b'IEND', b'')
+        data = standard_b64encode(png).decode('ascii')
+        chunks = [data[i:i + 4096] for i in range(0, len(data), 4096)]
+        cmds = '\033_Ga=t,f=100,i=1,m=1;{}\033\\'.format(chunks[0])
+        cmds += ''.join('\033_Gm=1;{}\033\\'.format(c) for c in chunks[1:-1])
+        cmds = (cmds + '\033_Gm=0;{}\033\\'.format(chunks[-1])).encode('ascii')
+        main_grman = s.grman
+        set_image_decode_threads(2)
+        try:
+            s.callbacks.clear()
+            self.ae(parse_bytes(s, cmds), len(cmds))
+            self.assertTrue(main_grman.decode_pending)
+            # The decode is finished with the screen it was started for
+            s.toggle_alt_screen()
+            self.assertFalse(main_grman.decode_pending)
+            self.ae(parse_response(s.callbacks.wtcbuf), 'OK')
+            self.assertIsNot(s.grman, main_grman)
+            self.ae(s.grman.image_count, 0)
+            self.ae(main_grman.image_count, 1)
+            self.ae(main_grman.image_for_client_id(1)['width'], w)
+            s.toggle_alt_screen()
+            self.assertIs(s.grman, main_grman)
+        finally:
+            set_image_decode_threads(0)
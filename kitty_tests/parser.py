@@ -309,6 +309,20 @@ class TestParser(BaseTest):
         e('s=', 'Malformed GraphicsCommand control block, expecting an integer value')
         e('s==', 'Malformed GraphicsCommand control block, expecting an integer value for key: s')
         e('s=1=', 'Malformed GraphicsCommand control block, expecting a comma or semi-colon after a value, found: 0x3d')
+        for payload in ('a', 'ab', 'abc', 'ßx' * 100):
+            t('a=q', payload=payload, action='q')
+        pb('\033_Ga=q;YWJj\033\033\\', ('Failed to parse GraphicsCommand command payload with error: '
+           'base64 encoded data must have a length that is a multiple of four',))
+        pb('\033_Ga=q;{}\033\\'.format(enc(b'x' * 4097)), ('Failed to parse GraphicsCommand command payload with error: output buffer too small',))
+        pb('\033_Ga=q;{}\033\\'.format(enc(b'x' * 4096)), c(action='q', payload='x' * 4096))
+
+        # The payload is decoded as it arrives, so it can be split anywhere
+        raw = '\033_Ga=q;{}\033\\'.format(enc('split payload')).encode('ascii')
+        for split in range(1, len(raw)):
+            cd = CmdDump()
+            parse_bytes_dump(cd, s, raw[:split])
+            parse_bytes_dump(cd, s, raw[split:])
+            self.ae(tuple(x for x in cd if x[0] != 'draw'), (c(action='q', payload='split payload'),))
 
     def test_deccara(self):
         s = self.create_screen()
@@ -453,3 +453,38 @@ class TestScreen(BaseTest):
 
         self.ae(as_text(), 'ababababab\nc\n\n')
         self.ae(as_text(True), 'ababababab\nc\n\n')
+
+    def test_export_text(self):
+        s = self.create_screen()
+        for i in range(8):
+            s.draw(str(i) * (7 if i == 3 else 1))
+            s.carriage_return(), s.linefeed()
+        first, screen_start, end = s.text_line_numbers()
+        self.ae((first, screen_start, end), (0, 5, 10))
+        self.ae(s.export_text(first, screen_start), b'0\n1\n2\n3333333\n')
+        # Lines continued on the next line do not end with a newline
+        self.ae(s.export_text(2, 4), b'2\n33333')
+        self.ae(s.export_text(screen_start, end), b'4\n5\n6\n7\n\n')
+        # Line numbers do not change as lines are added to the scrollback
+        s.draw('8'), s.carriage_return(), s.linefeed()
+        self.ae(s.text_line_numbers(), (1, 6, 11))
+        self.ae(s.export_text(0, 3), b'1\n2\n')
+        self.ae(s.export_text(5, 7), b'4\n5\n')
+        s.select_graphic_rendition(1)
+        s.draw('b')
+        self.ae(s.export_text(10, 11, True), b'\x1b[1mb\n')
+        self.ae(s.export_text(10, 11), b'b\n')
+
+    def test_export_text_after_rewrap(self):
+        # Rewrapping the scrollback into more lines than were ever added to
+        # it must not make the number of its first line underflow
+        s = self.create_screen(scrollback=20)
+        s.draw('0' * 20), s.carriage_return(), s.linefeed()
+        for i in range(1, 5):
+            s.draw(str(i)), s.carriage_return(), s.linefeed()
+        self.ae(s.text_line_numbers(), (0, 4, 9))
+        s.resize(5, 2)
+        first, screen_start, end = s.text_line_numbers()
+        self.assertLessEqual(first, screen_start)
+        self.assertLessEqual(screen_start, end)
+        self.ae(s.export_text(first, end).decode('ascii').replace('\n', ''), '0' * 20 + '1234')
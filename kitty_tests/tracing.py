@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# vim:fileencoding=utf-8
+# License: GPL v3 Copyright: 2020, Kovid Goyal <kovid at kovidgoyal.net>
+
+import json
+import tempfile
+from base64 import standard_b64decode
+
+from kitty.fast_data_types import (
+    is_tracing, start_tracing, stop_tracing, test_trace_thread, write_trace
+)
+
+from . import BaseTest
+from .graphics import load_helpers
+
+
+def read_trace():
+    with tempfile.NamedTemporaryFile(suffix='.json') as f:
+        count = write_trace(f.name)
+        events = json.load(f)['traceEvents']
+    return count, events
+
+
+def thread_events(events, thread_name):
+    # Other threads, such as image decoders, may record events at any time, so
+    # only the events of one thread are checked
+    tid = {e['args']['name']: e['tid'] for e in events if e['ph'] == 'M'}[thread_name]
+    return [(e['name'], e['ph']) for e in events if e['tid'] == tid and e['ph'] != 'M']
+
+
+class TestTracing(BaseTest):
+
+    def test_tracing(self):
+        png_data = standard_b64decode('iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNk+P+/HgAFhAJ/wlseKgAAAABJRU5ErkJggg==')
+        s, g, l, sl = load_helpers(self)
+        sl(png_data, f=100, expecting_data=b'\x00\xff\xff\x7f')
+        start_tracing()
+        try:
+            self.assertTrue(is_tracing())
+            sl(png_data, f=100, expecting_data=b'\x00\xff\xff\x7f')
+        finally:
+            stop_tracing()
+        self.assertFalse(is_tracing())
+        sl(png_data, f=100, expecting_data=b'\x00\xff\xff\x7f')
+        count, events = read_trace()
+        self.ae(count, len([e for e in events if e['ph'] != 'M']))
+        # The test runs in the thread that imported kitty
+        self.ae(thread_events(events, 'KittyMain'), [('decode_image', 'B'), ('inflate_png', 'B'), ('inflate_png', 'E'), ('decode_image', 'E')])
+
+    def test_trace_spans(self):
+        name = 'a"b\\c\td'
+        start_tracing()
+        try:
+            # Spans without a begin or end in the trace are dropped
+            test_trace_thread(name, 'EBBEEBBE')
+        finally:
+            stop_tracing()
+        events = read_trace()[1]
+        self.ae(''.join(ph for n, ph in thread_events(events, name)), 'BBEEBE')
@@ -21,6 +21,7 @@
 #endif
 #include <Python.h>
 #include <wchar.h>
+#include "kitty/exec-child.h"
 
 #define MIN(x, y) ((x) < (y)) ? (x) : (y)
 #define MAX_ARGC 1024
@@ -153,6 +154,10 @@ read_exe_path(char *exe, size_t buf_sz) {
 #endif // }}}
 
 int main(int argc, char *argv[]) {
+    if (argc > EXEC_CHILD_NUM_ARGS && strcmp(argv[1], EXEC_CHILD_ARG) == 0) {
+        // The exec helper for children spawned by kitty, see spawn() in kitty/child.c
+        exec_child(argv[7], argv + EXEC_CHILD_NUM_ARGS, argv[2], argv[3], atoi(argv[4]), atoi(argv[5]), atoi(argv[6]));
+    }
     char exe[PATH_MAX+1] = {0};
     if (!read_exe_path(exe, sizeof(exe))) return 1;
 
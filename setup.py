@@ -539,15 +539,17 @@ def find_c_files():
 
 
 def compile_glfw(compilation_database):
-    modules = 'cocoa' if is_macos else 'x11 wayland'
+    # The osmesa backend is used for headless rendering benchmarks, it has no
+    # build time dependencies as OSMesa is loaded at runtime
+    modules = 'cocoa' if is_macos else 'x11 wayland osmesa'
     for module in modules.split():
         try:
             genv = glfw.init_env(env, pkg_config, at_least_version, test_compile, module)
         except SystemExit as err:
-            if module != 'wayland':
+            if module not in ('wayland', 'osmesa'):
                 raise
             print(err, file=sys.stderr)
-            print(error('Disabling building of wayland backend'), file=sys.stderr)
+            print(error('Disabling building of {} backend'.format(module)), file=sys.stderr)
             continue
         sources = [os.path.join('glfw', x) for x in genv.sources]
         all_headers = [os.path.join('glfw', x) for x in genv.all_headers]
@@ -654,7 +656,7 @@ def build_launcher(args, launcher_dir='.', bundle_type='source'):
            src, '-o', dest] + ldflags + libs + pylib
     key = CompileKey('launcher.c', 'kitty')
     desc = 'Building {}...'.format(emphasis('launcher'))
-    args.compilation_database.add_command(desc, cmd, partial(newer, dest, src), key=key, keyfile=src)
+    args.compilation_database.add_command(desc, cmd, partial(newer, dest, src, 'kitty/exec-child.h'), key=key, keyfile=src)
     args.compilation_database.build_all()
 
 